@@ -0,0 +1,92 @@
+/*
+ * CheckCounts.c
+ *
+ * Consistency check for the ingredient and unit use counts. Recounts how
+ * many recipes list each ingredient and unit straight from the recipe
+ * records and compares the result with the count stored in each record
+ * (see UseCount). Databases are opened but never written back.
+ *
+ * Usage: CheckCounts [directory]
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "HostPalm.h"
+#include "HostTest.h"
+#include "Quartermaster.h"
+
+/*********************************************************************
+ * Internal Functions
+ *********************************************************************/
+
+/***********************************************************************
+ *
+ * FUNCTION:     CheckDatabase
+ *
+ * DESCRIPTION:  Compares the stored and recounted use count of every
+ *				 live record of gIngredientDB or gUnitDB, printing each
+ *				 mismatch
+ *
+ * PARAMETERS:   database, label for messages
+ *
+ * RETURNED:     number of mismatches
+ *
+ ***********************************************************************/
+static UInt16 CheckDatabase(DmOpenRef dbase, const char *label)
+{
+	UInt16 numRecords = DmNumRecords(dbase);
+	MemHandle recH;
+	UInt32 id;
+	UInt16 stored, counted;
+	UInt16 checked = 0;
+	UInt16 bad = 0;
+	UInt16 i;
+
+	for (i = 0; i < numRecords; i++) {
+		recH = DmQueryRecord(dbase, i);
+		if (!recH)
+			continue;
+		id = IDFromIndex(dbase, i);
+		stored = UseCount(dbase, id);
+		counted = HostTestCountUses(dbase == gUnitDB, id);
+		if (stored != counted) {
+			printf("%-10s %-32s stored %u, used by %u\n", label,
+				(char *)MemHandleLock(recH), stored, counted);
+			MemHandleUnlock(recH);
+			bad++;
+		}
+		checked++;
+	}
+
+	printf("%-10s %u checked, %u wrong\n", label, checked, bad);
+	return bad;
+}
+
+/*********************************************************************
+ * Main
+ *********************************************************************/
+
+int main(int argc, char **argv)
+{
+	UInt16 bad;
+	Err err;
+
+	if (argc > 1)
+		HostDmSetDirectory(argv[1]);
+
+	err = DatabaseOpen();
+	if (err == errNone)
+		err = DatabaseRequire(dbSetIndexes);
+	if (err != errNone) {
+		fprintf(stderr, "DatabaseOpen failed: 0x%04x\n", err);
+		return 2;
+	}
+
+	bad = CheckDatabase(gIngredientDB, "ingredient");
+	bad += CheckDatabase(gUnitDB, "unit");
+
+	// exits without DatabaseClose/HostDmFlushAll so nothing is written back
+	return bad ? 1 : 0;
+}
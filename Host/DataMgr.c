@@ -0,0 +1,1214 @@
+/*
+ * DataMgr.c
+ *
+ * Host stand-in for the PalmOS Data Manager, backed by .pdb files in
+ * the layout build_pdb.py writes (78 byte header, 8 byte record list
+ * entries, big-endian fields, record data in list order).
+ *
+ * Databases are loaded when the directory is first scanned and written
+ * back when the last open reference is closed (or on HostDmFlushAll).
+ *
+ */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "PalmOS.h"
+#include "HostPalm.h"
+#include "HostInternal.h"
+
+/*********************************************************************
+ * Internal Constants
+ *********************************************************************/
+
+#define pdbHeaderSize		78
+#define pdbRecordEntrySize	8
+#define pdbEpochOffset		2082844800UL	// seconds from 1904 to 1970
+#define hostMaxDatabases	64
+#define hostMaxPath			1024
+
+/*********************************************************************
+ * Internal Structures
+ *********************************************************************/
+
+typedef struct {
+	HostChunk *chunk;		// NULL once a record is deleted
+	UInt8 attr;
+	UInt32 uniqueID;
+} HostRecord;
+
+typedef struct HostDBTag {
+	Char name[dmDBNameLength];
+	Char path[hostMaxPath];
+	UInt16 attributes;
+	UInt16 version;
+	UInt32 crDate;
+	UInt32 modDate;
+	UInt32 bckUpDate;
+	UInt32 modNum;
+	UInt32 type;
+	UInt32 creator;
+	UInt32 uniqueIDSeed;
+	HostChunk *appInfo;
+	HostChunk *sortInfo;
+
+	HostRecord *records;
+	UInt16 numRecords;
+	UInt16 capacity;
+
+	UInt16 openCount;
+	Boolean dirty;		// must be written back to path
+	Boolean removed;	// DmDeleteDatabase was called
+} HostDB;
+
+typedef struct HostOpenDBTag {
+	HostDB *db;
+	LocalID dbID;
+	UInt16 mode;
+} HostOpenDB;
+
+/*********************************************************************
+ * Internal variables
+ *********************************************************************/
+
+static Char sDirectory[hostMaxPath] = "";
+static HostDB *sDatabases[hostMaxDatabases];
+static UInt16 sNumDatabases = 0;
+static Boolean sScanned = false;
+static Err sLastErr = errNone;
+
+/*********************************************************************
+ * Internal functions
+ *********************************************************************/
+
+static UInt32 GetBE32(const UInt8 *p)
+{
+	return ((UInt32)p[0] << 24) | ((UInt32)p[1] << 16) |
+		((UInt32)p[2] << 8) | (UInt32)p[3];
+}
+
+static UInt16 GetBE16(const UInt8 *p)
+{
+	return (UInt16)((p[0] << 8) | p[1]);
+}
+
+static void PutBE32(UInt8 *p, UInt32 v)
+{
+	p[0] = (UInt8)(v >> 24);
+	p[1] = (UInt8)(v >> 16);
+	p[2] = (UInt8)(v >> 8);
+	p[3] = (UInt8)v;
+}
+
+static void PutBE16(UInt8 *p, UInt16 v)
+{
+	p[0] = (UInt8)(v >> 8);
+	p[1] = (UInt8)v;
+}
+
+static UInt32 PalmTimestamp(void)
+{
+	return (UInt32)((UInt32)time(NULL) + pdbEpochOffset);
+}
+
+static Err SetErr(Err err)
+{
+	sLastErr = err;
+	return err;
+}
+
+static const Char* Directory(void)
+{
+	const Char *env;
+
+	if (sDirectory[0])
+		return sDirectory;
+	env = getenv("QM_HOST_DIR");
+	return (env && env[0]) ? env : ".";
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     DbFromRef
+ *
+ * DESCRIPTION:  Validates an open reference, optionally for writing
+ *
+ * PARAMETERS:   open ref, true if the caller modifies the database
+ *
+ * RETURNED:     database or NULL (last error set)
+ *
+ ***********************************************************************/
+static HostDB* DbFromRef(DmOpenRef dbP, Boolean write)
+{
+	if (!dbP || !dbP->db) {
+		SetErr(dmErrNoOpenDatabase);
+		return NULL;
+	}
+	if (write && !(dbP->mode & dmModeWrite)) {
+		SetErr(dmErrReadOnly);
+		return NULL;
+	}
+	return dbP->db;
+}
+
+static HostDB* DbFromID(LocalID dbID)
+{
+	if (dbID == 0 || dbID > sNumDatabases || sDatabases[dbID - 1]->removed)
+		return NULL;
+	return sDatabases[dbID - 1];
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     DbReserve
+ *
+ * DESCRIPTION:  Grows the record list so one more entry fits
+ *
+ * PARAMETERS:   database
+ *
+ * RETURNED:     errNone or dmErrMemError
+ *
+ ***********************************************************************/
+static Err DbReserve(HostDB *db)
+{
+	HostRecord *grown;
+	UInt16 capacity;
+
+	if (db->numRecords < db->capacity)
+		return errNone;
+	if (db->numRecords == dmMaxRecordIndex)
+		return dmErrMemError;
+
+	capacity = db->capacity ? db->capacity * 2 : 16;
+	if (capacity < db->capacity)
+		capacity = dmMaxRecordIndex;
+	grown = realloc(db->records, capacity * sizeof(HostRecord));
+	if (!grown)
+		return dmErrMemError;
+	db->records = grown;
+	db->capacity = capacity;
+	return errNone;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     DbNewUniqueID
+ *
+ * DESCRIPTION:  Hands out the next 24-bit record unique ID
+ *
+ * PARAMETERS:   database
+ *
+ * RETURNED:     unique ID (never 0)
+ *
+ ***********************************************************************/
+static UInt32 DbNewUniqueID(HostDB *db)
+{
+	db->uniqueIDSeed = (db->uniqueIDSeed + 1) & 0x00FFFFFF;
+	if (db->uniqueIDSeed == 0)
+		db->uniqueIDSeed = 1;
+	return db->uniqueIDSeed;
+}
+
+static void DbModified(HostDB *db)
+{
+	db->modNum++;
+	db->modDate = PalmTimestamp();
+	db->dirty = true;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     DbLoadFile
+ *
+ * DESCRIPTION:  Parses a .pdb file into a new in-memory database
+ *
+ * PARAMETERS:   path
+ *
+ * RETURNED:     database, or NULL if the file isn't a record database
+ *
+ ***********************************************************************/
+static HostDB* DbLoadFile(const Char *path)
+{
+	FILE *f;
+	UInt8 *buf;
+	long len;
+	HostDB *db;
+	UInt32 appInfoOfs, sortInfoOfs, firstOfs, start, end;
+	UInt16 i;
+
+	f = fopen(path, "rb");
+	if (!f)
+		return NULL;
+	fseek(f, 0, SEEK_END);
+	len = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	if (len < pdbHeaderSize) {
+		fclose(f);
+		return NULL;
+	}
+	buf = malloc(len);
+	if (!buf || fread(buf, 1, len, f) != (size_t)len) {
+		free(buf);
+		fclose(f);
+		return NULL;
+	}
+	fclose(f);
+
+	db = calloc(1, sizeof(HostDB));
+	memcpy(db->name, buf, dmDBNameLength);
+	db->name[dmDBNameLength - 1] = '\0';
+	snprintf(db->path, sizeof(db->path), "%s", path);
+	db->attributes   = GetBE16(buf + 32);
+	db->version      = GetBE16(buf + 34);
+	db->crDate       = GetBE32(buf + 36);
+	db->modDate      = GetBE32(buf + 40);
+	db->bckUpDate    = GetBE32(buf + 44);
+	db->modNum       = GetBE32(buf + 48);
+	appInfoOfs       = GetBE32(buf + 52);
+	sortInfoOfs      = GetBE32(buf + 56);
+	db->type         = GetBE32(buf + 60);
+	db->creator      = GetBE32(buf + 64);
+	db->uniqueIDSeed = GetBE32(buf + 68);
+	db->numRecords   = GetBE16(buf + 76);
+
+	if (db->attributes & 0x0001 ||
+			pdbHeaderSize + (long)db->numRecords * pdbRecordEntrySize > len) {
+		// resource databases (and truncated files) are not supported
+		free(db);
+		free(buf);
+		return NULL;
+	}
+
+	db->capacity = db->numRecords;
+	db->records = calloc(db->capacity ? db->capacity : 1, sizeof(HostRecord));
+	firstOfs = len;
+	for (i = 0; i < db->numRecords; i++) {
+		const UInt8 *entry = buf + pdbHeaderSize + i * pdbRecordEntrySize;
+		db->records[i].attr = entry[4] & ~dmRecAttrBusy;
+		db->records[i].uniqueID = ((UInt32)entry[5] << 16) |
+			((UInt32)entry[6] << 8) | entry[7];
+		if (db->records[i].uniqueID > db->uniqueIDSeed)
+			db->uniqueIDSeed = db->records[i].uniqueID;
+		if (i == 0)
+			firstOfs = GetBE32(entry);
+	}
+
+	for (i = 0; i < db->numRecords; i++) {
+		start = GetBE32(buf + pdbHeaderSize + i * pdbRecordEntrySize);
+		end = (i + 1 < db->numRecords)
+			? GetBE32(buf + pdbHeaderSize + (i + 1) * pdbRecordEntrySize)
+			: (UInt32)len;
+		if (start > (UInt32)len || end > (UInt32)len || end < start)
+			end = start = (UInt32)len;
+		if (end == start && (db->records[i].attr & dmRecAttrDelete))
+			continue;
+		db->records[i].chunk = HostChunkNew(end - start, db);
+		memcpy(db->records[i].chunk->data, buf + start, end - start);
+	}
+
+	if (appInfoOfs && appInfoOfs < (UInt32)len) {
+		end = sortInfoOfs ? sortInfoOfs : firstOfs;
+		if (end > (UInt32)len || end < appInfoOfs)
+			end = len;
+		db->appInfo = HostChunkNew(end - appInfoOfs, db);
+		memcpy(db->appInfo->data, buf + appInfoOfs, end - appInfoOfs);
+	}
+	if (sortInfoOfs && sortInfoOfs < (UInt32)len) {
+		end = (firstOfs >= sortInfoOfs) ? firstOfs : (UInt32)len;
+		db->sortInfo = HostChunkNew(end - sortInfoOfs, db);
+		memcpy(db->sortInfo->data, buf + sortInfoOfs, end - sortInfoOfs);
+	}
+
+	free(buf);
+	return db;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     DbWriteFile
+ *
+ * DESCRIPTION:  Serializes a database back to its .pdb file
+ *
+ * PARAMETERS:   database
+ *
+ * RETURNED:     errNone or dmErrMemError
+ *
+ ***********************************************************************/
+static Err DbWriteFile(HostDB *db)
+{
+	FILE *f;
+	UInt8 header[pdbHeaderSize];
+	UInt8 entry[pdbRecordEntrySize];
+	UInt32 offset;
+	UInt16 i;
+
+	offset = pdbHeaderSize + db->numRecords * pdbRecordEntrySize;
+
+	MemSet(header, sizeof(header), 0);
+	memcpy(header, db->name, strlen(db->name));
+	PutBE16(header + 32, db->attributes);
+	PutBE16(header + 34, db->version);
+	PutBE32(header + 36, db->crDate);
+	PutBE32(header + 40, db->modDate);
+	PutBE32(header + 44, db->bckUpDate);
+	PutBE32(header + 48, db->modNum);
+	PutBE32(header + 52, db->appInfo ? offset : 0);
+	if (db->appInfo)
+		offset += db->appInfo->size;
+	PutBE32(header + 56, db->sortInfo ? offset : 0);
+	if (db->sortInfo)
+		offset += db->sortInfo->size;
+	PutBE32(header + 60, db->type);
+	PutBE32(header + 64, db->creator);
+	PutBE32(header + 68, db->uniqueIDSeed);
+	PutBE32(header + 72, 0);
+	PutBE16(header + 76, db->numRecords);
+
+	f = fopen(db->path, "wb");
+	if (!f)
+		return dmErrMemError;
+	fwrite(header, 1, sizeof(header), f);
+
+	for (i = 0; i < db->numRecords; i++) {
+		PutBE32(entry, offset);
+		entry[4] = db->records[i].attr & ~dmRecAttrBusy;
+		entry[5] = (UInt8)(db->records[i].uniqueID >> 16);
+		entry[6] = (UInt8)(db->records[i].uniqueID >> 8);
+		entry[7] = (UInt8)db->records[i].uniqueID;
+		fwrite(entry, 1, sizeof(entry), f);
+		if (db->records[i].chunk)
+			offset += db->records[i].chunk->size;
+	}
+
+	if (db->appInfo)
+		fwrite(db->appInfo->data, 1, db->appInfo->size, f);
+	if (db->sortInfo)
+		fwrite(db->sortInfo->data, 1, db->sortInfo->size, f);
+	for (i = 0; i < db->numRecords; i++) {
+		if (db->records[i].chunk)
+			fwrite(db->records[i].chunk->data, 1, db->records[i].chunk->size, f);
+	}
+	fclose(f);
+
+	db->dirty = false;
+	return errNone;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     DbFree
+ *
+ * DESCRIPTION:  Releases all memory held by an in-memory database
+ *
+ * PARAMETERS:   database
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void DbFree(HostDB *db)
+{
+	UInt16 i;
+
+	for (i = 0; i < db->numRecords; i++)
+		HostChunkDispose(db->records[i].chunk);
+	HostChunkDispose(db->appInfo);
+	HostChunkDispose(db->sortInfo);
+	free(db->records);
+	free(db);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     ScanDirectory
+ *
+ * DESCRIPTION:  Loads every .pdb file in the host directory. When two
+ *				 files hold the same database name (build_pdb.py stamps
+ *				 its file names) the most recently modified one wins
+ *
+ * PARAMETERS:   nothing
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void ScanDirectory(void)
+{
+	DIR *dir;
+	struct dirent *ent;
+	Char path[hostMaxPath];
+	HostDB *db;
+	UInt16 i;
+	size_t n;
+
+	sScanned = true;
+	dir = opendir(Directory());
+	if (!dir)
+		return;
+
+	while ((ent = readdir(dir)) != NULL) {
+		n = strlen(ent->d_name);
+		if (n < 4 || strcmp(ent->d_name + n - 4, ".pdb") != 0)
+			continue;
+		if (snprintf(path, sizeof(path), "%s/%s", Directory(), ent->d_name) >= (int)sizeof(path))
+			continue;
+		db = DbLoadFile(path);
+		if (!db)
+			continue;
+
+		for (i = 0; i < sNumDatabases; i++) {
+			if (strcmp(sDatabases[i]->name, db->name) == 0)
+				break;
+		}
+		if (i < sNumDatabases) {
+			if (db->modDate > sDatabases[i]->modDate) {
+				DbFree(sDatabases[i]);
+				sDatabases[i] = db;
+			} else {
+				DbFree(db);
+			}
+		} else if (sNumDatabases < hostMaxDatabases) {
+			sDatabases[sNumDatabases++] = db;
+		} else {
+			DbFree(db);
+		}
+	}
+	closedir(dir);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     RecordSortInfo
+ *
+ * DESCRIPTION:  Fills the SortRecordInfo passed to comparison callbacks
+ *
+ * PARAMETERS:   record, out info
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void RecordSortInfo(const HostRecord *rec, SortRecordInfoType *info)
+{
+	info->attributes = rec->attr;
+	info->uniqueID[0] = (UInt8)(rec->uniqueID >> 16);
+	info->uniqueID[1] = (UInt8)(rec->uniqueID >> 8);
+	info->uniqueID[2] = (UInt8)rec->uniqueID;
+}
+
+static Int16 CompareRecords(HostDB *db, const HostRecord *a,
+	const HostRecord *b, DmComparF *compar, Int16 other)
+{
+	SortRecordInfoType infoA, infoB;
+
+	RecordSortInfo(a, &infoA);
+	RecordSortInfo(b, &infoB);
+	return compar(a->chunk->data, b->chunk->data, other, &infoA, &infoB,
+		db->appInfo);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     LiveRecordCount
+ *
+ * DESCRIPTION:  Number of records before the trailing run of deleted
+ *				 records (which the sort routines must ignore)
+ *
+ * PARAMETERS:   database
+ *
+ * RETURNED:     count
+ *
+ ***********************************************************************/
+static UInt16 LiveRecordCount(HostDB *db)
+{
+	UInt16 n = db->numRecords;
+
+	while (n > 0 && (db->records[n - 1].attr & dmRecAttrDelete))
+		n--;
+	return n;
+}
+
+/*********************************************************************
+ * Host-internal functions
+ *********************************************************************/
+
+void HostDbTouch(struct HostDBTag *db)
+{
+	if (db)
+		db->dirty = true;
+}
+
+/*********************************************************************
+ * Host controls
+ *********************************************************************/
+
+const Char* HostDmDirectory(void)
+{
+	return Directory();
+}
+
+void HostDmSetDirectory(const Char *path)
+{
+	HostDmReset();
+	strncpy(sDirectory, path ? path : "", hostMaxPath - 1);
+	sDirectory[hostMaxPath - 1] = '\0';
+}
+
+Err HostDmFlushAll(void)
+{
+	Err err = errNone;
+	UInt16 i;
+
+	for (i = 0; i < sNumDatabases; i++) {
+		if (sDatabases[i]->dirty && !sDatabases[i]->removed) {
+			if (DbWriteFile(sDatabases[i]) != errNone)
+				err = dmErrMemError;
+		}
+	}
+	return err;
+}
+
+void HostDmReset(void)
+{
+	UInt16 i;
+
+	HostDmFlushAll();
+	for (i = 0; i < sNumDatabases; i++)
+		DbFree(sDatabases[i]);
+	sNumDatabases = 0;
+	sScanned = false;
+	sLastErr = errNone;
+	HostPrefReset();
+}
+
+/*********************************************************************
+ * Database functions
+ *********************************************************************/
+
+Err DmCreateDatabase(UInt16 cardNo, const Char *nameP, UInt32 creator,
+	UInt32 type, Boolean resDB)
+{
+	HostDB *db;
+
+	if (!sScanned)
+		ScanDirectory();
+	if (!nameP || !nameP[0] || resDB)
+		return SetErr(dmErrInvalidParam);
+	if (DmFindDatabase(cardNo, nameP))
+		return SetErr(dmErrAlreadyExists);
+	if (sNumDatabases == hostMaxDatabases)
+		return SetErr(dmErrMemError);
+
+	db = calloc(1, sizeof(HostDB));
+	strncpy(db->name, nameP, dmDBNameLength - 1);
+	if (snprintf(db->path, sizeof(db->path), "%s/%s.pdb", Directory(), db->name) >= (int)sizeof(db->path)) {
+		free(db);
+		return SetErr(dmErrInvalidParam);
+	}
+	db->crDate = db->modDate = PalmTimestamp();
+	db->type = type;
+	db->creator = creator;
+	sDatabases[sNumDatabases++] = db;
+
+	if (DbWriteFile(db) != errNone)
+		return SetErr(dmErrMemError);
+	return SetErr(errNone);
+}
+
+Err DmDeleteDatabase(UInt16 cardNo, LocalID dbID)
+{
+	HostDB *db = DbFromID(dbID);
+
+	if (!db)
+		return SetErr(dmErrCantFind);
+	if (db->openCount > 0)
+		return SetErr(dmErrDatabaseOpen);
+	remove(db->path);
+	db->removed = true;
+	return SetErr(errNone);
+}
+
+LocalID DmFindDatabase(UInt16 cardNo, const Char *nameP)
+{
+	UInt16 i;
+
+	if (!sScanned)
+		ScanDirectory();
+	for (i = 0; i < sNumDatabases; i++) {
+		if (!sDatabases[i]->removed && strcmp(sDatabases[i]->name, nameP) == 0)
+			return i + 1;
+	}
+	SetErr(dmErrCantFind);
+	return 0;
+}
+
+DmOpenRef DmOpenDatabase(UInt16 cardNo, LocalID dbID, UInt16 mode)
+{
+	HostDB *db = DbFromID(dbID);
+	HostOpenDB *ref;
+
+	if (!db) {
+		SetErr(dmErrCantOpen);
+		return NULL;
+	}
+	ref = calloc(1, sizeof(HostOpenDB));
+	ref->db = db;
+	ref->dbID = dbID;
+	ref->mode = mode;
+	db->openCount++;
+	SetErr(errNone);
+	return ref;
+}
+
+Err DmCloseDatabase(DmOpenRef dbP)
+{
+	HostDB *db = DbFromRef(dbP, false);
+	Err err = errNone;
+
+	if (!db)
+		return sLastErr;
+	if (--db->openCount == 0 && db->dirty && !db->removed)
+		err = DbWriteFile(db);
+	dbP->db = NULL;
+	free(dbP);
+	return SetErr(err);
+}
+
+Err DmOpenDatabaseInfo(DmOpenRef dbP, LocalID *dbIDP, UInt16 *openCountP,
+	UInt16 *modeP, UInt16 *cardNoP, Boolean *resDBP)
+{
+	HostDB *db = DbFromRef(dbP, false);
+
+	if (!db)
+		return sLastErr;
+	if (dbIDP)      *dbIDP = dbP->dbID;
+	if (openCountP) *openCountP = db->openCount;
+	if (modeP)      *modeP = dbP->mode;
+	if (cardNoP)    *cardNoP = 0;
+	if (resDBP)     *resDBP = false;
+	return errNone;
+}
+
+Err DmDatabaseInfo(UInt16 cardNo, LocalID dbID, Char *nameP,
+	UInt16 *attributesP, UInt16 *versionP, UInt32 *crDateP,
+	UInt32 *modDateP, UInt32 *bckUpDateP, UInt32 *modNumP,
+	LocalID *appInfoIDP, LocalID *sortInfoIDP, UInt32 *typeP,
+	UInt32 *creatorP)
+{
+	HostDB *db = DbFromID(dbID);
+
+	if (!db)
+		return SetErr(dmErrCantFind);
+	if (nameP)       StrCopy(nameP, db->name);
+	if (attributesP) *attributesP = db->attributes;
+	if (versionP)    *versionP = db->version;
+	if (crDateP)     *crDateP = db->crDate;
+	if (modDateP)    *modDateP = db->modDate;
+	if (bckUpDateP)  *bckUpDateP = db->bckUpDate;
+	if (modNumP)     *modNumP = db->modNum;
+	if (appInfoIDP)  *appInfoIDP = MemHandleToLocalID(db->appInfo);
+	if (sortInfoIDP) *sortInfoIDP = 0;
+	if (typeP)       *typeP = db->type;
+	if (creatorP)    *creatorP = db->creator;
+	return errNone;
+}
+
+Err DmSetDatabaseInfo(UInt16 cardNo, LocalID dbID, const Char *nameP,
+	UInt16 *attributesP, UInt16 *versionP, UInt32 *crDateP,
+	UInt32 *modDateP, UInt32 *bckUpDateP, UInt32 *modNumP,
+	LocalID *appInfoIDP, LocalID *sortInfoIDP, UInt32 *typeP,
+	UInt32 *creatorP)
+{
+	HostDB *db = DbFromID(dbID);
+
+	if (!db)
+		return SetErr(dmErrCantFind);
+	if (nameP)       strncpy(db->name, nameP, dmDBNameLength - 1);
+	if (attributesP) db->attributes = *attributesP;
+	if (versionP)    db->version = *versionP;
+	if (crDateP)     db->crDate = *crDateP;
+	if (modDateP)    db->modDate = *modDateP;
+	if (bckUpDateP)  db->bckUpDate = *bckUpDateP;
+	if (modNumP)     db->modNum = *modNumP;
+	if (appInfoIDP) {
+		// like the device, a replaced block is left for the caller to free
+		db->appInfo = MemLocalIDToGlobal(*appInfoIDP, cardNo);
+		if (db->appInfo)
+			HostChunkSetOwner(db->appInfo, db);
+	}
+	if (typeP)       db->type = *typeP;
+	if (creatorP)    db->creator = *creatorP;
+	db->dirty = true;
+	return errNone;
+}
+
+Err DmGetLastErr(void)
+{
+	return sLastErr;
+}
+
+/*********************************************************************
+ * Record functions
+ *********************************************************************/
+
+UInt16 DmNumRecords(DmOpenRef dbP)
+{
+	HostDB *db = DbFromRef(dbP, false);
+	return db ? db->numRecords : 0;
+}
+
+Err DmRecordInfo(DmOpenRef dbP, UInt16 index, UInt16 *attrP,
+	UInt32 *uniqueIDP, LocalID *chunkIDP)
+{
+	HostDB *db = DbFromRef(dbP, false);
+
+	if (!db)
+		return sLastErr;
+	if (index >= db->numRecords)
+		return SetErr(dmErrIndexOutOfRange);
+	if (attrP)     *attrP = db->records[index].attr;
+	if (uniqueIDP) *uniqueIDP = db->records[index].uniqueID;
+	if (chunkIDP)  *chunkIDP = db->records[index].chunk ? index + 1 : 0;
+	return errNone;
+}
+
+Err DmSetRecordInfo(DmOpenRef dbP, UInt16 index, UInt16 *attrP,
+	UInt32 *uniqueIDP)
+{
+	HostDB *db = DbFromRef(dbP, true);
+
+	if (!db)
+		return sLastErr;
+	if (index >= db->numRecords)
+		return SetErr(dmErrIndexOutOfRange);
+	if (attrP)
+		db->records[index].attr = (UInt8)((db->records[index].attr & dmRecAttrBusy) |
+			(*attrP & ~dmRecAttrBusy));
+	if (uniqueIDP)
+		db->records[index].uniqueID = *uniqueIDP & 0x00FFFFFF;
+	DbModified(db);
+	return errNone;
+}
+
+Err DmFindRecordByID(DmOpenRef dbP, UInt32 uniqueID, UInt16 *indexP)
+{
+	HostDB *db = DbFromRef(dbP, false);
+	UInt16 i;
+
+	if (!db)
+		return sLastErr;
+	// Linear, like the device
+	for (i = 0; i < db->numRecords; i++) {
+		if (db->records[i].uniqueID == uniqueID) {
+			*indexP = i;
+			return errNone;
+		}
+	}
+	return SetErr(dmErrUniqueIDNotFound);
+}
+
+MemHandle DmNewRecord(DmOpenRef dbP, UInt16 *atP, UInt32 size)
+{
+	HostDB *db = DbFromRef(dbP, true);
+	HostRecord rec;
+	UInt16 at;
+
+	if (!db)
+		return NULL;
+	if (DbReserve(db) != errNone) {
+		SetErr(dmErrMemError);
+		return NULL;
+	}
+
+	rec.chunk = HostChunkNew(size, db);
+	if (!rec.chunk) {
+		SetErr(dmErrMemError);
+		return NULL;
+	}
+	rec.attr = dmRecAttrBusy | dmRecAttrDirty;
+	rec.uniqueID = DbNewUniqueID(db);
+
+	at = (*atP > db->numRecords) ? db->numRecords : *atP;
+	memmove(db->records + at + 1, db->records + at,
+		(db->numRecords - at) * sizeof(HostRecord));
+	db->records[at] = rec;
+	db->numRecords++;
+	*atP = at;
+
+	DbModified(db);
+	SetErr(errNone);
+	return rec.chunk;
+}
+
+MemHandle DmNewHandle(DmOpenRef dbP, UInt32 size)
+{
+	HostDB *db = DbFromRef(dbP, false);
+	HostChunk *chunk;
+
+	if (!db)
+		return NULL;
+	// in the database's heap, so DmWrite accepts it, but not a record
+	chunk = HostChunkNew(size, db);
+	SetErr(chunk ? errNone : dmErrMemError);
+	return chunk;
+}
+
+MemHandle DmQueryRecord(DmOpenRef dbP, UInt16 index)
+{
+	HostDB *db = DbFromRef(dbP, false);
+
+	if (!db)
+		return NULL;
+	if (index >= db->numRecords) {
+		SetErr(dmErrIndexOutOfRange);
+		return NULL;
+	}
+	if (!db->records[index].chunk) {
+		SetErr(dmErrRecordDeleted);
+		return NULL;
+	}
+	return db->records[index].chunk;
+}
+
+MemHandle DmGetRecord(DmOpenRef dbP, UInt16 index)
+{
+	HostDB *db = DbFromRef(dbP, true);
+
+	if (!db)
+		return NULL;
+	if (index >= db->numRecords) {
+		SetErr(dmErrIndexOutOfRange);
+		return NULL;
+	}
+	if (db->records[index].attr & dmRecAttrBusy) {
+		HostFatal(__FILE__, __LINE__, "DmGetRecord on busy record");
+		return NULL;
+	}
+	if (!db->records[index].chunk) {
+		SetErr(dmErrRecordDeleted);
+		return NULL;
+	}
+	db->records[index].attr |= dmRecAttrBusy;
+	return db->records[index].chunk;
+}
+
+Err DmReleaseRecord(DmOpenRef dbP, UInt16 index, Boolean dirty)
+{
+	HostDB *db = DbFromRef(dbP, false);
+
+	if (!db)
+		return sLastErr;
+	if (index >= db->numRecords)
+		return SetErr(dmErrIndexOutOfRange);
+	db->records[index].attr &= ~dmRecAttrBusy;
+	if (dirty) {
+		db->records[index].attr |= dmRecAttrDirty;
+		DbModified(db);
+	}
+	return errNone;
+}
+
+MemHandle DmResizeRecord(DmOpenRef dbP, UInt16 index, UInt32 newSize)
+{
+	HostDB *db = DbFromRef(dbP, true);
+	Err err;
+
+	if (!db)
+		return NULL;
+	if (index >= db->numRecords) {
+		SetErr(dmErrIndexOutOfRange);
+		return NULL;
+	}
+	if (!db->records[index].chunk) {
+		SetErr(dmErrRecordDeleted);
+		return NULL;
+	}
+	err = HostChunkResize(db->records[index].chunk, newSize);
+	if (err != errNone) {
+		SetErr(err == memErrChunkLocked ? err : dmErrMemError);
+		return NULL;
+	}
+	DbModified(db);
+	return db->records[index].chunk;
+}
+
+Err DmRemoveRecord(DmOpenRef dbP, UInt16 index)
+{
+	HostDB *db = DbFromRef(dbP, true);
+
+	if (!db)
+		return sLastErr;
+	if (index >= db->numRecords)
+		return SetErr(dmErrIndexOutOfRange);
+
+	HostChunkDispose(db->records[index].chunk);
+	memmove(db->records + index, db->records + index + 1,
+		(db->numRecords - index - 1) * sizeof(HostRecord));
+	db->numRecords--;
+	DbModified(db);
+	return errNone;
+}
+
+Err DmDeleteRecord(DmOpenRef dbP, UInt16 index)
+{
+	HostDB *db = DbFromRef(dbP, true);
+
+	if (!db)
+		return sLastErr;
+	if (index >= db->numRecords)
+		return SetErr(dmErrIndexOutOfRange);
+
+	HostChunkDispose(db->records[index].chunk);
+	db->records[index].chunk = NULL;
+	db->records[index].attr |= dmRecAttrDelete | dmRecAttrDirty;
+	DbModified(db);
+	return errNone;
+}
+
+Err DmArchiveRecord(DmOpenRef dbP, UInt16 index)
+{
+	HostDB *db = DbFromRef(dbP, true);
+
+	if (!db)
+		return sLastErr;
+	if (index >= db->numRecords)
+		return SetErr(dmErrIndexOutOfRange);
+
+	db->records[index].attr |= dmRecAttrDelete | dmRecAttrDirty;
+	DbModified(db);
+	return errNone;
+}
+
+Err DmDetachRecord(DmOpenRef dbP, UInt16 index, MemHandle *oldHP)
+{
+	HostDB *db = DbFromRef(dbP, true);
+
+	if (!db)
+		return sLastErr;
+	if (index >= db->numRecords)
+		return SetErr(dmErrIndexOutOfRange);
+	if (!db->records[index].chunk)
+		return SetErr(dmErrRecordDeleted);
+
+	*oldHP = db->records[index].chunk;
+	HostChunkSetOwner(*oldHP, NULL);
+	memmove(db->records + index, db->records + index + 1,
+		(db->numRecords - index - 1) * sizeof(HostRecord));
+	db->numRecords--;
+	DbModified(db);
+	return errNone;
+}
+
+Err DmAttachRecord(DmOpenRef dbP, UInt16 *atP, MemHandle newH,
+	MemHandle *oldHP)
+{
+	HostDB *db = DbFromRef(dbP, true);
+	UInt16 at;
+
+	if (!db)
+		return sLastErr;
+	if (!newH || newH->owner)
+		return SetErr(dmErrInvalidParam);
+
+	if (oldHP) {
+		if (*atP >= db->numRecords)
+			return SetErr(dmErrIndexOutOfRange);
+		*oldHP = db->records[*atP].chunk;
+		if (*oldHP)
+			HostChunkSetOwner(*oldHP, NULL);
+		db->records[*atP].chunk = newH;
+		db->records[*atP].attr = (db->records[*atP].attr & ~dmRecAttrDelete) |
+			dmRecAttrDirty;
+	} else {
+		if (DbReserve(db) != errNone)
+			return SetErr(dmErrMemError);
+		at = (*atP > db->numRecords) ? db->numRecords : *atP;
+		memmove(db->records + at + 1, db->records + at,
+			(db->numRecords - at) * sizeof(HostRecord));
+		db->records[at].chunk = newH;
+		db->records[at].attr = dmRecAttrDirty;
+		db->records[at].uniqueID = DbNewUniqueID(db);
+		db->numRecords++;
+		*atP = at;
+	}
+	HostChunkSetOwner(newH, db);
+	DbModified(db);
+	return errNone;
+}
+
+Err DmMoveRecord(DmOpenRef dbP, UInt16 from, UInt16 to)
+{
+	HostDB *db = DbFromRef(dbP, true);
+	HostRecord rec;
+
+	if (!db)
+		return sLastErr;
+	if (from >= db->numRecords || to > db->numRecords)
+		return SetErr(dmErrIndexOutOfRange);
+
+	// Like the device, the record is inserted before the record that was
+	// at 'to', so moving forward lands it at to - 1
+	rec = db->records[from];
+	if (to > from) {
+		to--;
+		memmove(db->records + from, db->records + from + 1,
+			(to - from) * sizeof(HostRecord));
+	} else if (to < from) {
+		memmove(db->records + to + 1, db->records + to,
+			(from - to) * sizeof(HostRecord));
+	}
+	db->records[to] = rec;
+	DbModified(db);
+	return errNone;
+}
+
+/*********************************************************************
+ * Storage writes
+ *********************************************************************/
+
+Err DmWrite(void *recordP, UInt32 offset, const void *srcP, UInt32 bytes)
+{
+	HostChunk *chunk = HostChunkFromPtr(recordP);
+
+	if (!chunk || !chunk->owner)
+		HostFatal(__FILE__, __LINE__, "DmWrite outside a database record");
+	if (offset + bytes > chunk->size)
+		HostFatal(__FILE__, __LINE__, "DmWrite out of bounds");
+	memmove((UInt8 *)recordP + offset, srcP, bytes);
+	HostDbTouch(chunk->owner);
+	return errNone;
+}
+
+Err DmSet(void *recordP, UInt32 offset, UInt32 bytes, UInt8 value)
+{
+	HostChunk *chunk = HostChunkFromPtr(recordP);
+
+	if (!chunk || !chunk->owner)
+		HostFatal(__FILE__, __LINE__, "DmSet outside a database record");
+	if (offset + bytes > chunk->size)
+		HostFatal(__FILE__, __LINE__, "DmSet out of bounds");
+	memset((UInt8 *)recordP + offset, value, bytes);
+	HostDbTouch(chunk->owner);
+	return errNone;
+}
+
+Err DmStrCopy(void *recordP, UInt32 offset, const Char *srcP)
+{
+	return DmWrite(recordP, offset, srcP, StrLen(srcP) + 1);
+}
+
+/*********************************************************************
+ * Sorting
+ *********************************************************************/
+
+UInt16 DmFindSortPosition(DmOpenRef dbP, void *newRecord,
+	SortRecordInfoPtr newRecordInfo, DmComparF *compar, Int16 other)
+{
+	HostDB *db = DbFromRef(dbP, false);
+	SortRecordInfoType info;
+	SortRecordInfoType empty = {0};
+	UInt16 lo = 0, hi, mid;
+
+	if (!db)
+		return 0;
+	hi = LiveRecordCount(db);
+
+	// Returns the position after the last record that sorts <= newRecord
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (!db->records[mid].chunk)
+			HostFatal(__FILE__, __LINE__, "deleted record inside sorted range");
+		RecordSortInfo(&db->records[mid], &info);
+		if (compar(newRecord, db->records[mid].chunk->data, other,
+				newRecordInfo ? newRecordInfo : &empty, &info, db->appInfo) < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return lo;
+}
+
+Err DmInsertionSort(DmOpenRef dbP, DmComparF *compar, Int16 other)
+{
+	HostDB *db = DbFromRef(dbP, true);
+	HostRecord rec;
+	UInt16 n, i, j;
+
+	if (!db)
+		return sLastErr;
+	n = LiveRecordCount(db);
+	for (i = 1; i < n; i++) {
+		rec = db->records[i];
+		for (j = i; j > 0 &&
+				CompareRecords(db, &db->records[j - 1], &rec, compar, other) > 0; j--)
+			db->records[j] = db->records[j - 1];
+		db->records[j] = rec;
+	}
+	DbModified(db);
+	return errNone;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     MergeSortRecords
+ *
+ * DESCRIPTION:  Stable merge sort used for DmQuickSort so results on
+ *				 the host are deterministic
+ *
+ * PARAMETERS:   database, records, scratch space, count, comparison
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void MergeSortRecords(HostDB *db, HostRecord *recs, HostRecord *tmp,
+	UInt16 n, DmComparF *compar, Int16 other)
+{
+	UInt16 half = n / 2, i = 0, j = half, k = 0;
+
+	if (n < 2)
+		return;
+	MergeSortRecords(db, recs, tmp, half, compar, other);
+	MergeSortRecords(db, recs + half, tmp, n - half, compar, other);
+
+	while (i < half && j < n) {
+		if (CompareRecords(db, &recs[j], &recs[i], compar, other) < 0)
+			tmp[k++] = recs[j++];
+		else
+			tmp[k++] = recs[i++];
+	}
+	while (i < half)
+		tmp[k++] = recs[i++];
+	while (j < n)
+		tmp[k++] = recs[j++];
+	memcpy(recs, tmp, n * sizeof(HostRecord));
+}
+
+Err DmQuickSort(DmOpenRef dbP, DmComparF *compar, Int16 other)
+{
+	HostDB *db = DbFromRef(dbP, true);
+	HostRecord *tmp, *live;
+	UInt16 i, n = 0, d = 0;
+
+	if (!db)
+		return sLastErr;
+	if (db->numRecords < 2)
+		return errNone;
+
+	// Deleted records are moved to the end, as on the device
+	tmp = malloc(db->numRecords * sizeof(HostRecord));
+	live = malloc(db->numRecords * sizeof(HostRecord));
+	for (i = 0; i < db->numRecords; i++) {
+		if (db->records[i].attr & dmRecAttrDelete)
+			tmp[d++] = db->records[i];
+		else
+			live[n++] = db->records[i];
+	}
+	memcpy(db->records + n, tmp, d * sizeof(HostRecord));
+	MergeSortRecords(db, live, tmp, n, compar, other);
+	memcpy(db->records, live, n * sizeof(HostRecord));
+	free(tmp);
+	free(live);
+
+	DbModified(db);
+	return errNone;
+}
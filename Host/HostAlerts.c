@@ -0,0 +1,42 @@
+/*
+ * HostAlerts.c
+ *
+ * Host replacement for Alerts.c - the data layer reports errors through
+ * displayError, which on the host just prints instead of raising a form
+ *
+ */
+
+#include <stdio.h>
+
+#include "PalmOS.h"
+#include "Quartermaster.h"
+
+/***********************************************************************
+ *
+ * FUNCTION:     displayError
+ *
+ * DESCRIPTION:  Prints non-fatal error code to stderr
+ *
+ * PARAMETERS:   Error code
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+void displayError(Err code) {
+	fprintf(stderr, "Quartermaster error 0x%04x\n", code);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     displayErrorIf
+ *
+ * DESCRIPTION:  Prints non-fatal error code if error is present
+ *
+ * PARAMETERS:   Error code
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+void displayErrorIf(Err code) {
+	if (code != errNone) displayError(code);
+}
@@ -0,0 +1,56 @@
+/*
+ * HostInternal.h
+ *
+ * Structures and functions shared between the host Manager stand-ins
+ *
+ */
+
+#ifndef HOSTINTERNAL_H_
+#define HOSTINTERNAL_H_
+
+#include "PalmOS.h"
+
+/*********************************************************************
+ * Structures
+ *********************************************************************/
+
+struct HostDBTag;
+
+// A movable chunk; MemHandle points at one of these
+typedef struct HostChunkTag {
+	UInt8 *data;
+	UInt32 size;
+	UInt16 lockCount;
+	struct HostDBTag *owner;	// database holding the chunk, NULL if dynamic
+} HostChunk;
+
+// Stored immediately before chunk data so a pointer can find its chunk
+typedef union {
+	HostChunk *chunk;
+	long double align;
+} HostChunkPrefix;
+
+/*********************************************************************
+ * MemoryMgr.c functions
+ *********************************************************************/
+
+HostChunk* HostChunkNew(UInt32 size, struct HostDBTag *owner);
+void HostChunkDispose(HostChunk *chunk);
+void HostChunkSetOwner(HostChunk *chunk, struct HostDBTag *owner);
+HostChunk* HostChunkFromPtr(const void *p);
+Err HostChunkResize(HostChunk *chunk, UInt32 newSize);
+
+/*********************************************************************
+ * DataMgr.c functions
+ *********************************************************************/
+
+void HostDbTouch(struct HostDBTag *db);
+const Char* HostDmDirectory(void);
+
+/*********************************************************************
+ * SystemMgr.c functions
+ *********************************************************************/
+
+void HostPrefReset(void);
+
+#endif /* HOSTINTERNAL_H_ */
@@ -0,0 +1,36 @@
+/*
+ * HostPalm.h
+ *
+ * Host-only controls for the Data Manager stand-in. None of this exists
+ * on the device; it lets a desktop harness choose where .pdb files live
+ * and force them back to disk.
+ *
+ */
+
+#ifndef HOSTPALM_H_
+#define HOSTPALM_H_
+
+#include "PalmOS.h"
+
+/*********************************************************************
+ * Data Manager controls
+ *********************************************************************/
+
+// Directory scanned for .pdb files (default: $QM_HOST_DIR, then "."),
+// which also holds the app preferences as .pref files
+void HostDmSetDirectory(const Char *path);
+
+// Writes every modified database back to its .pdb file
+Err HostDmFlushAll(void);
+
+// Flushes, then forgets all databases, open references and preferences
+void HostDmReset(void);
+
+/*********************************************************************
+ * Memory Manager controls
+ *********************************************************************/
+
+// Number of dynamic-heap chunks currently allocated (handles and ptrs)
+UInt32 HostMemChunkCount(void);
+
+#endif /* HOSTPALM_H_ */
@@ -0,0 +1,130 @@
+/*
+ * HostTest.c
+ *
+ * Helpers shared by the host benchmarks and checks, see HostTest.h.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "HostPalm.h"
+#include "HostTest.h"
+#include "Quartermaster.h"
+
+/***********************************************************************
+ *
+ * FUNCTION:     HostTestSeconds
+ *
+ * DESCRIPTION:  Monotonic clock in seconds (finer than TimGetTicks)
+ *
+ * PARAMETERS:   nothing
+ *
+ * RETURNED:     seconds
+ *
+ ***********************************************************************/
+double HostTestSeconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     HostTestRandomRecipe
+ *
+ * DESCRIPTION:  Adds a random recipe with AddRecipe, or with ImportRecipe
+ *				 when the shape says so
+ *
+ * PARAMETERS:   recipe shape
+ *
+ * RETURNED:     error code
+ *
+ ***********************************************************************/
+Err HostTestRandomRecipe(const HostTestRecipeShape *shape)
+{
+	Char ingredients[hostTestMaxLines][24];
+	Char units[hostTestMaxLines][24];
+	const Char *ingredientP[hostTestMaxLines];
+	const Char *unitP[hostTestMaxLines];
+	UInt8 counts[hostTestMaxLines];
+	UInt8 zeros[hostTestMaxLines] = {0};
+	Char name[32];
+	int j, n;
+
+	snprintf(name, sizeof(name), "%s %05d", shape->prefix, rand() % 100000);
+	n = shape->minLines + rand() % (shape->maxLines - shape->minLines + 1);
+	for (j = 0; j < n; j++) {
+		snprintf(ingredients[j], sizeof(ingredients[j]), "ingredient %d", rand() % shape->numIngredients);
+		snprintf(units[j], sizeof(units[j]), "unit %d", rand() % shape->numUnits);
+		ingredientP[j] = ingredients[j];
+		unitP[j] = units[j];
+		counts[j] = 1 + rand() % 4;
+	}
+	if (shape->import)
+		return ImportRecipe(name, ingredientP, unitP, n, counts, zeros, zeros, shape->steps);
+	return AddRecipe(name, ingredientP, unitP, n, counts, zeros, zeros, shape->steps);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     HostTestInvalidate
+ *
+ * DESCRIPTION:  Bumps the modification number of a closed database, so
+ *				 the indexes cached with it no longer match
+ *
+ * PARAMETERS:   database name
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+void HostTestInvalidate(const Char *name)
+{
+	LocalID dbID = DmFindDatabase(0, name);
+	UInt32 modNum;
+
+	DmDatabaseInfo(0, dbID, NULL, NULL, NULL, NULL, NULL, NULL, &modNum,
+		NULL, NULL, NULL, NULL);
+	modNum++;
+	DmSetDatabaseInfo(0, dbID, NULL, NULL, NULL, NULL, NULL, NULL, &modNum,
+		NULL, NULL, NULL, NULL);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     HostTestCountUses
+ *
+ * DESCRIPTION:  Counts the recipes that list an item at least once
+ *
+ * PARAMETERS:   true for a unit ID, false for an ingredient ID, item ID
+ *
+ * RETURNED:     number of recipes
+ *
+ ***********************************************************************/
+UInt16 HostTestCountUses(Boolean unit, UInt32 id)
+{
+	UInt16 numRecipes = DmNumRecords(gRecipeDB);
+	MemHandle recH;
+	RecipeView recipe;
+	UInt16 uses = 0;
+	UInt16 i;
+	UInt8 j;
+
+	for (i = 0; i < numRecipes; i++) {
+		recH = DmQueryRecord(gRecipeDB, i);
+		if (!recH)
+			continue;
+		RecipeViewInit(&recipe, MemHandleLock(recH));
+		for (j = 0; j < recipe.numIngredients; j++) {
+			if ((unit ? RecipeViewUnitID(&recipe, j) : RecipeViewIngredientID(&recipe, j)) == id) {
+				uses++;
+				break;
+			}
+		}
+		MemHandleUnlock(recH);
+	}
+	return uses;
+}
@@ -0,0 +1,52 @@
+/*
+ * HostTest.h
+ *
+ * Helpers shared by the host benchmarks and checks: a monotonic clock,
+ * synthetic recipes, and the bits of database bookkeeping more than one
+ * of them needs. Built into each tool rather than libqmhost.a, since none
+ * of it stands in for anything on the device.
+ *
+ */
+
+#ifndef HOSTTEST_H_
+#define HOSTTEST_H_
+
+#include "PalmOS.h"
+
+/*********************************************************************
+ * Constants and structures
+ *********************************************************************/
+
+#define hostTestMaxLines	12		// most ingredient lines in a synthetic recipe
+
+typedef struct {
+	const Char *prefix;				// name is prefix and a random 5-digit number
+	UInt8 minLines;					// lines per recipe, picked evenly from
+	UInt8 maxLines;					// minLines to maxLines (at most hostTestMaxLines)
+	int numIngredients;				// lines name "ingredient 0" and up
+	int numUnits;					// and "unit 0" and up
+	const Char *steps;
+	Boolean import;					// ImportRecipe (inside ImportBegin/ImportEnd), not AddRecipe
+} HostTestRecipeShape;
+//What HostTestRandomRecipe generates. The same shape and srand seed give
+//the same recipes
+
+/*********************************************************************
+ * Functions
+ *********************************************************************/
+
+// Monotonic clock in seconds (finer than TimGetTicks)
+double HostTestSeconds(void);
+
+// Adds a random recipe of the given shape
+Err HostTestRandomRecipe(const HostTestRecipeShape *shape);
+
+// Bumps the modification number of a closed database, so the indexes
+// DatabaseClose cached with it no longer match
+void HostTestInvalidate(const Char *name);
+
+// Counts the open recipes that list an item at least once: true for a
+// unit ID, false for an ingredient ID
+UInt16 HostTestCountUses(Boolean unit, UInt32 id);
+
+#endif /* HOSTTEST_H_ */
@@ -0,0 +1,246 @@
+/*
+ * IDMapCheck.c
+ *
+ * Consistency check of the recipe, ingredient and unit ID maps. After
+ * each step of a synthetic session - adding recipes, removing some,
+ * compacting, and opening again with the cached maps and with the cache
+ * invalidated - every unique ID seen so far is looked up with IndexFromID
+ * and compared with a DmFindRecordByID search (tombstones and removed
+ * records must not be found). Prints each mismatch and the counters of
+ * IDMapGetStats for every map.
+ *
+ * Usage: IDMapCheck [recipes] [distinct ingredients]
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "HostPalm.h"
+#include "HostTest.h"
+#include "Quartermaster.h"
+
+/*********************************************************************
+ * Internal Constants
+ *********************************************************************/
+
+#define checkDefaultRecipes		500
+#define checkDefaultIngredients	300
+#define checkUnits				8
+#define checkMaxPerRecipe		10
+#define checkMaxIDs				8192	// IDs remembered per database
+
+/*********************************************************************
+ * Internal Structures
+ *********************************************************************/
+
+typedef struct {
+	UInt32 ids[checkMaxIDs];
+	UInt16 numIds;
+} SeenIDs;
+//Every unique ID a database has held during the run, removed ones included
+
+/*********************************************************************
+ * Internal Variables
+ *********************************************************************/
+
+static SeenIDs gSeen[3];
+
+/*********************************************************************
+ * Internal Functions
+ *********************************************************************/
+
+/***********************************************************************
+ *
+ * FUNCTION:     Remember
+ *
+ * DESCRIPTION:  Adds the IDs of every record of a database, tombstones
+ *				 included, to the ones seen
+ *
+ * PARAMETERS:   database, IDs seen in it
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void Remember(DmOpenRef dbase, SeenIDs *seen)
+{
+	UInt32 id;
+	UInt16 i;
+	UInt16 j;
+
+	for (i = 0; i < DmNumRecords(dbase); i++) {
+		id = IDFromIndex(dbase, i);
+		for (j = 0; j < seen->numIds && seen->ids[j] != id; j++)
+			;
+		if (j == seen->numIds && seen->numIds < checkMaxIDs)
+			seen->ids[seen->numIds++] = id;
+	}
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     Expected
+ *
+ * DESCRIPTION:  Index IndexFromID should give for an ID, found by the
+ *				 Data Manager's own search
+ *
+ * PARAMETERS:   database, unique ID
+ *
+ * RETURNED:     index of the live record, or 0xFFFF
+ *
+ ***********************************************************************/
+static UInt16 Expected(DmOpenRef dbase, UInt32 id)
+{
+	UInt16 index;
+	UInt16 attr;
+
+	if (DmFindRecordByID(dbase, id, &index) != errNone)
+		return 0xFFFF;
+	if (DmRecordInfo(dbase, index, &attr, NULL, NULL) != errNone || (attr & dmRecAttrDelete))
+		return 0xFFFF;
+	return index;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     CheckStep
+ *
+ * DESCRIPTION:  Looks up every ID seen in the recipe, ingredient and
+ *				 unit databases, printing each mismatch
+ *
+ * PARAMETERS:   label for messages
+ *
+ * RETURNED:     number of mismatches
+ *
+ ***********************************************************************/
+static UInt16 CheckStep(const char *label)
+{
+	DmOpenRef dbs[3];
+	UInt16 index, expected;
+	UInt16 checked = 0;
+	UInt16 bad = 0;
+	UInt16 i;
+	int d;
+
+	dbs[0] = gRecipeDB;
+	dbs[1] = gIngredientDB;
+	dbs[2] = gUnitDB;
+	for (d = 0; d < 3; d++) {
+		Remember(dbs[d], &gSeen[d]);
+		for (i = 0; i < gSeen[d].numIds; i++) {
+			index = IndexFromID(dbs[d], gSeen[d].ids[i]);
+			expected = Expected(dbs[d], gSeen[d].ids[i]);
+			if (index != expected) {
+				printf("%-10s database %d: ID %lu at %u, expected %u\n", label, d,
+					(unsigned long)gSeen[d].ids[i], index, expected);
+				bad++;
+			}
+			checked++;
+		}
+	}
+
+	printf("%-10s %u lookups, %u wrong\n", label, checked, bad);
+	return bad;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     PrintStats
+ *
+ * DESCRIPTION:  Prints the counters of the three ID maps
+ *
+ * PARAMETERS:   label
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void PrintStats(const char *label)
+{
+	static const char *const names[3] = { "recipe", "ingredient", "unit" };
+	DmOpenRef dbs[3];
+	IDMapStats stats;
+	int d;
+
+	dbs[0] = gRecipeDB;
+	dbs[1] = gIngredientDB;
+	dbs[2] = gUnitDB;
+	for (d = 0; d < 3; d++) {
+		if (IDMapGetStats(dbs[d], &stats) != errNone)
+			continue;
+		printf("%-10s %-10s %7lu hits %5lu misses %3u rebuilds (%lu ticks)\n", label, names[d],
+			(unsigned long)stats.hits, (unsigned long)stats.misses, stats.rebuilds,
+			(unsigned long)stats.rebuildTicks);
+	}
+}
+
+/*********************************************************************
+ * Main
+ *********************************************************************/
+
+int main(int argc, char **argv)
+{
+	int numRecipes = argc > 1 ? atoi(argv[1]) : checkDefaultRecipes;
+	int numIngredients = argc > 2 ? atoi(argv[2]) : checkDefaultIngredients;
+	char dir[] = "/tmp/qmidmapXXXXXX";
+	HostTestRecipeShape shape = { "Recipe", 1, checkMaxPerRecipe,
+		numIngredients, checkUnits, "Stir.", false };
+	UInt16 bad = 0;
+	UInt16 index;
+	int cold;
+	int k;
+
+	if (numRecipes < 1 || numIngredients < 1)
+		return 2;
+	if (!mkdtemp(dir)) {
+		perror("mkdtemp");
+		return 2;
+	}
+	HostDmSetDirectory(dir);
+	srand(1);
+
+	if (DatabaseOpen() != errNone || DatabaseRequire(dbSetAll) != errNone) {
+		fprintf(stderr, "DatabaseOpen failed\n");
+		return 2;
+	}
+
+	for (k = 0; k < numRecipes; k++)
+		HostTestRandomRecipe(&shape);
+	bad += CheckStep("add");
+
+	// leaves tombstones, and removes the ingredients and units only they used
+	for (k = 0; k < numRecipes / 4; k++) {
+		index = rand() % DmNumRecords(gRecipeDB);
+		if (DmQueryRecord(gRecipeDB, index))
+			RemoveRecipe(index);
+	}
+	bad += CheckStep("remove");
+
+	DatabaseCompact();
+	bad += CheckStep("compact");
+	PrintStats("session");
+
+	// once with the maps restored from the cache, once rebuilt
+	for (cold = 0; cold < 2; cold++) {
+		DatabaseClose();
+		if (cold) {
+			HostTestInvalidate(databaseRecipeName);
+			HostTestInvalidate(databaseIngredientName);
+			HostTestInvalidate(databaseUnitName);
+		}
+		if (DatabaseOpen() != errNone || DatabaseRequire(dbSetAll) != errNone) {
+			fprintf(stderr, "DatabaseOpen failed\n");
+			return 2;
+		}
+		bad += CheckStep(cold ? "rebuilt" : "cached");
+		for (k = 0; k < numRecipes / 10; k++)
+			HostTestRandomRecipe(&shape);
+		bad += CheckStep(cold ? "rebuilt+" : "cached+");
+		PrintStats(cold ? "rebuilt" : "cached");
+	}
+
+	DatabaseClose();
+	HostDmReset();
+	printf("%d recipes in %s\n", numRecipes, dir);
+	return bad ? 1 : 0;
+}
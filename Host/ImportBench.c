@@ -0,0 +1,125 @@
+/*
+ * ImportBench.c
+ *
+ * Times importing a synthetic recipe set into empty databases two ways:
+ * one AddRecipe call per recipe, and ImportBegin/ImportRecipe/ImportEnd.
+ * Both runs must leave the same recipes in the same order.
+ *
+ * Usage: ImportBench [recipes] [distinct ingredients]
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "HostPalm.h"
+#include "HostTest.h"
+#include "Quartermaster.h"
+
+/*********************************************************************
+ * Internal Constants
+ *********************************************************************/
+
+#define benchDefaultRecipes		2000
+#define benchDefaultIngredients	300
+#define benchUnits				12
+#define benchMinPerRecipe		2
+
+/*********************************************************************
+ * Internal Functions
+ *********************************************************************/
+
+/***********************************************************************
+ *
+ * FUNCTION:     RunImport
+ *
+ * DESCRIPTION:  Creates empty databases in a new directory and adds the
+ *				 synthetic recipes to them
+ *
+ * PARAMETERS:   true to use the bulk import API, number of recipes,
+ *				 number of distinct ingredients, buffer for the recipe
+ *				 names in database order (32 bytes each)
+ *
+ * RETURNED:     seconds taken, or -1 on error
+ *
+ ***********************************************************************/
+static double RunImport(Boolean bulk, int numRecipes, int numIngredients, Char *names)
+{
+	char dir[] = "/tmp/qmbenchXXXXXX";
+	HostTestRecipeShape shape = { "Recipe", benchMinPerRecipe, hostTestMaxLines,
+		numIngredients, benchUnits, "Mix and serve.", bulk };
+	MemHandle recH;
+	double start, elapsed;
+	int i;
+	Err err = errNone;
+
+	if (!mkdtemp(dir)) {
+		perror("mkdtemp");
+		return -1;
+	}
+	HostDmSetDirectory(dir);
+	if (DatabaseOpen() != errNone)
+		return -1;
+
+	// same sequence for both runs
+	srand(1);
+	start = HostTestSeconds();
+	if (bulk)
+		err = ImportBegin();
+
+	for (i = 0; i < numRecipes && err == errNone; i++)
+		err = HostTestRandomRecipe(&shape);
+
+	if (bulk && ImportEnd() != errNone && err == errNone)
+		err = dmErrMemError;
+	elapsed = HostTestSeconds() - start;
+
+	for (i = 0; i < DmNumRecords(gRecipeDB); i++) {
+		recH = DmQueryRecord(gRecipeDB, i);
+		strncpy(names + i * 32, MemHandleLock(recH), 32);
+		MemHandleUnlock(recH);
+	}
+
+	DatabaseClose();
+	HostDmReset();
+	printf("%-10s %6d recipes  %8.3f s  (%s)\n", bulk ? "import" : "AddRecipe",
+		numRecipes, elapsed, dir);
+	if (err != errNone) {
+		fprintf(stderr, "error 0x%04x\n", err);
+		return -1;
+	}
+	return elapsed;
+}
+
+/*********************************************************************
+ * Main
+ *********************************************************************/
+
+int main(int argc, char **argv)
+{
+	int numRecipes = argc > 1 ? atoi(argv[1]) : benchDefaultRecipes;
+	int numIngredients = argc > 2 ? atoi(argv[2]) : benchDefaultIngredients;
+	Char *addNames = calloc(numRecipes, 32);
+	Char *importNames = calloc(numRecipes, 32);
+	double addTime, importTime;
+
+	if (numRecipes < 1 || numIngredients < 1 || !addNames || !importNames)
+		return 1;
+
+	addTime = RunImport(false, numRecipes, numIngredients, addNames);
+	importTime = RunImport(true, numRecipes, numIngredients, importNames);
+	if (addTime < 0 || importTime < 0)
+		return 1;
+
+	if (memcmp(addNames, importNames, (size_t)numRecipes * 32) != 0) {
+		fprintf(stderr, "recipe order differs between runs\n");
+		return 1;
+	}
+	printf("speedup    %.1fx\n", importTime > 0 ? addTime / importTime : 0.0);
+
+	free(addNames);
+	free(importNames);
+	return 0;
+}
@@ -0,0 +1,196 @@
+/*
+ * MemCheck.c
+ *
+ * Leak check of the data layer. Built with DEBUG_MEMORY, so Database.c
+ * and this file allocate through MemTrack.c. Runs the database calls
+ * each form makes on a synthetic recipe set, with a MemTrackCheckpoint
+ * where the form would get its frmCloseEvent and a closing one after
+ * DatabaseClose (as AppStop does), then prints the QMMemLog records
+ * those checkpoints wrote. Search results are freed the way the forms
+ * free them: by the recipe list when there are any, not at all when the
+ * search found nothing.
+ *
+ * Usage: MemCheck [recipes] [distinct ingredients]
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "HostPalm.h"
+#include "HostTest.h"
+#include "Quartermaster.h"
+#include "Quartermaster_Rsc.h"
+
+/*********************************************************************
+ * Internal Constants
+ *********************************************************************/
+
+#define checkDefaultRecipes		200
+#define checkDefaultIngredients	60
+#define checkUnits				8
+#define checkMaxPerRecipe		10
+
+/*********************************************************************
+ * Internal Functions
+ *********************************************************************/
+
+/***********************************************************************
+ *
+ * FUNCTION:     ShowResults
+ *
+ * DESCRIPTION:  Does with search results what the forms do: a search
+ *				 that found recipes opens the recipe list, which frees
+ *				 them on its frmCloseEvent
+ *
+ * PARAMETERS:   number of results, results, missing counts (or NULL)
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void ShowResults(UInt16 numResults, MemHandle results, MemHandle missing)
+{
+	if (numResults == 0)
+		return;
+	if (results)
+		MemHandleFree(results);
+	if (missing)
+		MemHandleFree(missing);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     PrintLog
+ *
+ * DESCRIPTION:  Prints the records of the QMMemLog database
+ *
+ * PARAMETERS:   nothing
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void PrintLog(void)
+{
+	LocalID dbID = DmFindDatabase(0, "QMMemLog");
+	DmOpenRef logDB;
+	MemHandle recH;
+	UInt16 i;
+
+	logDB = dbID ? DmOpenDatabase(0, dbID, dmModeReadOnly) : NULL;
+	if (!logDB)
+		return;
+	for (i = 0; i < DmNumRecords(logDB); i++) {
+		recH = DmQueryRecord(logDB, i);
+		if (!recH)
+			continue;
+		fputs(MemHandleLock(recH), stdout);
+		MemHandleUnlock(recH);
+	}
+	DmCloseDatabase(logDB);
+}
+
+/*********************************************************************
+ * Main
+ *********************************************************************/
+
+int main(int argc, char **argv)
+{
+	int numRecipes = argc > 1 ? atoi(argv[1]) : checkDefaultRecipes;
+	int numIngredients = argc > 2 ? atoi(argv[2]) : checkDefaultIngredients;
+	char dir[] = "/tmp/qmcheckXXXXXX";
+	HostTestRecipeShape shape = { "Recipe", 1, checkMaxPerRecipe,
+		numIngredients, checkUnits, "Mix well and bake until golden.", false };
+	MemHandle results, missing;
+	MemHandle recH;
+	RecipeView view;
+	GroceryAmount amounts[4];
+	UInt32 recipeIds[3];
+	Char *steps;
+	UInt16 numResults;
+	UInt16 numLeaked;
+	UInt16 i;
+	int k;
+
+	if (numRecipes < 1 || numIngredients < 1)
+		return 2;
+	if (!mkdtemp(dir)) {
+		perror("mkdtemp");
+		return 2;
+	}
+	HostDmSetDirectory(dir);
+	srand(1);
+
+	if (DatabaseOpen() != errNone) {
+		fprintf(stderr, "DatabaseOpen failed\n");
+		return 2;
+	}
+	MemTrackCheckpoint("DatabaseOpen", 0, false);
+
+	// edit recipe: new recipes, then changes and removals
+	for (k = 0; k < numRecipes; k++)
+		HostTestRandomRecipe(&shape);
+	shape.prefix = "Changed";
+	for (k = 0; k < numRecipes / 10; k++) {
+		RemoveRecipe(LiveRecordIndex(gRecipeDB, rand() % LiveRecordCount(gRecipeDB)));
+		HostTestRandomRecipe(&shape);
+	}
+	MemTrackCheckpoint("frmCloseEvent", formEditRecipe, false);
+
+	// view recipe
+	for (i = 0; i < LiveRecordCount(gRecipeDB); i++) {
+		recH = DmQueryRecord(gRecipeDB, LiveRecordIndex(gRecipeDB, i));
+		RecipeViewInit(&view, MemHandleLock(recH));
+		steps = RecipeViewStepsText(&view);
+		if (steps)
+			MemPtrFree(steps);
+		MemHandleUnlock(recH);
+	}
+	MemTrackCheckpoint("frmCloseEvent", formViewRecipe, false);
+
+	// recipe list text searches, one of which finds nothing
+	numResults = RecipeTextSearch("recipe", &results);
+	ShowResults(numResults, results, NULL);
+	numResults = RecipeTextSearch("no such recipe", &results);
+	ShowResults(numResults, results, NULL);
+	MemTrackCheckpoint("frmCloseEvent", formRecipeList, false);
+
+	// pantry searches, before and after the pantry has anything in it
+	for (k = 0; k < 2; k++) {
+		numResults = PantryStrictSearch(&results);
+		ShowResults(numResults, results, NULL);
+		numResults = PantryFuzzySearch(&results);
+		ShowResults(numResults, results, NULL);
+		numResults = PantryRankedSearch(searchMaxRanked, &results, &missing);
+		ShowResults(numResults, results, missing);
+		MemTrackCheckpoint("frmCloseEvent", formPantry, false);
+
+		for (i = 0; i < LiveRecordCount(gIngredientDB) / 3; i++)
+			AddIdToDatabase(gPantryDB, IDFromIndex(gIngredientDB, LiveRecordIndex(gIngredientDB, i * 3)));
+	}
+
+	// manage ingredients
+	for (i = 0; i < LiveRecordCount(gIngredientDB); i++) {
+		numResults = IngredientRecipeSearch(IDFromIndex(gIngredientDB, LiveRecordIndex(gIngredientDB, i)), &results);
+		ShowResults(numResults, results, NULL);
+	}
+	MemTrackCheckpoint("frmCloseEvent", formManageIngredients, false);
+
+	// grocery list
+	for (i = 0; i < 3; i++)
+		recipeIds[i] = IDFromIndex(gRecipeDB, LiveRecordIndex(gRecipeDB, i));
+	GroceryAddRecipes(recipeIds, 3, true);
+	for (i = 0; i < DmNumRecords(gGroceryDB); i++)
+		GroceryGetAmounts(i, amounts, 4);
+	MemTrackCheckpoint("frmCloseEvent", formGrocery, false);
+
+	DatabaseCompact();
+	DatabaseClose();
+	numLeaked = MemTrackCheckpoint("AppStop", 0, true);
+
+	printf("%d recipes in %s\n", numRecipes, dir);
+	PrintLog();
+	MemTrackStop();
+	HostDmReset();
+	return numLeaked ? 1 : 0;
+}
@@ -0,0 +1,343 @@
+/*
+ * MemoryMgr.c
+ *
+ * Host stand-in for the PalmOS Memory Manager. Every chunk, whether it
+ * came from MemHandleNew, MemPtrNew or is a database record, carries a
+ * small prefix pointing back at its HostChunk so MemPtrRecoverHandle and
+ * DmWrite bounds checks work the way they do on the device.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "PalmOS.h"
+#include "HostPalm.h"
+#include "HostInternal.h"
+
+/*********************************************************************
+ * Internal Constants
+ *********************************************************************/
+
+#define hostLocalIDBase		0x10000		// first chunk LocalID, clear of database IDs
+#define hostMaxLocalIDs		256
+
+/*********************************************************************
+ * Internal variables
+ *********************************************************************/
+
+static UInt32 sChunkCount = 0;
+
+// Chunks handed out as LocalIDs (hostLocalIDBase + slot), see MemHandleToLocalID
+static HostChunk *sLocalChunks[hostMaxLocalIDs];
+
+/*********************************************************************
+ * Internal functions
+ *********************************************************************/
+
+/***********************************************************************
+ *
+ * FUNCTION:     ChunkAllocData
+ *
+ * DESCRIPTION:  Allocates (or reallocates) the data block of a chunk,
+ *				 including the back-pointer prefix
+ *
+ * PARAMETERS:   chunk, new size, true to preserve existing contents
+ *
+ * RETURNED:     errNone or memErrNotEnoughSpace
+ *
+ ***********************************************************************/
+static Err ChunkAllocData(HostChunk *chunk, UInt32 size, Boolean keep)
+{
+	HostChunkPrefix *prefix;
+
+	if (chunk->data && keep)
+		prefix = realloc((HostChunkPrefix *)chunk->data - 1,
+			sizeof(HostChunkPrefix) + size);
+	else
+		prefix = calloc(1, sizeof(HostChunkPrefix) + size);
+
+	if (!prefix)
+		return memErrNotEnoughSpace;
+
+	if (!keep && chunk->data)
+		free((HostChunkPrefix *)chunk->data - 1);
+	else if (keep && size > chunk->size)
+		memset((UInt8 *)(prefix + 1) + chunk->size, 0, size - chunk->size);
+
+	prefix->chunk = chunk;
+	chunk->data = (UInt8 *)(prefix + 1);
+	chunk->size = size;
+	return errNone;
+}
+
+/*********************************************************************
+ * Host-internal functions
+ *********************************************************************/
+
+/***********************************************************************
+ *
+ * FUNCTION:     HostChunkNew
+ *
+ * DESCRIPTION:  Allocates a chunk, either in the dynamic heap or as
+ *				 storage for a database record
+ *
+ * PARAMETERS:   size, owning database (NULL for dynamic chunks)
+ *
+ * RETURNED:     new chunk or NULL
+ *
+ ***********************************************************************/
+HostChunk* HostChunkNew(UInt32 size, struct HostDBTag *owner)
+{
+	HostChunk *chunk = calloc(1, sizeof(HostChunk));
+
+	if (!chunk)
+		return NULL;
+
+	if (ChunkAllocData(chunk, size, false) != errNone) {
+		free(chunk);
+		return NULL;
+	}
+	chunk->owner = owner;
+	if (!owner)
+		sChunkCount++;
+	return chunk;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     HostChunkDispose
+ *
+ * DESCRIPTION:  Releases chunk memory without any ownership checks
+ *
+ * PARAMETERS:   chunk
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+void HostChunkDispose(HostChunk *chunk)
+{
+	UInt16 i;
+
+	if (!chunk)
+		return;
+	if (!chunk->owner)
+		sChunkCount--;
+	for (i = 0; i < hostMaxLocalIDs; i++) {
+		if (sLocalChunks[i] == chunk)
+			sLocalChunks[i] = NULL;
+	}
+	free((HostChunkPrefix *)chunk->data - 1);
+	free(chunk);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     HostChunkSetOwner
+ *
+ * DESCRIPTION:  Moves a chunk between the dynamic heap and a database
+ *				 (used by DmDetachRecord/DmAttachRecord)
+ *
+ * PARAMETERS:   chunk, new owner (NULL for dynamic heap)
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+void HostChunkSetOwner(HostChunk *chunk, struct HostDBTag *owner)
+{
+	if (!chunk->owner && owner)
+		sChunkCount--;
+	else if (chunk->owner && !owner)
+		sChunkCount++;
+	chunk->owner = owner;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     HostChunkFromPtr
+ *
+ * DESCRIPTION:  Recovers the chunk that owns a locked pointer
+ *
+ * PARAMETERS:   pointer to start of chunk data
+ *
+ * RETURNED:     chunk
+ *
+ ***********************************************************************/
+HostChunk* HostChunkFromPtr(const void *p)
+{
+	if (!p)
+		return NULL;
+	return ((const HostChunkPrefix *)p - 1)->chunk;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     HostChunkResize
+ *
+ * DESCRIPTION:  Resizes a chunk. Like the device, a locked chunk may
+ *				 shrink but can't grow because it would have to move
+ *
+ * PARAMETERS:   chunk, new size
+ *
+ * RETURNED:     errNone or memory error
+ *
+ ***********************************************************************/
+Err HostChunkResize(HostChunk *chunk, UInt32 newSize)
+{
+	if (!chunk)
+		return memErrInvalidParam;
+	if (newSize <= chunk->size) {
+		chunk->size = newSize;
+		return errNone;
+	}
+	if (chunk->lockCount > 0)
+		return memErrChunkLocked;
+	return ChunkAllocData(chunk, newSize, true);
+}
+
+/*********************************************************************
+ * Public functions
+ *********************************************************************/
+
+UInt32 HostMemChunkCount(void)
+{
+	return sChunkCount;
+}
+
+MemHandle MemHandleNew(UInt32 size)
+{
+	return HostChunkNew(size, NULL);
+}
+
+Err MemHandleFree(MemHandle h)
+{
+	if (!h)
+		return memErrInvalidParam;
+	if (h->owner)
+		HostFatal(__FILE__, __LINE__, "MemHandleFree on attached record");
+	HostChunkDispose(h);
+	return errNone;
+}
+
+MemPtr MemHandleLock(MemHandle h)
+{
+	if (!h) {
+		HostFatal(__FILE__, __LINE__, "MemHandleLock on NULL handle");
+		return NULL;
+	}
+	h->lockCount++;
+	return h->data;
+}
+
+Err MemHandleUnlock(MemHandle h)
+{
+	if (!h || h->lockCount == 0) {
+		HostFatal(__FILE__, __LINE__, "MemHandleUnlock on unlocked chunk");
+		return memErrChunkNotLocked;
+	}
+	h->lockCount--;
+	return errNone;
+}
+
+UInt16 MemHandleLockCount(MemHandle h)
+{
+	return h ? h->lockCount : 0;
+}
+
+UInt32 MemHandleSize(MemHandle h)
+{
+	return h ? h->size : 0;
+}
+
+Err MemHandleResize(MemHandle h, UInt32 newSize)
+{
+	return HostChunkResize(h, newSize);
+}
+
+LocalID MemHandleToLocalID(MemHandle h)
+{
+	UInt16 i;
+	UInt16 slot = hostMaxLocalIDs;
+
+	if (!h)
+		return 0;
+	for (i = 0; i < hostMaxLocalIDs; i++) {
+		if (sLocalChunks[i] == h)
+			return hostLocalIDBase + i;
+		if (!sLocalChunks[i] && slot == hostMaxLocalIDs)
+			slot = i;
+	}
+	if (slot == hostMaxLocalIDs)
+		HostFatal(__FILE__, __LINE__, "out of host LocalIDs");
+	sLocalChunks[slot] = h;
+	return hostLocalIDBase + slot;
+}
+
+MemPtr MemLocalIDToGlobal(LocalID local, UInt16 cardNo)
+{
+	if (local < hostLocalIDBase || local >= hostLocalIDBase + hostMaxLocalIDs)
+		return NULL;
+	return sLocalChunks[local - hostLocalIDBase];
+}
+
+MemPtr MemPtrNew(UInt32 size)
+{
+	HostChunk *chunk = HostChunkNew(size, NULL);
+
+	if (!chunk)
+		return NULL;
+	chunk->lockCount = 1;
+	return chunk->data;
+}
+
+Err MemPtrFree(MemPtr p)
+{
+	HostChunk *chunk = HostChunkFromPtr(p);
+
+	if (!chunk)
+		return memErrInvalidParam;
+	if (chunk->owner)
+		HostFatal(__FILE__, __LINE__, "MemPtrFree on attached record");
+	HostChunkDispose(chunk);
+	return errNone;
+}
+
+Err MemPtrUnlock(MemPtr p)
+{
+	return MemHandleUnlock(HostChunkFromPtr(p));
+}
+
+UInt32 MemPtrSize(MemPtr p)
+{
+	HostChunk *chunk = HostChunkFromPtr(p);
+	return chunk ? chunk->size : 0;
+}
+
+Err MemPtrResize(MemPtr p, UInt32 newSize)
+{
+	return HostChunkResize(HostChunkFromPtr(p), newSize);
+}
+
+MemHandle MemPtrRecoverHandle(MemPtr p)
+{
+	return HostChunkFromPtr(p);
+}
+
+Err MemSet(void *dstP, Int32 numBytes, UInt8 value)
+{
+	memset(dstP, value, numBytes);
+	return errNone;
+}
+
+Err MemMove(void *dstP, const void *sP, Int32 numBytes)
+{
+	if (numBytes > 0)
+		memmove(dstP, sP, numBytes);
+	return errNone;
+}
+
+Int16 MemCmp(const void *s1, const void *s2, Int32 numBytes)
+{
+	Int32 r = memcmp(s1, s2, numBytes);
+	return (r > 0) - (r < 0);
+}
@@ -0,0 +1,379 @@
+/*
+ * MigrateCheck.c
+ *
+ * Opens a database set written before use counts and sort keys - layout
+ * 1 recipes, as build_pdb.py --layout 1 writes them, with ingredient and
+ * unit names that differ only in case - and checks what the migrations
+ * leave behind. The set is written again for each way it can first be
+ * opened (DatabaseOpen alone, or followed by dbSetItems or dbSetAll) and
+ * then checked with every set open, and once more after DatabaseClose
+ * and a second DatabaseOpen:
+ *  - names that differ only in case are merged into one record
+ *  - every recipe line names an ingredient and unit that exist, equal to
+ *    the one written apart from case
+ *  - stored use counts match a recount from the recipes
+ *
+ * Usage: MigrateCheck
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "HostPalm.h"
+#include "HostTest.h"
+#include "Quartermaster.h"
+
+/*********************************************************************
+ * Internal Constants
+ *********************************************************************/
+
+#define checkNameSize		32		// recipe name field of a layout 1 record
+#define checkMaxLines		4
+#define checkIngredients	4		// distinct ingredients apart from case
+#define checkUnits			4		// ... and units
+
+/*********************************************************************
+ * Internal Structures
+ *********************************************************************/
+
+typedef struct {
+	const char *name;
+	const char *ingredients[checkMaxLines];
+	const char *units[checkMaxLines];
+	UInt8 whole[checkMaxLines];
+	UInt8 numLines;
+	const char *steps;
+} OldRecipe;
+//A recipe as written to a layout 1 record
+
+/*********************************************************************
+ * Internal Variables
+ *********************************************************************/
+
+static const OldRecipe gRecipes[] = {
+	{ "Scrambled Eggs", { "Butter", "Eggs" }, { "tbsp", "" }, { 2, 4 }, 2,
+		"Heat pan, melt butter, add eggs." },
+	{ "Cookies", { "butter", "Sugar", "Eggs" }, { "Tbsp", "cup", "" }, { 1, 1, 1 }, 3,
+		"Cream butter and sugar." },
+	{ "Toast", { "Bread", "BUTTER" }, { "slice", "TBSP" }, { 2, 1 }, 2,
+		"Toast and butter." }
+};
+
+#define checkRecipes	(sizeof(gRecipes) / sizeof(gRecipes[0]))
+
+/*********************************************************************
+ * Internal Functions
+ *********************************************************************/
+
+/***********************************************************************
+ *
+ * FUNCTION:     NameID
+ *
+ * DESCRIPTION:  Unique ID of a name in an old ingredient or unit
+ *				 database, adding a record for it (plain name, no use
+ *				 count or sort key) if there is none with exactly that
+ *				 spelling
+ *
+ * PARAMETERS:   open database, name
+ *
+ * RETURNED:     unique ID, 0 on error
+ *
+ ***********************************************************************/
+static UInt32 NameID(DmOpenRef dbase, const char *name)
+{
+	MemHandle recH;
+	UInt32 id = 0;
+	UInt16 index;
+	int same;
+
+	for (index = 0; index < DmNumRecords(dbase); index++) {
+		recH = DmQueryRecord(dbase, index);
+		same = strcmp(MemHandleLock(recH), name) == 0;
+		MemHandleUnlock(recH);
+		if (same) {
+			DmRecordInfo(dbase, index, NULL, &id, NULL);
+			return id;
+		}
+	}
+
+	index = dmMaxRecordIndex;
+	recH = DmNewRecord(dbase, &index, strlen(name) + 1);
+	if (!recH)
+		return 0;
+	DmStrCopy(MemHandleLock(recH), 0, name);
+	MemHandleUnlock(recH);
+	DmReleaseRecord(dbase, index, true);
+	DmRecordInfo(dbase, index, NULL, &id, NULL);
+	return id;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     PutID
+ *
+ * DESCRIPTION:  Stores an ID as 4 big-endian bytes, as in layout 1
+ *
+ * PARAMETERS:   destination, ID
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void PutID(UInt8 *p, UInt32 id)
+{
+	p[0] = (UInt8)(id >> 24);
+	p[1] = (UInt8)(id >> 16);
+	p[2] = (UInt8)(id >> 8);
+	p[3] = (UInt8)id;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     WriteOld
+ *
+ * DESCRIPTION:  Writes gRecipes as a version 0 recipe, ingredient and
+ *				 unit database, as build_pdb.py --layout 1 would
+ *
+ * PARAMETERS:   nothing
+ *
+ * RETURNED:     error code
+ *
+ ***********************************************************************/
+static Err WriteOld(void)
+{
+	static const Char *const names[3] = {
+		databaseRecipeName, databaseIngredientName, databaseUnitName
+	};
+	DmOpenRef dbs[3];
+	UInt8 rec[checkNameSize + 2 + checkMaxLines * 11 + 64];
+	MemHandle recH;
+	UInt32 size;
+	UInt16 index;
+	UInt8 n;
+	UInt8 j;
+	int d;
+	int r;
+
+	for (d = 0; d < 3; d++) {
+		if (DmCreateDatabase(0, names[d], appFileCreator, 'Data', false) != errNone)
+			return DmGetLastErr();
+		dbs[d] = DmOpenDatabase(0, DmFindDatabase(0, names[d]), dmModeReadWrite);
+		if (!dbs[d])
+			return DmGetLastErr();
+	}
+
+	for (r = 0; r < (int)checkRecipes; r++) {
+		n = gRecipes[r].numLines;
+		memset(rec, 0, sizeof(rec));
+		strncpy((char *)rec, gRecipes[r].name, checkNameSize - 1);
+		rec[checkNameSize] = n;
+		size = checkNameSize + 2;
+		for (j = 0; j < n; j++)
+			rec[size + j] = gRecipes[r].whole[j];
+		size += 3 * n; // no fractions
+		for (j = 0; j < n; j++, size += 4)
+			PutID(rec + size, NameID(dbs[1], gRecipes[r].ingredients[j]));
+		for (j = 0; j < n; j++, size += 4)
+			PutID(rec + size, NameID(dbs[2], gRecipes[r].units[j]));
+		strcpy((char *)rec + size, gRecipes[r].steps);
+		size += strlen(gRecipes[r].steps) + 1;
+
+		index = dmMaxRecordIndex;
+		recH = DmNewRecord(dbs[0], &index, size);
+		if (!recH)
+			return dmErrMemError;
+		DmWrite(MemHandleLock(recH), 0, rec, size);
+		MemHandleUnlock(recH);
+		DmReleaseRecord(dbs[0], index, true);
+	}
+
+	for (d = 0; d < 3; d++)
+		DmCloseDatabase(dbs[d]);
+	return HostDmFlushAll();
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     CheckItems
+ *
+ * DESCRIPTION:  Checks the live record count and use counts of
+ *				 gIngredientDB or gUnitDB, printing each mismatch
+ *
+ * PARAMETERS:   database, expected number of live records, label
+ *
+ * RETURNED:     number of mismatches
+ *
+ ***********************************************************************/
+static UInt16 CheckItems(DmOpenRef dbase, UInt16 expected, const char *label)
+{
+	MemHandle recH;
+	UInt32 id;
+	UInt16 stored, counted;
+	UInt16 live = 0;
+	UInt16 bad = 0;
+	UInt16 i;
+
+	for (i = 0; i < DmNumRecords(dbase); i++) {
+		recH = DmQueryRecord(dbase, i);
+		if (!recH)
+			continue;
+		live++;
+		id = IDFromIndex(dbase, i);
+		stored = UseCount(dbase, id);
+		counted = HostTestCountUses(dbase == gUnitDB, id);
+		if (stored != counted) {
+			printf("%-14s %s %lu stored %u uses, used by %u\n", label,
+				dbase == gUnitDB ? "unit" : "ingredient", (unsigned long)id, stored, counted);
+			bad++;
+		}
+	}
+	if (live != expected) {
+		printf("%-14s %u %s records, expected %u\n", label, live,
+			dbase == gUnitDB ? "unit" : "ingredient", expected);
+		bad++;
+	}
+	return bad;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     CheckRecipes
+ *
+ * DESCRIPTION:  Checks that every line of every recipe names the
+ *				 ingredient and unit it was written with, apart from case
+ *
+ * PARAMETERS:   label for messages
+ *
+ * RETURNED:     number of mismatches
+ *
+ ***********************************************************************/
+static UInt16 CheckRecipes(const char *label)
+{
+	Char ingredient[32];
+	Char unit[16];
+	MemHandle recH;
+	RecipeView recipe;
+	UInt32 ingredientIds[checkMaxLines];
+	UInt32 unitIds[checkMaxLines];
+	UInt16 bad = 0;
+	UInt16 i;
+	UInt8 n;
+	UInt8 j;
+	int r;
+
+	for (i = 0; i < DmNumRecords(gRecipeDB); i++) {
+		recH = DmQueryRecord(gRecipeDB, i);
+		if (!recH)
+			continue;
+		RecipeViewInit(&recipe, MemHandleLock(recH));
+		for (r = 0; r < (int)checkRecipes && strcmp(recipe.name, gRecipes[r].name) != 0; r++)
+			;
+		n = recipe.numIngredients;
+		for (j = 0; j < n && j < checkMaxLines; j++) {
+			ingredientIds[j] = RecipeViewIngredientID(&recipe, j);
+			unitIds[j] = RecipeViewUnitID(&recipe, j);
+		}
+		MemHandleUnlock(recH);
+
+		if (r == (int)checkRecipes || n != gRecipes[r].numLines) {
+			printf("%-14s recipe %u not as written\n", label, i);
+			bad++;
+			continue;
+		}
+		for (j = 0; j < n; j++) {
+			ingredient[0] = unit[0] = '\0';
+			IngredientNameByID(ingredient, sizeof(ingredient), ingredientIds[j]);
+			UnitNameByID(unit, sizeof(unit), unitIds[j]);
+			if (strcasecmp(ingredient, gRecipes[r].ingredients[j]) != 0 ||
+					strcasecmp(unit, gRecipes[r].units[j]) != 0) {
+				printf("%-14s %s line %u: \"%s\" \"%s\", written \"%s\" \"%s\"\n", label,
+					gRecipes[r].name, j, ingredient, unit,
+					gRecipes[r].ingredients[j], gRecipes[r].units[j]);
+				bad++;
+			}
+		}
+	}
+	return bad;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     CheckOpen
+ *
+ * DESCRIPTION:  Opens the databases, first requiring only the given
+ *				 sets, then runs every check with all sets open
+ *
+ * PARAMETERS:   dbSet flags to require first, label for messages
+ *
+ * RETURNED:     number of mismatches
+ *
+ ***********************************************************************/
+static UInt16 CheckOpen(UInt16 sets, const char *label)
+{
+	UInt16 bad;
+	Err err;
+
+	err = DatabaseOpen();
+	if (err == errNone && sets)
+		err = DatabaseRequire(sets);
+	if (err == errNone)
+		err = DatabaseRequire(dbSetAll);
+	if (err != errNone) {
+		printf("%-14s DatabaseOpen failed: 0x%04x\n", label, err);
+		return 1;
+	}
+
+	bad = CheckItems(gIngredientDB, checkIngredients, label);
+	bad += CheckItems(gUnitDB, checkUnits, label);
+	bad += CheckRecipes(label);
+	printf("%-14s %u wrong\n", label, bad);
+	return bad;
+}
+
+/*********************************************************************
+ * Main
+ *********************************************************************/
+
+int main(int argc, char **argv)
+{
+	static const struct {
+		UInt16 sets;
+		const char *label;
+	} firsts[] = {
+		{ 0, "open" },
+		{ dbSetItems, "open+items" },
+		{ dbSetAll, "open+all" }
+	};
+	char dir[32];
+	char label[32];
+	UInt16 bad = 0;
+	int f;
+
+	// a directory of its own for each, so no index or catalog is left over
+	for (f = 0; f < (int)(sizeof(firsts) / sizeof(firsts[0])); f++) {
+		strcpy(dir, "/tmp/qmmigrateXXXXXX");
+		if (!mkdtemp(dir)) {
+			perror("mkdtemp");
+			return 2;
+		}
+		HostDmReset();
+		HostDmSetDirectory(dir);
+		if (WriteOld() != errNone) {
+			fprintf(stderr, "writing the old databases failed\n");
+			return 2;
+		}
+
+		bad += CheckOpen(firsts[f].sets, firsts[f].label);
+		DatabaseClose();
+		snprintf(label, sizeof(label), "%s again", firsts[f].label);
+		bad += CheckOpen(0, label);
+		DatabaseClose();
+		printf("%-14s databases in %s\n", firsts[f].label, dir);
+	}
+
+	HostDmReset();
+	return bad ? 1 : 0;
+}
@@ -0,0 +1,194 @@
+/*
+ * OpenBench.c
+ *
+ * Times opening the databases of a synthetic recipe set, with and
+ * without the index cache that DatabaseClose leaves in the AppInfo blocks
+ * (see CacheSave): once as far as the recipe list needs (DatabaseOpen)
+ * and once with every set (DatabaseRequire(dbSetAll)). For the cold runs
+ * the modification number of each cached database is bumped first, the
+ * way a HotSync would, so the cache is rejected and the ID maps and ref
+ * tables are rebuilt from the records.
+ *
+ * Usage: OpenBench [recipes] [distinct ingredients]
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "HostPalm.h"
+#include "HostTest.h"
+#include "Quartermaster.h"
+
+/*********************************************************************
+ * Internal Constants
+ *********************************************************************/
+
+#define benchDefaultRecipes		2000
+#define benchDefaultIngredients	300
+#define benchUnits				12
+#define benchMinPerRecipe		2
+#define benchOpens				20		// opens timed per case
+
+/*********************************************************************
+ * Internal Functions
+ *********************************************************************/
+
+/***********************************************************************
+ *
+ * FUNCTION:     Rebuilds
+ *
+ * DESCRIPTION:  ID map rebuilds of the three cached databases since the
+ *				 last call. A map only rebuilds while its database is
+ *				 open, so reading the open ones after each open is enough
+ *
+ * PARAMETERS:   nothing
+ *
+ * RETURNED:     number of rebuilds
+ *
+ ***********************************************************************/
+static UInt32 Rebuilds(void)
+{
+	static UInt32 seen[3];
+	DmOpenRef dbs[3];
+	IDMapStats stats;
+	UInt32 total = 0;
+	int i;
+
+	dbs[0] = gRecipeDB;
+	dbs[1] = gIngredientDB;
+	dbs[2] = gUnitDB;
+	for (i = 0; i < 3; i++) {
+		if (IDMapGetStats(dbs[i], &stats) != errNone)
+			continue;
+		total += stats.rebuilds - seen[i];
+		seen[i] = stats.rebuilds;
+	}
+	return total;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     Populate
+ *
+ * DESCRIPTION:  Imports the synthetic recipes into empty databases in
+ *				 the current host directory and closes them
+ *
+ * PARAMETERS:   number of recipes, number of distinct ingredients
+ *
+ * RETURNED:     error code
+ *
+ ***********************************************************************/
+static Err Populate(int numRecipes, int numIngredients)
+{
+	HostTestRecipeShape shape = { "Recipe", benchMinPerRecipe, hostTestMaxLines,
+		numIngredients, benchUnits, "Mix and serve.", true };
+	int i;
+	Err err;
+
+	err = DatabaseOpen();
+	if (err == errNone)
+		err = ImportBegin();
+
+	srand(1);
+	for (i = 0; i < numRecipes && err == errNone; i++)
+		err = HostTestRandomRecipe(&shape);
+
+	if (ImportEnd() != errNone && err == errNone)
+		err = dmErrMemError;
+	Rebuilds();		// not counted against the first open
+	DatabaseClose();
+	return err;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     TimeOpens
+ *
+ * DESCRIPTION:  Times DatabaseOpen and DatabaseRequire, closing the
+ *				 databases after each open (the close is not timed)
+ *
+ * PARAMETERS:   true to invalidate the cache before each open, dbSet
+ *				 flags of the sets to open, receives the ID map rebuilds
+ *				 per open
+ *
+ * RETURNED:     seconds per open, or -1 on error
+ *
+ ***********************************************************************/
+static double TimeOpens(Boolean cold, UInt16 sets, UInt32 *rebuildsP)
+{
+	double elapsed = 0;
+	double start;
+	int i;
+
+	*rebuildsP = 0;
+	for (i = 0; i < benchOpens; i++) {
+		if (cold) {
+			HostTestInvalidate(databaseRecipeName);
+			HostTestInvalidate(databaseIngredientName);
+			HostTestInvalidate(databaseUnitName);
+		}
+		start = HostTestSeconds();
+		if (DatabaseOpen() != errNone || DatabaseRequire(sets) != errNone)
+			return -1;
+		elapsed += HostTestSeconds() - start;
+		*rebuildsP += Rebuilds();
+		DatabaseClose();
+	}
+	*rebuildsP /= benchOpens;
+	return elapsed / benchOpens;
+}
+
+/*********************************************************************
+ * Main
+ *********************************************************************/
+
+int main(int argc, char **argv)
+{
+	int numRecipes = argc > 1 ? atoi(argv[1]) : benchDefaultRecipes;
+	int numIngredients = argc > 2 ? atoi(argv[2]) : benchDefaultIngredients;
+	char dir[] = "/tmp/qmbenchXXXXXX";
+	static const UInt16 sets[2] = { dbSetRecipes, dbSetAll };
+	static const char *const labels[2] = { "recipe list", "all sets" };
+	UInt32 rebuilds[2][2];
+	double times[2][2];
+	int cold, i;
+	Err err;
+
+	if (numRecipes < 1 || numIngredients < 1)
+		return 1;
+	if (!mkdtemp(dir)) {
+		perror("mkdtemp");
+		return 1;
+	}
+
+	HostDmSetDirectory(dir);
+	err = Populate(numRecipes, numIngredients);
+	if (err != errNone) {
+		fprintf(stderr, "import failed: 0x%04x\n", err);
+		return 1;
+	}
+
+	// every case starts from databases already loaded from disk
+	for (cold = 0; cold < 2; cold++) {
+		for (i = 0; i < 2; i++) {
+			times[cold][i] = TimeOpens(cold, sets[i], &rebuilds[cold][i]);
+			if (times[cold][i] < 0) {
+				fprintf(stderr, "opening the databases failed\n");
+				return 1;
+			}
+		}
+	}
+	HostDmReset();
+
+	printf("%d recipes in %s\n", numRecipes, dir);
+	for (cold = 0; cold < 2; cold++) {
+		for (i = 0; i < 2; i++) {
+			printf("%-10s %-12s %8.3f ms per open  (%lu map rebuilds)\n",
+				cold ? "rebuilt" : "cached", labels[i], times[cold][i] * 1e3,
+				(unsigned long)rebuilds[cold][i]);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,276 @@
+/*
+ * PalmOS.h
+ *
+ * Host stand-in for the PalmOS SDK header. Declares just enough of the
+ * Data, Memory and String Managers (plus the opaque UI types used in
+ * Quartermaster.h prototypes) to build Database.c on a desktop machine.
+ *
+ * Databases are backed by .pdb files in the layout written by
+ * build_pdb.py, see HostPalm.h for the host-only controls.
+ *
+ */
+
+#ifndef PALMOS_H_
+#define PALMOS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdarg.h>
+
+/*********************************************************************
+ * Basic types
+ *********************************************************************/
+
+typedef uint8_t		UInt8;
+typedef uint16_t	UInt16;
+typedef uint32_t	UInt32;
+typedef int8_t		Int8;
+typedef int16_t		Int16;
+typedef int32_t		Int32;
+typedef char		Char;
+typedef UInt16		WChar;
+typedef UInt8		Boolean;
+typedef UInt16		Err;
+typedef Int16		Coord;
+typedef UInt32		LocalID;
+
+typedef void*		MemPtr;
+typedef struct HostChunkTag*	MemHandle;
+typedef struct HostOpenDBTag*	DmOpenRef;
+
+#ifndef true
+#define true		1
+#define false		0
+#endif
+
+#ifndef NULL
+#define NULL		0
+#endif
+
+#define OffsetOf(type, member)	((UInt32) offsetof(type, member))
+
+/*********************************************************************
+ * Error codes
+ *********************************************************************/
+
+#define errNone						0x0000
+#define memErrorClass				0x0100
+#define dmErrorClass				0x0200
+#define appErrorClass				0x8000
+
+#define memErrChunkLocked			(memErrorClass | 1)
+#define memErrNotEnoughSpace		(memErrorClass | 2)
+#define memErrInvalidParam			(memErrorClass | 3)
+#define memErrChunkNotLocked		(memErrorClass | 4)
+
+#define dmErrMemError				(dmErrorClass | 1)
+#define dmErrIndexOutOfRange		(dmErrorClass | 2)
+#define dmErrInvalidParam			(dmErrorClass | 3)
+#define dmErrReadOnly				(dmErrorClass | 4)
+#define dmErrDatabaseOpen			(dmErrorClass | 5)
+#define dmErrCantOpen				(dmErrorClass | 6)
+#define dmErrCantFind				(dmErrorClass | 7)
+#define dmErrCorruptDatabase		(dmErrorClass | 9)
+#define dmErrRecordDeleted			(dmErrorClass | 10)
+#define dmErrRecordArchived			(dmErrorClass | 11)
+#define dmErrRecordBusy				(dmErrorClass | 15)
+#define dmErrResourceNotFound		(dmErrorClass | 16)
+#define dmErrNoOpenDatabase			(dmErrorClass | 17)
+#define dmErrWriteOutOfBounds		(dmErrorClass | 20)
+#define dmErrUniqueIDNotFound		(dmErrorClass | 24)
+#define dmErrAlreadyExists			(dmErrorClass | 25)
+
+/*********************************************************************
+ * Data Manager constants and types
+ *********************************************************************/
+
+#define dmModeReadOnly				0x0001
+#define dmModeWrite					0x0002
+#define dmModeReadWrite				0x0003
+#define dmModeExclusive				0x0008
+
+#define dmRecAttrCategoryMask		0x0F
+#define dmRecAttrDelete				0x80
+#define dmRecAttrDirty				0x40
+#define dmRecAttrBusy				0x20
+#define dmRecAttrSecret				0x10
+
+#define dmHdrAttrBackup				0x0008
+
+#define dmMaxRecordIndex			0xFFFF
+#define dmDBNameLength				32
+
+typedef struct {
+	UInt8 attributes;
+	UInt8 uniqueID[3];
+} SortRecordInfoType;
+
+typedef SortRecordInfoType* SortRecordInfoPtr;
+
+typedef Int16 DmComparF(void *rec1, void *rec2, Int16 other,
+                        SortRecordInfoPtr rec1SortInfo,
+                        SortRecordInfoPtr rec2SortInfo,
+                        MemHandle appInfoH);
+
+/*********************************************************************
+ * Opaque UI types referenced by application prototypes
+ *********************************************************************/
+
+typedef struct {
+	Coord x;
+	Coord y;
+} PointType;
+
+typedef struct {
+	PointType topLeft;
+	PointType extent;
+} RectangleType;
+
+typedef RectangleType*			RectanglePtr;
+typedef struct EventTypeTag		EventType;
+typedef EventType*				EventPtr;
+typedef struct FormTypeTag		FormType;
+typedef FormType*				FormPtr;
+typedef struct ListTypeTag		ListType;
+
+/*********************************************************************
+ * Error Manager
+ *********************************************************************/
+
+void HostFatal(const Char *file, UInt32 line, const Char *msg);
+
+#define ErrFatalDisplay(msg)			HostFatal(__FILE__, __LINE__, msg)
+#define ErrFatalDisplayIf(cond, msg)	do { if (cond) HostFatal(__FILE__, __LINE__, msg); } while (0)
+#define ErrNonFatalDisplayIf(cond, msg)	((void)0)
+
+/*********************************************************************
+ * Memory Manager
+ *********************************************************************/
+
+MemHandle MemHandleNew(UInt32 size);
+Err MemHandleFree(MemHandle h);
+MemPtr MemHandleLock(MemHandle h);
+Err MemHandleUnlock(MemHandle h);
+UInt32 MemHandleSize(MemHandle h);
+Err MemHandleResize(MemHandle h, UInt32 newSize);
+UInt16 MemHandleLockCount(MemHandle h);
+LocalID MemHandleToLocalID(MemHandle h);
+MemPtr MemLocalIDToGlobal(LocalID local, UInt16 cardNo);
+
+MemPtr MemPtrNew(UInt32 size);
+Err MemPtrFree(MemPtr p);
+Err MemPtrUnlock(MemPtr p);
+UInt32 MemPtrSize(MemPtr p);
+Err MemPtrResize(MemPtr p, UInt32 newSize);
+MemHandle MemPtrRecoverHandle(MemPtr p);
+
+Err MemSet(void *dstP, Int32 numBytes, UInt8 value);
+Err MemMove(void *dstP, const void *sP, Int32 numBytes);
+Int16 MemCmp(const void *s1, const void *s2, Int32 numBytes);
+
+/*********************************************************************
+ * Data Manager
+ *********************************************************************/
+
+Err DmCreateDatabase(UInt16 cardNo, const Char *nameP, UInt32 creator,
+	UInt32 type, Boolean resDB);
+Err DmDeleteDatabase(UInt16 cardNo, LocalID dbID);
+LocalID DmFindDatabase(UInt16 cardNo, const Char *nameP);
+DmOpenRef DmOpenDatabase(UInt16 cardNo, LocalID dbID, UInt16 mode);
+Err DmCloseDatabase(DmOpenRef dbP);
+Err DmOpenDatabaseInfo(DmOpenRef dbP, LocalID *dbIDP, UInt16 *openCountP,
+	UInt16 *modeP, UInt16 *cardNoP, Boolean *resDBP);
+Err DmDatabaseInfo(UInt16 cardNo, LocalID dbID, Char *nameP,
+	UInt16 *attributesP, UInt16 *versionP, UInt32 *crDateP,
+	UInt32 *modDateP, UInt32 *bckUpDateP, UInt32 *modNumP,
+	LocalID *appInfoIDP, LocalID *sortInfoIDP, UInt32 *typeP,
+	UInt32 *creatorP);
+Err DmSetDatabaseInfo(UInt16 cardNo, LocalID dbID, const Char *nameP,
+	UInt16 *attributesP, UInt16 *versionP, UInt32 *crDateP,
+	UInt32 *modDateP, UInt32 *bckUpDateP, UInt32 *modNumP,
+	LocalID *appInfoIDP, LocalID *sortInfoIDP, UInt32 *typeP,
+	UInt32 *creatorP);
+Err DmGetLastErr(void);
+
+UInt16 DmNumRecords(DmOpenRef dbP);
+Err DmRecordInfo(DmOpenRef dbP, UInt16 index, UInt16 *attrP,
+	UInt32 *uniqueIDP, LocalID *chunkIDP);
+Err DmSetRecordInfo(DmOpenRef dbP, UInt16 index, UInt16 *attrP,
+	UInt32 *uniqueIDP);
+Err DmFindRecordByID(DmOpenRef dbP, UInt32 uniqueID, UInt16 *indexP);
+
+MemHandle DmNewRecord(DmOpenRef dbP, UInt16 *atP, UInt32 size);
+MemHandle DmNewHandle(DmOpenRef dbP, UInt32 size);
+MemHandle DmQueryRecord(DmOpenRef dbP, UInt16 index);
+MemHandle DmGetRecord(DmOpenRef dbP, UInt16 index);
+Err DmReleaseRecord(DmOpenRef dbP, UInt16 index, Boolean dirty);
+MemHandle DmResizeRecord(DmOpenRef dbP, UInt16 index, UInt32 newSize);
+Err DmRemoveRecord(DmOpenRef dbP, UInt16 index);
+Err DmDeleteRecord(DmOpenRef dbP, UInt16 index);
+Err DmArchiveRecord(DmOpenRef dbP, UInt16 index);
+Err DmDetachRecord(DmOpenRef dbP, UInt16 index, MemHandle *oldHP);
+Err DmAttachRecord(DmOpenRef dbP, UInt16 *atP, MemHandle newH,
+	MemHandle *oldHP);
+Err DmMoveRecord(DmOpenRef dbP, UInt16 from, UInt16 to);
+
+Err DmWrite(void *recordP, UInt32 offset, const void *srcP, UInt32 bytes);
+Err DmSet(void *recordP, UInt32 offset, UInt32 bytes, UInt8 value);
+Err DmStrCopy(void *recordP, UInt32 offset, const Char *srcP);
+
+UInt16 DmFindSortPosition(DmOpenRef dbP, void *newRecord,
+	SortRecordInfoPtr newRecordInfo, DmComparF *compar, Int16 other);
+Err DmQuickSort(DmOpenRef dbP, DmComparF *compar, Int16 other);
+Err DmInsertionSort(DmOpenRef dbP, DmComparF *compar, Int16 other);
+
+/*********************************************************************
+ * String Manager
+ *********************************************************************/
+
+UInt16 StrLen(const Char *src);
+Char* StrCopy(Char *dst, const Char *src);
+Char* StrNCopy(Char *dst, const Char *src, Int16 n);
+Char* StrCat(Char *dst, const Char *src);
+Char* StrNCat(Char *dst, const Char *src, Int16 n);
+Int16 StrCompare(const Char *s1, const Char *s2);
+Int16 StrNCompare(const Char *s1, const Char *s2, Int32 n);
+Int16 StrCaselessCompare(const Char *s1, const Char *s2);
+Int16 StrNCaselessCompare(const Char *s1, const Char *s2, Int32 n);
+Char* StrChr(const Char *str, WChar chr);
+Char* StrStr(const Char *str, const Char *token);
+Char* StrToLower(Char *dst, const Char *src);
+Int32 StrAToI(const Char *str);
+Char* StrIToA(Char *s, Int32 i);
+Int16 StrPrintF(Char *s, const Char *formatStr, ...);
+Int16 StrVPrintF(Char *s, const Char *formatStr, va_list arg);
+
+/*********************************************************************
+ * Preferences Manager
+ *********************************************************************/
+
+#define noPreferenceFound			(-1)
+
+Int16 PrefGetAppPreferences(UInt32 creator, UInt16 id, void *prefs,
+	UInt16 *prefsSize, Boolean saved);
+void PrefSetAppPreferences(UInt32 creator, UInt16 id, Int16 version,
+	const void *prefs, UInt16 prefsSize, Boolean saved);
+
+/*********************************************************************
+ * System Manager
+ *********************************************************************/
+
+typedef Int16 _comparF(void *, void *, Int32 other);
+typedef _comparF* CmpFuncPtr;
+
+void SysQSort(void *baseP, UInt16 numOfElements, Int16 width,
+	CmpFuncPtr comparF, Int32 other);
+void SysInsertionSort(void *baseP, UInt16 numOfElements, Int16 width,
+	CmpFuncPtr comparF, Int32 other);
+
+/*********************************************************************
+ * Time Manager
+ *********************************************************************/
+
+UInt32 TimGetTicks(void);
+UInt16 SysTicksPerSecond(void);
+
+#endif /* PALMOS_H_ */
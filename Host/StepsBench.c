@@ -0,0 +1,166 @@
+/*
+ * StepsBench.c
+ *
+ * Reports how much packing saves on the steps of the recipes in a
+ * database directory (such as build_pdb.py writes), and what reading
+ * them back costs: every recipe's steps are read with StepsRead a
+ * screenful at a time, packed as stored and again unpacked, the way
+ * DrawRecipe reads them. Databases are opened but never written back.
+ *
+ * Usage: StepsBench [directory]
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "HostPalm.h"
+#include "HostTest.h"
+#include "Quartermaster.h"
+
+/*********************************************************************
+ * Internal Constants
+ *********************************************************************/
+
+#define benchScreenChars	400		// about 11 lines of 36 characters on a 160x160 screen
+#define benchMinSeconds		0.5		// each timing runs at least this long
+
+/*********************************************************************
+ * Internal Functions
+ *********************************************************************/
+
+/***********************************************************************
+ *
+ * FUNCTION:     ReadAll
+ *
+ * DESCRIPTION:  Reads the steps of a set of views a screenful at a time
+ *
+ * PARAMETERS:   views, number of views
+ *
+ * RETURNED:     characters read
+ *
+ ***********************************************************************/
+static UInt32 ReadAll(const RecipeView *views, UInt16 numViews)
+{
+	Char buf[benchScreenChars];
+	StepsReader reader;
+	UInt32 total = 0;
+	UInt16 n;
+	UInt16 i;
+
+	for (i = 0; i < numViews; i++) {
+		StepsReaderInit(&reader, &views[i]);
+		while ((n = StepsRead(&reader, buf, sizeof(buf))) > 0)
+			total += n + (UInt8)buf[n - 1];	// keeps the reads from being optimized away
+	}
+	return total;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     TimeReads
+ *
+ * DESCRIPTION:  Times ReadAll over a set of views
+ *
+ * PARAMETERS:   views, number of views
+ *
+ * RETURNED:     seconds per ReadAll
+ *
+ ***********************************************************************/
+static double TimeReads(const RecipeView *views, UInt16 numViews)
+{
+	volatile UInt32 sink = 0;
+	double start = HostTestSeconds();
+	double elapsed;
+	UInt32 runs = 0;
+
+	do {
+		sink += ReadAll(views, numViews);
+		runs++;
+		elapsed = HostTestSeconds() - start;
+	} while (elapsed < benchMinSeconds);
+
+	return elapsed / runs;
+}
+
+/*********************************************************************
+ * Main
+ *********************************************************************/
+
+int main(int argc, char **argv)
+{
+	UInt16 numRecords;
+	RecipeView *packed;
+	RecipeView *unpacked;
+	Char **texts;
+	MemHandle recH;
+	UInt8 *recP;
+	UInt32 recStored;
+	UInt32 stored = 0;
+	UInt32 chars = 0;
+	UInt16 numPacked = 0;
+	UInt16 n = 0;
+	double packedTime, unpackedTime;
+	UInt16 i;
+	Err err;
+
+	if (argc > 1)
+		HostDmSetDirectory(argv[1]);
+
+	err = DatabaseOpen();
+	if (err != errNone) {
+		fprintf(stderr, "DatabaseOpen failed: 0x%04x\n", err);
+		return 2;
+	}
+
+	numRecords = DmNumRecords(gRecipeDB);
+	packed = calloc(numRecords + 1, sizeof(RecipeView));
+	unpacked = calloc(numRecords + 1, sizeof(RecipeView));
+	texts = calloc(numRecords + 1, sizeof(Char *));
+	if (!packed || !unpacked || !texts)
+		return 2;
+
+	// records stay locked for the rest of the run
+	for (i = 0; i < numRecords; i++) {
+		recH = DmQueryRecord(gRecipeDB, i);
+		if (!recH)
+			continue;
+		recP = MemHandleLock(recH);
+		RecipeViewInit(&packed[n], recP);
+		texts[n] = RecipeViewStepsText(&packed[n]);
+		if (!texts[n])
+			return 2;
+
+		// the same steps as a view over plain text (layout 0 is never packed)
+		unpacked[n] = packed[n];
+		unpacked[n].layout = 0;
+		unpacked[n].steps = texts[n];
+
+		// the steps run to the end of the record
+		recStored = MemHandleSize(recH) - ((UInt8 *)packed[n].steps - recP);
+		if (recStored <= StrLen(texts[n]))
+			numPacked++;
+		chars += StrLen(texts[n]) + 1;
+		stored += recStored;
+		n++;
+	}
+
+	if (n == 0 || chars == 0) {
+		fprintf(stderr, "no recipes\n");
+		return 1;
+	}
+
+	packedTime = TimeReads(packed, n);
+	unpackedTime = TimeReads(unpacked, n);
+
+	printf("recipes    %u (%u with packed steps)\n", n, numPacked);
+	printf("steps      %lu bytes as text, %lu stored (%.1f%%)\n", (unsigned long)chars,
+		(unsigned long)stored, 100.0 * stored / chars);
+	printf("packed     %.2f us per %u-character screen\n",
+		packedTime * 1e6 * benchScreenChars / chars, benchScreenChars);
+	printf("unpacked   %.2f us per %u-character screen\n",
+		unpackedTime * 1e6 * benchScreenChars / chars, benchScreenChars);
+
+	// exits without DatabaseClose/HostDmFlushAll so nothing is written back
+	return 0;
+}
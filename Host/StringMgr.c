@@ -0,0 +1,154 @@
+/*
+ * StringMgr.c
+ *
+ * Host stand-in for the PalmOS String Manager
+ *
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "PalmOS.h"
+
+/*********************************************************************
+ * Public functions
+ *********************************************************************/
+
+UInt16 StrLen(const Char *src)
+{
+	return (UInt16)strlen(src);
+}
+
+Char* StrCopy(Char *dst, const Char *src)
+{
+	return strcpy(dst, src);
+}
+
+Char* StrNCopy(Char *dst, const Char *src, Int16 n)
+{
+	// Like the device (and strncpy) this doesn't terminate a full copy
+	Int16 i;
+
+	for (i = 0; i < n && src[i]; i++)
+		dst[i] = src[i];
+	if (i < n)
+		dst[i] = '\0';
+	return dst;
+}
+
+Char* StrCat(Char *dst, const Char *src)
+{
+	return strcat(dst, src);
+}
+
+Char* StrNCat(Char *dst, const Char *src, Int16 n)
+{
+	// n is the maximum length of dst including the terminator
+	UInt16 len = StrLen(dst);
+
+	while (len + 1 < n && *src)
+		dst[len++] = *src++;
+	dst[len] = '\0';
+	return dst;
+}
+
+Int16 StrCompare(const Char *s1, const Char *s2)
+{
+	Int32 r = strcmp(s1, s2);
+	return (r > 0) - (r < 0);
+}
+
+Int16 StrNCompare(const Char *s1, const Char *s2, Int32 n)
+{
+	Int32 r = strncmp(s1, s2, n);
+	return (r > 0) - (r < 0);
+}
+
+Int16 StrCaselessCompare(const Char *s1, const Char *s2)
+{
+	return StrNCaselessCompare(s1, s2, 0x7FFFFFFF);
+}
+
+Int16 StrNCaselessCompare(const Char *s1, const Char *s2, Int32 n)
+{
+	Int32 i;
+	Int16 c1, c2;
+
+	for (i = 0; i < n; i++) {
+		c1 = tolower((UInt8)s1[i]);
+		c2 = tolower((UInt8)s2[i]);
+		if (c1 != c2)
+			return (c1 > c2) - (c1 < c2);
+		if (!c1)
+			break;
+	}
+	return 0;
+}
+
+Char* StrChr(const Char *str, WChar chr)
+{
+	return strchr(str, chr);
+}
+
+Char* StrStr(const Char *str, const Char *token)
+{
+	return strstr(str, token);
+}
+
+Char* StrToLower(Char *dst, const Char *src)
+{
+	Char *d = dst;
+
+	while (*src)
+		*d++ = (Char)tolower((UInt8)*src++);
+	*d = '\0';
+	return dst;
+}
+
+Int32 StrAToI(const Char *str)
+{
+	return (Int32)atol(str);
+}
+
+Char* StrIToA(Char *s, Int32 i)
+{
+	sprintf(s, "%ld", (long)i);
+	return s;
+}
+
+Int16 StrVPrintF(Char *s, const Char *formatStr, va_list arg)
+{
+	// PalmOS integers are 16 bits unless prefixed with 'l' (32 bits).
+	// Host varargs promote UInt16 to int, so %d/%u already work; %ld/%lu
+	// are rewritten to the host's 32-bit int conversions.
+	Char fmt[256];
+	UInt16 i = 0;
+
+	while (*formatStr && i < sizeof(fmt) - 1) {
+		if (formatStr[0] == '%') {
+			fmt[i++] = *formatStr++;
+			while (*formatStr && StrChr("-+ #0123456789.", *formatStr) &&
+					i < sizeof(fmt) - 1)
+				fmt[i++] = *formatStr++;
+			if (*formatStr == 'l')
+				formatStr++;
+		}
+		if (*formatStr && i < sizeof(fmt) - 1)
+			fmt[i++] = *formatStr++;
+	}
+	fmt[i] = '\0';
+	return (Int16)vsprintf(s, fmt, arg);
+}
+
+Int16 StrPrintF(Char *s, const Char *formatStr, ...)
+{
+	va_list arg;
+	Int16 n;
+
+	va_start(arg, formatStr);
+	n = StrVPrintF(s, formatStr, arg);
+	va_end(arg);
+	return n;
+}
@@ -0,0 +1,318 @@
+/*
+ * SystemMgr.c
+ *
+ * Host stand-ins for the Error, Preferences and Time Managers
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "PalmOS.h"
+#include "HostInternal.h"
+
+/*********************************************************************
+ * Internal Constants
+ *********************************************************************/
+
+// Matches the tick rate of most PalmOS 3.x devices
+#define hostTicksPerSecond	100
+
+#define hostMaxPrefPath		1100
+#define hostMaxPrefs		16
+
+/*********************************************************************
+ * Internal Structures
+ *********************************************************************/
+
+// One preference resource, kept once read or written
+typedef struct {
+	UInt32 creator;
+	UInt16 id;
+	Boolean saved;
+	Int16 version;
+	UInt16 size;
+	UInt8 *data;
+} HostPref;
+
+/*********************************************************************
+ * Internal Variables
+ *********************************************************************/
+
+static HostPref sPrefs[hostMaxPrefs];
+static UInt16 sNumPrefs = 0;
+
+/*********************************************************************
+ * Public functions
+ *********************************************************************/
+
+/***********************************************************************
+ *
+ * FUNCTION:     HostFatal
+ *
+ * DESCRIPTION:  ErrFatalDisplay equivalent - reports and aborts
+ *
+ * PARAMETERS:   source file, line, message
+ *
+ * RETURNED:     does not return
+ *
+ ***********************************************************************/
+void HostFatal(const Char *file, UInt32 line, const Char *msg)
+{
+	fprintf(stderr, "%s:%lu: fatal: %s\n", file, (unsigned long)line, msg);
+	abort();
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     SysInsertionSort
+ *
+ * DESCRIPTION:  Stable in-place insertion sort of fixed-width elements
+ *
+ * PARAMETERS:   array, element count, element width, comparison, other
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+void SysInsertionSort(void *baseP, UInt16 numOfElements, Int16 width,
+	CmpFuncPtr comparF, Int32 other)
+{
+	UInt8 *base = baseP;
+	UInt8 *tmp;
+	UInt16 i, j;
+
+	if (numOfElements < 2)
+		return;
+	tmp = malloc(width);
+	for (i = 1; i < numOfElements; i++) {
+		memcpy(tmp, base + i * width, width);
+		for (j = i; j > 0 && comparF(base + (j - 1) * width, tmp, other) > 0; j--)
+			memcpy(base + j * width, base + (j - 1) * width, width);
+		memcpy(base + j * width, tmp, width);
+	}
+	free(tmp);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     SysQSort
+ *
+ * DESCRIPTION:  Quicksort of fixed-width elements (not stable, like
+ *				 the device)
+ *
+ * PARAMETERS:   array, element count, element width, comparison, other
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+void SysQSort(void *baseP, UInt16 numOfElements, Int16 width,
+	CmpFuncPtr comparF, Int32 other)
+{
+	UInt8 *base = baseP;
+	UInt8 *tmp;
+	UInt16 i, last;
+
+	if (numOfElements < 8) {
+		SysInsertionSort(baseP, numOfElements, width, comparF, other);
+		return;
+	}
+
+	// middle element as pivot, Lomuto partition
+	tmp = malloc(width);
+	memcpy(tmp, base, width);
+	memcpy(base, base + (numOfElements / 2) * width, width);
+	memcpy(base + (numOfElements / 2) * width, tmp, width);
+	last = 0;
+	for (i = 1; i < numOfElements; i++) {
+		if (comparF(base + i * width, base, other) < 0) {
+			last++;
+			memcpy(tmp, base + last * width, width);
+			memcpy(base + last * width, base + i * width, width);
+			memcpy(base + i * width, tmp, width);
+		}
+	}
+	memcpy(tmp, base, width);
+	memcpy(base, base + last * width, width);
+	memcpy(base + last * width, tmp, width);
+	free(tmp);
+
+	SysQSort(base, last, width, comparF, other);
+	SysQSort(base + (last + 1) * width, numOfElements - last - 1, width, comparF, other);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     PrefPath
+ *
+ * DESCRIPTION:  Names the file holding one preference resource: the
+ *				 device keeps saved and unsaved preferences in two
+ *				 databases, the host keeps each in a file in the
+ *				 Data Manager directory
+ *
+ * PARAMETERS:   buffer (hostMaxPrefPath), creator, resource ID, saved
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void PrefPath(Char *path, UInt32 creator, UInt16 id, Boolean saved)
+{
+	snprintf(path, hostMaxPrefPath, "%s/%s-%c%c%c%c-%u.pref", HostDmDirectory(),
+		saved ? "Saved" : "Unsaved", (char)(creator >> 24), (char)(creator >> 16),
+		(char)(creator >> 8), (char)creator, id);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     PrefFind
+ *
+ * DESCRIPTION:  Finds a preference resource, reading it from its file
+ *				 the first time. The device reads them from a database
+ *				 already in memory, so they are only read from disk once
+ *
+ * PARAMETERS:   creator, resource ID, saved
+ *
+ * RETURNED:     the preference, or NULL if there is none
+ *
+ ***********************************************************************/
+static HostPref* PrefFind(UInt32 creator, UInt16 id, Boolean saved)
+{
+	Char path[hostMaxPrefPath];
+	UInt8 buf[0x10000];
+	HostPref *pref;
+	size_t len;
+	FILE *f;
+	UInt16 i;
+
+	for (i = 0; i < sNumPrefs; i++) {
+		pref = &sPrefs[i];
+		if (pref->creator == creator && pref->id == id && pref->saved == saved)
+			return pref;
+	}
+
+	PrefPath(path, creator, id, saved);
+	f = fopen(path, "rb");
+	if (!f)
+		return NULL;
+	len = fread(buf, 1, sizeof(buf), f);
+	fclose(f);
+	if (len < sizeof(Int16) || sNumPrefs == hostMaxPrefs)
+		return NULL;
+
+	pref = &sPrefs[sNumPrefs++];
+	pref->creator = creator;
+	pref->id = id;
+	pref->saved = saved;
+	memcpy(&pref->version, buf, sizeof(Int16));
+	pref->size = (UInt16)(len - sizeof(Int16));
+	pref->data = malloc(pref->size + 1);
+	memcpy(pref->data, buf + sizeof(Int16), pref->size);
+	return pref;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     HostPrefReset
+ *
+ * DESCRIPTION:  Forgets the preferences read so far, for a new directory
+ *
+ * PARAMETERS:   nothing
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+void HostPrefReset(void)
+{
+	UInt16 i;
+
+	for (i = 0; i < sNumPrefs; i++)
+		free(sPrefs[i].data);
+	sNumPrefs = 0;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     PrefGetAppPreferences
+ *
+ * DESCRIPTION:  Copies up to *prefsSize bytes of an app preference
+ *
+ * PARAMETERS:   creator, resource ID, buffer, in: buffer size, out: size
+ *				 stored, saved or unsaved preferences
+ *
+ * RETURNED:     version stored with it, or noPreferenceFound
+ *
+ ***********************************************************************/
+Int16 PrefGetAppPreferences(UInt32 creator, UInt16 id, void *prefs,
+	UInt16 *prefsSize, Boolean saved)
+{
+	HostPref *pref = PrefFind(creator, id, saved);
+
+	if (!pref)
+		return noPreferenceFound;
+	if (prefs)
+		memcpy(prefs, pref->data, pref->size < *prefsSize ? pref->size : *prefsSize);
+	*prefsSize = pref->size;
+	return pref->version;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     PrefSetAppPreferences
+ *
+ * DESCRIPTION:  Stores an app preference, replacing any earlier one, and
+ *				 writes it to its file
+ *
+ * PARAMETERS:   creator, resource ID, version, data, size, saved or
+ *				 unsaved preferences
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+void PrefSetAppPreferences(UInt32 creator, UInt16 id, Int16 version,
+	const void *prefs, UInt16 prefsSize, Boolean saved)
+{
+	Char path[hostMaxPrefPath];
+	HostPref *pref = PrefFind(creator, id, saved);
+	FILE *f;
+
+	if (!prefs)
+		prefsSize = 0;
+	if (!pref && sNumPrefs < hostMaxPrefs) {
+		pref = &sPrefs[sNumPrefs++];
+		pref->creator = creator;
+		pref->id = id;
+		pref->saved = saved;
+		pref->data = NULL;
+	}
+	if (pref) {
+		pref->version = version;
+		pref->size = prefsSize;
+		pref->data = realloc(pref->data, prefsSize + 1);
+		if (prefsSize)
+			memcpy(pref->data, prefs, prefsSize);
+	}
+
+	PrefPath(path, creator, id, saved);
+	f = fopen(path, "wb");
+	if (!f)
+		return;
+	fwrite(&version, sizeof(version), 1, f);
+	if (prefsSize)
+		fwrite(prefs, 1, prefsSize, f);
+	fclose(f);
+}
+
+UInt32 TimGetTicks(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (UInt32)(ts.tv_sec * hostTicksPerSecond +
+		ts.tv_nsec / (1000000000L / hostTicksPerSecond));
+}
+
+UInt16 SysTicksPerSecond(void)
+{
+	return hostTicksPerSecond;
+}
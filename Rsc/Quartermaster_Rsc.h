@@ -1,4 +1,15 @@
 /* pilrc generated file.  Do not edit!*/
+#define RecipeListPlanClear 1098
+#define RecipeListPlanShop 1097
+#define RecipeListPlanAdd 1096
+#define TextSearchCancel 1095
+#define TextSearchFind 1094
+#define fieldTextSearch 1093
+#define formTextSearch 1092
+#define RecipeListFindText 1091
+#define menuRecipeList 1090
+#define RankedSearch 1089
+#define IngredientRecipes 1088
 #define saveManualAddIngredient 1087
 #define cancelManualAddIngredient 1086
 #define fieldManualAddIngredient 1085
@@ -46,6 +46,14 @@ void displayError(Err code) {
 				StrCopy(buf, "No recipes match search criteria");
 				break;
 				
+			case errMealPlanFull:
+				StrCopy(buf, "Meal plan is full");
+				break;
+				
+			case errMealPlanEmpty:
+				StrCopy(buf, "Add recipes to the meal plan first");
+				break;
+				
 			case errAssertFailed:
 				StrCopy(buf, "Memory leak present");
 				break;
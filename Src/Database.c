@@ -2,15 +2,351 @@
 #include "Quartermaster.h"
 #include "Quartermaster_Rsc.h"
 
+/*********************************************************************
+ * Internal Constants
+ *********************************************************************/
+
+#define postingKindIngredient	0
+#define postingKindUnit			1
+#define postingKindTrigram		2	// kept in gTrigramDB, see TrigramCollect
+
+#define maskRecipesPerBlock		128
+#define maskWordNever			0xFFFF	// never set in the pantry mask, so never satisfied
+
+// Pantry/grocery databases below this version are sorted by ingredient name
+#define membershipDBVersion		1
+// ... and grocery databases below this one hold bare IDs, see GroceryMigrate
+#define groceryDBVersion		2
+#define groceryMaxDenom			0x7FFF	// largest denominator AmountAdd keeps
+
+// Ingredient/unit databases below this version have no use counts, see UseCountMigrate
+#define useCountDBVersion		1
+// ... and below this one no sort keys, see SortKeyMigrate
+#define sortKeyDBVersion		2
+// ... and below this one no refs, see RefMigrate
+#define itemRefDBVersion		3
+#define itemRefNone				0xFFFF
+#define refTableGrow			32		// refs added to a full RefTable at a time
+
+// AppInfo blocks of gRecipeDB, gIngredientDB and gUnitDB, see CacheSave
+#define cacheVersion			1
+#define cacheMaxSize			0xFF00UL	// stays under the 64K chunk limit
+
+// Recipe databases below this version have no sort key in RecipeHeader
+#define recipeKeyDBVersion		1
+#define recipeKeyOffset			32	// where RecipeHeader.key goes in an older record
+// ... and below this one may still hold layout 1 records, see RecipeRepack
+#define recipeLayoutDBVersion	2
+#define recipeLayoutV1			0	// RecipeHeader.layout of fixed arrays and 4-byte IDs
+#define recipeLayoutV2			2	// ... of varint lines, see RecipeBuild
+#define recipeRepackPerOpen		64	// layout 1 records DatabaseOpen converts each time
+#define recipeLineMaxSize		10	// longest layout 2 line: three varints and two bytes
+#define recipeStepsPacked		0x01	// RecipeHeader.layout flag: steps packed, see StepsPack
+
+// Packed steps bytes below stepsEscape are themselves
+#define stepsEscape				0x80	// the next byte is a literal with the high bit set
+#define stepsDictFirst			0x81	// this and above stand for stepsDict[byte - stepsDictFirst]
+#define stepsDictSize			127
+
+// QMMakeable records, each a MakeableHeader followed by its elements
+#define makeableRecCounts		0	// MakeableEntry of every recipe
+#define makeableRecStrict		1	// IDs of recipes with nothing missing
+#define makeableRecFuzzy		2	// IDs of recipes with anything in the pantry
+#define makeableNumRecs			3
+#define makeableDBVersion		1
+
+// QMTrigrams databases below this version are rebuilt on open
+#define trigramDBVersion		1
+
+// QMCatalog
+#define catalogDBVersion		1
+
+// Slots of gDatabases and DatabasePrefs.ids
+#define dbSlotRecipe			0
+#define dbSlotIngredient		1
+#define dbSlotUnit				2
+#define dbSlotPantry			3
+#define dbSlotGrocery			4
+#define dbSlotIndex				5
+#define dbSlotTrigram			6
+#define dbSlotMakeable			7
+#define dbSlotCatalog			8
+#define dbNumSlots				9
+
+#define TrigramFold(c)			(((c) >= 'A' && (c) <= 'Z') ? (c) + ('a' - 'A') : (c))
+
+// ID map slot counts (powers of two, 6 bytes per slot on device)
+#define idMapMinSlots			16
+#define idMapMaxSlots			8192
+
+// Name dictionary slots used while importing (power of two), see ImportBegin
+#define importDictSlots			1024
+#define importKeyMax			64		// longer names are looked up without the dictionary
+
+#define IDMapHash(id, slots)	((UInt16)((UInt32)((id) * 2654435761UL) >> 16) & ((slots) - 1))
+
 /*********************************************************************
  * Internal Structures
  *********************************************************************/
 
 typedef struct {
     Char name[32];
+    Char key[32];
     UInt8 numIngredients;
+    UInt8 layout;
 } RecipeHeader;
-//A minimal header for recipe records
+//A minimal header for recipe records, key is the name's sort key (see SortKeyMake)
+//layout (recipeLayoutV1 or recipeLayoutV2, plus recipeStepsPacked) was the 68k
+//pad byte, so records written before it existed read as layout 1. The header
+//is 66 bytes on every compiler
+
+typedef struct {
+    Char name[32];
+    Char key[32];
+    UInt32 recipeId;
+    UInt8 numIngredients;
+    UInt8 reserved[3];
+} CatalogHeader;
+//Header of a QMCatalog record, followed by numIngredients ingredient IDs in
+//line order. Record i holds the name, key and ingredients of record i of
+//gRecipeDB (or is a tombstone if that is), so what only needs those never
+//locks the full record. name and key lead as in RecipeHeader, so
+//CompareRecipeNames and FindSorted work on either. 72 bytes on every compiler
+
+typedef struct {
+	UInt32 ingredientId;
+	UInt32 unitId;
+	UInt8 count;
+	UInt8 frac;
+	UInt8 denom;
+	UInt8 reserved;
+} RecipeLine;
+//One ingredient line of a recipe being built, see RecipeBuild
+
+typedef struct {
+	UInt8 kind;
+	UInt8 reserved;
+	UInt16 numRecipes;
+	UInt32 itemId;
+} PostingHeader;
+//Header of a QMIndex or QMTrigrams record, followed by numRecipes recipe IDs in
+//ascending order. Records are sorted by kind, then by itemId
+
+//Ingredient and unit records are the null terminated name followed by a
+//UInt16 use count - the number of recipes that list the item - the null
+//terminated sort key of the name (see SortKeyMake) and the item's ref, the
+//small number layout 2 recipes store instead of its unique ID, as two
+//big-endian bytes. The count follows the name unaligned, so it is only read
+//with MemMove and written with DmWrite
+
+typedef struct {
+	UInt16 word;
+	UInt32 bits;
+} MaskWord;
+//One nonzero 32-bit word of a recipe's ingredient bitmask (bit = ingredient ordinal)
+
+typedef struct {
+	UInt16 starts[maskRecipesPerBlock + 1];
+	MaskWord words[1];
+} MaskBlock;
+//Masks for maskRecipesPerBlock recipes - recipe r owns words[starts[r]] up to
+//words[starts[r + 1]]. Split into blocks to stay under the 64K chunk limit
+
+typedef struct {
+	MemHandle ordinalsH;
+	MemHandle blocksH;
+	UInt16 numOrdinals;
+	UInt16 numRecipes;
+	Boolean valid;
+} MaskCache;
+//ordinalsH holds the ascending IDs of every ingredient used by a recipe
+//(an ingredient's ordinal is its position), blocksH one MaskBlock handle per
+//maskRecipesPerBlock recipes. Rebuilt lazily after recipes are added or removed
+
+typedef struct {
+	UInt32 id;
+	UInt16 index;
+} IDMapSlot;
+//Open addressing (linear probing) slot, id 0 marks an empty slot
+//(the Data Manager never hands out unique ID 0)
+
+typedef struct {
+	MemHandle slotsH;
+	UInt16 numSlots;
+	UInt16 count;
+	IDMapStats stats;
+} IDMap;
+//Unique ID -> record index map for gRecipeDB, gIngredientDB or gUnitDB. slotsH is
+//NULL if the database is too large for one chunk, lookups then use DmFindRecordByID
+
+typedef struct {
+	MemHandle idsH;
+	UInt16 count;
+	UInt16 firstFree;
+} RefTable;
+//Ref -> unique ID table of gIngredientDB or gUnitDB, count refs long with
+//0 marking a free ref (firstFree is the lowest). Rebuilt from the item
+//records on open and after DatabaseCompact, so deleted items keep their
+//ref until then
+
+typedef struct {
+	UInt16 version;
+	UInt16 dbVersion;
+	UInt32 modNum;
+	UInt16 numRecords;
+	UInt16 numDeleted;
+	UInt16 numSlots;
+	UInt16 mapCount;
+	UInt16 numRefs;
+	UInt16 firstFree;
+} CacheHeader;
+//Start of the AppInfo block DatabaseClose leaves in gRecipeDB, gIngredientDB
+//and gUnitDB: the database's version, modification number and record count
+//when it was saved, its LiveOrder.numDeleted, then numSlots IDMapSlots of its
+//ID map and numRefs entries of its ref table. version is cacheVersion from
+//DatabaseClose until DatabaseOpen restores the block and clears it
+
+typedef struct {
+	const Char *name;
+	UInt32 type;
+	DmOpenRef *refP;
+} DatabaseSlot;
+//One of the app's databases: its name, the type it is created with and the
+//global its open reference goes in
+
+typedef struct {
+	LocalID ids[dbNumSlots];
+} DatabasePrefs;
+//LocalIDs of the databases found by earlier launches, kept in the unsaved
+//preferences (appDatabasePrefID) as they only mean anything on this device
+
+typedef struct {
+	UInt16 numDeleted;
+	MemHandle orderH;
+} LiveOrder;
+//Tombstones (deleted records) in gRecipeDB, gIngredientDB or gUnitDB, and
+//the record index of every live record in order, built when first needed
+//while there are tombstones. See LiveRecordIndex
+
+typedef struct {
+	UInt32 hash;
+	UInt32 id;
+} ImportSlot;
+//Name -> unique ID dictionary slot, id 0 marks an empty slot. Names are
+//checked against the database record, so only the hash is kept
+
+typedef struct {
+	MemHandle slotsH;
+	UInt16 count;
+} ImportDict;
+
+typedef struct {
+	ImportDict ingredients;
+	ImportDict units;
+	UInt16 numImported;
+	Boolean active;
+} ImportState;
+//Kept between ImportBegin and ImportEnd
+
+typedef struct {
+	UInt16 count;
+	UInt16 reserved;
+} MakeableHeader;
+//Header of each QMMakeable record, followed by count elements in ascending
+//order of their leading recipe ID
+
+typedef struct {
+	UInt32 recipeId;
+	UInt8 numIngredients;
+	UInt8 numMissing;
+	UInt16 reserved;
+} MakeableEntry;
+//Distinct ingredients of a recipe, and how many of them are not in the pantry
+
+typedef struct {
+	UInt32 ingredientId;
+	UInt16 numAmounts;
+	UInt16 reserved;
+} GroceryHeader;
+//Header of a QMGrocList record, followed by numAmounts GroceryAmounts in
+//ascending unitId order. The records are in ingredient ID order like the
+//pantry's (a bare UInt32 ID), so both share the membership functions
+
+typedef struct {
+	UInt32 ingredientId;
+	GroceryAmount amount;
+} GroceryItem;
+//One recipe line while GroceryAddRecipes sums a meal plan
+
+/*********************************************************************
+ * Internal Variables
+ *********************************************************************/
+
+static MaskCache gMasks;
+
+static ImportState gImport;
+
+static LiveOrder gRecipeLive;
+static LiveOrder gIngredientLive;
+static LiveOrder gUnitLive;
+
+static IDMap gRecipeMap;
+static IDMap gIngredientMap;
+static IDMap gUnitMap;
+
+static RefTable gIngredientRefs;
+static RefTable gUnitRefs;
+
+// Common words and pieces of cooking text that packed steps refer to by
+// a single byte, see StepsPack. build_pdb.py holds the same list, and
+// stored recipes depend on it, so it must never change
+static const Char *const stepsDict[stepsDictSize] = {
+	" the ", " and ", " until ", " with ", " minutes", " into ", " of ",
+	" to ", " in ", " a ", " on ", " for ", " or ", " is ", " at ",
+	" from ", " over ", " each ", "then ", "about ", " before ", "ate",
+	" degrees", " hour", "heat", "oven", "bake", "boil", "simmer", "stir",
+	"Stir", "add ", "Add ", "mix", "pour", "Pour", "place", "Place",
+	"serve", "Serve", "salt", "pepper", "sugar", "butter", "flour",
+	"water", "milk", "egg", "cream", "sauce", "onion", "garlic", "cook",
+	"Cook", "remove", "Remove", "cover", "brown", "large", "small",
+	"medium", "bowl", "pan", "dish", "skillet", "pot", "mixture", "well",
+	"beat", "whisk", "combine", "Combine", "chop", "slice", "cut ", "Cut ",
+	"tender", "golden", "preheat", "Preheat", "season", "Season", "taste",
+	"together", "sprinkle", "spoon", "cheese", "chicken", "meat", "oil",
+	"juice", "lemon", "dough", "baking", "powder", "vanilla", "melt",
+	"stand", "let ", "Let ", "In a ", "Bring", "bring", "drain", "Drain",
+	"inch", "tea", "fry", "cup", "side", "top", "hot", "ing ", "ing",
+	"tion", "ed ", "er ", "es ", "ly ", "ent", "ound", "the", "and", "ll",
+	". ", ", ", ".\n"
+};
+
+// Name order projections of gPantryDB and gGroceryDB, see NameOrderIndex
+static MemHandle gPantryOrderH;
+static MemHandle gGroceryOrderH;
+
+static const DatabaseSlot gDatabases[dbNumSlots] = {
+	{ databaseRecipeName,     'Data', &gRecipeDB },
+	{ databaseIngredientName, 'Data', &gIngredientDB },
+	{ databaseUnitName,       'Data', &gUnitDB },
+	{ databasePantryName,     'Data', &gPantryDB },
+	{ databaseGroceryName,    'Data', &gGroceryDB },
+	{ databaseIndexName,      'Indx', &gIndexDB },
+	{ databaseTrigramName,    'Trgm', &gTrigramDB },
+	{ databaseMakeableName,   'Mkbl', &gMakeableDB },
+	{ databaseCatalogName,    'Ctlg', &gCatalogDB }
+};
+
+static DatabasePrefs gDatabasePrefs;
+static Boolean gDatabasePrefsDirty;
+
+// dbSet flags of the sets DatabaseRequire has opened
+static UInt16 gOpenSets;
+// Set when a migration leaves use counts to redo, see IndexSetOpen
+static Boolean gRecount;
+// Set while ItemSetOpen runs its migrations, which must not reopen the set
+static Boolean gItemsOpening;
+// Set when gRecipeDB may have changed since QMCatalog last matched it
+static Boolean gCatalogStale;
 
 /*********************************************************************
  * External Variables
@@ -21,106 +357,170 @@ DmOpenRef gIngredientDB;
 DmOpenRef gUnitDB;
 DmOpenRef gPantryDB;
 DmOpenRef gGroceryDB;
+DmOpenRef gIndexDB;
+DmOpenRef gMakeableDB;
+DmOpenRef gTrigramDB;
+DmOpenRef gCatalogDB;
 
 /*********************************************************************
  * Internal Functions
  *********************************************************************/
 
+static Err ListSetOpen();	// used by ItemMerge
+
 /***********************************************************************
  *
- * FUNCTION:     CompareRecipeNames
+ * FUNCTION:     SortKeyMake
  *
- * DESCRIPTION:  For DmFindSortPosition - compares recipe names 
- *               alphabetically
+ * DESCRIPTION:  Makes the sort key of a name - lower case (ASCII and
+ *				 Latin-1 letters), with leading and trailing white space
+ *				 dropped and runs of it inside the name turned into one
+ *				 space. Keys compare with SortKeyCompare, so names sort
+ *				 and match the same way on every OS version and locale
  *
- * PARAMETERS:   two recipe pointers
+ * PARAMETERS:   name, buffer for the key, size of buffer (the key is
+ *				 never longer than the name)
  *
- * RETURNED:     0 if strings match, positive number if rec1 sorts after
- *				 rec2 alphabetically, negative number if the reverse
+ * RETURNED:     length of the key
  *
  ***********************************************************************/
-static Int16 CompareRecipeNames(void *rec1, void *rec2, Int16 other,
-                        SortRecordInfoPtr rec1SortInfo,
-                        SortRecordInfoPtr rec2SortInfo,
-                        MemHandle appInfoH)
+static UInt16 SortKeyMake(const Char *name, Char *key, UInt16 size)
+{
+	UInt8 c;
+	UInt16 len = 0;
+	Boolean space = false;
+
+	for (; *name && len + 1 < size; name++) {
+		c = (UInt8)*name;
+		if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+			space = (len > 0);
+			continue;
+		}
+		if (space && len + 2 < size)
+			key[len++] = ' ';
+		space = false;
+		if ((c >= 'A' && c <= 'Z') || (c >= 0xC0 && c <= 0xDE && c != 0xD7))
+			c += 'a' - 'A';
+		key[len++] = (Char)c;
+	}
+	key[len] = '\0';
+	return len;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     SortKeyCompare
+ *
+ * DESCRIPTION:  Compares two sort keys byte by byte (no locale rules),
+ *				 or just their first len bytes
+ *
+ * PARAMETERS:   two sort keys, most bytes to compare (0xFFFF for all)
+ *
+ * RETURNED:     0 if keys match, positive number if key1 sorts after
+ *				 key2, negative number if the reverse
+ *
+ ***********************************************************************/
+static Int16 SortKeyCompare(const Char *key1, const Char *key2, UInt16 len)
+{
+	const UInt8 *p1 = (const UInt8 *)key1;
+	const UInt8 *p2 = (const UInt8 *)key2;
+
+	for (; len > 0; len--, p1++, p2++) {
+		if (*p1 != *p2)
+			return (*p1 < *p2) ? -1 : 1;
+		if (*p1 == 0)
+			break;
+	}
+	return 0;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     ItemKey
+ *
+ * DESCRIPTION:  Finds the sort key of an ingredient or unit record
+ *
+ * PARAMETERS:   record pointer
+ *
+ * RETURNED:     pointer to the key
+ *
+ ***********************************************************************/
+static Char* ItemKey(void *recP)
+{
+	return (Char *)recP + StrLen(recP) + 1 + sizeof(UInt16);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     ItemRef
+ *
+ * DESCRIPTION:  Finds the ref of an ingredient or unit record, stored
+ *				 after its sort key (see RefMigrate)
+ *
+ * PARAMETERS:   record pointer, size of record
+ *
+ * RETURNED:     ref, or itemRefNone if the record has none
+ *
+ ***********************************************************************/
+static UInt16 ItemRef(void *recP, UInt32 size)
 {
-   return StrCompare(((RecipeHeader *)rec1)->name, ((RecipeHeader *)rec2)->name);
+	Char *key = ItemKey(recP);
+	UInt8 *raw = (UInt8 *)key + StrLen(key) + 1;
+
+	if (raw + 2 > (UInt8 *)recP + size)
+		return itemRefNone;
+	return ((UInt16)raw[0] << 8) | raw[1];
 }
 
 /***********************************************************************
  *
- * FUNCTION:     DBStringCompare
+ * FUNCTION:     CompareRecipeNames
  *
- * DESCRIPTION:  For DmFindSortPosition - compares database entries as strings
+ * DESCRIPTION:  For DmFindSortPosition - compares recipes by the sort
+ *				 keys of their names (names differing only in case or
+ *				 spacing are then ordered by the names themselves)
  *
- * PARAMETERS:   two Char* pointers
+ * PARAMETERS:   two recipe or catalog record pointers
  *
- * RETURNED:     0 if strings match, positive number if rec1 sorts after
+ * RETURNED:     0 if names match, positive number if rec1 sorts after
  *				 rec2 alphabetically, negative number if the reverse
  *
  ***********************************************************************/
-static Int16 DBStringCompare(void *rec1, void *rec2, Int16 other,
+static Int16 CompareRecipeNames(void *rec1, void *rec2, Int16 other,
                         SortRecordInfoPtr rec1SortInfo,
                         SortRecordInfoPtr rec2SortInfo,
                         MemHandle appInfoH)
 {
-	return StrCompare((Char *)rec1, (Char *)rec2);
-    // Formerly used TxtCaselessCompare - removed for compatibility
-}
+	Int16 result = SortKeyCompare(((RecipeHeader *)rec1)->key, ((RecipeHeader *)rec2)->key, 0xFFFF);
 
+	if (result == 0)
+		result = SortKeyCompare(((RecipeHeader *)rec1)->name, ((RecipeHeader *)rec2)->name, 0xFFFF);
+	return result;
+}
 
 /***********************************************************************
  *
- * FUNCTION:     DBIngredientIDCompare
+ * FUNCTION:     CompareItemKeys
  *
- * DESCRIPTION:  For DmFindSortPosition - assumes rec1 and rec2 are IDs of database
- *				 entries which consist of strings
+ * DESCRIPTION:  For DmFindSortPosition - compares ingredient or unit
+ *				 records by sort key, so names differing only in case
+ *				 or spacing are the same item
  *
- * PARAMETERS:   two UInt32 pointers
+ * PARAMETERS:   two ingredient or unit record pointers
  *
- * RETURNED:     0 if parameters match, positive number if rec1 sorts after
+ * RETURNED:     0 if keys match, positive number if rec1 sorts after
  *				 rec2 alphabetically, negative number if the reverse
  *
  ***********************************************************************/
-static Int16 DBIngredientIDCompare(void *rec1, void *rec2, Int16 other,
+static Int16 CompareItemKeys(void *rec1, void *rec2, Int16 other,
                         SortRecordInfoPtr rec1SortInfo,
                         SortRecordInfoPtr rec2SortInfo,
                         MemHandle appInfoH)
 {
-    UInt32 id1, id2;
-    UInt16 index1, index2;
-    MemHandle recH1 = NULL, recH2 = NULL;
-    Char *str1 = NULL, *str2 = NULL;
-    Int16 result = 0;
-
-
-    if (!rec1 || !rec2)
-        return 0;
-
-    id1 = *(UInt32 *)rec1;
-    id2 = *(UInt32 *)rec2;
-
-    if (DmFindRecordByID(gIngredientDB, id1, &index1) != errNone)
-        return 0;
-    if (DmFindRecordByID(gIngredientDB, id2, &index2) != errNone)
-        return 0;
-
-    recH1 = DmQueryRecord(gIngredientDB, index1);
-    recH2 = DmQueryRecord(gIngredientDB, index2);
-    if (!recH1 || !recH2)
-        return 0;
-
-    str1 = (Char *)MemHandleLock(recH1);
-    str2 = (Char *)MemHandleLock(recH2);
-
-	result = StrCompare(str1, str2);
-
-    MemHandleUnlock(recH1);
-    MemHandleUnlock(recH2);
-
-    return result;
+	return SortKeyCompare(ItemKey(rec1), ItemKey(rec2), 0xFFFF);
 }
 
+
 /***********************************************************************
  *
  * FUNCTION:     DBIntCompare
@@ -133,7 +533,7 @@ static Int16 DBIngredientIDCompare(void *rec1, void *rec2, Int16 other,
  *				 rec2 alphabetically, negative number if the reverse
  *
  ***********************************************************************/
-/* static Int16 DBIntCompare(void *rec1, void *rec2, Int16 other,
+static Int16 DBIntCompare(void *rec1, void *rec2, Int16 other,
                         SortRecordInfoPtr rec1SortInfo,
                         SortRecordInfoPtr rec2SortInfo,
                         MemHandle appInfoH)
@@ -144,216 +544,4828 @@ static Int16 DBIngredientIDCompare(void *rec1, void *rec2, Int16 other,
         return 1;
     else
         return 0;
-} */
+}
 
 /***********************************************************************
  *
- * FUNCTION:     FindIfUsed
+ * FUNCTION:     ComparePostings
  *
- * DESCRIPTION:  Checks if an ingredient/unit is used in any recipes
- *				 (or if it can be removed)
+ * DESCRIPTION:  For DmFindSortPosition - orders index records by kind,
+ *				 then by item ID
  *
- * PARAMETERS:   bitflag (0 = ingredient id, 1 = unit id), item ID
- *				 (bitflag identifies what the item ID is a reference to)
+ * PARAMETERS:   two PostingHeader pointers
  *
- * RETURNED:     true if item appears in any recipe entry, false otherwise
+ * RETURNED:     0 if both refer to the same item, positive number if rec1
+ *				 sorts after rec2, negative number if the reverse
  *
  ***********************************************************************/
-static Boolean FindIfUsed(UInt8 dbase, UInt32 itemId) {
-	UInt16 dbaseSize = DmNumRecords(gRecipeDB);
-	MemHandle recH;
-	MemPtr *recP;
-	RecipeRecord recipe;
-	UInt16 i;
-	UInt16 j;
-	
-	for (i = 0; i < dbaseSize; i++) {
-		recH = DmQueryRecord(gRecipeDB, i);
-		if (!recH) continue;
-		recP = MemHandleLock(recH);
-		recipe = RecipeGetRecord(recP);
-		
-		if (dbase == 0) {
-			for (j = 0; j < recipeMaxIngredients && recipe.ingredientIDs[j] != 0; j++) {
-				if (recipe.ingredientIDs[j] == itemId) {
-					MemHandleUnlock(recH); 
-					return true;
-				}
-			}
-		}
-		else if (dbase == 1) {
-			for (j = 0; j < recipeMaxIngredients && recipe.ingredientUnits[j] != 0; j++) {
-				if (recipe.ingredientUnits[j] == itemId) {
-					MemHandleUnlock(recH); 
-					return true;
-				}
-			}
-		}
-		MemHandleUnlock(recH); 
-	}
-	
-	return false;
+static Int16 ComparePostings(void *rec1, void *rec2, Int16 other,
+                        SortRecordInfoPtr rec1SortInfo,
+                        SortRecordInfoPtr rec2SortInfo,
+                        MemHandle appInfoH)
+{
+	PostingHeader *p1 = rec1;
+	PostingHeader *p2 = rec2;
+
+	if (p1->kind != p2->kind)
+		return (p1->kind < p2->kind) ? -1 : 1;
+	if (p1->itemId < p2->itemId)
+		return -1;
+	else if (p1->itemId > p2->itemId)
+		return 1;
+	else
+		return 0;
 }
 
-/*********************************************************************
- * External Functions
- *********************************************************************/
- 
- /*********************************************************************
- * General DB Functions
- *********************************************************************/
+/***********************************************************************
+ *
+ * FUNCTION:     CompareKeys
+ *
+ * DESCRIPTION:  For SysQSort - compares two UInt32 sort keys
+ *
+ * PARAMETERS:   two UInt32 pointers
+ *
+ * RETURNED:     0 if keys match, positive number if key1 is larger,
+ *				 negative number if the reverse
+ *
+ ***********************************************************************/
+static Int16 CompareKeys(void *key1, void *key2, Int32 other)
+{
+	if (*(UInt32 *)key1 < *(UInt32 *)key2)
+		return -1;
+	else if (*(UInt32 *)key1 > *(UInt32 *)key2)
+		return 1;
+	else
+		return 0;
+}
 
 /***********************************************************************
  *
- * FUNCTION:     DatabaseOpen
+ * FUNCTION:     IDPosition
  *
- * DESCRIPTION:  Opens Pantry and Recipe databases
+ * DESCRIPTION:  Binary search over an ascending array of IDs
  *
- * PARAMETERS:   nothing
+ * PARAMETERS:   array, number of IDs, ID to find
  *
- * RETURNED:     errNone or dmErrCantOpen
+ * RETURNED:     position of the first ID >= id (numIds if none)
  *
  ***********************************************************************/
-Err DatabaseOpen() {
-    LocalID dbID;
-    
-    dbID = DmFindDatabase(0, databaseRecipeName);
-    if (!dbID) {
-        DmCreateDatabase(0, databaseRecipeName, databaseCreatorID, 'Data', false);
-        dbID = DmFindDatabase(0, databaseRecipeName);
-        if (!dbID) return dmErrCantOpen;
-    }
-    gRecipeDB = DmOpenDatabase(0, dbID, dmModeReadWrite);
-    if (!gRecipeDB) return DmGetLastErr();
-
-    dbID = DmFindDatabase(0, databaseIngredientName);
-    if (!dbID) {
-        DmCreateDatabase(0, databaseIngredientName, databaseCreatorID, 'Data', false);
-        dbID = DmFindDatabase(0, databaseIngredientName);
-        if (!dbID) return dmErrCantOpen;
-    }
-    gIngredientDB = DmOpenDatabase(0, dbID, dmModeReadWrite);
-    if (!gIngredientDB) return DmGetLastErr();
-    
-    dbID = DmFindDatabase(0, databaseUnitName);
-    if (!dbID) {
-        DmCreateDatabase(0, databaseUnitName, databaseCreatorID, 'Data', false);
-        dbID = DmFindDatabase(0, databaseUnitName);
-        if (!dbID) return dmErrCantOpen;
-    }
-    gUnitDB = DmOpenDatabase(0, dbID, dmModeReadWrite);
-    if (!gUnitDB) return DmGetLastErr();
-    
-    dbID = DmFindDatabase(0, databasePantryName);
-    if (!dbID) {
-        DmCreateDatabase(0, databasePantryName, databaseCreatorID, 'Data', false);
-        dbID = DmFindDatabase(0, databasePantryName);
-        if (!dbID) return dmErrCantOpen;
-    }
-    gPantryDB = DmOpenDatabase(0, dbID, dmModeReadWrite);
-    if (!gPantryDB) return DmGetLastErr();
-    
-    dbID = DmFindDatabase(0, databaseGroceryName);
-    if (!dbID) {
-        DmCreateDatabase(0, databaseGroceryName, databaseCreatorID, 'Data', false);
-        dbID = DmFindDatabase(0, databaseGroceryName);
-        if (!dbID) return dmErrCantOpen;
-    }
-    gGroceryDB = DmOpenDatabase(0, dbID, dmModeReadWrite);
-    if (!gGroceryDB) return DmGetLastErr();
+static UInt16 IDPosition(const UInt32 *ids, UInt16 numIds, UInt32 id)
+{
+	UInt16 lo = 0;
+	UInt16 hi = numIds;
+	UInt16 mid;
 
-    return errNone;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (ids[mid] < id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
 }
 
-
 /***********************************************************************
  *
- * FUNCTION:     DatabaseClose
+ * FUNCTION:     PostingDB
  *
- * DESCRIPTION:  Closes all databases
+ * DESCRIPTION:  Database holding the index records of a posting kind
  *
- * PARAMETERS:   nothing
+ * PARAMETERS:   kind
  *
- * RETURNED:     nothing
+ * RETURNED:     gTrigramDB for trigrams, gIndexDB otherwise
  *
  ***********************************************************************/
-void DatabaseClose() {
-    if (gRecipeDB)     DmCloseDatabase(gRecipeDB);
-    if (gIngredientDB) DmCloseDatabase(gIngredientDB);
-    if (gUnitDB)       DmCloseDatabase(gUnitDB);
-    if (gPantryDB)	   DmCloseDatabase(gPantryDB);
-    if (gGroceryDB)    DmCloseDatabase(gGroceryDB);
+static DmOpenRef PostingDB(UInt8 kind)
+{
+	return (kind == postingKindTrigram) ? gTrigramDB : gIndexDB;
 }
 
 /***********************************************************************
  *
- * FUNCTION:     IDFromIndex
+ * FUNCTION:     UseCountDB
  *
- * DESCRIPTION:  Utility function to convert between index and entry ID
+ * DESCRIPTION:  Database holding the items of a posting kind
  *
- * PARAMETERS:   database, index
+ * PARAMETERS:   kind (postingKindIngredient or postingKindUnit)
  *
- * RETURNED:     id (or 0 if index is invalid)
+ * RETURNED:     gIngredientDB or gUnitDB
  *
  ***********************************************************************/
-UInt32 IDFromIndex(DmOpenRef dbase, UInt16 index)
+static DmOpenRef UseCountDB(UInt8 kind)
 {
-    UInt32 id = 0;
-    Err err;
-    err = DmRecordInfo(dbase, index, NULL, &id, NULL);
-
-    if (err != errNone)
-        return 0;
-
-    return id;
+	return (kind == postingKindIngredient) ? gIngredientDB : gUnitDB;
 }
 
 /***********************************************************************
  *
- * FUNCTION:     IndexFromID
+ * FUNCTION:     UseCountRead
  *
- * DESCRIPTION:  Utility function to convert between index and entry ID
+ * DESCRIPTION:  Reads the use count stored after an ingredient or unit
+ *				 name
  *
- * PARAMETERS:   database, id
+ * PARAMETERS:   gIngredientDB or gUnitDB, record index
  *
- * RETURNED:     index (or 0xFFFF if index is invalid)
+ * RETURNED:     number of recipes using the item (0 if the record is
+ *				 deleted or has no count)
  *
  ***********************************************************************/
-UInt16 IndexFromID(DmOpenRef dbase, UInt32 id)
+static UInt16 UseCountRead(DmOpenRef dbase, UInt16 index)
 {
-    UInt16 index = 0xFFFF;
-    Err err;
-    err = DmFindRecordByID(dbase, id, &index);
-
-    if (err != errNone)
-        return 0xFFFF;
+	MemHandle recH = DmQueryRecord(dbase, index);
+	Char *recP;
+	UInt32 offset;
+	UInt16 count = 0;
 
-    return index;
+	if (!recH)
+		return 0;
+	recP = MemHandleLock(recH);
+	offset = StrLen(recP) + 1;
+	if (MemHandleSize(recH) >= offset + sizeof(UInt16))
+		MemMove(&count, recP + offset, sizeof(UInt16));
+	MemHandleUnlock(recH);
+	return count;
 }
 
 /***********************************************************************
  *
- * FUNCTION:     AddIdToDatabase
+ * FUNCTION:     UseCountWrite
  *
- * DESCRIPTION:  Checks if an identical entry already exists.
- *				 If not, creates new database entry consisting of id
+ * DESCRIPTION:  Stores the use count after an ingredient or unit name
  *
- * PARAMETERS:   database, id
+ * PARAMETERS:   gIngredientDB or gUnitDB, record index, count
  *
- * RETURNED:     errNone if either entry is found or entry creation succeeds
+ * RETURNED:     Err
  *
  ***********************************************************************/
-Err AddIdToDatabase(DmOpenRef dbase, UInt32 id)
+static Err UseCountWrite(DmOpenRef dbase, UInt16 index, UInt16 count)
 {
-    UInt16 index;
-    Err err;
-    MemHandle recH;
-    UInt32 *recP;
-
-    if (!dbase)
-        return dmErrInvalidParam;
-
-    index = DmFindSortPosition(dbase, &id, 0, (DmComparF *) DBIngredientIDCompare, 0);
+	MemHandle recH = DmQueryRecord(dbase, index);
+	Char *recP;
+	UInt32 offset;
+	Err err = errNone;
+
+	if (!recH)
+		return dmErrRecordDeleted;
+	recP = MemHandleLock(recH);
+	offset = StrLen(recP) + 1;
+	if (MemHandleSize(recH) >= offset + sizeof(UInt16))
+		DmWrite(recP, offset, &count, sizeof(UInt16));
+	else
+		err = dmErrCorruptDatabase; // not widened by UseCountMigrate
+	MemHandleUnlock(recH);
+	return err;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     UseCountAdjust
+ *
+ * DESCRIPTION:  Counts a recipe starting or stopping to use an
+ *				 ingredient or unit. Called by PostingAdd/PostingRemove,
+ *				 so the counts always match the index
+ *
+ * PARAMETERS:   kind, item ID, +1 or -1
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err UseCountAdjust(UInt8 kind, UInt32 itemId, Int16 delta)
+{
+	DmOpenRef dbase = UseCountDB(kind);
+	UInt16 index;
+	UInt16 count;
+
+	if (kind == postingKindTrigram)
+		return errNone;
+
+	index = IndexFromID(dbase, itemId);
+	if (index == 0xFFFF)
+		return dmErrUniqueIDNotFound;
+
+	count = UseCountRead(dbase, index);
+	if (delta < 0 && count == 0)
+		return errNone;
+	return UseCountWrite(dbase, index, count + delta);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     UseCountReset
+ *
+ * DESCRIPTION:  Zeroes every use count of a database, before IndexRebuild
+ *				 counts them again
+ *
+ * PARAMETERS:   gIngredientDB or gUnitDB
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void UseCountReset(DmOpenRef dbase)
+{
+	UInt16 numRecords = DmNumRecords(dbase);
+	UInt16 i;
+
+	for (i = 0; i < numRecords; i++) {
+		if (DmQueryRecord(dbase, i))
+			UseCountWrite(dbase, i, 0);
+	}
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     UseCountMigrate
+ *
+ * DESCRIPTION:  Widens the records of an ingredient or unit database
+ *				 written by an older version (name only) to hold a use
+ *				 count. The counts are filled in by IndexRebuild
+ *
+ * PARAMETERS:   database, pointer set to true if the database was
+ *				 migrated (left alone otherwise)
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err UseCountMigrate(DmOpenRef dbase, Boolean *migrated)
+{
+	LocalID dbID;
+	MemHandle recH;
+	UInt32 size;
+	UInt16 numRecords = DmNumRecords(dbase);
+	UInt16 cardNo;
+	UInt16 version;
+	UInt16 i;
+	Err err;
+
+	err = DmOpenDatabaseInfo(dbase, &dbID, NULL, NULL, &cardNo, NULL);
+	if (err == errNone)
+		err = DmDatabaseInfo(cardNo, dbID, NULL, NULL, &version, NULL, NULL,
+			NULL, NULL, NULL, NULL, NULL, NULL);
+	if (err != errNone || version >= useCountDBVersion)
+		return err;
+
+	for (i = 0; i < numRecords; i++) {
+		recH = DmQueryRecord(dbase, i);
+		if (!recH)
+			continue;
+		size = StrLen(MemHandleLock(recH)) + 1 + sizeof(UInt16);
+		MemHandleUnlock(recH);
+		if (MemHandleSize(recH) < size && !DmResizeRecord(dbase, i, size))
+			return dmErrMemError;
+	}
+	*migrated = true;
+
+	version = useCountDBVersion;
+	return DmSetDatabaseInfo(cardNo, dbID, NULL, NULL, &version, NULL, NULL,
+		NULL, NULL, NULL, NULL, NULL, NULL);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     PostingFind
+ *
+ * DESCRIPTION:  Looks up the index record for an ingredient, unit or
+ *				 trigram
+ *
+ * PARAMETERS:   kind (postingKindIngredient, postingKindUnit or
+ *				 postingKindTrigram), item ID,
+ *				 pointer to store the record index, or the position a new
+ *				 record should be inserted at if there is none
+ *
+ * RETURNED:     true if the item has an index record
+ *
+ ***********************************************************************/
+static Boolean PostingFind(UInt8 kind, UInt32 itemId, UInt16 *indexP)
+{
+	DmOpenRef dbase = PostingDB(kind);
+	PostingHeader key;
+	PostingHeader *recP;
+	MemHandle recH;
+	UInt16 index;
+	Boolean found = false;
+
+	MemSet(&key, sizeof(key), 0);
+	key.kind = kind;
+	key.itemId = itemId;
+	index = DmFindSortPosition(dbase, &key, 0, (DmComparF *) ComparePostings, 0);
+
+	if (index > 0) {
+		recH = DmQueryRecord(dbase, index - 1);
+		recP = MemHandleLock(recH);
+		found = (ComparePostings(recP, &key, 0, NULL, NULL, NULL) == 0);
+		MemHandleUnlock(recH);
+	}
+
+	*indexP = found ? index - 1 : index;
+	return found;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     PostingAdd
+ *
+ * DESCRIPTION:  Records that a recipe uses an ingredient or unit, or
+ *				 contains a trigram
+ *
+ * PARAMETERS:   kind, item ID, recipe ID
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err PostingAdd(UInt8 kind, UInt32 itemId, UInt32 recipeId)
+{
+	DmOpenRef dbase = PostingDB(kind);
+	PostingHeader header;
+	PostingHeader *recP;
+	MemHandle recH;
+	UInt32 *ids;
+	UInt16 index;
+	UInt16 numRecipes;
+	UInt16 pos;
+
+	if (!PostingFind(kind, itemId, &index)) {
+		MemSet(&header, sizeof(header), 0);
+		header.kind = kind;
+		header.numRecipes = 1;
+		header.itemId = itemId;
+
+		recH = DmNewRecord(dbase, &index, sizeof(PostingHeader) + sizeof(UInt32));
+		if (!recH) return dmErrMemError;
+		recP = MemHandleLock(recH);
+		DmWrite(recP, 0, &header, sizeof(PostingHeader));
+		DmWrite(recP, sizeof(PostingHeader), &recipeId, sizeof(UInt32));
+		MemHandleUnlock(recH);
+		DmReleaseRecord(dbase, index, true);
+		return UseCountAdjust(kind, itemId, 1);
+	}
+
+	recH = DmQueryRecord(dbase, index);
+	recP = MemHandleLock(recH);
+	numRecipes = recP->numRecipes;
+	pos = IDPosition((UInt32 *)(recP + 1), numRecipes, recipeId);
+	if (pos < numRecipes && ((UInt32 *)(recP + 1))[pos] == recipeId) {
+		MemHandleUnlock(recH);
+		return errNone; // recipe lists the item more than once
+	}
+	MemHandleUnlock(recH);
+
+	// unlocked first so the chunk is free to move while it grows
+	recH = DmResizeRecord(dbase, index, sizeof(PostingHeader) + (numRecipes + 1) * sizeof(UInt32));
+	if (!recH) return dmErrMemError;
+	recP = MemHandleLock(recH);
+	ids = (UInt32 *)(recP + 1);
+
+	if (pos < numRecipes)
+		DmWrite(recP, sizeof(PostingHeader) + (pos + 1) * sizeof(UInt32), &ids[pos],
+			(numRecipes - pos) * sizeof(UInt32));
+	DmWrite(recP, sizeof(PostingHeader) + pos * sizeof(UInt32), &recipeId, sizeof(UInt32));
+	numRecipes++;
+	DmWrite(recP, OffsetOf(PostingHeader, numRecipes), &numRecipes, sizeof(UInt16));
+	MemHandleUnlock(recH);
+
+	return UseCountAdjust(kind, itemId, 1);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     PostingRemove
+ *
+ * DESCRIPTION:  Records that a recipe no longer uses an ingredient or
+ *				 unit (or contains a trigram), removing the index record
+ *				 once no recipe does
+ *
+ * PARAMETERS:   kind, item ID, recipe ID
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err PostingRemove(UInt8 kind, UInt32 itemId, UInt32 recipeId)
+{
+	DmOpenRef dbase = PostingDB(kind);
+	PostingHeader *recP;
+	MemHandle recH;
+	UInt32 *ids;
+	UInt16 index;
+	UInt16 numRecipes;
+	UInt16 pos;
+
+	if (!PostingFind(kind, itemId, &index))
+		return errNone;
+
+	recH = DmQueryRecord(dbase, index);
+	recP = MemHandleLock(recH);
+	numRecipes = recP->numRecipes;
+	ids = (UInt32 *)(recP + 1);
+	pos = IDPosition(ids, numRecipes, recipeId);
+
+	if (pos >= numRecipes || ids[pos] != recipeId) {
+		MemHandleUnlock(recH);
+		return errNone;
+	}
+
+	UseCountAdjust(kind, itemId, -1);
+
+	if (numRecipes == 1) {
+		MemHandleUnlock(recH);
+		return DmRemoveRecord(dbase, index);
+	}
+
+	if (pos < numRecipes - 1)
+		DmWrite(recP, sizeof(PostingHeader) + pos * sizeof(UInt32), &ids[pos + 1],
+			(numRecipes - pos - 1) * sizeof(UInt32));
+	numRecipes--;
+	DmWrite(recP, OffsetOf(PostingHeader, numRecipes), &numRecipes, sizeof(UInt16));
+	MemHandleUnlock(recH);
+
+	if (!DmResizeRecord(dbase, index, sizeof(PostingHeader) + numRecipes * sizeof(UInt32)))
+		return dmErrMemError;
+
+	return errNone;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     IndexRecipe
+ *
+ * DESCRIPTION:  Adds every ingredient and unit of a recipe to the index
+ *
+ * PARAMETERS:   index of recipe in gRecipeDB
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err IndexRecipe(UInt16 recipeIndex)
+{
+	MemHandle recH;
+	RecipeView recipe;
+	UInt32 recipeId;
+	UInt16 i;
+	Err err = errNone;
+
+	recipeId = IDFromIndex(gRecipeDB, recipeIndex);
+	recH = DmQueryRecord(gRecipeDB, recipeIndex);
+	if (!recH) return dmErrIndexOutOfRange;
+	RecipeViewInit(&recipe, MemHandleLock(recH));
+
+	for (i = 0; i < recipe.numIngredients && err == errNone; i++) {
+		err = PostingAdd(postingKindIngredient, RecipeViewIngredientID(&recipe, i), recipeId);
+		if (err == errNone)
+			err = PostingAdd(postingKindUnit, RecipeViewUnitID(&recipe, i), recipeId);
+	}
+
+	MemHandleUnlock(recH);
+	return err;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     IndexRebuild
+ *
+ * DESCRIPTION:  Rebuilds the index database from the recipe database
+ *
+ * PARAMETERS:   nothing
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err IndexRebuild()
+{
+	UInt16 numRecipes = DmNumRecords(gRecipeDB);
+	UInt16 i;
+	Err err = errNone;
+
+	for (i = DmNumRecords(gIndexDB); i > 0; i--)
+		DmRemoveRecord(gIndexDB, i - 1);
+	UseCountReset(gIngredientDB);
+	UseCountReset(gUnitDB);
+
+	for (i = 0; i < numRecipes && err == errNone; i++) {
+		if (DmQueryRecord(gRecipeDB, i))
+			err = IndexRecipe(i);
+	}
+
+	return err;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     TrigramAppend
+ *
+ * DESCRIPTION:  Appends every trigram of a string to a list. A trigram
+ *				 is three consecutive characters, case folded and packed
+ *				 into the low 24 bits
+ *
+ * PARAMETERS:   string, list (room for StrLen(text) more entries),
+ *				 pointer to number of entries in list
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void TrigramAppend(const Char *text, UInt32 *trigrams, UInt16 *count)
+{
+	UInt32 trigram = 0;
+	UInt16 i;
+
+	for (i = 0; text[i] != '\0'; i++) {
+		trigram = ((trigram << 8) | (UInt8)TrigramFold((UInt8)text[i])) & 0xFFFFFF;
+		if (i >= 2)
+			trigrams[(*count)++] = trigram;
+	}
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     TrigramSort
+ *
+ * DESCRIPTION:  Sorts a trigram list and drops duplicates
+ *
+ * PARAMETERS:   list, number of entries
+ *
+ * RETURNED:     number of distinct trigrams
+ *
+ ***********************************************************************/
+static UInt16 TrigramSort(UInt32 *trigrams, UInt16 count)
+{
+	UInt16 i;
+	UInt16 n = 0;
+
+	SysQSort(trigrams, count, sizeof(UInt32), CompareKeys, 0);
+	for (i = 0; i < count; i++) {
+		if (n == 0 || trigrams[i] != trigrams[n - 1])
+			trigrams[n++] = trigrams[i];
+	}
+	return n;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     TrigramCollect
+ *
+ * DESCRIPTION:  Lists the distinct trigrams of a recipe's name and steps
+ *				 in ascending order
+ *
+ * PARAMETERS:   locked recipe record, MemHandle pointer to store the
+ *				 list, pointer to store the number of trigrams
+ *
+ * RETURNED:     Err (*ret is NULL if there are no trigrams)
+ *
+ ***********************************************************************/
+static Err TrigramCollect(MemPtr recP, MemHandle *ret, UInt16 *count)
+{
+	RecipeView view;
+	Char *steps;
+	UInt32 *trigrams;
+	UInt32 maxCount;
+
+	*ret = NULL;
+	*count = 0;
+	RecipeViewInit(&view, recP);
+	steps = RecipeViewStepsText(&view);
+	if (!steps)
+		return memErrNotEnoughSpace;
+
+	maxCount = StrLen(((RecipeHeader *)recP)->name) + StrLen(steps);
+	if (maxCount < 3) {
+		MemPtrFree(steps);
+		return errNone;
+	}
+
+	*ret = MemHandleNew(maxCount * sizeof(UInt32));
+	if (!*ret) {
+		MemPtrFree(steps);
+		return memErrNotEnoughSpace;
+	}
+	trigrams = MemHandleLock(*ret);
+	TrigramAppend(((RecipeHeader *)recP)->name, trigrams, count);
+	TrigramAppend(steps, trigrams, count);
+	*count = TrigramSort(trigrams, *count);
+	MemHandleUnlock(*ret);
+	MemPtrFree(steps);
+
+	if (*count == 0) {
+		MemHandleFree(*ret);
+		*ret = NULL;
+	} else {
+		MemHandleResize(*ret, *count * sizeof(UInt32));
+	}
+	return errNone;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     TrigramUpdate
+ *
+ * DESCRIPTION:  Moves a recipe's trigram postings from an old trigram
+ *				 list to a new one. Trigrams in both lists aren't touched
+ *
+ * PARAMETERS:   recipe ID, old list and count (NULL and 0 for a new
+ *				 recipe), new list and count (NULL and 0 for a removed
+ *				 recipe), both as returned by TrigramCollect
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err TrigramUpdate(UInt32 recipeId, MemHandle oldH, UInt16 numOld, MemHandle newH, UInt16 numNew)
+{
+	UInt32 *oldP = oldH ? MemHandleLock(oldH) : NULL;
+	UInt32 *newP = newH ? MemHandleLock(newH) : NULL;
+	UInt16 i = 0;
+	UInt16 j = 0;
+	Err err = errNone;
+
+	while ((i < numOld || j < numNew) && err == errNone) {
+		if (j == numNew || (i < numOld && oldP[i] < newP[j]))
+			err = PostingRemove(postingKindTrigram, oldP[i++], recipeId);
+		else if (i == numOld || newP[j] < oldP[i])
+			err = PostingAdd(postingKindTrigram, newP[j++], recipeId);
+		else {
+			i++;
+			j++;
+		}
+	}
+
+	if (oldH) MemHandleUnlock(oldH);
+	if (newH) MemHandleUnlock(newH);
+	return err;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     TrigramIndexRecipe
+ *
+ * DESCRIPTION:  Adds every trigram of a recipe's name and steps to the
+ *				 trigram index
+ *
+ * PARAMETERS:   index of recipe in gRecipeDB
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err TrigramIndexRecipe(UInt16 recipeIndex)
+{
+	MemHandle recH;
+	MemHandle trigramsH;
+	UInt16 numTrigrams;
+	Err err;
+
+	recH = DmQueryRecord(gRecipeDB, recipeIndex);
+	if (!recH) return dmErrIndexOutOfRange;
+	err = TrigramCollect(MemHandleLock(recH), &trigramsH, &numTrigrams);
+	MemHandleUnlock(recH);
+
+	if (err == errNone && trigramsH) {
+		err = TrigramUpdate(IDFromIndex(gRecipeDB, recipeIndex), NULL, 0, trigramsH, numTrigrams);
+		MemHandleFree(trigramsH);
+	}
+	return err;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     TrigramRebuild
+ *
+ * DESCRIPTION:  Rebuilds the trigram index from the recipe database
+ *
+ * PARAMETERS:   nothing
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err TrigramRebuild()
+{
+	UInt16 numRecipes = DmNumRecords(gRecipeDB);
+	LocalID dbID;
+	UInt16 cardNo;
+	UInt16 version = trigramDBVersion;
+	UInt16 i;
+	Err err = errNone;
+
+	for (i = DmNumRecords(gTrigramDB); i > 0; i--)
+		DmRemoveRecord(gTrigramDB, i - 1);
+
+	for (i = 0; i < numRecipes && err == errNone; i++) {
+		if (DmQueryRecord(gRecipeDB, i))
+			err = TrigramIndexRecipe(i);
+	}
+	if (err != errNone)
+		return err;
+
+	err = DmOpenDatabaseInfo(gTrigramDB, &dbID, NULL, NULL, &cardNo, NULL);
+	if (err == errNone)
+		err = DmSetDatabaseInfo(cardNo, dbID, NULL, NULL, &version, NULL, NULL,
+			NULL, NULL, NULL, NULL, NULL, NULL);
+	return err;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     TextContains
+ *
+ * DESCRIPTION:  Case insensitive substring test
+ *
+ * PARAMETERS:   text, case folded (TrigramFold) piece to find, its length
+ *
+ * RETURNED:     true if text contains the piece
+ *
+ ***********************************************************************/
+static Boolean TextContains(const Char *text, const Char *folded, UInt16 len)
+{
+	UInt16 i;
+
+	for (; *text != '\0'; text++) {
+		for (i = 0; i < len && text[i] != '\0' &&
+				TrigramFold((UInt8)text[i]) == (UInt8)folded[i]; i++)
+			;
+		if (i == len)
+			return true;
+	}
+	return false;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     RecipeIDsByName
+ *
+ * DESCRIPTION:  Puts a set of recipe IDs into the order the recipes
+ *				 appear in gRecipeDB (by name), for OpenRecipeList
+ *
+ * PARAMETERS:   recipe IDs (no duplicates), number of IDs, MemHandle
+ *				 pointer to store returned list of recipe IDs
+ *
+ * RETURNED:     number of recipes found (*ret is NULL if none)
+ *
+ ***********************************************************************/
+static UInt16 RecipeIDsByName(const UInt32 *ids, UInt16 numIds, MemHandle* ret)
+{
+	MemHandle keysH;
+	UInt32 *keys;
+	UInt32 *results;
+	UInt16 index;
+	UInt16 i;
+	UInt16 idx = 0;
+
+	*ret = NULL;
+	if (numIds == 0)
+		return 0;
+
+	keysH = MemHandleNew(numIds * sizeof(UInt32));
+	*ret = MemHandleNew(numIds * sizeof(UInt32));
+	if (!keysH || !*ret) {
+		if (keysH) MemHandleFree(keysH);
+		if (*ret) MemHandleFree(*ret);
+		*ret = NULL;
+		displayError(memErrNotEnoughSpace);
+		return 0;
+	}
+	keys = MemHandleLock(keysH);
+
+	// recipe index in the high word, position in ids in the low word
+	for (i = 0; i < numIds; i++) {
+		index = IndexFromID(gRecipeDB, ids[i]);
+		if (index != 0xFFFF)
+			keys[idx++] = ((UInt32)index << 16) | i;
+	}
+	SysQSort(keys, idx, sizeof(UInt32), CompareKeys, 0);
+
+	results = MemHandleLock(*ret);
+	for (i = 0; i < idx; i++)
+		results[i] = ids[keys[i] & 0xFFFF];
+	MemHandleUnlock(*ret);
+
+	MemHandleUnlock(keysH);
+	MemHandleFree(keysH);
+
+	if (idx == 0) {
+		MemHandleFree(*ret);
+		*ret = NULL;
+	} else {
+		MemHandleResize(*ret, idx * sizeof(UInt32));
+	}
+	return idx;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     RecipePrefixCompare
+ *
+ * DESCRIPTION:  Compares the start of a recipe's sort key with the sort
+ *				 key of a prefix, in the order CompareRecipeNames sorts by
+ *
+ * PARAMETERS:   index of recipe in gRecipeDB (and QMCatalog), prefix key,
+ *				 length of key
+ *
+ * RETURNED:     0 if the name starts with prefix, negative if the name
+ *				 sorts before it, positive if after (or if the record
+ *				 is missing)
+ *
+ ***********************************************************************/
+static Int16 RecipePrefixCompare(UInt16 index, const Char *prefix, UInt16 len)
+{
+	MemHandle recH = DmQueryRecord(gCatalogDB, index);
+	Int16 result;
+
+	if (!recH)
+		return 1;
+	result = SortKeyCompare(((CatalogHeader *)MemHandleLock(recH))->key, prefix, len);
+	MemHandleUnlock(recH);
+	return result;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     FindIfUsed
+ *
+ * DESCRIPTION:  Checks if an ingredient/unit is used in any recipes
+ *				 (or if it can be removed)
+ *
+ * PARAMETERS:   bitflag (0 = ingredient id, 1 = unit id), item ID
+ *				 (bitflag identifies what the item ID is a reference to)
+ *
+ * RETURNED:     true if item appears in any recipe entry, false otherwise
+ *
+ ***********************************************************************/
+static Boolean FindIfUsed(UInt8 dbase, UInt32 itemId) {
+	return UseCount(UseCountDB(dbase), itemId) > 0;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     MaskInvalidate
+ *
+ * DESCRIPTION:  Frees the recipe bitmasks so the next search rebuilds
+ *				 them. Must be called whenever recipes are added or removed
+ *
+ * PARAMETERS:   nothing
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void MaskInvalidate()
+{
+	MemHandle *blocks;
+	UInt16 numBlocks;
+	UInt16 i;
+
+	if (gMasks.blocksH) {
+		numBlocks = (gMasks.numRecipes + maskRecipesPerBlock - 1) / maskRecipesPerBlock;
+		blocks = MemHandleLock(gMasks.blocksH);
+		for (i = 0; i < numBlocks; i++) {
+			if (blocks[i]) MemHandleFree(blocks[i]);
+		}
+		MemHandleUnlock(gMasks.blocksH);
+		MemHandleFree(gMasks.blocksH);
+	}
+	if (gMasks.ordinalsH)
+		MemHandleFree(gMasks.ordinalsH);
+
+	MemSet(&gMasks, sizeof(gMasks), 0);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     MaskAddBit
+ *
+ * DESCRIPTION:  Sets a bit in a recipe's list of mask words, adding a
+ *				 word if the recipe has none for it yet
+ *
+ * PARAMETERS:   recipe's first mask word, number of words (updated),
+ *				 word number, bits to set
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void MaskAddBit(MaskWord *words, UInt16 *numWords, UInt16 word, UInt32 bits)
+{
+	UInt16 i;
+
+	for (i = 0; i < *numWords; i++) {
+		if (words[i].word == word) {
+			words[i].bits |= bits;
+			return;
+		}
+	}
+	words[i].word = word;
+	words[i].bits = bits;
+	(*numWords)++;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     MaskBuild
+ *
+ * DESCRIPTION:  Assigns ordinals to every ingredient in the index and
+ *				 builds the ingredient bitmask of every recipe, from its
+ *				 QMCatalog record
+ *
+ * PARAMETERS:   nothing
+ *
+ * RETURNED:     errNone or memErrNotEnoughSpace
+ *
+ ***********************************************************************/
+static Err MaskBuild()
+{
+	UInt16 numRecipes = DmNumRecords(gRecipeDB);
+	UInt16 numBlocks = (numRecipes + maskRecipesPerBlock - 1) / maskRecipesPerBlock;
+	PostingHeader *postP;
+	MaskBlock *block;
+	MemHandle *blocks;
+	MemHandle recH;
+	CatalogHeader *catP;
+	UInt32 *ids;
+	UInt32 *ordinals = NULL;
+	UInt16 ordinal;
+	UInt16 numWords;
+	UInt16 first;
+	UInt16 count;
+	UInt16 b;
+	UInt16 i;
+	UInt16 j;
+
+	MaskInvalidate();
+	gMasks.numRecipes = numRecipes;
+
+	// ingredient records sort before all unit records in the index
+	PostingFind(postingKindUnit, 0, &gMasks.numOrdinals);
+	if (gMasks.numOrdinals > 0) {
+		gMasks.ordinalsH = MemHandleNew(gMasks.numOrdinals * sizeof(UInt32));
+		if (!gMasks.ordinalsH) goto fail;
+		ordinals = MemHandleLock(gMasks.ordinalsH);
+		for (i = 0; i < gMasks.numOrdinals; i++) {
+			recH = DmQueryRecord(gIndexDB, i);
+			postP = MemHandleLock(recH);
+			ordinals[i] = postP->itemId;
+			MemHandleUnlock(recH);
+		}
+	}
+
+	if (numBlocks > 0) {
+		gMasks.blocksH = MemHandleNew(numBlocks * sizeof(MemHandle));
+		if (!gMasks.blocksH) goto fail;
+		blocks = MemHandleLock(gMasks.blocksH);
+		MemSet(blocks, numBlocks * sizeof(MemHandle), 0);
+
+		for (b = 0; b < numBlocks; b++) {
+			first = b * maskRecipesPerBlock;
+			count = (numRecipes - first < maskRecipesPerBlock) ? numRecipes - first : maskRecipesPerBlock;
+
+			// sized for the worst case (a word per ingredient, one for a
+			// deleted recipe), shrunk once the block is filled
+			numWords = 0;
+			for (i = 0; i < count; i++) {
+				recH = DmQueryRecord(gCatalogDB, first + i);
+				if (recH) {
+					numWords += ((CatalogHeader *)MemHandleLock(recH))->numIngredients;
+					MemHandleUnlock(recH);
+				} else {
+					numWords++;
+				}
+			}
+			blocks[b] = MemHandleNew(OffsetOf(MaskBlock, words) +
+				(numWords + 1) * sizeof(MaskWord));
+			if (!blocks[b]) {
+				MemHandleUnlock(gMasks.blocksH);
+				goto fail;
+			}
+			block = MemHandleLock(blocks[b]);
+			block->starts[0] = 0;
+
+			for (i = 0; i < count; i++) {
+				numWords = 0;
+				recH = DmQueryRecord(gCatalogDB, first + i);
+				if (!recH) {
+					MaskAddBit(block->words + block->starts[i], &numWords, maskWordNever, 1);
+				} else {
+					catP = MemHandleLock(recH);
+					ids = (UInt32 *)(catP + 1);
+
+					for (j = 0; j < catP->numIngredients; j++) {
+						ordinal = IDPosition(ordinals, gMasks.numOrdinals, ids[j]);
+						if (ordinal < gMasks.numOrdinals && ordinals[ordinal] == ids[j])
+							MaskAddBit(block->words + block->starts[i], &numWords,
+								ordinal / 32, (UInt32)1 << (ordinal % 32));
+						else // not in the index, can't be satisfied
+							MaskAddBit(block->words + block->starts[i], &numWords, maskWordNever, 1);
+					}
+					MemHandleUnlock(recH);
+				}
+				block->starts[i + 1] = block->starts[i] + numWords;
+			}
+
+			numWords = block->starts[count];
+			MemHandleUnlock(blocks[b]);
+			MemHandleResize(blocks[b], OffsetOf(MaskBlock, words) + numWords * sizeof(MaskWord));
+		}
+		MemHandleUnlock(gMasks.blocksH);
+	}
+
+	if (ordinals)
+		MemHandleUnlock(gMasks.ordinalsH);
+	gMasks.valid = true;
+	return errNone;
+
+fail:
+	if (ordinals)
+		MemHandleUnlock(gMasks.ordinalsH);
+	MaskInvalidate();
+	return memErrNotEnoughSpace;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     MaskPantry
+ *
+ * DESCRIPTION:  Builds a bitmask of the pantry over the same ingredient
+ *				 ordinals as the recipe bitmasks (gMasks must be valid)
+ *
+ * PARAMETERS:   pointer to store number of words in the mask
+ *
+ * RETURNED:     MemHandle to the mask, or NULL if out of memory. Holds
+ *				 one spare zero word so it is never empty
+ *
+ ***********************************************************************/
+static MemHandle MaskPantry(UInt16 *numWords)
+{
+	UInt16 numPantry = DmNumRecords(gPantryDB);
+	MemHandle pantryH;
+	MemHandle recH;
+	UInt32 *ordinals;
+	UInt32 *pantry;
+	UInt32 *recP;
+	UInt16 ordinal;
+	UInt16 i;
+
+	*numWords = (gMasks.numOrdinals + 31) / 32;
+	pantryH = MemHandleNew((*numWords + 1) * sizeof(UInt32));
+	if (!pantryH)
+		return NULL;
+	pantry = MemHandleLock(pantryH);
+	MemSet(pantry, (*numWords + 1) * sizeof(UInt32), 0);
+
+	if (gMasks.numOrdinals > 0) {
+		ordinals = MemHandleLock(gMasks.ordinalsH);
+		for (i = 0; i < numPantry; i++) {
+			recH = DmQueryRecord(gPantryDB, i);
+			if (!recH) continue;
+			recP = MemHandleLock(recH);
+			ordinal = IDPosition(ordinals, gMasks.numOrdinals, *recP);
+			if (ordinal < gMasks.numOrdinals && ordinals[ordinal] == *recP)
+				pantry[ordinal / 32] |= (UInt32)1 << (ordinal % 32);
+			MemHandleUnlock(recH);
+		}
+		MemHandleUnlock(gMasks.ordinalsH);
+	}
+
+	MemHandleUnlock(pantryH);
+	return pantryH;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     BitCount
+ *
+ * DESCRIPTION:  Counts the set bits of a mask word
+ *
+ * PARAMETERS:   bits
+ *
+ * RETURNED:     number of bits set
+ *
+ ***********************************************************************/
+static UInt8 BitCount(UInt32 bits)
+{
+	UInt8 n = 0;
+
+	while (bits) {
+		bits &= bits - 1;
+		n++;
+	}
+	return n;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     MakeablePosition
+ *
+ * DESCRIPTION:  Binary search of the elements of a QMMakeable record by
+ *				 their leading recipe ID
+ *
+ * PARAMETERS:   first element, number of elements, element size, recipe ID
+ *
+ * RETURNED:     position of the first element whose ID is >= recipe ID
+ *
+ ***********************************************************************/
+static UInt16 MakeablePosition(const UInt8 *elems, UInt16 count, UInt16 elemSize, UInt32 recipeId)
+{
+	UInt16 lo = 0;
+	UInt16 hi = count;
+	UInt16 mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (*(const UInt32 *)(elems + mid * elemSize) < recipeId)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     MakeableInsert
+ *
+ * DESCRIPTION:  Adds an element to a QMMakeable record, or overwrites the
+ *				 element already kept for its recipe
+ *
+ * PARAMETERS:   record number, element size, element (starting with
+ *				 its recipe ID)
+ *
+ * RETURNED:     errNone or dmErrMemError
+ *
+ ***********************************************************************/
+static Err MakeableInsert(UInt16 rec, UInt16 elemSize, const void *elemP)
+{
+	UInt32 recipeId = *(const UInt32 *)elemP;
+	MakeableHeader *hdrP;
+	MemHandle recH;
+	UInt16 count;
+	UInt16 pos;
+	UInt32 offset;
+
+	recH = DmQueryRecord(gMakeableDB, rec);
+	if (!recH) return dmErrIndexOutOfRange;
+	hdrP = MemHandleLock(recH);
+	count = hdrP->count;
+	pos = MakeablePosition((UInt8 *)(hdrP + 1), count, elemSize, recipeId);
+	offset = sizeof(MakeableHeader) + (UInt32)pos * elemSize;
+
+	if (pos < count && *(UInt32 *)((UInt8 *)hdrP + offset) == recipeId) {
+		DmWrite(hdrP, offset, elemP, elemSize);
+		MemHandleUnlock(recH);
+		return errNone;
+	}
+	MemHandleUnlock(recH);
+
+	recH = DmResizeRecord(gMakeableDB, rec, sizeof(MakeableHeader) + (UInt32)(count + 1) * elemSize);
+	if (!recH) return dmErrMemError;
+	hdrP = MemHandleLock(recH);
+
+	if (pos < count)
+		DmWrite(hdrP, offset + elemSize, (UInt8 *)hdrP + offset, (UInt32)(count - pos) * elemSize);
+	DmWrite(hdrP, offset, elemP, elemSize);
+	count++;
+	DmWrite(hdrP, OffsetOf(MakeableHeader, count), &count, sizeof(UInt16));
+
+	MemHandleUnlock(recH);
+	return errNone;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     MakeableRemove
+ *
+ * DESCRIPTION:  Removes a recipe's element from a QMMakeable record
+ *
+ * PARAMETERS:   record number, element size, recipe ID
+ *
+ * RETURNED:     errNone (also if the recipe has no element)
+ *
+ ***********************************************************************/
+static Err MakeableRemove(UInt16 rec, UInt16 elemSize, UInt32 recipeId)
+{
+	MakeableHeader *hdrP;
+	MemHandle recH;
+	UInt16 count;
+	UInt16 pos;
+	UInt32 offset;
+
+	recH = DmQueryRecord(gMakeableDB, rec);
+	if (!recH) return dmErrIndexOutOfRange;
+	hdrP = MemHandleLock(recH);
+	count = hdrP->count;
+	pos = MakeablePosition((UInt8 *)(hdrP + 1), count, elemSize, recipeId);
+	offset = sizeof(MakeableHeader) + (UInt32)pos * elemSize;
+
+	if (pos >= count || *(UInt32 *)((UInt8 *)hdrP + offset) != recipeId) {
+		MemHandleUnlock(recH);
+		return errNone;
+	}
+
+	if (pos + 1 < count)
+		DmWrite(hdrP, offset, (UInt8 *)hdrP + offset + elemSize, (UInt32)(count - pos - 1) * elemSize);
+	count--;
+	DmWrite(hdrP, OffsetOf(MakeableHeader, count), &count, sizeof(UInt16));
+	MemHandleUnlock(recH);
+
+	DmResizeRecord(gMakeableDB, rec, sizeof(MakeableHeader) + (UInt32)count * elemSize);
+	return errNone;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     MakeableUpdate
+ *
+ * DESCRIPTION:  Stores a recipe's counts and moves it in or out of the
+ *				 strict and fuzzy lists to match
+ *
+ * PARAMETERS:   new counts, previous counts (NULL if the recipe is new)
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err MakeableUpdate(const MakeableEntry *entry, const MakeableEntry *old)
+{
+	Boolean strict = (entry->numMissing == 0);
+	Boolean fuzzy = (entry->numMissing < entry->numIngredients);
+	Err err;
+
+	err = MakeableInsert(makeableRecCounts, sizeof(MakeableEntry), entry);
+
+	if (err == errNone && (!old || strict != (old->numMissing == 0))) {
+		if (strict)
+			err = MakeableInsert(makeableRecStrict, sizeof(UInt32), &entry->recipeId);
+		else if (old)
+			err = MakeableRemove(makeableRecStrict, sizeof(UInt32), entry->recipeId);
+	}
+	if (err == errNone && (!old || fuzzy != (old->numMissing < old->numIngredients))) {
+		if (fuzzy)
+			err = MakeableInsert(makeableRecFuzzy, sizeof(UInt32), &entry->recipeId);
+		else if (old)
+			err = MakeableRemove(makeableRecFuzzy, sizeof(UInt32), entry->recipeId);
+	}
+	return err;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     MakeableAddRecipe
+ *
+ * DESCRIPTION:  Counts a new recipe's ingredients against the pantry and
+ *				 adds it to the makeable recipe lists it belongs in
+ *
+ * PARAMETERS:   index of recipe in gRecipeDB
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err MakeableAddRecipe(UInt16 recipeIndex)
+{
+	MakeableEntry entry;
+	MemHandle recH;
+	CatalogHeader *catP;
+	UInt32 *ids;
+	UInt16 i;
+	UInt16 j;
+
+	recH = DmQueryRecord(gCatalogDB, recipeIndex);
+	if (!recH) return dmErrIndexOutOfRange;
+
+	MemSet(&entry, sizeof(entry), 0);
+	catP = MemHandleLock(recH);
+	ids = (UInt32 *)(catP + 1);
+	entry.recipeId = catP->recipeId;
+
+	for (i = 0; i < catP->numIngredients; i++) {
+		for (j = 0; j < i && ids[j] != ids[i]; j++)
+			;
+		if (j < i) continue; // counted already
+
+		entry.numIngredients++;
+		if (!EntryInDatabase(gPantryDB, ids[i]))
+			entry.numMissing++;
+	}
+	MemHandleUnlock(recH);
+
+	return MakeableUpdate(&entry, NULL);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     MakeableRemoveRecipe
+ *
+ * DESCRIPTION:  Drops a recipe from the makeable recipe lists
+ *
+ * PARAMETERS:   recipe ID
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err MakeableRemoveRecipe(UInt32 recipeId)
+{
+	Err err;
+
+	err = MakeableRemove(makeableRecCounts, sizeof(MakeableEntry), recipeId);
+	if (err == errNone)
+		err = MakeableRemove(makeableRecStrict, sizeof(UInt32), recipeId);
+	if (err == errNone)
+		err = MakeableRemove(makeableRecFuzzy, sizeof(UInt32), recipeId);
+	return err;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     MakeablePantryChanged
+ *
+ * DESCRIPTION:  Updates the counts of the recipes that use an ingredient
+ *				 after it was added to or removed from the pantry. Only
+ *				 those recipes (from the index) are touched
+ *
+ * PARAMETERS:   ingredient ID, true if added to the pantry
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err MakeablePantryChanged(UInt32 ingId, Boolean added)
+{
+	PostingHeader *postP;
+	MakeableHeader *hdrP;
+	MakeableEntry *entries;
+	MakeableEntry entry;
+	MakeableEntry old;
+	MemHandle postH;
+	MemHandle recH;
+	UInt32 *recipeIds;
+	UInt16 index;
+	UInt16 pos;
+	UInt16 i;
+	Err err = errNone;
+
+	if (!gMakeableDB || !PostingFind(postingKindIngredient, ingId, &index))
+		return errNone;
+
+	postH = DmQueryRecord(gIndexDB, index);
+	postP = MemHandleLock(postH);
+	recipeIds = (UInt32 *)(postP + 1);
+
+	for (i = 0; i < postP->numRecipes && err == errNone; i++) {
+		recH = DmQueryRecord(gMakeableDB, makeableRecCounts);
+		if (!recH) {
+			err = dmErrIndexOutOfRange;
+			break;
+		}
+		hdrP = MemHandleLock(recH);
+		entries = (MakeableEntry *)(hdrP + 1);
+		pos = MakeablePosition((UInt8 *)entries, hdrP->count, sizeof(MakeableEntry), recipeIds[i]);
+		if (pos >= hdrP->count || entries[pos].recipeId != recipeIds[i]) {
+			MemHandleUnlock(recH);
+			continue;
+		}
+		old = entry = entries[pos];
+		MemHandleUnlock(recH);
+
+		if (added && entry.numMissing > 0)
+			entry.numMissing--;
+		else if (!added && entry.numMissing < entry.numIngredients)
+			entry.numMissing++;
+		err = MakeableUpdate(&entry, &old);
+	}
+
+	MemHandleUnlock(postH);
+	return err;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     MakeableWriteRecord
+ *
+ * DESCRIPTION:  Appends a QMMakeable record holding a list of elements
+ *
+ * PARAMETERS:   elements, number of elements, element size
+ *
+ * RETURNED:     errNone or dmErrMemError
+ *
+ ***********************************************************************/
+static Err MakeableWriteRecord(const void *elems, UInt16 count, UInt16 elemSize)
+{
+	MakeableHeader header;
+	MemHandle recH;
+	MemPtr recP;
+	UInt16 index = DmNumRecords(gMakeableDB);
+
+	recH = DmNewRecord(gMakeableDB, &index, sizeof(MakeableHeader) + (UInt32)count * elemSize);
+	if (!recH) return dmErrMemError;
+	recP = MemHandleLock(recH);
+
+	header.count = count;
+	header.reserved = 0;
+	DmWrite(recP, 0, &header, sizeof(MakeableHeader));
+	if (count > 0)
+		DmWrite(recP, sizeof(MakeableHeader), elems, (UInt32)count * elemSize);
+
+	MemHandleUnlock(recH);
+	return DmReleaseRecord(gMakeableDB, index, true);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     MakeableRebuild
+ *
+ * DESCRIPTION:  Recomputes the makeable recipe lists from scratch, from
+ *				 the recipe and pantry bitmasks
+ *
+ * PARAMETERS:   nothing
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err MakeableRebuild()
+{
+	UInt16 numRecipes = DmNumRecords(gRecipeDB);
+	UInt16 numBlocks = (numRecipes + maskRecipesPerBlock - 1) / maskRecipesPerBlock;
+	UInt16 pantryWords;
+	MemHandle pantryH = NULL;
+	MemHandle entriesH = NULL;
+	MemHandle idsH = NULL;
+	MemHandle *blocks;
+	MaskBlock *block;
+	MaskWord *word;
+	MakeableEntry *entries;
+	UInt32 *pantry;
+	UInt32 *ids;
+	UInt32 pantryBits;
+	UInt16 numEntries = 0;
+	UInt16 numIds;
+	UInt16 count;
+	UInt16 b;
+	UInt16 i;
+	UInt16 w;
+	UInt16 dbVersion = makeableDBVersion;
+	LocalID dbID;
+	UInt16 cardNo;
+	Err err = errNone;
+
+	for (i = DmNumRecords(gMakeableDB); i > 0; i--)
+		DmRemoveRecord(gMakeableDB, i - 1);
+
+	if (!gMasks.valid) {
+		err = MaskBuild();
+		if (err != errNone) return err;
+	}
+
+	pantryH = MaskPantry(&pantryWords);
+	entriesH = MemHandleNew((numRecipes + 1) * sizeof(MakeableEntry));
+	idsH = MemHandleNew((numRecipes + 1) * sizeof(UInt32));
+	if (!pantryH || !entriesH || !idsH) {
+		err = memErrNotEnoughSpace;
+		goto done;
+	}
+	pantry = MemHandleLock(pantryH);
+	entries = MemHandleLock(entriesH);
+
+	if (numBlocks > 0) {
+		blocks = MemHandleLock(gMasks.blocksH);
+		for (b = 0; b < numBlocks; b++) {
+			block = MemHandleLock(blocks[b]);
+			count = (numRecipes - b * maskRecipesPerBlock < maskRecipesPerBlock) ?
+				numRecipes - b * maskRecipesPerBlock : maskRecipesPerBlock;
+
+			for (i = 0; i < count; i++) {
+				// deleted recipes have no ID to be found by
+				if (!DmQueryRecord(gRecipeDB, b * maskRecipesPerBlock + i))
+					continue;
+
+				entries[numEntries].recipeId = IDFromIndex(gRecipeDB, b * maskRecipesPerBlock + i);
+				entries[numEntries].numIngredients = 0;
+				entries[numEntries].numMissing = 0;
+				entries[numEntries].reserved = 0;
+				for (w = block->starts[i]; w < block->starts[i + 1]; w++) {
+					word = &block->words[w];
+					pantryBits = (word->word < pantryWords) ? pantry[word->word] : 0;
+					entries[numEntries].numIngredients += BitCount(word->bits);
+					entries[numEntries].numMissing += BitCount(word->bits & ~pantryBits);
+				}
+				numEntries++;
+			}
+			MemHandleUnlock(blocks[b]);
+		}
+		MemHandleUnlock(gMasks.blocksH);
+	}
+
+	// CompareKeys only looks at the leading recipe ID
+	SysQSort(entries, numEntries, sizeof(MakeableEntry), CompareKeys, 0);
+	err = MakeableWriteRecord(entries, numEntries, sizeof(MakeableEntry));
+
+	ids = MemHandleLock(idsH);
+	if (err == errNone) {
+		for (i = 0, numIds = 0; i < numEntries; i++) {
+			if (entries[i].numMissing == 0)
+				ids[numIds++] = entries[i].recipeId;
+		}
+		err = MakeableWriteRecord(ids, numIds, sizeof(UInt32));
+	}
+	if (err == errNone) {
+		for (i = 0, numIds = 0; i < numEntries; i++) {
+			if (entries[i].numMissing < entries[i].numIngredients)
+				ids[numIds++] = entries[i].recipeId;
+		}
+		err = MakeableWriteRecord(ids, numIds, sizeof(UInt32));
+	}
+	MemHandleUnlock(idsH);
+	MemHandleUnlock(entriesH);
+	MemHandleUnlock(pantryH);
+
+	if (err == errNone) {
+		DmOpenDatabaseInfo(gMakeableDB, &dbID, NULL, NULL, &cardNo, NULL);
+		DmSetDatabaseInfo(cardNo, dbID, NULL, NULL, &dbVersion, NULL, NULL,
+			NULL, NULL, NULL, NULL, NULL, NULL);
+	}
+
+done:
+	if (pantryH) MemHandleFree(pantryH);
+	if (entriesH) MemHandleFree(entriesH);
+	if (idsH) MemHandleFree(idsH);
+	return err;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     MakeableList
+ *
+ * DESCRIPTION:  Copies the strict or fuzzy makeable recipe list out of
+ *				 QMMakeable, in recipe name order
+ *
+ * PARAMETERS:   makeableRecStrict or makeableRecFuzzy, MemHandle pointer
+ *				 to store returned list of recipe IDs
+ *
+ * RETURNED:     number of recipes in the list (*ret is NULL if none)
+ *
+ ***********************************************************************/
+static UInt16 MakeableList(UInt16 rec, MemHandle* ret)
+{
+	MakeableHeader *hdrP;
+	MemHandle recH;
+	UInt16 numResults;
+
+	*ret = NULL;
+	recH = gMakeableDB ? DmQueryRecord(gMakeableDB, rec) : NULL;
+	if (!recH)
+		return 0;
+
+	hdrP = MemHandleLock(recH);
+	numResults = RecipeIDsByName((UInt32 *)(hdrP + 1), hdrP->count, ret);
+	MemHandleUnlock(recH);
+
+	return numResults;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     RankSiftUp
+ *
+ * DESCRIPTION:  Restores the max-heap order after a key was appended
+ *
+ * PARAMETERS:   heap, position of the new key
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void RankSiftUp(UInt32 *heap, UInt16 i)
+{
+	UInt32 key = heap[i];
+
+	while (i > 0 && heap[(i - 1) / 2] < key) {
+		heap[i] = heap[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	heap[i] = key;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     RankSiftDown
+ *
+ * DESCRIPTION:  Restores the max-heap order after the key at a position
+ *				 was replaced by a smaller one
+ *
+ * PARAMETERS:   heap, number of keys, position of the replaced key
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void RankSiftDown(UInt32 *heap, UInt16 numKeys, UInt16 i)
+{
+	UInt32 key = heap[i];
+	UInt16 child;
+
+	while ((child = 2 * i + 1) < numKeys) {
+		if (child + 1 < numKeys && heap[child + 1] > heap[child])
+			child++;
+		if (heap[child] <= key)
+			break;
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = key;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     NameOrderSlot
+ *
+ * DESCRIPTION:  Finds where the name order projection of a pantry or
+ *				 grocery database is kept
+ *
+ * PARAMETERS:   database
+ *
+ * RETURNED:     pointer to the cached MemHandle (NULL if not built)
+ *
+ ***********************************************************************/
+static MemHandle* NameOrderSlot(DmOpenRef dbase)
+{
+	return (dbase == gGroceryDB) ? &gGroceryOrderH : &gPantryOrderH;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     NameOrderInvalidate
+ *
+ * DESCRIPTION:  Drops the name order projection of a database. Must be
+ *				 called whenever entries are added or removed
+ *
+ * PARAMETERS:   database
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void NameOrderInvalidate(DmOpenRef dbase)
+{
+	MemHandle *slot = NameOrderSlot(dbase);
+
+	if (*slot) {
+		MemHandleFree(*slot);
+		*slot = NULL;
+	}
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     NameOrderBuild
+ *
+ * DESCRIPTION:  Builds the list of record indexes of a pantry or grocery
+ *				 database in ingredient name order. gIngredientDB is kept
+ *				 sorted by name, so sorting on ingredient index is enough
+ *
+ * PARAMETERS:   database
+ *
+ * RETURNED:     MemHandle to UInt16 record indexes, or NULL
+ *
+ ***********************************************************************/
+static MemHandle NameOrderBuild(DmOpenRef dbase)
+{
+	UInt16 numEntries = DmNumRecords(dbase);
+	MemHandle orderH;
+	MemHandle recH;
+	UInt32 *keys;
+	UInt16 *order;
+	UInt16 ingIndex;
+	UInt16 i;
+
+	if (numEntries == 0)
+		return NULL;
+
+	orderH = MemHandleNew(numEntries * sizeof(UInt32));
+	if (!orderH)
+		return NULL;
+	keys = MemHandleLock(orderH);
+
+	// key = ingredient index in the high word, record index in the low word
+	for (i = 0; i < numEntries; i++) {
+		ingIndex = 0xFFFF;
+		recH = DmQueryRecord(dbase, i);
+		if (recH) {
+			ingIndex = IndexFromID(gIngredientDB, *(UInt32 *)MemHandleLock(recH));
+			MemHandleUnlock(recH);
+		}
+		keys[i] = ((UInt32)ingIndex << 16) | i;
+	}
+	SysQSort(keys, numEntries, sizeof(UInt32), CompareKeys, 0);
+
+	// narrowed in place - order[i] only overlaps keys that were already read
+	order = (UInt16 *)keys;
+	for (i = 0; i < numEntries; i++)
+		order[i] = (UInt16)keys[i];
+
+	MemHandleUnlock(orderH);
+	MemHandleResize(orderH, numEntries * sizeof(UInt16));
+	return orderH;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     MembershipMigrate
+ *
+ * DESCRIPTION:  Re-sorts a pantry or grocery database written by an older
+ *				 version (ordered by ingredient name) into ID order
+ *
+ * PARAMETERS:   database
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err MembershipMigrate(DmOpenRef dbase)
+{
+	LocalID dbID;
+	UInt16 cardNo;
+	UInt16 version;
+	Err err;
+
+	err = DmOpenDatabaseInfo(dbase, &dbID, NULL, NULL, &cardNo, NULL);
+	if (err == errNone)
+		err = DmDatabaseInfo(cardNo, dbID, NULL, NULL, &version, NULL, NULL,
+			NULL, NULL, NULL, NULL, NULL, NULL);
+	if (err != errNone || version >= membershipDBVersion)
+		return err;
+
+	err = DmQuickSort(dbase, (DmComparF *) DBIntCompare, 0);
+	if (err != errNone)
+		return err;
+
+	version = membershipDBVersion;
+	return DmSetDatabaseInfo(cardNo, dbID, NULL, NULL, &version, NULL, NULL,
+		NULL, NULL, NULL, NULL, NULL, NULL);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     GroceryMigrate
+ *
+ * DESCRIPTION:  Widens the bare ingredient ID records of a grocery
+ *				 database written by an older version into GroceryHeaders
+ *				 with no amounts
+ *
+ * PARAMETERS:   nothing
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err GroceryMigrate()
+{
+	LocalID dbID;
+	UInt16 cardNo;
+	UInt16 version;
+	MemHandle recH;
+	UInt16 numRecords;
+	UInt16 i;
+	Err err;
+
+	err = DmOpenDatabaseInfo(gGroceryDB, &dbID, NULL, NULL, &cardNo, NULL);
+	if (err == errNone)
+		err = DmDatabaseInfo(cardNo, dbID, NULL, NULL, &version, NULL, NULL,
+			NULL, NULL, NULL, NULL, NULL, NULL);
+	if (err != errNone || version >= groceryDBVersion)
+		return err;
+
+	numRecords = DmNumRecords(gGroceryDB);
+	for (i = 0; i < numRecords; i++) {
+		recH = DmQueryRecord(gGroceryDB, i);
+		if (!recH || MemHandleSize(recH) >= sizeof(GroceryHeader))
+			continue;
+		recH = DmResizeRecord(gGroceryDB, i, sizeof(GroceryHeader));
+		if (!recH)
+			return dmErrMemError;
+		DmSet(MemHandleLock(recH), sizeof(UInt32), sizeof(GroceryHeader) - sizeof(UInt32), 0);
+		MemHandleUnlock(recH);
+	}
+
+	version = groceryDBVersion;
+	return DmSetDatabaseInfo(cardNo, dbID, NULL, NULL, &version, NULL, NULL,
+		NULL, NULL, NULL, NULL, NULL, NULL);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     MembershipID
+ *
+ * DESCRIPTION:  Reads the ingredient ID a pantry or grocery record
+ *				 starts with
+ *
+ * PARAMETERS:   database, record index
+ *
+ * RETURNED:     ingredient ID, 0 if there is no such record
+ *
+ ***********************************************************************/
+static UInt32 MembershipID(DmOpenRef dbase, UInt16 index)
+{
+	MemHandle recH = DmQueryRecord(dbase, index);
+	UInt32 id = 0;
+
+	if (recH) {
+		id = *(UInt32 *)MemHandleLock(recH);
+		MemHandleUnlock(recH);
+	}
+	return id;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     Gcd
+ *
+ * DESCRIPTION:  Greatest common divisor (Euclid)
+ *
+ * PARAMETERS:   two numbers
+ *
+ * RETURNED:     gcd, the other number if one of them is 0
+ *
+ ***********************************************************************/
+static UInt32 Gcd(UInt32 a, UInt32 b)
+{
+	UInt32 t;
+
+	while (b) {
+		t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     AmountAdd
+ *
+ * DESCRIPTION:  Adds a quantity to a grocery amount with exact fraction
+ *				 arithmetic, leaving the fraction reduced and proper
+ *
+ * PARAMETERS:   amount to add to, whole part, numerator and denominator
+ *				 (0 for no fraction) of the quantity
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void AmountAdd(GroceryAmount *amount, UInt32 whole, UInt32 num, UInt32 denom)
+{
+	UInt32 sumNum, sumDenom, g;
+
+	if (denom == 0) {
+		num = 0;
+		denom = 1;
+	}
+	whole += amount->whole + num / denom;
+	num %= denom;
+
+	sumNum = amount->denom ? amount->num : 0;
+	sumDenom = amount->denom ? amount->denom : 1;
+
+	// Both fractions are proper with denominators up to groceryMaxDenom,
+	// so the sum over their least common denominator fits in 32 bits
+	g = Gcd(sumDenom, denom);
+	sumNum = sumNum * (denom / g) + num * (sumDenom / g);
+	sumDenom = sumDenom / g * denom;
+	whole += sumNum / sumDenom;
+	sumNum %= sumDenom;
+
+	g = Gcd(sumNum, sumDenom);
+	sumNum /= g;
+	sumDenom /= g;
+
+	// only approximated past groceryMaxDenom, recipe denominators (UInt8)
+	// never get there in practice
+	while (sumDenom > groceryMaxDenom) {
+		sumNum >>= 1;
+		sumDenom >>= 1;
+	}
+
+	amount->whole = (whole > 0xFFFF) ? 0xFFFF : (UInt16)whole;
+	amount->num = (UInt16)sumNum;
+	amount->denom = sumNum ? (UInt16)sumDenom : 0;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     CompareGroceryItems
+ *
+ * DESCRIPTION:  For SysQSort - orders GroceryItems by ingredient ID, then
+ *				 by unit ID
+ *
+ * PARAMETERS:   two GroceryItem pointers
+ *
+ * RETURNED:     0 if they match, positive number if item1 is larger,
+ *				 negative number if the reverse
+ *
+ ***********************************************************************/
+static Int16 CompareGroceryItems(void *item1, void *item2, Int32 other)
+{
+	GroceryItem *a = item1;
+	GroceryItem *b = item2;
+
+	if (a->ingredientId != b->ingredientId)
+		return (a->ingredientId < b->ingredientId) ? -1 : 1;
+	if (a->amount.unitId != b->amount.unitId)
+		return (a->amount.unitId < b->amount.unitId) ? -1 : 1;
+	return 0;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     GroceryStore
+ *
+ * DESCRIPTION:  Adds the summed amounts of one ingredient to the grocery
+ *				 list, either to the ingredient's record or as a new record
+ *
+ * PARAMETERS:   gGroceryDB index of the ingredient's record (or where to
+ *				 insert it), true to insert a new record, GroceryItems of
+ *				 the ingredient in unit ID order (one per unit), number of
+ *				 items
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err GroceryStore(UInt16 index, Boolean insert, const GroceryItem *items, UInt16 numItems)
+{
+	GroceryHeader header;
+	GroceryAmount *amounts;
+	GroceryAmount *old = NULL;
+	MemHandle recH = NULL;
+	MemPtr recP;
+	UInt32 size;
+	UInt16 numOld = 0;
+	UInt16 n = 0;
+	UInt16 i = 0;
+	UInt16 j = 0;
+
+	if (!insert) {
+		recH = DmQueryRecord(gGroceryDB, index);
+		if (!recH)
+			return dmErrIndexOutOfRange;
+		recP = MemHandleLock(recH);
+		if (MemHandleSize(recH) >= sizeof(GroceryHeader))
+			numOld = ((GroceryHeader *)recP)->numAmounts;
+		old = (GroceryAmount *)((GroceryHeader *)recP + 1);
+	}
+
+	amounts = MemPtrNew((numOld + numItems) * sizeof(GroceryAmount));
+	if (!amounts) {
+		if (recH) MemHandleUnlock(recH);
+		return memErrNotEnoughSpace;
+	}
+
+	// both lists are in unit ID order
+	while (i < numOld || j < numItems) {
+		if (j == numItems || (i < numOld && old[i].unitId < items[j].amount.unitId)) {
+			amounts[n++] = old[i++];
+		} else if (i == numOld || items[j].amount.unitId < old[i].unitId) {
+			amounts[n++] = items[j++].amount;
+		} else {
+			amounts[n] = old[i++];
+			AmountAdd(&amounts[n++], items[j].amount.whole, items[j].amount.num,
+				items[j].amount.denom);
+			j++;
+		}
+	}
+	if (recH) MemHandleUnlock(recH);
+
+	header.ingredientId = items[0].ingredientId;
+	header.numAmounts = n;
+	header.reserved = 0;
+	size = sizeof(GroceryHeader) + (UInt32)n * sizeof(GroceryAmount);
+
+	recH = insert ? DmNewRecord(gGroceryDB, &index, size) : DmResizeRecord(gGroceryDB, index, size);
+	if (recH) {
+		recP = MemHandleLock(recH);
+		DmWrite(recP, 0, &header, sizeof(GroceryHeader));
+		DmWrite(recP, sizeof(GroceryHeader), amounts, (UInt32)n * sizeof(GroceryAmount));
+		MemHandleUnlock(recH);
+		if (insert)
+			DmReleaseRecord(gGroceryDB, index, true);
+	}
+
+	MemPtrFree(amounts);
+	return recH ? errNone : dmErrMemError;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     IDMapFor
+ *
+ * DESCRIPTION:  Finds the ID map kept for a database
+ *
+ * PARAMETERS:   database
+ *
+ * RETURNED:     map, or NULL if the database doesn't have one
+ *
+ ***********************************************************************/
+static IDMap* IDMapFor(DmOpenRef dbase)
+{
+	if (!dbase)
+		return NULL;
+	if (dbase == gRecipeDB)
+		return &gRecipeMap;
+	if (dbase == gIngredientDB)
+		return &gIngredientMap;
+	if (dbase == gUnitDB)
+		return &gUnitMap;
+	return NULL;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     IDMapPut
+ *
+ * DESCRIPTION:  Stores an ID in the first free slot of its probe sequence
+ *
+ * PARAMETERS:   slots, number of slots, id, record index
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void IDMapPut(IDMapSlot *slots, UInt16 numSlots, UInt32 id, UInt16 index)
+{
+	UInt16 s = IDMapHash(id, numSlots);
+
+	while (slots[s].id != 0 && slots[s].id != id)
+		s = (s + 1) & (numSlots - 1);
+	slots[s].id = id;
+	slots[s].index = index;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     IDMapFree
+ *
+ * DESCRIPTION:  Frees an ID map (counters are kept)
+ *
+ * PARAMETERS:   map
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void IDMapFree(IDMap *map)
+{
+	if (map->slotsH)
+		MemHandleFree(map->slotsH);
+	map->slotsH = NULL;
+	map->numSlots = 0;
+	map->count = 0;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     IDMapRebuild
+ *
+ * DESCRIPTION:  Rebuilds an ID map from the record list of its database,
+ *				 sized to keep the table at most half full
+ *
+ * PARAMETERS:   map, database
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void IDMapRebuild(IDMap *map, DmOpenRef dbase)
+{
+	UInt16 numRecords = DmNumRecords(dbase);
+	UInt32 start = TimGetTicks();
+	UInt32 numSlots = idMapMinSlots;
+	IDMapSlot *slots;
+	UInt32 id;
+	UInt16 attr;
+	UInt16 i;
+
+	IDMapFree(map);
+
+	while (numSlots < (UInt32)numRecords * 2)
+		numSlots <<= 1;
+	if (numSlots > idMapMaxSlots) {
+		if ((UInt32)numRecords * 4 > (UInt32)idMapMaxSlots * 3)
+			return; // too full to probe well - fall back to DmFindRecordByID
+		numSlots = idMapMaxSlots;
+	}
+
+	map->slotsH = MemHandleNew(numSlots * sizeof(IDMapSlot));
+	if (!map->slotsH)
+		return;
+	slots = MemHandleLock(map->slotsH);
+	MemSet(slots, numSlots * sizeof(IDMapSlot), 0);
+
+	for (i = 0; i < numRecords; i++) {
+		if (DmRecordInfo(dbase, i, &attr, &id, NULL) == errNone && id != 0 &&
+				!(attr & dmRecAttrDelete)) {
+			IDMapPut(slots, numSlots, id, i);
+			map->count++;
+		}
+	}
+
+	MemHandleUnlock(map->slotsH);
+	map->numSlots = numSlots;
+	map->stats.rebuilds++;
+	map->stats.rebuildTicks += TimGetTicks() - start;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     IDMapLookup
+ *
+ * DESCRIPTION:  Finds the record index stored for an ID
+ *
+ * PARAMETERS:   map, id
+ *
+ * RETURNED:     record index, or 0xFFFF if the ID isn't in the map
+ *
+ ***********************************************************************/
+static UInt16 IDMapLookup(IDMap *map, UInt32 id)
+{
+	IDMapSlot *slots;
+	UInt16 s;
+	UInt16 index = 0xFFFF;
+
+	if (id == 0)
+		return 0xFFFF;
+
+	slots = MemHandleLock(map->slotsH);
+	for (s = IDMapHash(id, map->numSlots); slots[s].id != 0; s = (s + 1) & (map->numSlots - 1)) {
+		if (slots[s].id == id) {
+			index = slots[s].index;
+			break;
+		}
+	}
+	MemHandleUnlock(map->slotsH);
+
+	return index;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     IDMapInsert
+ *
+ * DESCRIPTION:  Updates an ID map after a record was inserted - records
+ *				 at or after the new one have moved down one place
+ *
+ * PARAMETERS:   database, id of new record, index it was inserted at
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void IDMapInsert(DmOpenRef dbase, UInt32 id, UInt16 index)
+{
+	IDMap *map = IDMapFor(dbase);
+	IDMapSlot *slots;
+	UInt16 s;
+
+	if (!map || !map->slotsH)
+		return;
+
+	if ((UInt32)(map->count + 1) * 2 > map->numSlots) {
+		IDMapRebuild(map, dbase); // record is already in the database
+		return;
+	}
+
+	slots = MemHandleLock(map->slotsH);
+	if (index + 1 < DmNumRecords(dbase)) { // appending moves nothing
+		for (s = 0; s < map->numSlots; s++) {
+			if (slots[s].id != 0 && slots[s].index >= index)
+				slots[s].index++;
+		}
+	}
+	IDMapPut(slots, map->numSlots, id, index);
+	MemHandleUnlock(map->slotsH);
+	map->count++;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     IDMapRemove
+ *
+ * DESCRIPTION:  Updates an ID map after a record was deleted. Deleted
+ *				 records stay in place as tombstones, so no other record
+ *				 moves
+ *
+ * PARAMETERS:   database, id of deleted record
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void IDMapRemove(DmOpenRef dbase, UInt32 id)
+{
+	IDMap *map = IDMapFor(dbase);
+	IDMapSlot *slots;
+	UInt16 mask;
+	UInt16 s;
+	UInt16 next;
+	UInt16 home;
+
+	if (!map || !map->slotsH)
+		return;
+
+	slots = MemHandleLock(map->slotsH);
+	mask = map->numSlots - 1;
+
+	for (s = IDMapHash(id, map->numSlots); slots[s].id != 0 && slots[s].id != id; s = (s + 1) & mask)
+		;
+
+	if (slots[s].id == id) {
+		// backward shift deletion - pulls later entries of the probe run
+		// into the hole when the hole lies between their home slot and them
+		slots[s].id = 0;
+		for (next = (s + 1) & mask; slots[next].id != 0; next = (next + 1) & mask) {
+			home = IDMapHash(slots[next].id, map->numSlots);
+			if (((next - home) & mask) >= ((next - s) & mask)) {
+				slots[s] = slots[next];
+				slots[next].id = 0;
+				s = next;
+			}
+		}
+		map->count--;
+	}
+	MemHandleUnlock(map->slotsH);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     IDMapMove
+ *
+ * DESCRIPTION:  Updates an ID map after DmMoveRecord - the records between
+ *				 the old and new place have moved one place towards the
+ *				 old one
+ *
+ * PARAMETERS:   database, id of moved record, old index, new index
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void IDMapMove(DmOpenRef dbase, UInt32 id, UInt16 from, UInt16 to)
+{
+	IDMap *map = IDMapFor(dbase);
+	IDMapSlot *slots;
+	UInt16 s;
+
+	if (!map || !map->slotsH || from == to)
+		return;
+
+	slots = MemHandleLock(map->slotsH);
+	for (s = 0; s < map->numSlots; s++) {
+		if (slots[s].id == 0)
+			continue;
+		if (slots[s].id == id)
+			slots[s].index = to;
+		else if (from < to && slots[s].index > from && slots[s].index <= to)
+			slots[s].index--;
+		else if (from > to && slots[s].index >= to && slots[s].index < from)
+			slots[s].index++;
+	}
+	MemHandleUnlock(map->slotsH);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     LiveFor
+ *
+ * DESCRIPTION:  Finds the tombstone bookkeeping kept for a database
+ *
+ * PARAMETERS:   database
+ *
+ * RETURNED:     LiveOrder, or NULL if the database doesn't use tombstones
+ *
+ ***********************************************************************/
+static LiveOrder* LiveFor(DmOpenRef dbase)
+{
+	if (!dbase)
+		return NULL;
+	if (dbase == gRecipeDB)
+		return &gRecipeLive;
+	if (dbase == gIngredientDB)
+		return &gIngredientLive;
+	if (dbase == gUnitDB)
+		return &gUnitLive;
+	return NULL;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     LiveInvalidate
+ *
+ * DESCRIPTION:  Drops the live record order of a database. Must be called
+ *				 whenever records are inserted, deleted or moved
+ *
+ * PARAMETERS:   database
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void LiveInvalidate(DmOpenRef dbase)
+{
+	LiveOrder *live = LiveFor(dbase);
+
+	if (live && live->orderH) {
+		MemHandleFree(live->orderH);
+		live->orderH = NULL;
+	}
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     LiveCountDeleted
+ *
+ * DESCRIPTION:  Counts the tombstones a database was opened with
+ *
+ * PARAMETERS:   database
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void LiveCountDeleted(DmOpenRef dbase)
+{
+	LiveOrder *live = LiveFor(dbase);
+	UInt16 numRecords = DmNumRecords(dbase);
+	UInt16 attr;
+	UInt16 i;
+
+	LiveInvalidate(dbase);
+	live->numDeleted = 0;
+	for (i = 0; i < numRecords; i++) {
+		if (DmRecordInfo(dbase, i, &attr, NULL, NULL) == errNone && (attr & dmRecAttrDelete))
+			live->numDeleted++;
+	}
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     DeleteRecord
+ *
+ * DESCRIPTION:  Deletes a recipe, ingredient or unit record, leaving a
+ *				 tombstone so no other record index changes. Tombstones
+ *				 are cleared out by DatabaseCompact
+ *
+ * PARAMETERS:   database, record index, record's unique ID
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err DeleteRecord(DmOpenRef dbase, UInt16 index, UInt32 id)
+{
+	Err err;
+
+	err = DmDeleteRecord(dbase, index);
+	if (err != errNone)
+		return err;
+
+	IDMapRemove(dbase, id);
+	LiveFor(dbase)->numDeleted++;
+	LiveInvalidate(dbase);
+	return errNone;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     FindSorted
+ *
+ * DESCRIPTION:  Binary search of a sorted database that may hold
+ *				 tombstones (DmFindSortPosition requires deleted records
+ *				 to be at the end)
+ *
+ * PARAMETERS:   database, key, comparison function the database is
+ *				 sorted by, pointer to store index
+ *
+ * RETURNED:     true if a live record compares equal to the key (*indexP
+ *				 is its index), false otherwise (*indexP is the insert
+ *				 position)
+ *
+ ***********************************************************************/
+static Boolean FindSorted(DmOpenRef dbase, void *key, DmComparF *compar, UInt16 *indexP)
+{
+	UInt16 lo = 0;
+	UInt16 hi = DmNumRecords(dbase);
+	UInt16 mid;
+	UInt16 probe;
+	MemHandle recH = NULL;
+	Int16 result;
+
+	// live records before lo sort <= key, live records from hi on sort > key
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		for (probe = mid; probe < hi && !(recH = DmQueryRecord(dbase, probe)); probe++)
+			;
+		if (probe == hi) {
+			hi = mid;
+			continue;
+		}
+		result = compar(key, MemHandleLock(recH), 0, NULL, NULL, NULL);
+		MemHandleUnlock(recH);
+		if (result < 0)
+			hi = mid;
+		else
+			lo = probe + 1;
+	}
+	*indexP = lo;
+
+	// only the last live record before lo can be equal
+	for (probe = lo; probe > 0 && !(recH = DmQueryRecord(dbase, probe - 1)); probe--)
+		;
+	if (probe == 0)
+		return false;
+	result = compar(key, MemHandleLock(recH), 0, NULL, NULL, NULL);
+	MemHandleUnlock(recH);
+	if (result != 0)
+		return false;
+
+	*indexP = probe - 1;
+	return true;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     SortedAt
+ *
+ * DESCRIPTION:  Checks if a record of a sorted database can be replaced
+ *				 by a new one without moving it, by comparing the new
+ *				 record with the live records either side
+ *
+ * PARAMETERS:   database, index of record, new record, comparison
+ *				 function the database is sorted by
+ *
+ * RETURNED:     true if the database stays in order
+ *
+ ***********************************************************************/
+static Boolean SortedAt(DmOpenRef dbase, UInt16 index, void *key, DmComparF *compar)
+{
+	UInt16 numRecords = DmNumRecords(dbase);
+	MemHandle recH = NULL;
+	UInt16 probe;
+	Int16 result;
+
+	for (probe = index; probe > 0 && !(recH = DmQueryRecord(dbase, probe - 1)); probe--)
+		;
+	if (probe > 0) {
+		result = compar(MemHandleLock(recH), key, 0, NULL, NULL, NULL);
+		MemHandleUnlock(recH);
+		if (result > 0)
+			return false;
+	}
+
+	for (probe = index + 1; probe < numRecords && !(recH = DmQueryRecord(dbase, probe)); probe++)
+		;
+	if (probe < numRecords) {
+		result = compar(key, MemHandleLock(recH), 0, NULL, NULL, NULL);
+		MemHandleUnlock(recH);
+		if (result > 0)
+			return false;
+	}
+	return true;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     LiveCompact
+ *
+ * DESCRIPTION:  Removes every tombstone of a database in one pass - a
+ *				 single sort moves them to the end, where removing a
+ *				 record doesn't shift any others
+ *
+ * PARAMETERS:   database, comparison function the database is sorted by
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err LiveCompact(DmOpenRef dbase, DmComparF *compar)
+{
+	LiveOrder *live = LiveFor(dbase);
+	UInt16 n;
+	UInt16 attr;
+	Err err;
+
+	if (!live || live->numDeleted == 0)
+		return errNone;
+
+	err = DmQuickSort(dbase, compar, 0);
+	if (err != errNone)
+		return err;
+
+	for (n = DmNumRecords(dbase); n > 0; n--) {
+		if (DmRecordInfo(dbase, n - 1, &attr, NULL, NULL) != errNone || !(attr & dmRecAttrDelete))
+			break;
+		DmRemoveRecord(dbase, n - 1);
+	}
+
+	live->numDeleted = 0;
+	LiveInvalidate(dbase);
+	IDMapRebuild(IDMapFor(dbase), dbase);
+	return errNone;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     RefTableFor
+ *
+ * DESCRIPTION:  Finds the ref table kept for a database
+ *
+ * PARAMETERS:   database
+ *
+ * RETURNED:     table, or NULL if the database doesn't have one
+ *
+ ***********************************************************************/
+static RefTable* RefTableFor(DmOpenRef dbase)
+{
+	if (!dbase)
+		return NULL;
+	if (dbase == gIngredientDB)
+		return &gIngredientRefs;
+	if (dbase == gUnitDB)
+		return &gUnitRefs;
+	return NULL;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     RefTableFree
+ *
+ * DESCRIPTION:  Frees a ref table
+ *
+ * PARAMETERS:   table
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void RefTableFree(RefTable *table)
+{
+	if (table->idsH)
+		MemHandleFree(table->idsH);
+	table->idsH = NULL;
+	table->count = 0;
+	table->firstFree = 0;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     RefTableBuild
+ *
+ * DESCRIPTION:  Rebuilds the ref table of gIngredientDB or gUnitDB from
+ *				 the refs stored in its live records
+ *
+ * PARAMETERS:   gIngredientDB or gUnitDB
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err RefTableBuild(DmOpenRef dbase)
+{
+	RefTable *table = RefTableFor(dbase);
+	UInt16 numRecords = DmNumRecords(dbase);
+	MemHandle recH;
+	UInt32 *ids;
+	UInt32 id;
+	UInt16 ref;
+	UInt16 i;
+
+	RefTableFree(table);
+	for (i = 0; i < numRecords; i++) {
+		recH = DmQueryRecord(dbase, i);
+		if (!recH)
+			continue;
+		ref = ItemRef(MemHandleLock(recH), MemHandleSize(recH));
+		MemHandleUnlock(recH);
+		if (ref != itemRefNone && ref >= table->count)
+			table->count = ref + 1;
+	}
+	if (table->count == 0)
+		return errNone;
+
+	table->idsH = MemHandleNew(table->count * sizeof(UInt32));
+	if (!table->idsH) {
+		table->count = 0;
+		return memErrNotEnoughSpace;
+	}
+	ids = MemHandleLock(table->idsH);
+	MemSet(ids, table->count * sizeof(UInt32), 0);
+	for (i = 0; i < numRecords; i++) {
+		recH = DmQueryRecord(dbase, i);
+		if (!recH)
+			continue;
+		ref = ItemRef(MemHandleLock(recH), MemHandleSize(recH));
+		MemHandleUnlock(recH);
+		DmRecordInfo(dbase, i, NULL, &id, NULL);
+		if (ref != itemRefNone)
+			ids[ref] = id;
+	}
+	while (table->firstFree < table->count && ids[table->firstFree] != 0)
+		table->firstFree++;
+	MemHandleUnlock(table->idsH);
+	return errNone;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     RefToID
+ *
+ * DESCRIPTION:  Looks up the unique ID of an ingredient or unit ref
+ *
+ * PARAMETERS:   gIngredientDB or gUnitDB, ref
+ *
+ * RETURNED:     unique ID, or 0 if the ref isn't in use
+ *
+ ***********************************************************************/
+static UInt32 RefToID(DmOpenRef dbase, UInt16 ref)
+{
+	RefTable *table = RefTableFor(dbase);
+	UInt32 id;
+
+	if (!table || ref >= table->count)
+		return 0;
+	id = ((UInt32 *)MemHandleLock(table->idsH))[ref];
+	MemHandleUnlock(table->idsH);
+	return id;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     RefNext
+ *
+ * DESCRIPTION:  Picks the ref for a new ingredient or unit - the lowest
+ *				 free one, so refs stay small - growing the table to
+ *				 hold it. The ref stays free until RefSet
+ *
+ * PARAMETERS:   gIngredientDB or gUnitDB
+ *
+ * RETURNED:     ref, or itemRefNone if out of memory
+ *
+ ***********************************************************************/
+static UInt16 RefNext(DmOpenRef dbase)
+{
+	RefTable *table = RefTableFor(dbase);
+	UInt32 size;
+
+	if (table->firstFree < table->count)
+		return table->firstFree;
+	if (table->count >= itemRefNone - refTableGrow)
+		return itemRefNone;
+
+	if (!table->idsH) {
+		table->idsH = MemHandleNew(refTableGrow * sizeof(UInt32));
+		if (!table->idsH)
+			return itemRefNone;
+	} else if (MemHandleSize(table->idsH) < (table->count + 1) * sizeof(UInt32)) {
+		size = (table->count + refTableGrow) * sizeof(UInt32);
+		if (MemHandleResize(table->idsH, size) != errNone)
+			return itemRefNone;
+	}
+	((UInt32 *)MemHandleLock(table->idsH))[table->count] = 0;
+	MemHandleUnlock(table->idsH);
+	table->count++;
+	return table->firstFree;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     RefSet
+ *
+ * DESCRIPTION:  Marks a ref picked by RefNext as used by a new item
+ *
+ * PARAMETERS:   gIngredientDB or gUnitDB, ref, unique ID of the item
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void RefSet(DmOpenRef dbase, UInt16 ref, UInt32 id)
+{
+	RefTable *table = RefTableFor(dbase);
+	UInt32 *ids = MemHandleLock(table->idsH);
+
+	ids[ref] = id;
+	while (table->firstFree < table->count && ids[table->firstFree] != 0)
+		table->firstFree++;
+	MemHandleUnlock(table->idsH);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     ItemRefByID
+ *
+ * DESCRIPTION:  Finds the ref of an ingredient or unit
+ *
+ * PARAMETERS:   gIngredientDB or gUnitDB, unique ID
+ *
+ * RETURNED:     ref, or itemRefNone if there is no such item
+ *
+ ***********************************************************************/
+static UInt16 ItemRefByID(DmOpenRef dbase, UInt32 id)
+{
+	UInt16 index = IndexFromID(dbase, id);
+	MemHandle recH;
+	UInt16 ref;
+
+	recH = (index != 0xFFFF) ? DmQueryRecord(dbase, index) : NULL;
+	if (!recH)
+		return itemRefNone;
+	ref = ItemRef(MemHandleLock(recH), MemHandleSize(recH));
+	MemHandleUnlock(recH);
+	return ref;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     CacheSave
+ *
+ * DESCRIPTION:  Saves the tombstone count, ID map and ref table of a
+ *				 database in its AppInfo block (see CacheHeader), stamped
+ *				 with its modification number so DatabaseOpen can tell
+ *				 whether anything has changed it since
+ *
+ * PARAMETERS:   gRecipeDB, gIngredientDB or gUnitDB
+ *
+ * RETURNED:     nothing (without a block the next open rebuilds them)
+ *
+ ***********************************************************************/
+static void CacheSave(DmOpenRef dbase)
+{
+	IDMap *map = IDMapFor(dbase);
+	RefTable *table = RefTableFor(dbase);
+	CacheHeader header;
+	MemHandle infoH;
+	UInt8 *infoP;
+	LocalID dbID;
+	LocalID appInfoID;
+	UInt16 cardNo;
+	UInt32 offset;
+	UInt32 size;
+
+	if (!map || DmOpenDatabaseInfo(dbase, &dbID, NULL, NULL, &cardNo, NULL) != errNone)
+		return;
+
+	MemSet(&header, sizeof(CacheHeader), 0);
+	header.version    = cacheVersion;
+	header.numRecords = DmNumRecords(dbase);
+	header.numDeleted = LiveFor(dbase)->numDeleted;
+	if (map->slotsH) {
+		header.numSlots = map->numSlots;
+		header.mapCount = map->count;
+	}
+	if (table) {
+		header.numRefs   = table->count;
+		header.firstFree = table->firstFree;
+	}
+	size = sizeof(CacheHeader) + (UInt32)header.numSlots * sizeof(IDMapSlot) +
+		(UInt32)header.numRefs * sizeof(UInt32);
+	if (size > cacheMaxSize)
+		return;
+
+	DmDatabaseInfo(cardNo, dbID, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+		&appInfoID, NULL, NULL, NULL);
+	if (appInfoID) {
+		infoH = MemLocalIDToGlobal(appInfoID, cardNo);
+		if (MemHandleSize(infoH) != size && MemHandleResize(infoH, size) != errNone)
+			return;
+	} else {
+		infoH = DmNewHandle(dbase, size);
+		if (!infoH)
+			return;
+		appInfoID = MemHandleToLocalID(infoH);
+		DmSetDatabaseInfo(cardNo, dbID, NULL, NULL, NULL, NULL, NULL, NULL,
+			NULL, &appInfoID, NULL, NULL, NULL);
+	}
+
+	// read last, as attaching the block may count as a change
+	DmDatabaseInfo(cardNo, dbID, NULL, NULL, &header.dbVersion, NULL, NULL,
+		NULL, &header.modNum, NULL, NULL, NULL, NULL);
+
+	infoP = MemHandleLock(infoH);
+	DmWrite(infoP, 0, &header, sizeof(CacheHeader));
+	offset = sizeof(CacheHeader);
+	if (header.numSlots > 0) {
+		DmWrite(infoP, offset, MemHandleLock(map->slotsH), header.numSlots * sizeof(IDMapSlot));
+		MemHandleUnlock(map->slotsH);
+		offset += header.numSlots * sizeof(IDMapSlot);
+	}
+	if (header.numRefs > 0) {
+		DmWrite(infoP, offset, MemHandleLock(table->idsH), header.numRefs * sizeof(UInt32));
+		MemHandleUnlock(table->idsH);
+	}
+	MemHandleUnlock(infoH);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     CacheRestore
+ *
+ * DESCRIPTION:  Restores what CacheSave kept of a database, if nothing
+ *				 has changed it since. The block is marked used, so a
+ *				 session that ends without DatabaseClose leaves nothing
+ *				 stale behind
+ *
+ * PARAMETERS:   gRecipeDB, gIngredientDB or gUnitDB
+ *
+ * RETURNED:     true if restored, false if the tombstone count, ID map
+ *				 and ref table must be rebuilt
+ *
+ ***********************************************************************/
+static Boolean CacheRestore(DmOpenRef dbase)
+{
+	IDMap *map = IDMapFor(dbase);
+	RefTable *table = RefTableFor(dbase);
+	CacheHeader *header;
+	MemHandle infoH;
+	UInt8 *infoP;
+	LocalID dbID;
+	LocalID appInfoID;
+	UInt16 cardNo;
+	UInt16 version;
+	UInt16 unused = 0;
+	UInt32 modNum;
+	UInt32 slotsSize;
+	UInt32 refsSize;
+	Boolean restored = false;
+
+	if (!map || DmOpenDatabaseInfo(dbase, &dbID, NULL, NULL, &cardNo, NULL) != errNone)
+		return false;
+	DmDatabaseInfo(cardNo, dbID, NULL, NULL, &version, NULL, NULL, NULL,
+		&modNum, &appInfoID, NULL, NULL, NULL);
+	infoH = appInfoID ? MemLocalIDToGlobal(appInfoID, cardNo) : NULL;
+	if (!infoH || MemHandleSize(infoH) < sizeof(CacheHeader))
+		return false;
+
+	infoP = MemHandleLock(infoH);
+	header = (CacheHeader *)infoP;
+	slotsSize = (UInt32)header->numSlots * sizeof(IDMapSlot);
+	refsSize = (UInt32)header->numRefs * sizeof(UInt32);
+	if (header->version != cacheVersion || header->dbVersion != version ||
+			header->modNum != modNum || header->numRecords != DmNumRecords(dbase) ||
+			MemHandleSize(infoH) != sizeof(CacheHeader) + slotsSize + refsSize ||
+			(header->numRefs > 0 && !table) ||
+			(table && version < itemRefDBVersion)) { // RefMigrate is still to come
+		MemHandleUnlock(infoH);
+		return false;
+	}
+
+	LiveInvalidate(dbase);
+	LiveFor(dbase)->numDeleted = header->numDeleted;
+
+	// a map too big to keep is left to IDMapRebuild to give up on again
+	IDMapFree(map);
+	if (header->numSlots == 0) {
+		IDMapRebuild(map, dbase);
+		restored = true;
+	} else {
+		map->slotsH = MemHandleNew(slotsSize);
+		if (map->slotsH) {
+			MemMove(MemHandleLock(map->slotsH), infoP + sizeof(CacheHeader), slotsSize);
+			MemHandleUnlock(map->slotsH);
+			map->numSlots = header->numSlots;
+			map->count = header->mapCount;
+			restored = true;
+		}
+	}
+
+	if (restored && table) {
+		RefTableFree(table);
+		if (header->numRefs > 0) {
+			table->idsH = MemHandleNew(refsSize);
+			if (table->idsH) {
+				MemMove(MemHandleLock(table->idsH), infoP + sizeof(CacheHeader) + slotsSize, refsSize);
+				MemHandleUnlock(table->idsH);
+				table->count = header->numRefs;
+				table->firstFree = header->firstFree;
+			} else {
+				restored = false;
+			}
+		}
+	}
+
+	if (restored)
+		DmWrite(infoP, 0, &unused, sizeof(UInt16));
+	MemHandleUnlock(infoH);
+	return restored;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     ItemBuild
+ *
+ * DESCRIPTION:  Lays out an ingredient or unit record for a name (with a
+ *				 use count and ref of 0) in a dynamic heap buffer. The
+ *				 buffer is also the key to search for the name with
+ *				 CompareItemKeys
+ *
+ * PARAMETERS:   name
+ *
+ * RETURNED:     MemHandle to the record (unlocked), NULL if out of memory
+ *
+ ***********************************************************************/
+static MemHandle ItemBuild(const Char *name)
+{
+	UInt16 nameLen = StrLen(name);
+	UInt16 keyLen;
+	MemHandle bufH;
+	Char *bufP;
+
+	bufH = MemHandleNew(2 * (nameLen + 1) + 2 * sizeof(UInt16));
+	if (!bufH) return NULL;
+	bufP = MemHandleLock(bufH);
+
+	MemMove(bufP, name, nameLen + 1);
+	MemSet(bufP + nameLen + 1, sizeof(UInt16), 0);
+	keyLen = SortKeyMake(name, bufP + nameLen + 1 + sizeof(UInt16), nameLen + 1);
+	MemSet(bufP + nameLen + 1 + sizeof(UInt16) + keyLen + 1, sizeof(UInt16), 0);
+
+	MemHandleUnlock(bufH);
+	MemHandleResize(bufH, nameLen + 1 + sizeof(UInt16) + keyLen + 1 + sizeof(UInt16));
+	return bufH;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     ItemIDByRecord
+ *
+ * DESCRIPTION:  Finds the ingredient or unit with the sort key of a
+ *				 record built by ItemBuild, or stores the record as a
+ *				 new entry with the next free ref
+ *
+ * PARAMETERS:   gIngredientDB or gUnitDB, record buffer
+ *
+ * RETURNED:     unique ID, or -1 if a new entry couldn't be created
+ *
+ ***********************************************************************/
+static UInt32 ItemIDByRecord(DmOpenRef dbase, MemHandle bufH)
+{
+	UInt32 size = MemHandleSize(bufH);
+	UInt32 entryID = 0;
+	MemHandle recH;
+	UInt8 *bufP;
+	UInt16 index;
+	UInt16 ref;
+	Boolean found;
+
+	found = FindSorted(dbase, MemHandleLock(bufH), (DmComparF *) CompareItemKeys, &index);
+	MemHandleUnlock(bufH);
+	if (found) {
+		DmRecordInfo(dbase, index, NULL, &entryID, NULL);
+		return entryID;
+	}
+
+	ref = RefNext(dbase);
+	if (ref == itemRefNone)
+		return -1;
+	bufP = MemHandleLock(bufH);
+	bufP[size - 2] = (UInt8)(ref >> 8);
+	bufP[size - 1] = (UInt8)ref;
+
+	recH = DmNewRecord(dbase, &index, size);
+	if (!recH) {
+		MemHandleUnlock(bufH);
+		return -1;
+	}
+	DmWrite(MemHandleLock(recH), 0, bufP, size);
+	MemHandleUnlock(bufH);
+	MemHandleUnlock(recH);
+	DmReleaseRecord(dbase, index, true);
+
+	DmRecordInfo(dbase, index, NULL, &entryID, NULL);
+	RefSet(dbase, ref, entryID);
+	IDMapInsert(dbase, entryID, index);
+	LiveInvalidate(dbase);
+	return entryID;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     MergeTarget
+ *
+ * DESCRIPTION:  Looks an ID up in the merge list built by ItemMerge
+ *
+ * PARAMETERS:   (merged ID, surviving ID) pairs in ascending order of
+ *				 merged ID, number of pairs, ID
+ *
+ * RETURNED:     surviving ID, or id itself if it wasn't merged
+ *
+ ***********************************************************************/
+static UInt32 MergeTarget(const UInt32 *pairs, UInt16 numPairs, UInt32 id)
+{
+	UInt16 lo = 0;
+	UInt16 hi = numPairs;
+	UInt16 mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (pairs[2 * mid] < id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return (lo < numPairs && pairs[2 * lo] == id) ? pairs[2 * lo + 1] : id;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     ItemMergePairs
+ *
+ * DESCRIPTION:  Lists the ingredients or units whose sort key is the
+ *				 same as the record before them, with the ID of the
+ *				 first record of that key
+ *
+ * PARAMETERS:   gIngredientDB or gUnitDB (sorted by key), number of
+ *				 live records at its start, buffer for (merged ID,
+ *				 surviving ID) pairs or NULL to only count them
+ *
+ * RETURNED:     number of pairs
+ *
+ ***********************************************************************/
+static UInt16 ItemMergePairs(DmOpenRef dbase, UInt16 numLive, UInt32 *pairs)
+{
+	MemHandle prevH;
+	MemHandle recH;
+	UInt32 survivor = 0;
+	UInt32 id;
+	UInt16 numPairs = 0;
+	UInt16 i;
+	Boolean same;
+
+	for (i = 0; i < numLive; i++) {
+		DmRecordInfo(dbase, i, NULL, &id, NULL);
+		same = false;
+		if (i > 0) {
+			prevH = DmQueryRecord(dbase, i - 1);
+			recH = DmQueryRecord(dbase, i);
+			same = (CompareItemKeys(MemHandleLock(prevH), MemHandleLock(recH), 0, NULL, NULL, NULL) == 0);
+			MemHandleUnlock(prevH);
+			MemHandleUnlock(recH);
+		}
+		if (!same) {
+			survivor = id;
+			continue;
+		}
+		if (pairs) {
+			pairs[2 * numPairs] = id;
+			pairs[2 * numPairs + 1] = survivor;
+		}
+		numPairs++;
+	}
+	return numPairs;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     ItemMerge
+ *
+ * DESCRIPTION:  Merges ingredients or units whose names have the same
+ *				 sort key (e.g. "butter" and "Butter" stored before there
+ *				 were keys) into the first of them - recipes, pantry and
+ *				 grocery list are pointed at it and the others removed.
+ *				 The index and use counts must be rebuilt afterwards
+ *
+ * PARAMETERS:   gIngredientDB or gUnitDB, sorted by key (tombstones at
+ *				 the end)
+ *
+ * RETURNED:     number of entries removed
+ *
+ ***********************************************************************/
+static UInt16 ItemMerge(DmOpenRef dbase)
+{
+	Boolean units = (dbase == gUnitDB);
+	DmOpenRef lists[2];
+	MemHandle pairsH;
+	MemHandle recH;
+	RecipeView recipe;
+	UInt32 *pairs;
+	UInt8 *recP;
+	UInt32 offset;
+	UInt32 survivor;
+	UInt32 id;
+	UInt32 prevId;
+	UInt16 numLive = 0;
+	UInt16 numPairs;
+	UInt16 i;
+	UInt16 j;
+	UInt8 k;
+
+	while (numLive < DmNumRecords(dbase) && DmQueryRecord(dbase, numLive))
+		numLive++;
+	numPairs = ItemMergePairs(dbase, numLive, NULL);
+	if (numPairs == 0)
+		return 0;
+	// pantry and grocery entries are pointed at the survivors too; opened
+	// directly, DatabaseRequire would run into the half open dbSetItems
+	if (ListSetOpen() != errNone)
+		return 0; // left as they are, both still work
+
+	pairsH = MemHandleNew(numPairs * 2 * sizeof(UInt32));
+	if (!pairsH)
+		return 0; // left as they are, both still work
+	pairs = MemHandleLock(pairsH);
+	ItemMergePairs(dbase, numLive, pairs);
+	SysQSort(pairs, numPairs, 2 * sizeof(UInt32), CompareKeys, 0);
+
+	// IDs in layout 1 recipes are big-endian bytes. Layout 2 recipes hold
+	// refs, which are only given out after this runs (build_pdb.py already
+	// merges names with the same sort key), so none of them need changing
+	for (i = 0; i < DmNumRecords(gRecipeDB); i++) {
+		recH = DmQueryRecord(gRecipeDB, i);
+		if (!recH)
+			continue;
+		recP = MemHandleLock(recH);
+		RecipeViewInit(&recipe, recP);
+		for (k = 0; k < recipe.numIngredients && recipe.layout == recipeLayoutV1; k++) {
+			id = units ? RecipeViewUnitID(&recipe, k) : RecipeViewIngredientID(&recipe, k);
+			survivor = MergeTarget(pairs, numPairs, id);
+			if (survivor == id)
+				continue;
+			offset = (units ? recipe.unitIDs : recipe.ingredientIDs) + k * 4 - recP;
+			DmSet(recP, offset, 1, (UInt8)(survivor >> 24));
+			DmSet(recP, offset + 1, 1, (UInt8)(survivor >> 16));
+			DmSet(recP, offset + 2, 1, (UInt8)(survivor >> 8));
+			DmSet(recP, offset + 3, 1, (UInt8)survivor);
+		}
+		MemHandleUnlock(recH);
+	}
+
+	// pantry and grocery entries are kept in ID order without repeats
+	lists[0] = gPantryDB;
+	lists[1] = gGroceryDB;
+	for (j = 0; j < 2 && !units; j++) {
+		for (i = 0; i < DmNumRecords(lists[j]); i++) {
+			recH = DmQueryRecord(lists[j], i);
+			recP = MemHandleLock(recH);
+			survivor = MergeTarget(pairs, numPairs, *(UInt32 *)recP);
+			if (survivor != *(UInt32 *)recP)
+				DmWrite(recP, 0, &survivor, sizeof(UInt32));
+			MemHandleUnlock(recH);
+		}
+		DmQuickSort(lists[j], (DmComparF *) DBIntCompare, 0);
+		prevId = 0;
+		for (i = 0; i < DmNumRecords(lists[j]); ) {
+			recH = DmQueryRecord(lists[j], i);
+			id = *(UInt32 *)MemHandleLock(recH);
+			MemHandleUnlock(recH);
+			if (i > 0 && id == prevId) {
+				DmRemoveRecord(lists[j], i);
+			} else {
+				prevId = id;
+				i++;
+			}
+		}
+		NameOrderInvalidate(lists[j]);
+	}
+
+	for (i = numLive; i > 0; i--) {
+		DmRecordInfo(dbase, i - 1, NULL, &id, NULL);
+		if (MergeTarget(pairs, numPairs, id) != id)
+			DmRemoveRecord(dbase, i - 1);
+	}
+
+	MemHandleUnlock(pairsH);
+	MemHandleFree(pairsH);
+	return numPairs;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     SortKeyMigrate
+ *
+ * DESCRIPTION:  Adds sort keys to the records of an ingredient or unit
+ *				 database written by an older version (after
+ *				 UseCountMigrate and RecipeKeyMigrate), re-sorts it by
+ *				 key and merges names that only differed in case or
+ *				 spacing, see ItemMerge
+ *
+ * PARAMETERS:   gIngredientDB or gUnitDB, pointer set to true if entries
+ *				 were merged (left alone otherwise)
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err SortKeyMigrate(DmOpenRef dbase, Boolean *merged)
+{
+	LocalID dbID;
+	MemHandle recH;
+	MemHandle bufH;
+	Char *bufP;
+	UInt32 size;
+	UInt16 numRecords = DmNumRecords(dbase);
+	UInt16 cardNo;
+	UInt16 version = 0;
+	UInt16 count;
+	UInt16 i;
+	Err err;
+
+	err = DmOpenDatabaseInfo(dbase, &dbID, NULL, NULL, &cardNo, NULL);
+	if (err == errNone)
+		err = DmDatabaseInfo(cardNo, dbID, NULL, NULL, &version, NULL, NULL,
+			NULL, NULL, NULL, NULL, NULL, NULL);
+	if (err != errNone || version >= sortKeyDBVersion)
+		return err;
+
+	for (i = 0; i < numRecords; i++) {
+		recH = DmQueryRecord(dbase, i);
+		if (!recH)
+			continue;
+		count = UseCountRead(dbase, i);
+		bufH = ItemBuild(MemHandleLock(recH));
+		MemHandleUnlock(recH);
+		if (!bufH)
+			return memErrNotEnoughSpace;
+
+		bufP = MemHandleLock(bufH);
+		size = MemHandleSize(bufH);
+		MemMove(bufP + StrLen(bufP) + 1, &count, sizeof(UInt16));
+		recH = DmResizeRecord(dbase, i, size);
+		if (recH) {
+			DmWrite(MemHandleLock(recH), 0, bufP, size);
+			MemHandleUnlock(recH);
+		}
+		MemHandleUnlock(bufH);
+		MemHandleFree(bufH);
+		if (!recH)
+			return dmErrMemError;
+	}
+
+	err = DmQuickSort(dbase, (DmComparF *) CompareItemKeys, 0);
+	if (err == errNone && ItemMerge(dbase) > 0)
+		*merged = true;
+	LiveInvalidate(dbase);
+	IDMapRebuild(IDMapFor(dbase), dbase);
+	if (err != errNone)
+		return err;
+
+	version = sortKeyDBVersion;
+	return DmSetDatabaseInfo(cardNo, dbID, NULL, NULL, &version, NULL, NULL,
+		NULL, NULL, NULL, NULL, NULL, NULL);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     RefMigrate
+ *
+ * DESCRIPTION:  Gives every item of an ingredient or unit database
+ *				 written by an older version (after SortKeyMigrate) a
+ *				 ref - its rank by unique ID, which is also what
+ *				 build_pdb.py writes into layout 2 recipes
+ *
+ * PARAMETERS:   gIngredientDB or gUnitDB
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err RefMigrate(DmOpenRef dbase)
+{
+	LocalID dbID;
+	MemHandle idsH = NULL;
+	MemHandle recH;
+	UInt32 *ids = NULL;
+	Char *recP;
+	Char *key;
+	UInt32 id;
+	UInt32 offset;
+	UInt16 numRecords = DmNumRecords(dbase);
+	UInt16 numLive = 0;
+	UInt16 position;
+	UInt16 cardNo;
+	UInt16 version;
+	UInt16 i;
+	UInt8 ref[2];
+	Err err;
+
+	err = DmOpenDatabaseInfo(dbase, &dbID, NULL, NULL, &cardNo, NULL);
+	if (err == errNone)
+		err = DmDatabaseInfo(cardNo, dbID, NULL, NULL, &version, NULL, NULL,
+			NULL, NULL, NULL, NULL, NULL, NULL);
+	if (err != errNone || version >= itemRefDBVersion)
+		return err;
+
+	if (numRecords > 0) {
+		idsH = MemHandleNew(numRecords * sizeof(UInt32));
+		if (!idsH)
+			return memErrNotEnoughSpace;
+		ids = MemHandleLock(idsH);
+		for (i = 0; i < numRecords; i++) {
+			if (DmQueryRecord(dbase, i))
+				DmRecordInfo(dbase, i, NULL, &ids[numLive++], NULL);
+		}
+		SysQSort(ids, numLive, sizeof(UInt32), CompareKeys, 0);
+	}
+
+	for (i = 0; i < numRecords && err == errNone; i++) {
+		recH = DmQueryRecord(dbase, i);
+		if (!recH)
+			continue;
+		DmRecordInfo(dbase, i, NULL, &id, NULL);
+		position = IDPosition(ids, numLive, id);
+		ref[0] = (UInt8)(position >> 8);
+		ref[1] = (UInt8)position;
+
+		recP = MemHandleLock(recH);
+		key = ItemKey(recP);
+		offset = key + StrLen(key) + 1 - recP;
+		MemHandleUnlock(recH);
+		if (MemHandleSize(recH) < offset + sizeof(ref))
+			recH = DmResizeRecord(dbase, i, offset + sizeof(ref));
+		if (recH) {
+			DmWrite(MemHandleLock(recH), offset, ref, sizeof(ref));
+			MemHandleUnlock(recH);
+		} else {
+			err = dmErrMemError;
+		}
+	}
+	if (idsH) {
+		MemHandleUnlock(idsH);
+		MemHandleFree(idsH);
+	}
+	if (err != errNone)
+		return err;
+
+	version = itemRefDBVersion;
+	return DmSetDatabaseInfo(cardNo, dbID, NULL, NULL, &version, NULL, NULL,
+		NULL, NULL, NULL, NULL, NULL, NULL);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     RecipeKeyMigrate
+ *
+ * DESCRIPTION:  Inserts the sort key into every recipe of a gRecipeDB
+ *				 written by an older version (or by build_pdb.py), then
+ *				 re-sorts it by key
+ *
+ * PARAMETERS:   nothing
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err RecipeKeyMigrate()
+{
+	LocalID dbID;
+	MemHandle recH;
+	RecipeHeader *header;
+	UInt8 *recP;
+	UInt32 size;
+	UInt16 numRecords = DmNumRecords(gRecipeDB);
+	UInt16 cardNo;
+	UInt16 version = 0;
+	UInt16 i;
+	Err err;
+
+	err = DmOpenDatabaseInfo(gRecipeDB, &dbID, NULL, NULL, &cardNo, NULL);
+	if (err == errNone)
+		err = DmDatabaseInfo(cardNo, dbID, NULL, NULL, &version, NULL, NULL,
+			NULL, NULL, NULL, NULL, NULL, NULL);
+	if (err != errNone || version >= recipeKeyDBVersion)
+		return err;
+
+	for (i = 0; i < numRecords; i++) {
+		recH = DmQueryRecord(gRecipeDB, i);
+		if (!recH)
+			continue;
+		size = MemHandleSize(recH);
+		if (size < recipeKeyOffset + 2)
+			return dmErrCorruptDatabase;
+
+		header = MemPtrNew(size + sizeof(header->key));
+		if (!header)
+			return memErrNotEnoughSpace;
+		recP = MemHandleLock(recH);
+		MemMove(header, recP, recipeKeyOffset);
+		MemMove(&header->numIngredients, recP + recipeKeyOffset, size - recipeKeyOffset);
+		MemHandleUnlock(recH);
+		header->name[sizeof(header->name) - 1] = '\0';
+		MemSet(header->key, sizeof(header->key), 0);
+		SortKeyMake(header->name, header->key, sizeof(header->key));
+
+		size += sizeof(header->key);
+		recH = DmResizeRecord(gRecipeDB, i, size);
+		if (recH) {
+			DmWrite(MemHandleLock(recH), 0, header, size);
+			MemHandleUnlock(recH);
+		}
+		MemPtrFree(header);
+		if (!recH)
+			return dmErrMemError;
+	}
+
+	err = DmQuickSort(gRecipeDB, (DmComparF *) CompareRecipeNames, 0);
+	LiveInvalidate(gRecipeDB);
+	IDMapRebuild(&gRecipeMap, gRecipeDB);
+	if (err != errNone)
+		return err;
+
+	version = recipeKeyDBVersion;
+	return DmSetDatabaseInfo(cardNo, dbID, NULL, NULL, &version, NULL, NULL,
+		NULL, NULL, NULL, NULL, NULL, NULL);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     LinesHaveID
+ *
+ * DESCRIPTION:  Checks the lines of a recipe for an ingredient or unit
+ *
+ * PARAMETERS:   lines, number of lines, true to look at the units rather
+ *				 than the ingredients, ID to find
+ *
+ * RETURNED:     true if found
+ *
+ ***********************************************************************/
+static Boolean LinesHaveID(const RecipeLine *lines, UInt16 numLines, Boolean unit, UInt32 id)
+{
+	UInt16 i;
+
+	for (i = 0; i < numLines; i++) {
+		if ((unit ? lines[i].unitId : lines[i].ingredientId) == id)
+			return true;
+	}
+	return false;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     VarintPut
+ *
+ * DESCRIPTION:  Writes a number 7 bits at a time, lowest first, with the
+ *				 top bit of each byte set if another follows (numbers
+ *				 below 128 take one byte)
+ *
+ * PARAMETERS:   buffer, number
+ *
+ * RETURNED:     pointer just past the bytes written
+ *
+ ***********************************************************************/
+static UInt8* VarintPut(UInt8 *p, UInt16 value)
+{
+	while (value >= 0x80) {
+		*p++ = (UInt8)(value | 0x80);
+		value >>= 7;
+	}
+	*p++ = (UInt8)value;
+	return p;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     VarintGet
+ *
+ * DESCRIPTION:  Reads a number written by VarintPut
+ *
+ * PARAMETERS:   pointer to the read position, advanced past the number
+ *
+ * RETURNED:     number
+ *
+ ***********************************************************************/
+static UInt16 VarintGet(const UInt8 **pP)
+{
+	const UInt8 *p = *pP;
+	UInt16 value = 0;
+	UInt8 shift = 0;
+
+	do {
+		value |= (UInt16)(*p & 0x7F) << shift;
+		shift += 7;
+	} while ((*p++ & 0x80) && shift < 21);
+	*pP = p;
+	return value;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     StepsPack
+ *
+ * DESCRIPTION:  Packs recipe steps: the longest stepsDict entry found at
+ *				 each position is replaced by its byte, other characters
+ *				 below 0x80 are kept and the rest escaped. The result is
+ *				 null terminated like the steps, and can be read a piece
+ *				 at a time with StepsRead
+ *
+ * PARAMETERS:   steps, buffer for the packed steps or NULL to only
+ *				 measure them
+ *
+ * RETURNED:     size of the packed steps including the terminator
+ *
+ ***********************************************************************/
+static UInt16 StepsPack(const Char *text, UInt8 *out)
+{
+	const Char *entry;
+	UInt16 size = 0;
+	UInt16 best = 0;
+	UInt16 bestLen;
+	UInt16 i, len;
+
+	while (*text != '\0') {
+		bestLen = 1;
+		for (i = 0; i < stepsDictSize; i++) {
+			entry = stepsDict[i];
+			if (entry[0] != text[0])
+				continue;
+			for (len = 1; entry[len] != '\0' && entry[len] == text[len]; len++)
+				;
+			if (entry[len] == '\0' && len > bestLen) {
+				best = i;
+				bestLen = len;
+			}
+		}
+
+		if (bestLen > 1) {
+			if (out) out[size] = stepsDictFirst + best;
+			size++;
+		} else if ((UInt8)text[0] >= stepsEscape) {
+			if (out) {
+				out[size] = stepsEscape;
+				out[size + 1] = text[0];
+			}
+			size += 2;
+		} else {
+			if (out) out[size] = text[0];
+			size++;
+		}
+		text += bestLen;
+	}
+
+	if (out) out[size] = '\0';
+	return size + 1;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     RecipeBuild
+ *
+ * DESCRIPTION:  Lays out a complete layout 2 recipe record in a dynamic
+ *				 heap buffer, so it can be stored with a single DmWrite.
+ *				 Each line is the ingredient's ref, the unit's ref and
+ *				 the whole count shifted left one as varints, the low bit
+ *				 set if a fraction byte and denominator byte follow. The
+ *				 steps come after the last line, packed if that makes
+ *				 them smaller
+ *
+ * PARAMETERS:   Name, lines, number of lines and steps of recipe
+ *
+ * RETURNED:     MemHandle to the record (unlocked), NULL if out of memory
+ *				 or an ingredient or unit has no ref
+ *
+ ***********************************************************************/
+static MemHandle RecipeBuild(
+    const Char *recipeName,
+    const RecipeLine lines[],
+    UInt16 numLines,
+    const Char *recipeSteps)
+{
+	RecipeHeader *header;
+	MemHandle bufH;
+	UInt8 *p;
+	UInt16 stepsLen = StrLen(recipeSteps) + 1;
+	UInt16 packedLen = StepsPack(recipeSteps, NULL);
+	UInt16 ingredientRef;
+	UInt16 unitRef;
+	UInt16 i;
+	UInt32 size;
+
+	bufH = MemHandleNew(sizeof(RecipeHeader) + numLines * recipeLineMaxSize + stepsLen);
+	if (!bufH) return NULL;
+	header = MemHandleLock(bufH);
+
+	MemSet(header, sizeof(RecipeHeader), 0);
+	StrNCopy(header->name, recipeName, 31);
+	header->name[31] = '\0';
+	SortKeyMake(header->name, header->key, sizeof(header->key));
+	header->numIngredients = numLines;
+	header->layout = recipeLayoutV2;
+
+	p = (UInt8 *)(header + 1);
+	for (i = 0; i < numLines; i++) {
+		ingredientRef = ItemRefByID(gIngredientDB, lines[i].ingredientId);
+		unitRef = ItemRefByID(gUnitDB, lines[i].unitId);
+		if (ingredientRef == itemRefNone || unitRef == itemRefNone) {
+			MemHandleUnlock(bufH);
+			MemHandleFree(bufH);
+			return NULL;
+		}
+		p = VarintPut(p, ingredientRef);
+		p = VarintPut(p, unitRef);
+		if (lines[i].frac || lines[i].denom) {
+			p = VarintPut(p, ((UInt16)lines[i].count << 1) | 1);
+			*p++ = lines[i].frac;
+			*p++ = lines[i].denom;
+		} else {
+			p = VarintPut(p, (UInt16)lines[i].count << 1);
+		}
+	}
+	if (packedLen < stepsLen) {
+		header->layout |= recipeStepsPacked;
+		p += StepsPack(recipeSteps, p);
+	} else {
+		MemMove(p, recipeSteps, stepsLen);
+		p += stepsLen;
+	}
+
+	size = p - (UInt8 *)header;
+	MemHandleUnlock(bufH);
+	MemHandleResize(bufH, size);
+	return bufH;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     CatalogWrite
+ *
+ * DESCRIPTION:  Writes a recipe's QMCatalog record, from its recipe
+ *				 record or a buffer laid out like one. The recipe must
+ *				 already be at the index in gRecipeDB, for its ID
+ *
+ * PARAMETERS:   index of recipe, locked recipe record, true to insert a
+ *				 catalog record at the index, false to replace the one
+ *				 there
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err CatalogWrite(UInt16 index, MemPtr recP, Boolean insert)
+{
+	CatalogHeader *header;
+	RecipeView recipe;
+	MemHandle bufH;
+	MemHandle catH;
+	UInt32 *ids;
+	UInt32 size;
+	UInt16 i;
+	Err err = errNone;
+
+	RecipeViewInit(&recipe, recP);
+	size = sizeof(CatalogHeader) + recipe.numIngredients * sizeof(UInt32);
+	bufH = MemHandleNew(size);
+	if (!bufH) return memErrNotEnoughSpace;
+	header = MemHandleLock(bufH);
+
+	MemSet(header, sizeof(CatalogHeader), 0);
+	MemMove(header->name, ((RecipeHeader *)recP)->name, sizeof(header->name));
+	MemMove(header->key, ((RecipeHeader *)recP)->key, sizeof(header->key));
+	header->recipeId = IDFromIndex(gRecipeDB, index);
+	header->numIngredients = recipe.numIngredients;
+	ids = (UInt32 *)(header + 1);
+	for (i = 0; i < recipe.numIngredients; i++)
+		ids[i] = RecipeViewIngredientID(&recipe, i);
+
+	catH = insert ? DmNewRecord(gCatalogDB, &index, size) : DmResizeRecord(gCatalogDB, index, size);
+	if (catH) {
+		DmWrite(MemHandleLock(catH), 0, header, size);
+		MemHandleUnlock(catH);
+		if (insert)
+			err = DmReleaseRecord(gCatalogDB, index, true);
+	} else {
+		err = dmErrMemError;
+	}
+	MemHandleUnlock(bufH);
+	MemHandleFree(bufH);
+	return err;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     CatalogSetVersion
+ *
+ * DESCRIPTION:  Sets the version of QMCatalog. 0 while it may not match
+ *				 gRecipeDB, so CatalogSetOpen rebuilds it
+ *
+ * PARAMETERS:   version
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err CatalogSetVersion(UInt16 version)
+{
+	LocalID dbID;
+	UInt16 cardNo;
+	Err err;
+
+	err = DmOpenDatabaseInfo(gCatalogDB, &dbID, NULL, NULL, &cardNo, NULL);
+	if (err == errNone)
+		err = DmSetDatabaseInfo(cardNo, dbID, NULL, NULL, &version, NULL, NULL,
+			NULL, NULL, NULL, NULL, NULL, NULL);
+	return err;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     CatalogRebuild
+ *
+ * DESCRIPTION:  Rebuilds QMCatalog from the recipe database, with a
+ *				 tombstone for each of its tombstones. The ingredient
+ *				 refs of layout 2 recipes need dbSetItems
+ *
+ * PARAMETERS:   nothing
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err CatalogRebuild()
+{
+	UInt16 numRecipes = DmNumRecords(gRecipeDB);
+	MemHandle recH;
+	UInt16 index;
+	UInt16 i;
+	Err err;
+
+	// not trusted again until it is complete
+	err = CatalogSetVersion(0);
+	for (i = DmNumRecords(gCatalogDB); i > 0; i--)
+		DmRemoveRecord(gCatalogDB, i - 1);
+
+	for (i = 0; i < numRecipes && err == errNone; i++) {
+		recH = DmQueryRecord(gRecipeDB, i);
+		if (recH) {
+			err = CatalogWrite(i, MemHandleLock(recH), true);
+			MemHandleUnlock(recH);
+			continue;
+		}
+		index = i;
+		recH = DmNewRecord(gCatalogDB, &index, 1);
+		if (!recH) {
+			err = dmErrMemError;
+			break;
+		}
+		DmReleaseRecord(gCatalogDB, index, false);
+		err = DmDeleteRecord(gCatalogDB, index);
+	}
+	if (err == errNone)
+		err = CatalogSetVersion(catalogDBVersion);
+	return err;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     CatalogSort
+ *
+ * DESCRIPTION:  Brings QMCatalog back in line with gRecipeDB after that
+ *				 was sorted (by LiveCompact or ImportEnd): sorts it the
+ *				 same way and removes the tombstones LiveCompact removed.
+ *				 Checked record by record, and rebuilt if they differ
+ *
+ * PARAMETERS:   nothing
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err CatalogSort()
+{
+	UInt16 numRecipes = DmNumRecords(gRecipeDB);
+	MemHandle catH;
+	MemHandle recH;
+	Boolean match;
+	UInt16 n;
+	UInt16 i;
+	Err err;
+
+	err = DmQuickSort(gCatalogDB, (DmComparF *) CompareRecipeNames, 0);
+	for (n = DmNumRecords(gCatalogDB); err == errNone && n > numRecipes; n--) {
+		if (DmQueryRecord(gCatalogDB, n - 1))
+			break;
+		err = DmRemoveRecord(gCatalogDB, n - 1);
+	}
+
+	match = (err == errNone && DmNumRecords(gCatalogDB) == numRecipes);
+	for (i = 0; match && i < numRecipes; i++) {
+		catH = DmQueryRecord(gCatalogDB, i);
+		recH = DmQueryRecord(gRecipeDB, i);
+		if (!catH || !recH) {
+			match = (!catH && !recH);
+		} else {
+			match = (((CatalogHeader *)MemHandleLock(catH))->recipeId == IDFromIndex(gRecipeDB, i));
+			MemHandleUnlock(catH);
+		}
+	}
+	return match ? errNone : CatalogRebuild();
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     RecipeStore
+ *
+ * DESCRIPTION:  Copies a record built by RecipeBuild into gRecipeDB, and
+ *				 its catalog record into QMCatalog. Neither is kept unless
+ *				 both are stored
+ *
+ * PARAMETERS:   record buffer, index to insert at (updated to where the
+ *				 record ended up)
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err RecipeStore(MemHandle bufH, UInt16 *index)
+{
+	UInt32 size = MemHandleSize(bufH);
+	MemHandle recH;
+	MemPtr bufP;
+	Err err;
+
+	recH = DmNewRecord(gRecipeDB, index, size);
+	if (!recH) return dmErrMemError;
+
+	bufP = MemHandleLock(bufH);
+	DmWrite(MemHandleLock(recH), 0, bufP, size);
+	MemHandleUnlock(recH);
+	LiveInvalidate(gRecipeDB);
+
+	err = DmReleaseRecord(gRecipeDB, *index, true);
+	if (err == errNone)
+		err = CatalogWrite(*index, bufP, true);
+	MemHandleUnlock(bufH);
+	if (err != errNone)
+		DmRemoveRecord(gRecipeDB, *index);
+	return err;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     ImportHash
+ *
+ * DESCRIPTION:  FNV-1a hash of a sort key for the import dictionaries
+ *
+ * PARAMETERS:   sort key
+ *
+ * RETURNED:     hash
+ *
+ ***********************************************************************/
+static UInt32 ImportHash(const Char *name)
+{
+	UInt32 hash = 2166136261UL;
+
+	while (*name) {
+		hash ^= (UInt8)*name++;
+		hash *= 16777619UL;
+	}
+	return hash;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     ImportDictFree
+ *
+ * DESCRIPTION:  Frees an import dictionary
+ *
+ * PARAMETERS:   dictionary
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void ImportDictFree(ImportDict *dict)
+{
+	if (dict->slotsH)
+		MemHandleFree(dict->slotsH);
+	dict->slotsH = NULL;
+	dict->count = 0;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     ImportResolve
+ *
+ * DESCRIPTION:  Looks a name up in an import dictionary by sort key,
+ *				 falling back to (and caching the result of) a search of
+ *				 the database, which creates missing entries
+ *
+ * PARAMETERS:   dictionary, gIngredientDB or gUnitDB, name
+ *
+ * RETURNED:     unique ID, or -1 if a new entry couldn't be created
+ *
+ ***********************************************************************/
+static UInt32 ImportResolve(ImportDict *dict, DmOpenRef dbase, const Char *name)
+{
+	Char key[importKeyMax];
+	ImportSlot *slots;
+	MemHandle bufH;
+	MemHandle recH;
+	UInt32 hash;
+	UInt32 id = 0;
+	UInt16 s;
+
+	if (StrLen(name) >= sizeof(key))
+		return (dbase == gIngredientDB) ? IngredientIDByName(name) : UnitIDByName(name);
+	SortKeyMake(name, key, sizeof(key));
+	hash = ImportHash(key);
+
+	slots = MemHandleLock(dict->slotsH);
+	s = (UInt16)hash & (importDictSlots - 1);
+	for (; slots[s].id != 0; s = (s + 1) & (importDictSlots - 1)) {
+		if (slots[s].hash != hash)
+			continue;
+		recH = DmQueryRecord(dbase, IndexFromID(dbase, slots[s].id));
+		if (recH) {
+			if (SortKeyCompare(ItemKey(MemHandleLock(recH)), key, 0xFFFF) == 0)
+				id = slots[s].id;
+			MemHandleUnlock(recH);
+		}
+		if (id) {
+			MemHandleUnlock(dict->slotsH);
+			return id;
+		}
+	}
+
+	bufH = ItemBuild(name);
+	id = bufH ? ItemIDByRecord(dbase, bufH) : -1;
+	if (bufH) MemHandleFree(bufH);
+
+	// kept at most 3/4 full so probe sequences stay short, later names
+	// just aren't cached
+	if (id != -1 && dict->count < importDictSlots / 4 * 3) {
+		slots[s].hash = hash;
+		slots[s].id = id;
+		dict->count++;
+	}
+	MemHandleUnlock(dict->slotsH);
+	return id;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     RecipeResolve
+ *
+ * DESCRIPTION:  Looks up (or creates) the ingredients and units of a
+ *				 recipe being added or edited and collects its lines for
+ *				 RecipeBuild
+ *
+ * PARAMETERS:   ingredients, units, number of ingredients, amounts,
+ *				 true to resolve names through the import dictionaries,
+ *				 pointer to store the handle of the lines (NULL on error)
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err RecipeResolve(
+    const Char *ingredientNames[],
+    const Char *unitNames[],
+    UInt16 numIngredients,
+    const UInt8 counts[],
+    const UInt8 fracs[],
+    const UInt8 denoms[],
+    Boolean import,
+    MemHandle *linesH)
+{
+	RecipeLine *lines;
+	UInt16 i;
+	Err err = errNone;
+
+	*linesH = NULL;
+	if (numIngredients > recipeMaxIngredients)
+		return errRecipeMaxIngreds;
+
+	// one spare so a recipe without ingredients still gets a chunk
+	*linesH = MemHandleNew((numIngredients + 1) * sizeof(RecipeLine));
+	if (!*linesH)
+		return memErrNotEnoughSpace;
+	lines = MemHandleLock(*linesH);
+
+	for (i = 0; i < numIngredients && err == errNone; i++) {
+		if (import) {
+			lines[i].ingredientId = ImportResolve(&gImport.ingredients, gIngredientDB, ingredientNames[i]);
+			lines[i].unitId = ImportResolve(&gImport.units, gUnitDB, unitNames[i]);
+		} else {
+			lines[i].ingredientId = IngredientIDByName(ingredientNames[i]);
+			lines[i].unitId = UnitIDByName(unitNames[i]);
+		}
+		if (lines[i].ingredientId == -1 || lines[i].unitId == -1)
+			err = dmErrResourceNotFound;
+		lines[i].count = counts[i];
+		lines[i].frac = fracs[i];
+		lines[i].denom = denoms[i];
+		lines[i].reserved = 0;
+	}
+
+	MemHandleUnlock(*linesH);
+	if (err != errNone) {
+		MemHandleFree(*linesH);
+		*linesH = NULL;
+	}
+	return err;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     RecipeLines
+ *
+ * DESCRIPTION:  Copies the lines of a stored recipe out of its record
+ *
+ * PARAMETERS:   view over the record, pointer to store the handle of
+ *				 the lines
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err RecipeLines(RecipeView *recipe, MemHandle *linesH)
+{
+	RecipeLine *lines;
+	UInt8 i;
+
+	*linesH = MemHandleNew((recipe->numIngredients + 1) * sizeof(RecipeLine));
+	if (!*linesH)
+		return memErrNotEnoughSpace;
+	lines = MemHandleLock(*linesH);
+	for (i = 0; i < recipe->numIngredients; i++) {
+		lines[i].ingredientId = RecipeViewIngredientID(recipe, i);
+		lines[i].unitId = RecipeViewUnitID(recipe, i);
+		RecipeViewQuantity(recipe, i, &lines[i].count, &lines[i].frac, &lines[i].denom);
+		lines[i].reserved = 0;
+	}
+	MemHandleUnlock(*linesH);
+	return errNone;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     RecipeRepack
+ *
+ * DESCRIPTION:  Rewrites a layout 1 recipe in layout 2. Its name, IDs
+ *				 and text don't change, so its position, index postings,
+ *				 trigrams and makeable entry all stay valid
+ *
+ * PARAMETERS:   record index
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err RecipeRepack(UInt16 index)
+{
+	MemHandle recH = DmQueryRecord(gRecipeDB, index);
+	MemHandle linesH;
+	MemHandle bufH;
+	RecipeView recipe;
+	UInt32 size;
+	Err err;
+
+	if (!recH)
+		return dmErrRecordDeleted;
+	RecipeViewInit(&recipe, MemHandleLock(recH));
+	err = RecipeLines(&recipe, &linesH);
+	if (err != errNone) {
+		MemHandleUnlock(recH);
+		return err;
+	}
+	bufH = RecipeBuild(recipe.name, MemHandleLock(linesH), recipe.numIngredients, recipe.steps);
+	MemHandleUnlock(recH);
+	MemHandleUnlock(linesH);
+	MemHandleFree(linesH);
+	if (!bufH)
+		return memErrNotEnoughSpace;
+
+	size = MemHandleSize(bufH);
+	recH = DmResizeRecord(gRecipeDB, index, size);
+	if (recH) {
+		DmWrite(MemHandleLock(recH), 0, MemHandleLock(bufH), size);
+		MemHandleUnlock(bufH);
+		MemHandleUnlock(recH);
+	}
+	MemHandleFree(bufH);
+	return recH ? errNone : dmErrMemError;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     RecipeLayoutMigrate
+ *
+ * DESCRIPTION:  Repacks the layout 1 recipes of a gRecipeDB written by
+ *				 an older version (or by build_pdb.py --layout 1), a few
+ *				 at a time so opening a large database stays quick. The
+ *				 rest are read as they are until a later call, and the
+ *				 database is stamped once none are left
+ *
+ * PARAMETERS:   most recipes to repack
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err RecipeLayoutMigrate(UInt16 maxRepack)
+{
+	LocalID dbID;
+	MemHandle recH;
+	UInt16 numRecords = DmNumRecords(gRecipeDB);
+	UInt16 numTried = 0;
+	UInt16 cardNo;
+	UInt16 version;
+	UInt16 i;
+	UInt8 layout;
+	Boolean left = false;
+	Err err;
+
+	err = DmOpenDatabaseInfo(gRecipeDB, &dbID, NULL, NULL, &cardNo, NULL);
+	if (err == errNone)
+		err = DmDatabaseInfo(cardNo, dbID, NULL, NULL, &version, NULL, NULL,
+			NULL, NULL, NULL, NULL, NULL, NULL);
+	if (err != errNone || version >= recipeLayoutDBVersion)
+		return err;
+
+	for (i = 0; i < numRecords; i++) {
+		recH = DmQueryRecord(gRecipeDB, i);
+		if (!recH)
+			continue;
+		layout = ((RecipeHeader *)MemHandleLock(recH))->layout;
+		MemHandleUnlock(recH);
+		if (layout != recipeLayoutV1)
+			continue;
+		if (numTried == maxRepack) {
+			left = true;
+			break;
+		}
+
+		// a record that can't be repacked now is still readable as it is
+		numTried++;
+		if (RecipeRepack(i) != errNone)
+			left = true;
+	}
+	if (left)
+		return errNone;
+
+	version = recipeLayoutDBVersion;
+	return DmSetDatabaseInfo(cardNo, dbID, NULL, NULL, &version, NULL, NULL,
+		NULL, NULL, NULL, NULL, NULL, NULL);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     DatabaseFind
+ *
+ * DESCRIPTION:  Finds one of the app's databases, creating it if it is
+ *				 missing. The LocalID an earlier launch found is tried
+ *				 first, and only trusted while it still names the same
+ *				 database
+ *
+ * PARAMETERS:   slot (dbSlot...), pointer set to true if the database
+ *				 was created (left alone otherwise), or NULL
+ *
+ * RETURNED:     LocalID, or 0 if it could not be created
+ *
+ ***********************************************************************/
+static LocalID DatabaseFind(UInt16 slot, Boolean *createdP)
+{
+	const DatabaseSlot *db = &gDatabases[slot];
+	LocalID dbID = gDatabasePrefs.ids[slot];
+	Char name[dmDBNameLength];
+	UInt32 creator;
+
+	if (dbID && DmDatabaseInfo(0, dbID, name, NULL, NULL, NULL, NULL, NULL,
+			NULL, NULL, NULL, NULL, &creator) == errNone &&
+			creator == databaseCreatorID && StrCompare(name, db->name) == 0)
+		return dbID;
+
+	dbID = DmFindDatabase(0, db->name);
+	if (!dbID) {
+		DmCreateDatabase(0, db->name, databaseCreatorID, db->type, false);
+		dbID = DmFindDatabase(0, db->name);
+		if (dbID && createdP)
+			*createdP = true;
+	}
+	if (dbID != gDatabasePrefs.ids[slot]) {
+		gDatabasePrefs.ids[slot] = dbID;
+		gDatabasePrefsDirty = true;
+	}
+	return dbID;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     DatabaseOpenSlot
+ *
+ * DESCRIPTION:  Opens one of the app's databases read-write into its
+ *				 global, see DatabaseFind
+ *
+ * PARAMETERS:   slot (dbSlot...), pointer set to true if the database
+ *				 was created, or NULL
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err DatabaseOpenSlot(UInt16 slot, Boolean *createdP)
+{
+	DmOpenRef *refP = gDatabases[slot].refP;
+	LocalID dbID = DatabaseFind(slot, createdP);
+
+	if (!dbID)
+		return dmErrCantOpen;
+	*refP = DmOpenDatabase(0, dbID, dmModeReadWrite);
+	return *refP ? errNone : DmGetLastErr();
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     RecipeSetOpen
+ *
+ * DESCRIPTION:  Opens dbSetRecipes: gRecipeDB, with its tombstone count
+ *				 and ID map restored from the last DatabaseClose when
+ *				 nothing has changed it since (otherwise QMCatalog is
+ *				 marked stale)
+ *
+ * PARAMETERS:   nothing
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err RecipeSetOpen()
+{
+	Err err;
+
+	if (gOpenSets & dbSetRecipes)
+		return errNone;
+
+	err = DatabaseOpenSlot(dbSlotRecipe, NULL);
+	if (err != errNone)
+		return err;
+
+	if (!CacheRestore(gRecipeDB)) {
+		LiveCountDeleted(gRecipeDB);
+		IDMapRebuild(&gRecipeMap, gRecipeDB);
+		gCatalogStale = true;
+	}
+	err = RecipeKeyMigrate();
+	if (err != errNone)
+		return err;
+
+	gOpenSets |= dbSetRecipes;
+	return errNone;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     ListSetOpen
+ *
+ * DESCRIPTION:  Opens dbSetLists: gPantryDB and gGroceryDB
+ *
+ * PARAMETERS:   nothing
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err ListSetOpen()
+{
+	Err err;
+
+	if (gOpenSets & dbSetLists)
+		return errNone;
+
+	err = DatabaseOpenSlot(dbSlotPantry, NULL);
+	if (err == errNone)
+		err = DatabaseOpenSlot(dbSlotGrocery, NULL);
+	if (err == errNone)
+		err = MembershipMigrate(gPantryDB);
+	if (err == errNone)
+		err = MembershipMigrate(gGroceryDB);
+	if (err == errNone)
+		err = GroceryMigrate();
+	if (err != errNone)
+		return err;
+
+	gOpenSets |= dbSetLists;
+	return errNone;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     ItemSetOpen
+ *
+ * DESCRIPTION:  Opens dbSetItems: gIngredientDB and gUnitDB, with their
+ *				 ID maps and ref tables, and repacks some of the layout 1
+ *				 recipes now their refs can be given out. Sets gRecount if
+ *				 a migration left use counts to redo
+ *
+ * PARAMETERS:   nothing
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err ItemSetOpen()
+{
+	Boolean warmIngredients;
+	Boolean warmUnits;
+	Err err;
+
+	if (gOpenSets & dbSetItems)
+		return errNone;
+	if (gItemsOpening)
+		return dmErrDatabaseOpen; // a migration below must not need the set
+
+	err = RecipeSetOpen();
+	if (err == errNone)
+		err = DatabaseOpenSlot(dbSlotIngredient, NULL);
+	if (err == errNone)
+		err = DatabaseOpenSlot(dbSlotUnit, NULL);
+	if (err != errNone)
+		return err;
+
+	warmIngredients = CacheRestore(gIngredientDB);
+	warmUnits = CacheRestore(gUnitDB);
+	gItemsOpening = true;
+	if (!warmIngredients) {
+		LiveCountDeleted(gIngredientDB);
+		IDMapRebuild(&gIngredientMap, gIngredientDB);
+	}
+	if (!warmUnits) {
+		LiveCountDeleted(gUnitDB);
+		IDMapRebuild(&gUnitMap, gUnitDB);
+	}
+
+	err = UseCountMigrate(gIngredientDB, &gRecount);
+	if (err == errNone)
+		err = UseCountMigrate(gUnitDB, &gRecount);
+	if (err == errNone)
+		err = SortKeyMigrate(gIngredientDB, &gRecount);
+	if (err == errNone)
+		err = SortKeyMigrate(gUnitDB, &gRecount);
+	if (err == errNone)
+		err = RefMigrate(gIngredientDB);
+	if (err == errNone)
+		err = RefMigrate(gUnitDB);
+	if (err == errNone && !warmIngredients)
+		err = RefTableBuild(gIngredientDB);
+	if (err == errNone && !warmUnits)
+		err = RefTableBuild(gUnitDB);
+	if (err == errNone)
+		err = RecipeLayoutMigrate(recipeRepackPerOpen);
+	gItemsOpening = false;
+	if (err != errNone)
+		return err;
+
+	gOpenSets |= dbSetItems;
+	return errNone;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     CatalogSetOpen
+ *
+ * DESCRIPTION:  Opens dbSetCatalog: QMCatalog, after dbSetRecipes. It is
+ *				 derived from the recipes, and rebuilt (with dbSetItems
+ *				 open for the ingredient refs) unless it matched gRecipeDB
+ *				 at the last DatabaseClose and neither has changed since
+ *
+ * PARAMETERS:   nothing
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err CatalogSetOpen()
+{
+	Boolean created = false;
+	UInt16 version = 0;
+	LocalID dbID;
+	Err err;
+
+	if (gOpenSets & dbSetCatalog)
+		return errNone;
+
+	err = RecipeSetOpen();
+	if (err == errNone)
+		err = DatabaseOpenSlot(dbSlotCatalog, &created);
+	if (err != errNone)
+		return err;
+
+	DmOpenDatabaseInfo(gCatalogDB, &dbID, NULL, NULL, NULL, NULL);
+	DmDatabaseInfo(0, dbID, NULL, NULL, &version, NULL, NULL, NULL,
+		NULL, NULL, NULL, NULL, NULL);
+	if (created || gCatalogStale || version != catalogDBVersion ||
+			DmNumRecords(gCatalogDB) != DmNumRecords(gRecipeDB)) {
+		err = ItemSetOpen();
+		if (err == errNone)
+			err = CatalogRebuild();
+		if (err != errNone)
+			return err;
+	}
+
+	gCatalogStale = false;
+	gOpenSets |= dbSetCatalog;
+	return errNone;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     IndexSetOpen
+ *
+ * DESCRIPTION:  Opens dbSetIndexes: the recipe and trigram indexes and
+ *				 the makeable recipe lists, rebuilding any that are
+ *				 missing or out of date. All of them are derived from
+ *				 the other sets, which are opened first
+ *
+ * PARAMETERS:   nothing
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+static Err IndexSetOpen()
+{
+	Boolean created = false;
+	Boolean rebuild = false;
+	UInt16 version;
+	LocalID dbID;
+	Err err;
+
+	if (gOpenSets & dbSetIndexes)
+		return errNone;
+
+	err = ListSetOpen();
+	if (err == errNone)
+		err = ItemSetOpen();
+	if (err == errNone)
+		err = CatalogSetOpen();
+	if (err == errNone)
+		err = DatabaseOpenSlot(dbSlotIndex, &created);
+	if (err != errNone)
+		return err;
+
+	// The index is derived data, so it is rebuilt whenever it is missing
+	// (first launch, or recipes installed without it). Rebuilding it also
+	// recounts ingredient and unit uses
+	if (created || gRecount || (DmNumRecords(gIndexDB) == 0 && DmNumRecords(gRecipeDB) > 0)) {
+		err = IndexRebuild();
+		if (err != errNone)
+			return err;
+		gRecount = false;
+		rebuild = true;
+	}
+
+	err = DatabaseOpenSlot(dbSlotTrigram, NULL);
+	if (err != errNone)
+		return err;
+
+	// Also derived from the recipes, versioned so older layouts are redone
+	version = 0;
+	DmOpenDatabaseInfo(gTrigramDB, &dbID, NULL, NULL, NULL, NULL);
+	DmDatabaseInfo(0, dbID, NULL, NULL, &version, NULL, NULL, NULL,
+		NULL, NULL, NULL, NULL, NULL);
+	if (version != trigramDBVersion ||
+			(DmNumRecords(gTrigramDB) == 0 && LiveRecordCount(gRecipeDB) > 0)) {
+		err = TrigramRebuild();
+		if (err != errNone)
+			return err;
+	}
+
+	err = DatabaseOpenSlot(dbSlotMakeable, &rebuild);
+	if (err != errNone)
+		return err;
+
+	// Makeable recipe lists are derived from the recipes, index and pantry
+	version = 0;
+	DmOpenDatabaseInfo(gMakeableDB, &dbID, NULL, NULL, NULL, NULL);
+	DmDatabaseInfo(0, dbID, NULL, NULL, &version, NULL, NULL, NULL,
+		NULL, NULL, NULL, NULL, NULL);
+	if (rebuild || version != makeableDBVersion || DmNumRecords(gMakeableDB) != makeableNumRecs) {
+		err = MakeableRebuild();
+		if (err != errNone)
+			return err;
+	}
+
+	gOpenSets |= dbSetIndexes;
+	return errNone;
+}
+
+/*********************************************************************
+ * External Functions
+ *********************************************************************/
+ 
+ /*********************************************************************
+ * General DB Functions
+ *********************************************************************/
+
+/***********************************************************************
+ *
+ * FUNCTION:     DatabaseOpen
+ *
+ * DESCRIPTION:  Opens the Recipe database and its catalog, which is all
+ *				 the recipe list needs to draw. The others are opened by
+ *				 DatabaseRequire when a form or function first needs them
+ *
+ * PARAMETERS:   nothing
+ *
+ * RETURNED:     errNone or dmErrCantOpen
+ *
+ ***********************************************************************/
+Err DatabaseOpen() {
+    UInt16 size = sizeof(gDatabasePrefs);
+    Err err;
+
+    MemSet(&gDatabasePrefs, sizeof(gDatabasePrefs), 0);
+    if (PrefGetAppPreferences(databaseCreatorID, appDatabasePrefID, &gDatabasePrefs,
+            &size, false) != appPrefVersionNum || size != sizeof(gDatabasePrefs))
+        MemSet(&gDatabasePrefs, sizeof(gDatabasePrefs), 0);
+    gDatabasePrefsDirty = false;
+    gOpenSets = 0;
+    gRecount = false;
+    gCatalogStale = false;
+
+    err = RecipeSetOpen();
+    if (err == errNone)
+        err = CatalogSetOpen();
+    return err;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     DatabaseRequire
+ *
+ * DESCRIPTION:  Opens the database sets a form or function needs, with
+ *				 the sets they are built from, if they are not open yet.
+ *				 Record indexes held by callers stay valid
+ *
+ * PARAMETERS:   dbSet flags
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+Err DatabaseRequire(UInt16 sets) {
+    Err err = errNone;
+
+    // counts left to redo by a migration are not put off until later
+    if ((gOpenSets & sets) == sets && !gRecount)
+        return errNone;
+
+    if (sets & dbSetRecipes)
+        err = RecipeSetOpen();
+    if (err == errNone && (sets & dbSetCatalog))
+        err = CatalogSetOpen();
+    if (err == errNone && (sets & dbSetLists))
+        err = ListSetOpen();
+    if (err == errNone && (sets & dbSetItems))
+        err = ItemSetOpen();
+    if (err == errNone && ((sets & dbSetIndexes) || gRecount))
+        err = IndexSetOpen();
+    return err;
+}
+
+
+/***********************************************************************
+ *
+ * FUNCTION:     DatabaseClose
+ *
+ * DESCRIPTION:  Packs away tombstones, saves what DatabaseOpen would
+ *				 otherwise rebuild (see CacheSave) and the LocalIDs it
+ *				 found, and closes all open databases
+ *
+ * PARAMETERS:   nothing
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+void DatabaseClose() {
+    UInt16 i;
+
+    DatabaseCompact();
+    if (gRecipeDB)     CacheSave(gRecipeDB);
+    if (gIngredientDB) CacheSave(gIngredientDB);
+    if (gUnitDB)       CacheSave(gUnitDB);
+    if (gRecipeDB)     DmCloseDatabase(gRecipeDB);
+    if (gIngredientDB) DmCloseDatabase(gIngredientDB);
+    if (gUnitDB)       DmCloseDatabase(gUnitDB);
+    if (gPantryDB)	   DmCloseDatabase(gPantryDB);
+    if (gGroceryDB)    DmCloseDatabase(gGroceryDB);
+    if (gIndexDB)      DmCloseDatabase(gIndexDB);
+    if (gMakeableDB)   DmCloseDatabase(gMakeableDB);
+    if (gTrigramDB)    DmCloseDatabase(gTrigramDB);
+    if (gCatalogDB)    DmCloseDatabase(gCatalogDB);
+    MaskInvalidate();
+    IDMapFree(&gRecipeMap);
+    IDMapFree(&gIngredientMap);
+    IDMapFree(&gUnitMap);
+    RefTableFree(&gIngredientRefs);
+    RefTableFree(&gUnitRefs);
+    LiveInvalidate(gRecipeDB);
+    LiveInvalidate(gIngredientDB);
+    LiveInvalidate(gUnitDB);
+    NameOrderInvalidate(gPantryDB);
+    NameOrderInvalidate(gGroceryDB);
+    MemSet(&gRecipeLive, sizeof(gRecipeLive), 0);
+    MemSet(&gIngredientLive, sizeof(gIngredientLive), 0);
+    MemSet(&gUnitLive, sizeof(gUnitLive), 0);
+    for (i = 0; i < dbNumSlots; i++)
+        *gDatabases[i].refP = NULL;
+    gOpenSets = 0;
+    gRecount = false;
+    gCatalogStale = false;
+
+    if (gDatabasePrefsDirty)
+        PrefSetAppPreferences(databaseCreatorID, appDatabasePrefID, appPrefVersionNum,
+            &gDatabasePrefs, sizeof(gDatabasePrefs), false);
+    gDatabasePrefsDirty = false;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     DatabaseCompact
+ *
+ * DESCRIPTION:  Removes the tombstones left by deleted recipes,
+ *				 ingredients and units. Record indexes change, so any
+ *				 held by callers must be dropped (IDs stay valid)
+ *
+ * PARAMETERS:   nothing
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+Err DatabaseCompact() {
+    Err err = errNone;
+
+    if (gRecipeLive.numDeleted > 0) {
+        err = LiveCompact(gRecipeDB, (DmComparF *) CompareRecipeNames);
+        MaskInvalidate();
+        if (err == errNone && gCatalogDB)
+            err = CatalogSort();
+    }
+    // removed ingredients and units give their refs back
+    if (err == errNone && gIngredientLive.numDeleted > 0) {
+        err = LiveCompact(gIngredientDB, (DmComparF *) CompareItemKeys);
+        NameOrderInvalidate(gPantryDB);
+        NameOrderInvalidate(gGroceryDB);
+        if (err == errNone)
+            err = RefTableBuild(gIngredientDB);
+    }
+    if (err == errNone && gUnitLive.numDeleted > 0) {
+        err = LiveCompact(gUnitDB, (DmComparF *) CompareItemKeys);
+        if (err == errNone)
+            err = RefTableBuild(gUnitDB);
+    }
+
+    return err;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     LiveRecordCount
+ *
+ * DESCRIPTION:  Number of records in a database, not counting tombstones
+ *
+ * PARAMETERS:   database
+ *
+ * RETURNED:     number of live records
+ *
+ ***********************************************************************/
+UInt16 LiveRecordCount(DmOpenRef dbase)
+{
+	LiveOrder *live = LiveFor(dbase);
+
+	if (!dbase)
+		return 0;
+	return DmNumRecords(dbase) - (live ? live->numDeleted : 0);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     LiveRecordIndex
+ *
+ * DESCRIPTION:  Converts a position among the live records of a database
+ *				 (as shown in lists) into a record index, skipping
+ *				 tombstones
+ *
+ * PARAMETERS:   database, position
+ *
+ * RETURNED:     record index, or 0xFFFF if position is invalid
+ *
+ ***********************************************************************/
+UInt16 LiveRecordIndex(DmOpenRef dbase, UInt16 position)
+{
+	LiveOrder *live = LiveFor(dbase);
+	UInt16 numRecords = DmNumRecords(dbase);
+	UInt16 *order;
+	UInt16 index = 0xFFFF;
+	UInt16 i;
+	UInt16 n = 0;
+
+	if (!live || live->numDeleted == 0)
+		return (position < numRecords) ? position : 0xFFFF;
+	if (position >= numRecords - live->numDeleted)
+		return 0xFFFF;
+
+	if (!live->orderH) {
+		live->orderH = MemHandleNew((numRecords - live->numDeleted) * sizeof(UInt16));
+		if (!live->orderH)
+			return 0xFFFF;
+		order = MemHandleLock(live->orderH);
+		for (i = 0; i < numRecords && n < numRecords - live->numDeleted; i++) {
+			if (DmQueryRecord(dbase, i))
+				order[n++] = i;
+		}
+		MemHandleUnlock(live->orderH);
+	}
+
+	order = MemHandleLock(live->orderH);
+	index = order[position];
+	MemHandleUnlock(live->orderH);
+	return index;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     IDFromIndex
+ *
+ * DESCRIPTION:  Utility function to convert between index and entry ID
+ *
+ * PARAMETERS:   database, index
+ *
+ * RETURNED:     id (or 0 if index is invalid)
+ *
+ ***********************************************************************/
+UInt32 IDFromIndex(DmOpenRef dbase, UInt16 index)
+{
+    UInt32 id = 0;
+    Err err;
+    err = DmRecordInfo(dbase, index, NULL, &id, NULL);
+
+    if (err != errNone)
+        return 0;
+
+    return id;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     IndexFromID
+ *
+ * DESCRIPTION:  Utility function to convert between index and entry ID
+ *				 (O(1) for gRecipeDB, gIngredientDB and gUnitDB)
+ *
+ * PARAMETERS:   database, id
+ *
+ * RETURNED:     index (or 0xFFFF if index is invalid)
+ *
+ ***********************************************************************/
+UInt16 IndexFromID(DmOpenRef dbase, UInt32 id)
+{
+    IDMap *map = IDMapFor(dbase);
+    UInt16 index = 0xFFFF;
+    UInt16 attr;
+    Err err;
+
+    // Recipes, ingredients and units go through their ID map. An index that no
+    // longer holds the ID means the map is stale, so it is rebuilt once
+    if (map && map->slotsH) {
+        index = IDMapLookup(map, id);
+        if (index != 0xFFFF && IDFromIndex(dbase, index) != id) {
+            IDMapRebuild(map, dbase);
+            index = map->slotsH ? IDMapLookup(map, id) : 0xFFFF;
+        }
+        if (index != 0xFFFF)
+            map->stats.hits++;
+        else
+            map->stats.misses++;
+        if (map->slotsH)
+            return index;
+    }
+
+    err = DmFindRecordByID(dbase, id, &index);
+
+    if (err != errNone)
+        return 0xFFFF;
+
+    // tombstones keep their unique ID
+    if (DmRecordInfo(dbase, index, &attr, NULL, NULL) != errNone || (attr & dmRecAttrDelete))
+        return 0xFFFF;
+
+    return index;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     IDMapGetStats
+ *
+ * DESCRIPTION:  Reports lookup hits/misses and rebuild count and time
+ *				 (in ticks) of the ID map kept for a database
+ *
+ * PARAMETERS:   gRecipeDB, gIngredientDB or gUnitDB, pointer to store
+ *				 counters
+ *
+ * RETURNED:     errNone, or dmErrInvalidParam for other databases
+ *
+ ***********************************************************************/
+Err IDMapGetStats(DmOpenRef dbase, IDMapStats *stats)
+{
+	IDMap *map = IDMapFor(dbase);
+
+	if (!map || !stats)
+		return dmErrInvalidParam;
+
+	*stats = map->stats;
+	return errNone;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     UseCount
+ *
+ * DESCRIPTION:  Number of recipes that use an ingredient or unit, as
+ *				 stored in its record (no recipes are read)
+ *
+ * PARAMETERS:   gIngredientDB or gUnitDB, item ID
+ *
+ * RETURNED:     use count, 0 if the ID isn't found
+ *
+ ***********************************************************************/
+UInt16 UseCount(DmOpenRef dbase, UInt32 id)
+{
+	UInt16 index = IndexFromID(dbase, id);
+
+	if (index == 0xFFFF)
+		return 0;
+	return UseCountRead(dbase, index);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     AddIdToDatabase
+ *
+ * DESCRIPTION:  Checks if an identical entry already exists.
+ *				 If not, creates new database entry consisting of id
+ *
+ * PARAMETERS:   database, id
+ *
+ * RETURNED:     errNone if either entry is found or entry creation succeeds
+ *
+ ***********************************************************************/
+Err AddIdToDatabase(DmOpenRef dbase, UInt32 id)
+{
+    UInt16 index;
+    UInt32 size;
+    Err err;
+    MemHandle recH;
+    UInt32 *recP;
+
+    if (!dbase)
+        return dmErrInvalidParam;
+    // the makeable lists follow the pantry
+    if (dbase == gPantryDB && DatabaseRequire(dbSetIndexes) != errNone)
+        return dmErrCantOpen;
+
+    index = DmFindSortPosition(dbase, &id, 0, (DmComparF *) DBIntCompare, 0);
 
 	if (index > 0) {
 		recH = DmQueryRecord(dbase, index - 1);
@@ -368,100 +5380,451 @@ Err AddIdToDatabase(DmOpenRef dbase, UInt32 id)
 		recP = NULL, recH = NULL;
 	}
 
-    recH = DmNewRecord(dbase, &index, sizeof(UInt32));
+    // grocery entries added by hand have no amounts
+    size = (dbase == gGroceryDB) ? sizeof(GroceryHeader) : sizeof(UInt32);
+    recH = DmNewRecord(dbase, &index, size);
     if (!recH)
         return dmErrMemError;
-	recP = MemHandleLock(recH);
-	DmWrite(recP, 0, &id, sizeof(UInt32));
+    recP = MemHandleLock(recH);
+    DmSet(recP, 0, size, 0);
+    DmWrite(recP, 0, &id, sizeof(UInt32));
     MemHandleUnlock(recH);
 
     err = DmReleaseRecord(dbase, index, true);
+    NameOrderInvalidate(dbase);
+    if (err == errNone && dbase == gPantryDB)
+        err = MakeablePantryChanged(id, true);
+
+    return err;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     EntryInDatabase
+ *
+ * DESCRIPTION:  Checks if an entry already exists.
+ *
+ * PARAMETERS:   database, entry (id)
+ *
+ * RETURNED:     boolean
+ *
+ ***********************************************************************/
+Boolean EntryInDatabase(DmOpenRef dbase, UInt32 id)
+{
+    UInt16 index;
+    MemHandle recH;
+    UInt32 *recP;
+
+    if (!dbase)
+        return false;
+
+    index = DmFindSortPosition(dbase, &id, 0, (DmComparF *) DBIntCompare, 0);
+
+	if (index > 0) {
+		recH = DmQueryRecord(dbase, index - 1);
+		recP = MemHandleLock(recH);
+		
+		if (*recP == id) {
+			MemHandleUnlock(recH);
+			return true; 
+		}
+		MemHandleUnlock(recH);
+	}
+
+	return false;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     IndexOfEntry
+ *
+ * DESCRIPTION:  IDInDatabase but it returns the index instead of a boolean
+ *
+ * PARAMETERS:   database, entry (id)
+ *
+ * RETURNED:     UInt16 index or 0xFFFF if not exists
+ *
+ ***********************************************************************/
+UInt16 IndexOfEntry(DmOpenRef dbase, UInt32 id)
+{
+    UInt16 index;
+    MemHandle recH;
+    UInt32 *recP;
+
+    if (!dbase)
+        return false;
+
+    index = DmFindSortPosition(dbase, &id, 0, (DmComparF *) DBIntCompare, 0);
+
+	if (index > 0) {
+		recH = DmQueryRecord(dbase, index - 1);
+		recP = MemHandleLock(recH);
+		
+		if (*recP == id) {
+			MemHandleUnlock(recH);
+			return index - 1; 
+		}
+		MemHandleUnlock(recH);
+	}
+
+	return 0xFFFF;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     RemoveEntry
+ *
+ * DESCRIPTION:  Removes an entry from the pantry or grocery database
+ *
+ * PARAMETERS:   database, record index
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+Err RemoveEntry(DmOpenRef dbase, UInt16 index)
+{
+	UInt32 id = 0;
+	MemHandle recH;
+	Err err;
+
+	// the makeable lists follow the pantry
+	if (dbase == gPantryDB && DatabaseRequire(dbSetIndexes) != errNone)
+		return dmErrCantOpen;
+	if (dbase == gPantryDB && (recH = DmQueryRecord(dbase, index)) != NULL) {
+		id = *(UInt32 *)MemHandleLock(recH);
+		MemHandleUnlock(recH);
+	}
+
+	err = DmRemoveRecord(dbase, index);
+	NameOrderInvalidate(dbase);
+	if (err == errNone && id)
+		err = MakeablePantryChanged(id, false);
+	return err;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     NameOrderIndex
+ *
+ * DESCRIPTION:  Pantry and grocery databases are sorted by ID for lookups.
+ *				 Converts a position in ingredient name order (as shown
+ *				 in their lists) into a record index
+ *
+ * PARAMETERS:   database, position in name order
+ *
+ * RETURNED:     record index, or 0xFFFF if position is invalid
+ *
+ ***********************************************************************/
+UInt16 NameOrderIndex(DmOpenRef dbase, UInt16 position)
+{
+	MemHandle *slot = NameOrderSlot(dbase);
+	UInt16 *order;
+	UInt16 index = 0xFFFF;
+
+	if (!*slot)
+		*slot = NameOrderBuild(dbase);
+	if (!*slot)
+		return 0xFFFF;
+
+	if (position < MemHandleSize(*slot) / sizeof(UInt16)) {
+		order = MemHandleLock(*slot);
+		index = order[position];
+		MemHandleUnlock(*slot);
+	}
+	return index;
+}
+
+
+/*********************************************************************
+ * Recipe DB Functions
+ *********************************************************************/
+
+/***********************************************************************
+ *
+ * FUNCTION:     AddRecipe
+ *
+ * DESCRIPTION:  Adds new recipe to database
+ *
+ * PARAMETERS:   Name, ingredients, units, amounts, number of ingredients
+ *				 and steps of recipe
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+Err AddRecipe(
+    const Char *recipeName,
+    const Char *ingredientNames[],
+    const Char *unitNames[],
+    UInt16 numIngredients,
+    const UInt8 counts[],
+    const UInt8 fracs[],
+    const UInt8 denoms[],
+    const Char *recipeSteps)
+{
+	MemHandle bufH;
+	MemHandle linesH;
+	UInt16 recordIndex;
+    Err err;
+    
+    err = DatabaseRequire(dbSetAll);
+    if (err != errNone) return err;
 
-    return err;
+    err = RecipeResolve(ingredientNames, unitNames, numIngredients,
+    	counts, fracs, denoms, false, &linesH);
+    if (err != errNone) return err;
+	
+	bufH = RecipeBuild(recipeName, MemHandleLock(linesH), numIngredients, recipeSteps);
+	MemHandleUnlock(linesH);
+	MemHandleFree(linesH);
+	if (!bufH) return memErrNotEnoughSpace;
+	
+	// the built record starts with its RecipeHeader, so it is its own sort
+	// key; the catalog is in the same order and quicker to probe
+	if (FindSorted(gCatalogDB, MemHandleLock(bufH), (DmComparF *) CompareRecipeNames, &recordIndex))
+		recordIndex++;
+	MemHandleUnlock(bufH);
+	
+	err = RecipeStore(bufH, &recordIndex);
+	MemHandleFree(bufH);
+	if (err != errNone) return err;
+	
+	MaskInvalidate();
+	IDMapInsert(gRecipeDB, IDFromIndex(gRecipeDB, recordIndex), recordIndex);
+	err = IndexRecipe(recordIndex);
+	if (err == errNone)
+		err = TrigramIndexRecipe(recordIndex);
+	if (err == errNone)
+		err = MakeableAddRecipe(recordIndex);
+	
+	return err;
 }
 
 /***********************************************************************
  *
- * FUNCTION:     EntryInDatabase
+ * FUNCTION:     UpdateRecipe
  *
- * DESCRIPTION:  Checks if an entry already exists.
+ * DESCRIPTION:  Replaces a recipe in place, keeping its unique ID. The
+ *				 record only moves if its name now sorts elsewhere, and
+ *				 only ingredients and units the edit added or dropped are
+ *				 reindexed (dropped ones no recipe uses are removed, as
+ *				 in RemoveRecipe)
  *
- * PARAMETERS:   database, entry (id)
+ * PARAMETERS:   Index of recipe, then name, ingredients, units, amounts,
+ *				 number of ingredients and steps as for AddRecipe
  *
- * RETURNED:     boolean
+ * RETURNED:     Err
  *
  ***********************************************************************/
-Boolean EntryInDatabase(DmOpenRef dbase, UInt32 id)
+Err UpdateRecipe(
+    UInt16 recipeIndex,
+    const Char *recipeName,
+    const Char *ingredientNames[],
+    const Char *unitNames[],
+    UInt16 numIngredients,
+    const UInt8 counts[],
+    const UInt8 fracs[],
+    const UInt8 denoms[],
+    const Char *recipeSteps)
 {
-    UInt16 index;
-    MemHandle recH;
-    UInt32 *recP;
+	MemHandle bufH;
+	MemHandle recH;
+	MemHandle linesH;
+	MemHandle oldLinesH;
+	RecipeView recipe;
+	RecipeLine *lines;
+	RecipeLine *oldLines;
+	MemPtr recP;
+	void *keyP;
+	UInt32 recipeId;
+	UInt32 size;
+	UInt16 oldNumIngredients;
+	UInt16 newIndex;
+	UInt16 index;
+	UInt16 i;
+	Boolean changed = false;
+	MemHandle oldTrigramsH = NULL;
+	MemHandle newTrigramsH = NULL;
+	UInt16 numOldTrigrams = 0;
+	UInt16 numNewTrigrams = 0;
+	Err err;
 
-    if (!dbase)
-        return false;
+	err = DatabaseRequire(dbSetAll);
+	if (err != errNone)
+		return err;
+	if (numIngredients > recipeMaxIngredients)
+		return errRecipeMaxIngreds;
 
-    index = DmFindSortPosition(dbase, &id, 0, (DmComparF *) DBIngredientIDCompare, 0);
+	recH = DmQueryRecord(gRecipeDB, recipeIndex);
+	if (!recH) return dmErrRecordDeleted;
+	recipeId = IDFromIndex(gRecipeDB, recipeIndex);
 
-	if (index > 0) {
-		recH = DmQueryRecord(dbase, index - 1);
+	RecipeViewInit(&recipe, MemHandleLock(recH));
+	oldNumIngredients = recipe.numIngredients;
+	err = RecipeLines(&recipe, &oldLinesH);
+	MemHandleUnlock(recH);
+	if (err != errNone) return err;
+
+	// nothing is removed yet, so items the recipe keeps resolve to the same IDs
+	err = RecipeResolve(ingredientNames, unitNames, numIngredients,
+		counts, fracs, denoms, false, &linesH);
+	if (err != errNone) {
+		MemHandleFree(oldLinesH);
+		return err;
+	}
+	lines = MemHandleLock(linesH);
+	oldLines = MemHandleLock(oldLinesH);
+
+	bufH = RecipeBuild(recipeName, lines, numIngredients, recipeSteps);
+	if (!bufH) {
+		err = memErrNotEnoughSpace;
+		goto done;
+	}
+	size = MemHandleSize(bufH);
+
+	// the catalog is still in order of the old name, so FindSorted works
+	// before the record is rewritten
+	newIndex = recipeIndex;
+	keyP = MemHandleLock(bufH);
+	if (!SortedAt(gCatalogDB, recipeIndex, keyP, (DmComparF *) CompareRecipeNames) &&
+			FindSorted(gCatalogDB, keyP, (DmComparF *) CompareRecipeNames, &newIndex))
+		newIndex++;
+
+	// trigrams of the text before and after the edit, see TrigramUpdate
+	err = TrigramCollect(keyP, &newTrigramsH, &numNewTrigrams);
+	MemHandleUnlock(bufH);
+	if (err == errNone) {
+		err = TrigramCollect(MemHandleLock(recH), &oldTrigramsH, &numOldTrigrams);
+		MemHandleUnlock(recH);
+	}
+
+	if (err == errNone) {
+		recH = DmResizeRecord(gRecipeDB, recipeIndex, size);
+		if (!recH) err = dmErrMemError;
+	}
+	if (err == errNone) {
 		recP = MemHandleLock(recH);
-		
-		if (*recP == id) {
-			MemHandleUnlock(recH);
-			return true; 
-		}
+		DmWrite(recP, 0, MemHandleLock(bufH), size);
+		MemHandleUnlock(bufH);
+		// the catalog follows the record, or is rebuilt from the recipes
+		if (CatalogWrite(recipeIndex, recP, false) != errNone)
+			err = CatalogRebuild();
 		MemHandleUnlock(recH);
 	}
+	if (err == errNone)
+		err = TrigramUpdate(recipeId, oldTrigramsH, numOldTrigrams, newTrigramsH, numNewTrigrams);
+	MemHandleFree(bufH);
+	if (oldTrigramsH) MemHandleFree(oldTrigramsH);
+	if (newTrigramsH) MemHandleFree(newTrigramsH);
+	if (err != errNone) goto done;
 
-	return false;
+	if (newIndex != recipeIndex && newIndex != recipeIndex + 1) {
+		err = DmMoveRecord(gRecipeDB, recipeIndex, newIndex);
+		if (err != errNone) goto done;
+		if (DmMoveRecord(gCatalogDB, recipeIndex, newIndex) != errNone)
+			err = CatalogRebuild();
+		if (newIndex > recipeIndex)
+			newIndex--;
+		IDMapMove(gRecipeDB, recipeId, recipeIndex, newIndex);
+		LiveInvalidate(gRecipeDB);
+		changed = true;
+		if (err != errNone) goto done;
+	} else {
+		newIndex = recipeIndex;
+	}
+
+	for (i = 0; i < oldNumIngredients; i++) {
+		if (!LinesHaveID(lines, numIngredients, false, oldLines[i].ingredientId)) {
+			PostingRemove(postingKindIngredient, oldLines[i].ingredientId, recipeId);
+			changed = true;
+		}
+		if (!LinesHaveID(lines, numIngredients, true, oldLines[i].unitId))
+			PostingRemove(postingKindUnit, oldLines[i].unitId, recipeId);
+	}
+	for (i = 0; i < numIngredients; i++) {
+		if (!LinesHaveID(oldLines, oldNumIngredients, false, lines[i].ingredientId)) {
+			err = PostingAdd(postingKindIngredient, lines[i].ingredientId, recipeId);
+			if (err != errNone) goto done;
+			changed = true;
+		}
+		if (!LinesHaveID(oldLines, oldNumIngredients, true, lines[i].unitId)) {
+			err = PostingAdd(postingKindUnit, lines[i].unitId, recipeId);
+			if (err != errNone) goto done;
+		}
+	}
+
+	// masks are by record index and ingredient, makeable counts by ingredient
+	if (changed) {
+		MaskInvalidate();
+		err = MakeableRemoveRecipe(recipeId);
+		if (err == errNone)
+			err = MakeableAddRecipe(newIndex);
+		if (err != errNone) goto done;
+	}
+
+	for (i = 0; i < oldNumIngredients; i++) {
+		if (!FindIfUsed(postingKindIngredient, oldLines[i].ingredientId))
+			RemoveIngredient(oldLines[i].ingredientId);
+		if (!FindIfUsed(postingKindUnit, oldLines[i].unitId)) {
+			index = IndexFromID(gUnitDB, oldLines[i].unitId);
+			if (index != 0xFFFF)
+				DeleteRecord(gUnitDB, index, oldLines[i].unitId);
+		}
+	}
+
+done:
+	MemHandleUnlock(linesH);
+	MemHandleUnlock(oldLinesH);
+	MemHandleFree(linesH);
+	MemHandleFree(oldLinesH);
+	return err;
 }
 
 /***********************************************************************
  *
- * FUNCTION:     IndexOfEntry
+ * FUNCTION:     ImportBegin
  *
- * DESCRIPTION:  IDInDatabase but it returns the index instead of a boolean
+ * DESCRIPTION:  Starts a bulk import. Recipes passed to ImportRecipe are
+ *				 appended unsorted and names are resolved through an
+ *				 in-memory dictionary; ImportEnd sorts once and rebuilds
+ *				 the search data. Use instead of AddRecipe for many recipes
  *
- * PARAMETERS:   database, entry (id)
+ * PARAMETERS:   nothing
  *
- * RETURNED:     UInt16 index or 0xFFFF if not exists
+ * RETURNED:     errNone, dmErrInvalidParam if an import is already
+ *				 running, or memErrNotEnoughSpace
  *
  ***********************************************************************/
-UInt16 IndexOfEntry(DmOpenRef dbase, UInt32 id)
+Err ImportBegin()
 {
-    UInt16 index;
-    MemHandle recH;
-    UInt32 *recP;
-
-    if (!dbase)
-        return false;
+	if (gImport.active)
+		return dmErrInvalidParam;
+	if (DatabaseRequire(dbSetAll) != errNone)
+		return dmErrCantOpen;
 
-    index = DmFindSortPosition(dbase, &id, 0, (DmComparF *) DBIngredientIDCompare, 0);
-
-	if (index > 0) {
-		recH = DmQueryRecord(dbase, index - 1);
-		recP = MemHandleLock(recH);
-		
-		if (*recP == id) {
-			MemHandleUnlock(recH);
-			return index - 1; 
-		}
-		MemHandleUnlock(recH);
+	MemSet(&gImport, sizeof(gImport), 0);
+	gImport.ingredients.slotsH = MemHandleNew(importDictSlots * sizeof(ImportSlot));
+	gImport.units.slotsH = MemHandleNew(importDictSlots * sizeof(ImportSlot));
+	if (!gImport.ingredients.slotsH || !gImport.units.slotsH) {
+		ImportDictFree(&gImport.ingredients);
+		ImportDictFree(&gImport.units);
+		return memErrNotEnoughSpace;
 	}
+	MemSet(MemHandleLock(gImport.ingredients.slotsH), importDictSlots * sizeof(ImportSlot), 0);
+	MemHandleUnlock(gImport.ingredients.slotsH);
+	MemSet(MemHandleLock(gImport.units.slotsH), importDictSlots * sizeof(ImportSlot), 0);
+	MemHandleUnlock(gImport.units.slotsH);
 
-	return 0xFFFF;
+	gImport.active = true;
+	return errNone;
 }
 
-
-/*********************************************************************
- * Recipe DB Functions
- *********************************************************************/
-
 /***********************************************************************
  *
- * FUNCTION:     AddRecipe
+ * FUNCTION:     ImportRecipe
  *
- * DESCRIPTION:  Adds new recipe to database
+ * DESCRIPTION:  Adds a recipe during a bulk import (see ImportBegin).
+ *				 It isn't in name order or returned by pantry searches
+ *				 until ImportEnd
  *
  * PARAMETERS:   Name, ingredients, units, amounts, number of ingredients
  *				 and steps of recipe
@@ -469,7 +5832,7 @@ UInt16 IndexOfEntry(DmOpenRef dbase, UInt32 id)
  * RETURNED:     Err
  *
  ***********************************************************************/
-Err AddRecipe(
+Err ImportRecipe(
     const Char *recipeName,
     const Char *ingredientNames[],
     const Char *unitNames[],
@@ -479,179 +5842,666 @@ Err AddRecipe(
     const UInt8 denoms[],
     const Char *recipeSteps)
 {
-    RecipeHeader recipe;
-	MemHandle recH;
-	MemPtr recP;
-	UInt16 stepsLen;
-	UInt16 ingredientsLen;
-	UInt32 totalSize;
-    UInt32 ingredientIDs[recipeMaxIngredients];
-    UInt32 ingredientUnits[recipeMaxIngredients];
+	MemHandle bufH;
+	MemHandle linesH;
 	UInt16 recordIndex;
-    UInt16 offset = 0;
-    UInt16 i;
-    Err err;
-    
-    err = MemSet(&recipe, sizeof(recipe), 0);
-    if (err != errNone) return err;
-    
-    // constructs recipe header
-    stepsLen  = StrLen(recipeSteps) + 1;
-    ingredientsLen = numIngredients * (3 * sizeof(UInt8) + 2 * sizeof(UInt32));
-    totalSize = sizeof(RecipeHeader) + ingredientsLen + stepsLen;
+	Err err;
+
+	if (!gImport.active)
+		return dmErrInvalidParam;
+
+	err = RecipeResolve(ingredientNames, unitNames, numIngredients,
+		counts, fracs, denoms, true, &linesH);
+	if (err != errNone) return err;
+
+	bufH = RecipeBuild(recipeName, MemHandleLock(linesH), numIngredients, recipeSteps);
+	MemHandleUnlock(linesH);
+	MemHandleFree(linesH);
+	if (!bufH) return memErrNotEnoughSpace;
+
+	recordIndex = DmNumRecords(gRecipeDB);
+	err = RecipeStore(bufH, &recordIndex);
+	MemHandleFree(bufH);
+	if (err != errNone) return err;
+
+	// appending doesn't move other records, so the map stays valid until
+	// ImportEnd sorts
+	IDMapInsert(gRecipeDB, IDFromIndex(gRecipeDB, recordIndex), recordIndex);
+	gImport.numImported++;
+	err = IndexRecipe(recordIndex);
+	if (err == errNone)
+		err = TrigramIndexRecipe(recordIndex);
+	return err;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     ImportEnd
+ *
+ * DESCRIPTION:  Finishes a bulk import - puts gRecipeDB and QMCatalog
+ *				 back in name order and rebuilds the makeable recipe lists. Must be
+ *				 called after ImportBegin even if an ImportRecipe failed
+ *
+ * PARAMETERS:   nothing
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+Err ImportEnd()
+{
+	Err err = errNone;
+
+	if (!gImport.active)
+		return dmErrInvalidParam;
+
+	ImportDictFree(&gImport.ingredients);
+	ImportDictFree(&gImport.units);
+	gImport.active = false;
+
+	if (gImport.numImported > 0) {
+		err = DmQuickSort(gRecipeDB, (DmComparF *) CompareRecipeNames, 0);
+		IDMapRebuild(&gRecipeMap, gRecipeDB);
+		LiveInvalidate(gRecipeDB);
+		MaskInvalidate();
+		if (err == errNone)
+			err = CatalogSort();
+		if (err == errNone)
+			err = MakeableRebuild();
+	}
+	return err;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     RemoveRecipe
+ *
+ * DESCRIPTION:  Removes recipe from database, and removes any ingredients/units
+ *				 from respective databases that only appear in deleted recipe
+ *
+ * PARAMETERS:   Index of recipe to remove
+ *
+ * RETURNED:     errNone or error
+ *
+ ***********************************************************************/
+Err RemoveRecipe(UInt16 recipeIndex) {
+	MemHandle recH;
+	MemHandle trigramsH;
+	RecipeView recipe;
+	UInt32 recipeId;
+	UInt32 id;
+	Err err;
+	UInt16 numTrigrams;
+	UInt16 index;
+	UInt16 i;
 	
-	StrNCopy(recipe.name, recipeName, 31);
-	recipe.name[31] = '\0';
-	recipe.numIngredients = numIngredients;
+	err = DatabaseRequire(dbSetAll);
+	if (err != errNone) return err;
+
+	recipeId = IDFromIndex(gRecipeDB, recipeIndex);
 	
-	// builds arrays of ingredient IDs
-    for (i = 0; i < numIngredients; i++) {
-        ingredientIDs[i] = IngredientIDByName(ingredientNames[i]);
-        if (ingredientIDs[i] == -1) return dmErrResourceNotFound; 
-
-        ingredientUnits[i] = UnitIDByName(unitNames[i]);
-        if (ingredientUnits[i] == -1) return dmErrResourceNotFound;
-    }	
+	recH = DmQueryRecord(gRecipeDB, recipeIndex);
+	if (!recH) return dmErrRecordDeleted;
+
+	RecipeViewInit(&recipe, MemHandleLock(recH));
 	
-	// writes entry
-	recordIndex = DmFindSortPosition(gRecipeDB, &recipe, 0, (DmComparF *) CompareRecipeNames, 0);
+	MaskInvalidate();
+	MakeableRemoveRecipe(recipeId);
 	
-	recH = DmNewRecord(gRecipeDB, &recordIndex, totalSize);
-	if (!recH) return dmErrMemError;
-	recP = MemHandleLock(recH);    
+	if (TrigramCollect(MemHandleLock(recH), &trigramsH, &numTrigrams) == errNone && trigramsH) {
+		TrigramUpdate(recipeId, trigramsH, numTrigrams, NULL, 0);
+		MemHandleFree(trigramsH);
+	}
+	MemHandleUnlock(recH);
 	
-	DmSet(recP, 0, totalSize, 0);
-	DmWrite(recP, 0, &recipe, sizeof(recipe));         
-    offset += sizeof(RecipeHeader);
-	DmWrite(recP, offset, counts, numIngredients * sizeof(UInt8)); 
-	offset += numIngredients * sizeof(UInt8);
-	DmWrite(recP, offset, fracs, numIngredients * sizeof(UInt8)); 
-	offset += numIngredients * sizeof(UInt8);
-	DmWrite(recP, offset, denoms, numIngredients * sizeof(UInt8)); 
-	offset += numIngredients * sizeof(UInt8);
-	DmWrite(recP, offset, ingredientIDs, numIngredients * sizeof(UInt32));
-	offset += numIngredients * sizeof(UInt32);
-	DmWrite(recP, offset, ingredientUnits, numIngredients * sizeof(UInt32));
-	offset += numIngredients * sizeof(UInt32);
-
-	// It seems that DmWrite errors are always fatal, so code handling it wouldn't do anything
-	// offset should now be equivalent to sizeof(RecipeHeader) + ingredientsLen - numIngredients * sizeof(UInt32)
-	DmWrite(recP, offset, recipeSteps, stepsLen); 
+	// index must be current before FindIfUsed/RemoveIngredient run below
+	for (i = 0; i < recipe.numIngredients; i++) {
+		PostingRemove(postingKindIngredient, RecipeViewIngredientID(&recipe, i), recipeId);
+		PostingRemove(postingKindUnit, RecipeViewUnitID(&recipe, i), recipeId);
+	}
+		
+	for (i = 0; i < recipe.numIngredients; i++) {
+		RemoveIngredient(RecipeViewIngredientID(&recipe, i));
+	}
+		
+	for (i = 0; i < recipe.numIngredients; i++) {
+		id = RecipeViewUnitID(&recipe, i);
+		if (!(FindIfUsed(postingKindUnit, id))) {
+			index = IndexFromID(gUnitDB, id);
+			if (index != 0xFFFF)
+				DeleteRecord(gUnitDB, index, id);
+		} 
+	}
 	
 	MemHandleUnlock(recH);
-	err = DmReleaseRecord(gRecipeDB, recordIndex, true);
 	
+	// leaves a tombstone, so indexes held by callers stay valid
+	err = DeleteRecord(gRecipeDB, recipeIndex, recipeId);
+	if (err == errNone && DmDeleteRecord(gCatalogDB, recipeIndex) != errNone)
+		err = CatalogRebuild();
 	return err;
 }
 
 /***********************************************************************
  *
- * FUNCTION:     RemoveRecipe
+ * FUNCTION:     RecipeViewInit
+ *
+ * DESCRIPTION:  Sets up a view over a locked recipe record. Nothing is
+ *				 copied - fields are decoded by the accessors on demand,
+ *				 and the view is only valid while the record stays locked
+ *
+ * PARAMETERS:   view to fill in, MemPtr to gRecipeDB entry
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+void RecipeViewInit(RecipeView *view, MemPtr recP)
+{
+	RecipeHeader* header = recP;
+	UInt8 numIngredients = header->numIngredients;
+	const UInt8 *p;
+	UInt8 i;
+
+	MemSet(view, sizeof(RecipeView), 0);
+	view->name           = header->name;
+	view->numIngredients = numIngredients;
+	view->layout         = header->layout;
+	view->cursorLine     = 0xFF;
+
+	if (header->layout == recipeLayoutV1) {
+		view->counts        = (UInt8*)header + sizeof(RecipeHeader);
+		view->fracs         = view->counts + numIngredients;
+		view->denoms        = view->fracs + numIngredients;
+		view->ingredientIDs = view->denoms + numIngredients;
+		view->unitIDs       = view->ingredientIDs + numIngredients * sizeof(UInt32);
+		view->steps         = (Char*)(view->unitIDs + numIngredients * sizeof(UInt32));
+		return;
+	}
+
+	// lines vary in length, so the steps are found by skipping them all
+	view->lines = (UInt8*)header + sizeof(RecipeHeader);
+	p = view->lines;
+	for (i = 0; i < numIngredients; i++) {
+		VarintGet(&p);
+		VarintGet(&p);
+		if (VarintGet(&p) & 1)
+			p += 2;
+	}
+	view->cursor = view->lines;
+	view->steps  = (Char*)p;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     RecipeViewLine
+ *
+ * DESCRIPTION:  Decodes one line of a layout 2 recipe view into the
+ *				 view. Stepping forward only decodes the lines in
+ *				 between, so reading the lines in order is linear
+ *
+ * PARAMETERS:   view, ingredient number
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void RecipeViewLine(RecipeView *view, UInt8 i)
+{
+	UInt16 count;
+
+	if (view->cursorLine == i)
+		return;
+	if (view->cursorLine == 0xFF || view->cursorLine > i) {
+		view->cursor = view->lines;
+		view->cursorLine = 0xFF;
+	}
+
+	do {
+		view->ingredientRef = VarintGet(&view->cursor);
+		view->unitRef = VarintGet(&view->cursor);
+		count = VarintGet(&view->cursor);
+		view->count = (UInt8)(count >> 1);
+		view->frac = 0;
+		view->denom = 0;
+		if (count & 1) {
+			view->frac = view->cursor[0];
+			view->denom = view->cursor[1];
+			view->cursor += 2;
+		}
+		view->cursorLine++;
+	} while (view->cursorLine != i);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     RecipeViewIngredientID
+ *
+ * DESCRIPTION:  Decodes one ingredient ID of a recipe view (layout 1
+ *				 IDs are stored big-endian and may be unaligned, layout 2
+ *				 holds refs)
+ *
+ * PARAMETERS:   view, ingredient number
+ *
+ * RETURNED:     IngredientDB ID
+ *
+ ***********************************************************************/
+UInt32 RecipeViewIngredientID(RecipeView *view, UInt8 i)
+{
+	const UInt8 *raw;
+
+	if (view->lines) {
+		RecipeViewLine(view, i);
+		return RefToID(gIngredientDB, view->ingredientRef);
+	}
+	raw = view->ingredientIDs + i * 4;
+	return ((UInt32)raw[0] << 24) | ((UInt32)raw[1] << 16) |
+		((UInt32)raw[2] << 8) | (UInt32)raw[3];
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     RecipeViewUnitID
+ *
+ * DESCRIPTION:  Decodes one unit ID of a recipe view
+ *
+ * PARAMETERS:   view, ingredient number
+ *
+ * RETURNED:     UnitDB ID
+ *
+ ***********************************************************************/
+UInt32 RecipeViewUnitID(RecipeView *view, UInt8 i)
+{
+	const UInt8 *raw;
+
+	if (view->lines) {
+		RecipeViewLine(view, i);
+		return RefToID(gUnitDB, view->unitRef);
+	}
+	raw = view->unitIDs + i * 4;
+	return ((UInt32)raw[0] << 24) | ((UInt32)raw[1] << 16) |
+		((UInt32)raw[2] << 8) | (UInt32)raw[3];
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     RecipeViewQuantity
+ *
+ * DESCRIPTION:  Reads the quantity of one ingredient of a recipe view
+ *
+ * PARAMETERS:   view, ingredient number, pointers to store whole count,
+ *				 fraction numerator and denominator
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+void RecipeViewQuantity(RecipeView *view, UInt8 i, UInt8 *count, UInt8 *frac, UInt8 *denom)
+{
+	if (view->lines) {
+		RecipeViewLine(view, i);
+		*count = view->count;
+		*frac  = view->frac;
+		*denom = view->denom;
+		return;
+	}
+	*count = view->counts[i];
+	*frac  = view->fracs[i];
+	*denom = view->denoms[i];
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     StepsReaderInit
+ *
+ * DESCRIPTION:  Starts reading the steps of a recipe view from the top
+ *
+ * PARAMETERS:   reader to set up, recipe view
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+void StepsReaderInit(StepsReader *reader, const RecipeView *view)
+{
+	reader->next       = (const UInt8*)view->steps;
+	reader->pending    = NULL;
+	reader->pendingLen = 0;
+	reader->packed     = (view->layout & recipeStepsPacked) != 0;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     StepsRead
+ *
+ * DESCRIPTION:  Reads the next piece of a recipe's steps as text,
+ *				 unpacking only as much as fits
+ *
+ * PARAMETERS:   reader (see StepsReaderInit), buffer, its size
+ *
+ * RETURNED:     number of characters read (not null terminated), 0 at
+ *				 the end of the steps
+ *
+ ***********************************************************************/
+UInt16 StepsRead(StepsReader *reader, Char *buf, UInt16 size)
+{
+	const UInt8 *p = reader->next;
+	UInt16 n = 0;
+	UInt16 len;
+	UInt8 c;
+
+	while (n < size) {
+		// the rest of a dictionary entry the last read had no room for
+		if (reader->pendingLen > 0) {
+			len = reader->pendingLen < size - n ? reader->pendingLen : size - n;
+			MemMove(buf + n, reader->pending, len);
+			reader->pending += len;
+			reader->pendingLen -= len;
+			n += len;
+			continue;
+		}
+
+		c = *p;
+		if (c == '\0')
+			break;
+		p++;
+		if (c < stepsEscape || !reader->packed) {
+			buf[n++] = c;
+		} else if (c == stepsEscape) {
+			buf[n++] = *p++;
+		} else {
+			reader->pending = stepsDict[c - stepsDictFirst];
+			reader->pendingLen = StrLen(reader->pending);
+		}
+	}
+
+	reader->next = p;
+	return n;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     StepsReaderTell
  *
- * DESCRIPTION:  Removes recipe from database, and removes any ingredients/units
- *				 from respective databases that only appear in deleted recipe
+ * DESCRIPTION:  Where a reader is in the steps, as a mark that stays
+ *				 valid while the record is unlocked or moves
  *
- * PARAMETERS:   Index of recipe to remove
+ * PARAMETERS:   reader, recipe view it was started on, receives the mark
  *
- * RETURNED:     errNone or error
+ * RETURNED:     nothing
  *
  ***********************************************************************/
-Err RemoveRecipe(UInt16 recipeIndex) {
-	MemHandle recH;
-	MemPtr recP;
-	RecipeRecord recipe;
-	Err err;
-	UInt16 index;
-	UInt16 i;
-	
-	// Removes recipe from database but gets MemHandle to data
-	err = DmDetachRecord(gRecipeDB, recipeIndex, &recH); 
-	if (!(err == errNone)) return err;
+void StepsReaderTell(const StepsReader *reader, const RecipeView *view, StepsMark *mark)
+{
+	mark->next       = reader->next - (const UInt8*)view->steps;
+	mark->pendingPos = 0;
+	// a dictionary entry is only pending right after the byte standing for it
+	if (reader->pendingLen > 0)
+		mark->pendingPos = reader->pending - stepsDict[reader->next[-1] - stepsDictFirst];
+}
 
-	recP = MemHandleLock(recH);
-	recipe = RecipeGetRecord(recP);
-	MemHandleUnlock(recH);
-		
-	for (i = 0; i < recipeMaxIngredients && recipe.ingredientIDs[i] != 0; i++) {
-		RemoveIngredient(recipe.ingredientIDs[i]);
-	}
-		
-	for (i = 0; i < recipeMaxIngredients && recipe.ingredientUnits[i] != 0; i++) {
-		if (!(FindIfUsed(1, recipe.ingredientUnits[i]))) {
-			err = DmFindRecordByID(gUnitDB, recipe.ingredientUnits[i], &index);
-			if (err == errNone) DmRemoveRecord(gUnitDB, index);
-		} 
+/***********************************************************************
+ *
+ * FUNCTION:     StepsReaderSeek
+ *
+ * DESCRIPTION:  Starts reading the steps of a recipe view from a mark,
+ *				 without reading what comes before it
+ *
+ * PARAMETERS:   reader to set up, recipe view, mark (see StepsReaderTell)
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+void StepsReaderSeek(StepsReader *reader, const RecipeView *view, const StepsMark *mark)
+{
+	const Char *entry;
+
+	StepsReaderInit(reader, view);
+	reader->next += mark->next;
+	if (mark->pendingPos > 0) {
+		entry = stepsDict[reader->next[-1] - stepsDictFirst];
+		reader->pending    = entry + mark->pendingPos;
+		reader->pendingLen = StrLen(entry) - mark->pendingPos;
 	}
-	
-	MemHandleFree(recH);
-	return errNone;
 }
 
 /***********************************************************************
  *
- * FUNCTION:     RecipeGetRecord
+ * FUNCTION:     RecipeViewStepsText
  *
- * DESCRIPTION:  Reconstructs recipe header from recipe database entry
+ * DESCRIPTION:  Unpacks all of a recipe's steps, for callers that need
+ *				 them as one string (see StepsRead to read them in pieces)
  *
- * PARAMETERS:   MemPtr to gRecipeDB entry
+ * PARAMETERS:   recipe view
  *
- * RETURNED:     RecipeRecord
+ * RETURNED:     null terminated steps, to be freed with MemPtrFree, or
+ *				 NULL if out of memory
  *
  ***********************************************************************/
-RecipeRecord RecipeGetRecord(MemPtr recP)
+Char* RecipeViewStepsText(const RecipeView *view)
 {
-	RecipeRecord recipe;
-	RecipeHeader* header = recP;
-	UInt8 *counts = (UInt8*)header + sizeof(RecipeHeader);
-	UInt8 *fracs  = counts + header->numIngredients;
-	UInt8 *denoms = fracs  + header->numIngredients;
-    UInt8 *nameRaw = denoms + header->numIngredients; //Reads name and unit arrays as UInt8 arrays to prevent alignment issues
-    UInt8 *unitRaw = nameRaw + header->numIngredients * sizeof(UInt32); 
-	Err err;
-	UInt8 i;
-	
-	err = MemSet(&recipe, sizeof(RecipeRecord), 0);
-	StrNCopy(recipe.name, header->name, 31);
-	recipe.name[31] = '\0';
-	recipe.numIngredients = header->numIngredients;
-
-    for (i = 0; i < header->numIngredients; i++) {
-        recipe.ingredientCounts[i] = counts[i];
-        recipe.ingredientFracs[i]  = fracs[i];
-        recipe.ingredientDenoms[i] = denoms[i];
-        
-        recipe.ingredientIDs[i]=
-        	((UInt32)nameRaw[i * 4]     << 24) |
-        	((UInt32)nameRaw[i * 4 + 1] << 16) |
-        	((UInt32)nameRaw[i * 4 + 2] << 8)  |
-        	((UInt32)nameRaw[i * 4 + 3]);
-        
-    	recipe.ingredientUnits[i] =
-        	((UInt32)unitRaw[i * 4]     << 24) |
-        	((UInt32)unitRaw[i * 4 + 1] << 16) |
-        	((UInt32)unitRaw[i * 4 + 2] << 8)  |
-        	((UInt32)unitRaw[i * 4 + 3]);
-    }
+	StepsReader reader;
+	const UInt8 *p = (const UInt8*)view->steps;
+	UInt16 len = 0;
+	Char *text;
+
+	if (!(view->layout & recipeStepsPacked)) {
+		len = StrLen(view->steps);
+	} else {
+		for (; *p != '\0'; p++) {
+			if (*p < stepsEscape) {
+				len++;
+			} else if (*p == stepsEscape) {
+				len++;
+				p++;
+			} else {
+				len += StrLen(stepsDict[*p - stepsDictFirst]);
+			}
+		}
+	}
 
-	return recipe;
+	text = MemPtrNew(len + 1);
+	if (!text)
+		return NULL;
+	StepsReaderInit(&reader, view);
+	text[StepsRead(&reader, text, len)] = '\0';
+	return text;
 }
 
+/***********************************************************************
+ *
+ * FUNCTION:     RecipePrefixPosition
+ *
+ * DESCRIPTION:  Binary search for the first recipe whose name starts
+ *				 with a prefix (ignoring case and spacing), for
+ *				 type-ahead in the recipe list
+ *
+ * PARAMETERS:   prefix, recipe IDs in gRecipeDB order (as returned by
+ *				 the searches) or NULL for every recipe, number of IDs
+ *
+ * RETURNED:     list position of the recipe (position in ids, or live
+ *				 record position), 0xFFFF if no name starts with prefix
+ *
+ ***********************************************************************/
+UInt16 RecipePrefixPosition(const Char *prefix, const UInt32 *ids, UInt16 numIds)
+{
+	Char key[32]; // as long as RecipeHeader.key
+	UInt16 len = SortKeyMake(prefix, key, sizeof(key));
+	UInt16 total = ids ? numIds : LiveRecordCount(gRecipeDB);
+	UInt16 lo = 0;
+	UInt16 hi = total;
+	UInt16 mid;
+
+	if (len == 0)
+		return 0xFFFF;
+	// a space just typed still separates words
+	if (prefix[StrLen(prefix) - 1] == ' ' && len + 1 < sizeof(key)) {
+		key[len++] = ' ';
+		key[len] = '\0';
+	}
+
+	// keys are sorted, so those whose first len characters sort before
+	// the prefix all come first
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (RecipePrefixCompare(ids ? IndexFromID(gRecipeDB, ids[mid]) :
+				LiveRecordIndex(gRecipeDB, mid), key, len) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo < total && RecipePrefixCompare(ids ? IndexFromID(gRecipeDB, ids[lo]) :
+			LiveRecordIndex(gRecipeDB, lo), key, len) == 0)
+		return lo;
+	return 0xFFFF;
+}
 
 /***********************************************************************
  *
- * FUNCTION:     RecipeGetStepsPtr
+ * FUNCTION:     RecipeTextSearch
  *
- * DESCRIPTION:  Returns pointer to recipe steps
+ * DESCRIPTION:  Finds recipes whose name or steps contain a piece of
+ *				 text, ignoring case. Candidates are the recipes in the
+ *				 trigram postings of every trigram of the text, and are
+ *				 then checked against the recipe itself (text shorter
+ *				 than a trigram is checked against every recipe)
  *
- * PARAMETERS:   MemPtr to gRecipeDB entry
+ * PARAMETERS:   text, MemHandle pointer to store returned list of
+ *				 recipe IDs
  *
- * RETURNED:     Pointer to steps portion of recipe entry
+ * RETURNED:     number of recipes found (*ret is NULL if none)
  *
  ***********************************************************************/
-Char* RecipeGetStepsPtr(MemPtr recP)
+UInt16 RecipeTextSearch(const Char *text, MemHandle* ret)
 {
-	UInt16 ingredientsLen = ((RecipeHeader*)recP)->numIngredients * (3 * sizeof(UInt8) + 2 * sizeof(UInt32));
-	return (Char*)recP + sizeof(RecipeHeader) + ingredientsLen;
+	MemHandle candidatesH = NULL;
+	MemHandle recH;
+	PostingHeader *postP;
+	RecipeView view;
+	Char *steps;
+	Char *folded;
+	UInt32 *trigrams = NULL;
+	UInt32 *candidates;
+	UInt32 *ids;
+	Boolean found;
+	UInt16 len = StrLen(text);
+	UInt16 numTrigrams = 0;
+	UInt16 numCandidates = 0;
+	UInt16 index;
+	UInt16 smallest = 0;
+	UInt16 i;
+	UInt16 j;
+	UInt16 k;
+	UInt16 n;
+
+	*ret = NULL;
+	if (len == 0 || DatabaseRequire(dbSetIndexes) != errNone)
+		return 0;
+
+	folded = MemPtrNew(len + 1);
+	if (len >= 3)
+		trigrams = MemPtrNew(len * sizeof(UInt32));
+	if (!folded || (len >= 3 && !trigrams)) {
+		if (folded) MemPtrFree(folded);
+		displayError(memErrNotEnoughSpace);
+		return 0;
+	}
+	for (i = 0; i <= len; i++)
+		folded[i] = TrigramFold((UInt8)text[i]);
+
+	if (len < 3) {
+		// no trigrams to narrow by - every recipe is a candidate
+		numCandidates = LiveRecordCount(gRecipeDB);
+		if (numCandidates > 0)
+			candidatesH = MemHandleNew(numCandidates * sizeof(UInt32));
+		if (candidatesH) {
+			candidates = MemHandleLock(candidatesH);
+			for (i = 0; i < numCandidates; i++)
+				candidates[i] = IDFromIndex(gRecipeDB, LiveRecordIndex(gRecipeDB, i));
+			MemHandleUnlock(candidatesH);
+		}
+	} else {
+		TrigramAppend(folded, trigrams, &numTrigrams);
+		numTrigrams = TrigramSort(trigrams, numTrigrams);
+
+		// every trigram must have a posting; the shortest one gives the
+		// candidates and the rest are intersected into it (postings are in
+		// ascending ID order)
+		for (i = 0; i < numTrigrams; i++) {
+			if (!PostingFind(postingKindTrigram, trigrams[i], &index))
+				break;
+			trigrams[i] = index; // posting record index from here on
+			recH = DmQueryRecord(gTrigramDB, index);
+			postP = MemHandleLock(recH);
+			if (i == 0 || postP->numRecipes < numCandidates) {
+				numCandidates = postP->numRecipes;
+				smallest = i;
+			}
+			MemHandleUnlock(recH);
+		}
+
+		if (i == numTrigrams)
+			candidatesH = MemHandleNew(numCandidates * sizeof(UInt32));
+		if (candidatesH) {
+			candidates = MemHandleLock(candidatesH);
+			recH = DmQueryRecord(gTrigramDB, trigrams[smallest]);
+			postP = MemHandleLock(recH);
+			MemMove(candidates, postP + 1, numCandidates * sizeof(UInt32));
+			MemHandleUnlock(recH);
+
+			for (i = 0; i < numTrigrams && numCandidates > 0; i++) {
+				if (i == smallest)
+					continue;
+				recH = DmQueryRecord(gTrigramDB, trigrams[i]);
+				postP = MemHandleLock(recH);
+				ids = (UInt32 *)(postP + 1);
+				for (j = 0, k = 0, n = 0; j < numCandidates && k < postP->numRecipes; ) {
+					if (candidates[j] < ids[k])
+						j++;
+					else if (candidates[j] > ids[k])
+						k++;
+					else {
+						candidates[n++] = candidates[j];
+						j++;
+						k++;
+					}
+				}
+				numCandidates = n;
+				MemHandleUnlock(recH);
+			}
+			MemHandleUnlock(candidatesH);
+		} else {
+			numCandidates = 0;
+		}
+	}
+
+	// trigrams only narrow the search - the text itself must be there
+	n = 0;
+	if (candidatesH) {
+		candidates = MemHandleLock(candidatesH);
+		for (i = 0; i < numCandidates; i++) {
+			// names are in the catalog, only the steps need the record
+			index = IndexFromID(gRecipeDB, candidates[i]);
+			recH = DmQueryRecord(gCatalogDB, index);
+			if (!recH) continue;
+			found = TextContains(((CatalogHeader *)MemHandleLock(recH))->name, folded, len);
+			MemHandleUnlock(recH);
+			if (!found && (recH = DmQueryRecord(gRecipeDB, index)) != NULL) {
+				RecipeViewInit(&view, MemHandleLock(recH));
+				steps = RecipeViewStepsText(&view);
+				if (steps) {
+					found = TextContains(steps, folded, len);
+					MemPtrFree(steps);
+				}
+				MemHandleUnlock(recH);
+			}
+			if (found)
+				candidates[n++] = candidates[i];
+		}
+		n = RecipeIDsByName(candidates, n, ret);
+		MemHandleUnlock(candidatesH);
+		MemHandleFree(candidatesH);
+	}
+
+	MemPtrFree(folded);
+	if (trigrams) MemPtrFree(trigrams);
+	return n;
 }
 
 /*********************************************************************
@@ -675,30 +6525,25 @@ Err RemoveIngredient(UInt32 ingId) {
 	UInt16 index;
 	Err err;
 
-	if (!(FindIfUsed(0, ingId))) {
+	err = DatabaseRequire(dbSetAll);
+	if (err != errNone)
+		return err;
+	if (!(FindIfUsed(postingKindIngredient, ingId))) {
 	
 		index = IndexOfEntry(gPantryDB, ingId);
 		if (index != 0xFFFF)
-			err = DmRemoveRecord(gPantryDB, index);
+			err = RemoveEntry(gPantryDB, index);
 			
 		index = IndexOfEntry(gGroceryDB, ingId);
 		if (index != 0xFFFF)
-			err = DmRemoveRecord(gGroceryDB, index);
-	
-		// Note: ingredient must be deleted from pantry/grocery dbs first
-		// because of how DbIngredientIDCompare works
+			err = RemoveEntry(gGroceryDB, index);
 	
-		err = DmFindRecordByID(gIngredientDB, ingId, &index);
-		if (err == errNone) 
-			DmRemoveRecord(gIngredientDB, index);
-		else
-			return err;
+		index = IndexFromID(gIngredientDB, ingId);
+		if (index == 0xFFFF)
+			return dmErrUniqueIDNotFound;
 			
-		// If speed is a concern, switch this to using DmDeleteRecord and
-		// manually pack later. But I anticipate deleting records on-device
-		// to be rare
-
-		return errNone;
+		// Tombstoned with DmDeleteRecord and packed later by DatabaseCompact
+		return DeleteRecord(gIngredientDB, index, ingId);
 	} else {
 		return errIngredInUse;
 	}
@@ -709,7 +6554,8 @@ Err RemoveIngredient(UInt32 ingId) {
  * FUNCTION:     IngredientIDByName
  *
  * DESCRIPTION:  Returns database identifier of the ingredient with the
- *				 specified name, or creates a new entry
+ *				 specified name (ignoring case and spacing, see
+ *				 SortKeyMake), or creates a new entry
  *
  * PARAMETERS:   name of ingredient
  *
@@ -718,51 +6564,16 @@ Err RemoveIngredient(UInt32 ingId) {
  ***********************************************************************/
 UInt32 IngredientIDByName(const Char *ingredientName)
 {
-    UInt16 numRecords = DmNumRecords(gIngredientDB);
-    UInt32 entryID = 0;
-    MemHandle recH;
-    Char *recP;
-    UInt16 index;
-    
-    index = DmFindSortPosition(gIngredientDB, (void *) ingredientName, 0, (DmComparF *) DBStringCompare, 0);
-
-    // Old code - linear search
- /*   for (i = 0; i < numRecords; i++) {
-        recH = DmQueryRecord(gIngredientDB, i);
-        if (recH) {
-	        recP = MemHandleLock(recH);
-	        if (StrCompare(recP, ingredientName) == 0) {
-	            DmRecordInfo(gIngredientDB, i, NULL, &entryID, NULL);
-	            MemHandleUnlock(recH);
-	            return entryID;
-	        }
-        	MemHandleUnlock(recH);
-        }
-    } */
-    
-    if (index > 0) {
-    	recH = DmQueryRecord(gIngredientDB, index - 1);
-    	recP = MemHandleLock(recH);
-	    if (StrCompare(recP, ingredientName) == 0) {
-	    	DmRecordInfo(gIngredientDB, index - 1, NULL, &entryID, NULL);
-	        MemHandleUnlock(recH);
-	        return entryID;
-	    }
-        MemHandleUnlock(recH);
-    }
+    MemHandle bufH;
+    UInt32 entryID;
 
-	// If none found, creates new record
-    recH = DmNewRecord(gIngredientDB, &index, StrLen(ingredientName) + 1);
-    if (!recH) {
+    // the new record is built first, it is also the search key
+    bufH = ItemBuild(ingredientName);
+    if (!bufH) {
         return -1;
     }
-
-    recP = MemHandleLock(recH);
-    DmWrite(recP, 0, ingredientName, StrLen(ingredientName) + 1);
-    MemHandleUnlock(recH);
-    DmReleaseRecord(gIngredientDB, index, true);
-
-    DmRecordInfo(gIngredientDB, index, NULL, &entryID, NULL);
+    entryID = ItemIDByRecord(gIngredientDB, bufH);
+    MemHandleFree(bufH);
     return entryID;
 }
 
@@ -770,7 +6581,8 @@ UInt32 IngredientIDByName(const Char *ingredientName)
  *
  * FUNCTION:     IngredientNameByID
  *
- * DESCRIPTION:  Gets ingredient name from DB identifier, writes to buffer
+ * DESCRIPTION:  Gets ingredient name from DB identifier, writes to buffer.
+ *				 Opens dbSetItems if no form has yet
  *
  * PARAMETERS:   DB id, buffer to write to
  *
@@ -783,7 +6595,10 @@ Err IngredientNameByID(Char* buffer, UInt8 len, UInt32 entryID)
 	Char* recP;
 	UInt16 index;
 	
-	if (DmFindRecordByID(gIngredientDB, entryID, &index) == errNone) {
+	if (DatabaseRequire(dbSetItems) != errNone)
+		return dmErrCantFind;
+	index = IndexFromID(gIngredientDB, entryID);
+	if (index != 0xFFFF) {
 		recH = DmQueryRecord(gIngredientDB, index);
 		if (recH) {
 			recP = MemHandleLock(recH);
@@ -797,6 +6612,37 @@ Err IngredientNameByID(Char* buffer, UInt8 len, UInt32 entryID)
 	return dmErrCantFind;
 }
 
+/***********************************************************************
+ *
+ * FUNCTION:     IngredientRecipeSearch
+ *
+ * DESCRIPTION:  Finds the recipes that use an ingredient, from the index
+ *
+ * PARAMETERS:   Ingredient ID, MemHandle pointer to store returned list
+ *				 of recipe IDs
+ *
+ * RETURNED:     number of recipes that match
+ *
+ ***********************************************************************/
+UInt16 IngredientRecipeSearch(UInt32 ingId, MemHandle* ret) {
+	PostingHeader *recP;
+	MemHandle recH;
+	UInt16 index;
+	UInt16 numResults;
+	
+	*ret = NULL;
+	if (DatabaseRequire(dbSetIndexes) != errNone ||
+			!PostingFind(postingKindIngredient, ingId, &index))
+		return 0;
+	
+	recH = DmQueryRecord(gIndexDB, index);
+	recP = MemHandleLock(recH);
+	numResults = RecipeIDsByName((UInt32 *)(recP + 1), recP->numRecipes, ret);
+	MemHandleUnlock(recH);
+	
+	return numResults;
+}
+
 /*********************************************************************
  * Unit DB Functions
  *********************************************************************/
@@ -806,7 +6652,8 @@ Err IngredientNameByID(Char* buffer, UInt8 len, UInt32 entryID)
  * FUNCTION:     UnitIDByName
  *
  * DESCRIPTION:  Returns database identifier of the unit with the
- *				 specified name, or creates a new entry
+ *				 specified name (ignoring case and spacing), or creates
+ *				 a new entry
  *
  * PARAMETERS:   unit name string
  *
@@ -815,38 +6662,15 @@ Err IngredientNameByID(Char* buffer, UInt8 len, UInt32 entryID)
  ***********************************************************************/
 UInt32 UnitIDByName(const Char *unitName)
 {
-    UInt16 numRecords = DmNumRecords(gUnitDB);
-    UInt32 entryID = 0;
-    MemHandle recH;
-    Char *recP;
-    UInt16 index;
-    
-    index = DmFindSortPosition(gUnitDB, (void *) unitName, 0, (DmComparF *) DBStringCompare, 0);
-    
-    if (index > 0) {
-    	recH = DmQueryRecord(gUnitDB, index - 1);
-    	recP = MemHandleLock(recH);
-	    if (StrCompare(recP, unitName) == 0) {
-	    	DmRecordInfo(gUnitDB, index - 1, NULL, &entryID, NULL);
-	        MemHandleUnlock(recH);
-	        return entryID;
-	    }
-        MemHandleUnlock(recH);
-        recP = NULL, recH = NULL;
-    }
+    MemHandle bufH;
+    UInt32 entryID;
 
-    // If no match found creates new record
-    recH = DmNewRecord(gUnitDB, &index, StrLen(unitName) + 1);
-    if (!recH) {
+    bufH = ItemBuild(unitName);
+    if (!bufH) {
         return -1;
     }
-
-    recP = MemHandleLock(recH);
-    DmWrite(recP, 0, unitName, StrLen(unitName) + 1); //includes null terminator
-    MemHandleUnlock(recH);
-    DmReleaseRecord(gUnitDB, index, true);
-
-    DmRecordInfo(gUnitDB, index, NULL, &entryID, NULL);
+    entryID = ItemIDByRecord(gUnitDB, bufH);
+    MemHandleFree(bufH);
     return entryID;
 }
 
@@ -854,7 +6678,8 @@ UInt32 UnitIDByName(const Char *unitName)
  *
  * FUNCTION:     UnitNameByID
  *
- * DESCRIPTION:  Gets unit name from DB identifier, writes to buffer
+ * DESCRIPTION:  Gets unit name from DB identifier, writes to buffer.
+ *				 Opens dbSetItems if no form has yet
  *
  * PARAMETERS:   buffer to write to, buffer length, entry ID
  *
@@ -867,7 +6692,10 @@ Err UnitNameByID(Char* buffer, UInt8 len, UInt32 entryID)
 	Char* recP;
 	UInt16 index;
 	
-	if (DmFindRecordByID(gUnitDB, entryID, &index) == errNone) {
+	if (DatabaseRequire(dbSetItems) != errNone)
+		return dmErrCantFind;
+	index = IndexFromID(gUnitDB, entryID);
+	if (index != 0xFFFF) {
 		recH = DmQueryRecord(gUnitDB, index);
 		if (recH) {
 			recP = MemHandleLock(recH);
@@ -889,113 +6717,279 @@ Err UnitNameByID(Char* buffer, UInt8 len, UInt32 entryID)
  *
  * FUNCTION:     PantryFuzzySearch
  *
- * DESCRIPTION:  Queries recipe database to find recipes that any ingredient
- *				 in the pantry
+ * DESCRIPTION:  Finds recipes that use any ingredient in the pantry (kept
+ *				 up to date in QMMakeable)
  *
- * PARAMETERS:   MemHandle pointer to store returned list of recipes
+ * PARAMETERS:   MemHandle pointer to store returned list of recipe IDs
  *
  * RETURNED:     number of recipes that match
  *
  ***********************************************************************/
 UInt16 PantryFuzzySearch(MemHandle* ret) {
-	UInt16 numRecipes = DmNumRecords(gRecipeDB);
-	UInt16* results;
-	MemHandle recH;
-	MemPtr recP;
-	RecipeRecord recipe;
-	UInt16 i;
-	UInt16 j;
-	UInt16 idx = 0;
-	
-	if (numRecipes == 0)
+	if (DatabaseRequire(dbSetIndexes) != errNone) {
+		*ret = NULL;
 		return 0;
-	
-	*ret = MemHandleNew(numRecipes * sizeof(UInt16));
-	results = MemHandleLock(*ret);
-	
-	if (!results) {
-		displayError(memErrNotEnoughSpace);
-		return 0;
-	} //Could use improvement
-	
-	for (i = 0; i < numRecipes; i++) {
-		recH = DmQueryRecord(gRecipeDB, i);
-		if (!recH) continue;
-		recP = MemHandleLock(recH);
-		recipe = RecipeGetRecord(recP);
-		MemHandleUnlock(recH); 
-		
-		for (j = 0; j < recipe.numIngredients; j++) {
-			if (EntryInDatabase(gPantryDB, recipe.ingredientIDs[j])) { // checks in this manner because pantryDB has ingredients in sorted order
-				results[idx] = i;
-				idx++;
-				break; // only affects innermost loop
-			}
-		}
 	}
-	
-	
-	MemHandleUnlock(*ret);
-	MemHandleResize(*ret, idx * sizeof(UInt16));
-	return idx;
+	return MakeableList(makeableRecFuzzy, ret);
 }
 
 /***********************************************************************
  *
  * FUNCTION:     PantryStrictSearch
  *
- * DESCRIPTION:  Queries recipe database to find recipes that can
- *				 be made with ingredients in pantry
+ * DESCRIPTION:  Finds recipes that can be made with ingredients in
+ *				 pantry (kept up to date in QMMakeable)
  *
- * PARAMETERS:   MemHandle pointer to store returned list of recipes
+ * PARAMETERS:   MemHandle pointer to store returned list of recipe IDs
  *
  * RETURNED:     number of recipes that match
  *
  ***********************************************************************/
 UInt16 PantryStrictSearch(MemHandle* ret) {
-	UInt16 numRecipes = DmNumRecords(gRecipeDB);
-	UInt16* results;
+	if (DatabaseRequire(dbSetIndexes) != errNone) {
+		*ret = NULL;
+		return 0;
+	}
+	return MakeableList(makeableRecStrict, ret);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     PantryRankedSearch
+ *
+ * DESCRIPTION:  Finds the recipes closest to being makeable - those with
+ *				 the fewest ingredients missing from the pantry (ties in
+ *				 name order). Recipes with nothing in the pantry are left out
+ *
+ * PARAMETERS:   most recipes to return, MemHandle pointer to store
+ *				 returned list of recipe IDs, MemHandle pointer to store
+ *				 the missing count (UInt8) of each recipe
+ *
+ * RETURNED:     number of recipes returned (*ret is NULL if none)
+ *
+ ***********************************************************************/
+UInt16 PantryRankedSearch(UInt16 maxResults, MemHandle* ret, MemHandle* missingRet) {
+	MakeableHeader *hdrP;
+	MakeableEntry *entries;
 	MemHandle recH;
-	MemPtr recP;
-	RecipeRecord recipe;
-	Boolean CanBeMade;
+	MemHandle heapH;
+	UInt32 *heap;
+	UInt32 *results;
+	UInt8 *missing;
+	UInt32 key;
+	UInt16 numKeys = 0;
+	UInt16 index;
 	UInt16 i;
-	UInt16 j;
-	UInt16 idx = 0;
-	
-	if (numRecipes == 0)
+
+	*ret = NULL;
+	*missingRet = NULL;
+	if (DatabaseRequire(dbSetIndexes) != errNone)
 		return 0;
-	
-	*ret = MemHandleNew(numRecipes * sizeof(UInt16));
-	results = MemHandleLock(*ret);
-	
-	if (!results) {
+	recH = gMakeableDB ? DmQueryRecord(gMakeableDB, makeableRecCounts) : NULL;
+	if (!recH || maxResults == 0)
+		return 0;
+
+	heapH = MemHandleNew(maxResults * sizeof(UInt32));
+	if (!heapH) {
 		displayError(memErrNotEnoughSpace);
 		return 0;
-	} 
-	
-	for (i = 0; i < numRecipes; i++) {
-		recH = DmQueryRecord(gRecipeDB, i);
-		if (!recH) continue;
-		recP = MemHandleLock(recH);
-		recipe = RecipeGetRecord(recP);
-		MemHandleUnlock(recH); 
-		
-		CanBeMade = true;
-		
+	}
+	heap = MemHandleLock(heapH);
+
+	// One pass over the stored counts, keeping the best maxResults in a
+	// max-heap keyed by missing count (high word) then recipe index
+	hdrP = MemHandleLock(recH);
+	entries = (MakeableEntry *)(hdrP + 1);
+	for (i = 0; i < hdrP->count; i++) {
+		if (entries[i].numMissing >= entries[i].numIngredients)
+			continue;
+		if (numKeys == maxResults && entries[i].numMissing > (heap[0] >> 16))
+			continue;
+
+		index = IndexFromID(gRecipeDB, entries[i].recipeId);
+		if (index == 0xFFFF)
+			continue;
+		key = ((UInt32)entries[i].numMissing << 16) | index;
+
+		if (numKeys < maxResults) {
+			heap[numKeys] = key;
+			RankSiftUp(heap, numKeys++);
+		} else if (key < heap[0]) {
+			heap[0] = key;
+			RankSiftDown(heap, numKeys, 0);
+		}
+	}
+	MemHandleUnlock(recH);
+
+	if (numKeys > 0) {
+		*ret = MemHandleNew(numKeys * sizeof(UInt32));
+		*missingRet = MemHandleNew(numKeys * sizeof(UInt8));
+	}
+	if (!*ret || !*missingRet) {
+		if (*ret) MemHandleFree(*ret);
+		if (*missingRet) MemHandleFree(*missingRet);
+		*ret = NULL;
+		*missingRet = NULL;
+		if (numKeys > 0) displayError(memErrNotEnoughSpace);
+		numKeys = 0;
+	} else {
+		SysQSort(heap, numKeys, sizeof(UInt32), CompareKeys, 0);
+		results = MemHandleLock(*ret);
+		missing = MemHandleLock(*missingRet);
+		for (i = 0; i < numKeys; i++) {
+			results[i] = IDFromIndex(gRecipeDB, (UInt16)heap[i]);
+			missing[i] = (UInt8)(heap[i] >> 16);
+		}
+		MemHandleUnlock(*missingRet);
+		MemHandleUnlock(*ret);
+	}
+
+	MemHandleUnlock(heapH);
+	MemHandleFree(heapH);
+	return numKeys;
+}
+
+/*********************************************************************
+ * Grocery DB Functions
+ *********************************************************************/
+
+/***********************************************************************
+ *
+ * FUNCTION:     GroceryAddRecipes
+ *
+ * DESCRIPTION:  Adds the ingredients of a set of recipes (a meal plan) to
+ *				 the grocery list in one pass. Quantities are summed per
+ *				 ingredient and unit, including what the list already held
+ *
+ * PARAMETERS:   recipe IDs, number of recipes, true to leave out
+ *				 ingredients that are in the pantry
+ *
+ * RETURNED:     Err
+ *
+ ***********************************************************************/
+Err GroceryAddRecipes(const UInt32 *recipeIds, UInt16 numRecipes, Boolean skipPantry)
+{
+	MemHandle itemsH;
+	MemHandle recH;
+	GroceryItem *items;
+	RecipeView recipe;
+	UInt32 numItems = 0;
+	UInt32 id;
+	UInt16 numPantry, numGrocery;
+	UInt16 p = 0;
+	UInt16 g = 0;
+	UInt16 index;
+	UInt16 numUnits;
+	UInt16 i, end, r;
+	UInt8 count, frac, denom;
+	UInt8 j;
+	Err err;
+
+	err = DatabaseRequire(dbSetItems | dbSetLists);
+	if (err != errNone)
+		return err;
+
+	for (r = 0; r < numRecipes; r++) {
+		index = IndexFromID(gRecipeDB, recipeIds[r]);
+		recH = (index != 0xFFFF) ? DmQueryRecord(gRecipeDB, index) : NULL;
+		if (recH) {
+			numItems += ((RecipeHeader *)MemHandleLock(recH))->numIngredients;
+			MemHandleUnlock(recH);
+		}
+	}
+	if (numItems == 0)
+		return errNone;
+
+	// every recipe line in one chunk
+	itemsH = (numItems * sizeof(GroceryItem) < 0xFFFF) ? MemHandleNew(numItems * sizeof(GroceryItem)) : NULL;
+	if (!itemsH)
+		return memErrNotEnoughSpace;
+	items = MemHandleLock(itemsH);
+
+	numItems = 0;
+	for (r = 0; r < numRecipes; r++) {
+		index = IndexFromID(gRecipeDB, recipeIds[r]);
+		recH = (index != 0xFFFF) ? DmQueryRecord(gRecipeDB, index) : NULL;
+		if (!recH)
+			continue;
+		RecipeViewInit(&recipe, MemHandleLock(recH));
 		for (j = 0; j < recipe.numIngredients; j++) {
-			if (!EntryInDatabase(gPantryDB, recipe.ingredientIDs[j]))
-				CanBeMade = false;
+			RecipeViewQuantity(&recipe, j, &count, &frac, &denom);
+			MemSet(&items[numItems].amount, sizeof(GroceryAmount), 0);
+			items[numItems].ingredientId = RecipeViewIngredientID(&recipe, j);
+			items[numItems].amount.unitId = RecipeViewUnitID(&recipe, j);
+			AmountAdd(&items[numItems].amount, count, frac, denom);
+			numItems++;
 		}
-		
-		if (CanBeMade) {
-			results[idx] = i;
-			idx++;
+		MemHandleUnlock(recH);
+	}
+	SysQSort(items, (UInt16)numItems, sizeof(GroceryItem), CompareGroceryItems, 0);
+
+	// The items, the pantry and the grocery list are all in ingredient ID
+	// order, so one merge pass over the three does it
+	numPantry = DmNumRecords(gPantryDB);
+	for (i = 0; i < numItems && err == errNone; i = end) {
+		id = items[i].ingredientId;
+
+		// sum each unit's run into the front of the ingredient's items
+		numUnits = 0;
+		for (end = i; end < numItems && items[end].ingredientId == id; end++) {
+			if (numUnits > 0 && items[i + numUnits - 1].amount.unitId == items[end].amount.unitId)
+				AmountAdd(&items[i + numUnits - 1].amount, items[end].amount.whole,
+					items[end].amount.num, items[end].amount.denom);
+			else
+				items[i + numUnits++] = items[end];
 		}
+
+		if (skipPantry) {
+			while (p < numPantry && MembershipID(gPantryDB, p) < id)
+				p++;
+			if (p < numPantry && MembershipID(gPantryDB, p) == id)
+				continue;
+		}
+
+		numGrocery = DmNumRecords(gGroceryDB);
+		while (g < numGrocery && MembershipID(gGroceryDB, g) < id)
+			g++;
+		err = GroceryStore(g, g == numGrocery || MembershipID(gGroceryDB, g) != id,
+			items + i, numUnits);
+		g++;
 	}
-	
-	
-	MemHandleUnlock(*ret);
-	MemHandleResize(*ret, idx * sizeof(UInt16));
-	return idx;
-}
\ No newline at end of file
+
+	MemHandleUnlock(itemsH);
+	MemHandleFree(itemsH);
+	NameOrderInvalidate(gGroceryDB);
+	return err;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     GroceryGetAmounts
+ *
+ * DESCRIPTION:  Reads the quantities kept for a grocery list entry
+ *
+ * PARAMETERS:   gGroceryDB index, buffer for the amounts, most amounts
+ *				 to copy
+ *
+ * RETURNED:     number of amounts the entry has (may be more than were
+ *				 copied)
+ *
+ ***********************************************************************/
+UInt16 GroceryGetAmounts(UInt16 index, GroceryAmount *amounts, UInt16 maxAmounts)
+{
+	MemHandle recH = DmQueryRecord(gGroceryDB, index);
+	GroceryHeader *header;
+	UInt16 numAmounts = 0;
+
+	if (!recH)
+		return 0;
+
+	header = MemHandleLock(recH);
+	if (MemHandleSize(recH) >= sizeof(GroceryHeader))
+		numAmounts = header->numAmounts;
+	if (maxAmounts > numAmounts)
+		maxAmounts = numAmounts;
+	MemMove(amounts, header + 1, maxAmounts * sizeof(GroceryAmount));
+	MemHandleUnlock(recH);
+	return numAmounts;
+}
@@ -3,6 +3,14 @@
 #include "Quartermaster.h"
 #include "Quartermaster_Rsc.h"
 
+/*********************************************************************
+ * Internal Constants
+ *********************************************************************/
+
+#define editNameSize			32	// an arena name slot: 31 characters and the terminator
+#define editLineSize			(2 * sizeof(Char*) + 2 * editNameSize + 3)	// arena bytes per line
+#define editArenaSpare			16	// lines the arena has past the recipe's when it opens
+
 /*********************************************************************
  * Internal variables
  *********************************************************************/
@@ -11,17 +19,15 @@ typedef struct {
     Boolean isNew;             
     
     UInt8 numIngredients;
-    UInt8 ingredientCounts[recipeMaxIngredients];
-    UInt8 ingredientFracs[recipeMaxIngredients];
-    UInt8 ingredientDenoms[recipeMaxIngredients];
-    
-    Char** ingredientNames;
-    Char* ingredientStorage;
-    UInt16 ingredientStorageSize;
+    UInt16 numLines;            // lines the arena has room for
+    UInt8* ingredientCounts;
+    UInt8* ingredientFracs;
+    UInt8* ingredientDenoms;
     
+    Char** ingredientNames;     // every line, used or not, points at its own slot
     Char** unitNames;
-    Char* unitStorage;
-    UInt16 unitStorageSize;
+    
+    void* arena;                // holds all of the arrays above, see ArenaInit
 
 } EditRecipeContext;
 
@@ -36,7 +42,7 @@ static EditRecipeContext ctx;
  * FUNCTION:     saveRecipe
  *
  * DESCRIPTION:  Saves loaded recipe into recipe database
- *				 Deletes old entry and inserts new entry,
+ *				 Updates an existing entry in place (keeping its ID),
  *				 automatically cleaning up deleted ingredient/unit entries
  *
  * PARAMETERS:   Button id
@@ -55,7 +61,15 @@ static Err saveRecipe() {
 	steps = (steps != NULL) ? steps : "";
 
 	if (!name) return dmErrInvalidParam;
-	if (!ctx.isNew) RemoveRecipe(ctx.recipeIndex);	
+	if (!ctx.isNew)
+		return UpdateRecipe(ctx.recipeIndex, name,
+			 (const Char**)ctx.ingredientNames,
+			 (const Char**)ctx.unitNames, 
+			 ctx.numIngredients,
+			 ctx.ingredientCounts, 
+			 ctx.ingredientFracs, 
+			 ctx.ingredientDenoms, 
+			 steps);
 	err = AddRecipe(name,
 			 (const Char**)ctx.ingredientNames,
 			 (const Char**)ctx.unitNames, 
@@ -67,6 +81,108 @@ static Err saveRecipe() {
 	return err;
 }
 
+/***********************************************************************
+ *
+ * FUNCTION:     ArenaInit
+ *
+ * DESCRIPTION:  Allocates the one chunk that holds every ingredient line
+ *				 of the recipe being edited, and gives each line its own
+ *				 ingredient and unit name slot. Lines are added and
+ *				 deleted by copying into slots and moving slot pointers,
+ *				 so nothing is reallocated until the lines run out (see
+ *				 ArenaGrow) or frmCloseEvent frees it
+ *
+ * PARAMETERS:   number of lines to make room for, at most
+ *				 recipeMaxIngredients
+ *
+ * RETURNED:     err
+ *
+ ***********************************************************************/
+static Err ArenaInit(UInt16 numLines) {
+	Char *slotP;
+	UInt16 i;
+
+	ctx.arena = MemPtrNew(numLines * editLineSize);
+	if (!ctx.arena)
+		return memErrNotEnoughSpace;
+	ctx.numLines = numLines;
+
+	// the pointers go first so they stay aligned
+	ctx.ingredientNames = ctx.arena;
+	ctx.unitNames       = ctx.ingredientNames + numLines;
+	slotP = (Char *)(ctx.unitNames + numLines);
+	for (i = 0; i < numLines; i++) {
+		ctx.ingredientNames[i] = slotP;
+		ctx.unitNames[i]       = slotP + editNameSize;
+		slotP[0]               = '\0';
+		slotP[editNameSize]    = '\0';
+		slotP += 2 * editNameSize;
+	}
+
+	ctx.ingredientCounts = (UInt8 *)slotP;
+	ctx.ingredientFracs  = ctx.ingredientCounts + numLines;
+	ctx.ingredientDenoms = ctx.ingredientFracs + numLines;
+	MemSet(ctx.ingredientCounts, 3 * numLines, 0);
+	return errNone;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     ArenaGrow
+ *
+ * DESCRIPTION:  Moves the lines into an arena with twice as many of
+ *				 them (up to recipeMaxIngredients), once every line of
+ *				 the current one is in use. Doubling keeps the lines
+ *				 copied over all the adds to fewer than the recipe has
+ *
+ * PARAMETERS:   nothing
+ *
+ * RETURNED:     err, the old arena is kept on failure
+ *
+ ***********************************************************************/
+static Err ArenaGrow() {
+	EditRecipeContext old = ctx;
+	UInt16 numLines = 2 * ctx.numLines;
+	UInt8 i;
+	Err err;
+
+	if (ctx.numIngredients < ctx.numLines)
+		return errNone;
+
+	if (numLines > recipeMaxIngredients)
+		numLines = recipeMaxIngredients;
+	err = ArenaInit(numLines);
+	if (err != errNone) {
+		ctx = old;
+		return err;
+	}
+	for (i = 0; i < old.numIngredients; i++) {
+		StrCopy(ctx.ingredientNames[i], old.ingredientNames[i]);
+		StrCopy(ctx.unitNames[i], old.unitNames[i]);
+	}
+	MemMove(ctx.ingredientCounts, old.ingredientCounts, old.numIngredients);
+	MemMove(ctx.ingredientFracs, old.ingredientFracs, old.numIngredients);
+	MemMove(ctx.ingredientDenoms, old.ingredientDenoms, old.numIngredients);
+	MemPtrFree(old.arena);
+	return errNone;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     CopyName
+ *
+ * DESCRIPTION:  Copies a name into an arena slot, truncating it to fit
+ *
+ * PARAMETERS:   slot, name
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void CopyName(Char *slotP, const Char *nameP) {
+	StrNCopy(slotP, nameP, editNameSize - 1);
+	slotP[editNameSize - 1] = '\0';
+}
+
 /***********************************************************************
  *
  * FUNCTION:     DeleteIngredient
@@ -80,11 +196,16 @@ static Err saveRecipe() {
  *
  ***********************************************************************/
 static Err DeleteIngredient(UInt16 index) {
+    Char* ingredientSlot;
+    Char* unitSlot;
     UInt16 i;
 
     if (index >= ctx.numIngredients)
         return dmErrIndexOutOfRange;
 
+    ingredientSlot = ctx.ingredientNames[index];
+    unitSlot       = ctx.unitNames[index];
+
     for (i = index; i < ctx.numIngredients - 1; i++) {
         ctx.ingredientCounts[i] = ctx.ingredientCounts[i + 1];
         ctx.ingredientFracs[i]  = ctx.ingredientFracs[i + 1];
@@ -99,8 +220,9 @@ static Err DeleteIngredient(UInt16 index) {
     ctx.ingredientCounts[ctx.numIngredients] = 0;
     ctx.ingredientFracs[ctx.numIngredients]  = 0;
     ctx.ingredientDenoms[ctx.numIngredients] = 0;
-    ctx.ingredientNames[ctx.numIngredients]  = NULL;
-    ctx.unitNames[ctx.numIngredients]        = NULL;
+    // the deleted line's slots are reused by the next line added
+    ctx.ingredientNames[ctx.numIngredients]  = ingredientSlot;
+    ctx.unitNames[ctx.numIngredients]        = unitSlot;
 
     return errNone;
 }
@@ -131,7 +253,7 @@ static Err AddIngredientForm() {
 	FrmDrawForm(frmP);
 	lst = FrmGetObjectPtr(frmP, FrmGetObjectIndex(frmP, listAddIngredient));
 	
-	LstSetListChoices(lst, NULL, DmNumRecords(gIngredientDB));
+	LstSetListChoices(lst, NULL, LiveRecordCount(gIngredientDB));
 	LstSetDrawFunction(lst, DrawIngredientList);
 	LstDrawList(lst);
 	LstSetSelection(lst, -1);
@@ -162,13 +284,17 @@ static Boolean EditRecipeDoCommand(UInt16 command) {
 	
 	switch (command) {
 	   	case EditRecipeAddIng:
-	   		if (ctx.numIngredients == recipeMaxIngredients) {
+	   		if (ctx.numIngredients >= recipeMaxIngredients) {
 	   			displayError(errRecipeMaxIngreds);
 	   		} else {
 	   			/*frmP = FrmInitForm(formAddIngredient);
 	   			selection = FrmDoDialog(frmP);
 	   			FrmDeleteForm(frmP); */
-	   			AddIngredientForm();
+	   			err = ArenaGrow();
+	   			if (err != errNone)
+	   				displayError(err);
+	   			else
+	   				AddIngredientForm();
 	   		}
 	   		handled = true;
 	   		break;
@@ -315,8 +441,6 @@ Boolean AddIngredientHandleEvent(EventPtr eventP) {
     Char *nameP, *unitP, *wholeP, *fracP, *denomP;
     UInt16 selection;
     EventType event;
-    Err err;
-    UInt16 i;
 
 
 	if (eventP->eType == ctlSelectEvent) {
@@ -339,75 +463,8 @@ Boolean AddIngredientHandleEvent(EventPtr eventP) {
 					ctx.ingredientFracs[ctx.numIngredients]  = fracP  ? StrAToI(fracP)  : 0;
 					ctx.ingredientDenoms[ctx.numIngredients] = denomP ? StrAToI(denomP) : 0;
 					
-					selection = (StrLen(nameP) < 32) ? StrLen(nameP) : 31;
-					if (ctx.ingredientStorageSize == 0) {
-						ctx.ingredientStorage = MemPtrNew(selection + 1);
-						ctx.ingredientNames[ctx.numIngredients] = ctx.ingredientStorage;
-						StrNCopy(ctx.ingredientStorage, nameP, selection);
-						ctx.ingredientStorage[selection] = '\0';
-						ctx.ingredientStorageSize = selection + 1;
-					}
-					else {
-						recP = MemPtrNew(ctx.ingredientStorageSize + selection + 1);
-						err = MemMove(recP, ctx.ingredientStorage, ctx.ingredientStorageSize);
-						if (err != errNone) {
-							displayError(err);
-							if (recP) MemPtrFree(recP);
-							FrmReturnToForm(formEditRecipe);
-							break;
-						}
-						for (i = 0; i < ctx.numIngredients; i++) {
-							ctx.ingredientNames[i] = (ctx.ingredientNames[i] - ctx.ingredientStorage) + recP;
-						}
-						StrNCopy(recP + ctx.ingredientStorageSize, nameP, selection);
-						recP[ctx.ingredientStorageSize + selection] = '\0';
-						ctx.ingredientNames[ctx.numIngredients] = recP + ctx.ingredientStorageSize;
-						
-						MemPtrFree(ctx.ingredientStorage);
-						ctx.ingredientStorage = recP;
-						ctx.ingredientStorageSize += selection + 1; 
-					/* 	err = MemPtrResize(ctx.ingredientStorage, ctx.ingredientStorageSize + selection + 1);
-						if (err != errNone) {
-							displayError(err);
-							if (ctx.namePtrs) MemPtrFree(ctx.namePtrs);
-							if (ctx.nameStorage) MemPtrFree(ctx.nameStorage);
-							FrmReturnToForm(formEditRecipe);
-							break;
-						}
-						StrNCopy(ctx.ingredientStorage + ctx.ingredientStorageSize, nameP, selection);
-						ctx.ingredientStorage[ctx.ingredientStorageSize + selection] = '\0';
-						ctx.ingredientNames[ctx.numIngredients] = ctx.ingredientStorage + ctx.ingredientStorageSize;
-						ctx.ingredientStorageSize += selection + 1; */
-					}
-					
-					selection = (StrLen(unitP) < 32) ? StrLen(unitP) : 31;
-					if (ctx.unitStorageSize == 0) {
-						ctx.unitStorage = MemPtrNew(selection + 1);
-						ctx.unitNames[ctx.numIngredients] = ctx.unitStorage;
-						StrNCopy(ctx.unitStorage, unitP, selection);
-						ctx.unitStorage[selection] = '\0';
-						ctx.unitStorageSize = selection + 1;
-					}
-					else {
-						recP = MemPtrNew(ctx.unitStorageSize + selection + 1);
-						err = MemMove(recP, ctx.unitStorage, ctx.unitStorageSize);
-						if (err != errNone) {
-							displayError(err);
-							if (recP) MemPtrFree(recP);
-							FrmReturnToForm(formEditRecipe);
-							break;
-						}
-						for (i = 0; i < ctx.numIngredients; i++) {
-							ctx.unitNames[i] = (UInt32)(ctx.unitNames[i] - ctx.unitStorage) + recP;
-						}
-						StrNCopy(recP + ctx.unitStorageSize, unitP, selection);
-						recP[ctx.unitStorageSize + selection] = '\0';
-						ctx.unitNames[ctx.numIngredients] = recP + ctx.unitStorageSize;
-						
-						MemPtrFree(ctx.unitStorage);
-						ctx.unitStorage = recP;
-						ctx.unitStorageSize += selection + 1;
-					}
+					CopyName(ctx.ingredientNames[ctx.numIngredients], nameP);
+					CopyName(ctx.unitNames[ctx.numIngredients], unitP);
 					
 					ctx.numIngredients++;
 					FrmReturnToForm(formEditRecipe);
@@ -426,7 +483,7 @@ Boolean AddIngredientHandleEvent(EventPtr eventP) {
 				lst = FrmGetObjectPtr(frmP, FrmGetObjectIndex(frmP, listAddIngredient));
 				selection = LstGetSelection(lst); 
 				if (selection != noListSelection) { 
-					recH = DmQueryRecord(gIngredientDB, selection); 
+					recH = DmQueryRecord(gIngredientDB, LiveRecordIndex(gIngredientDB, selection)); 
 					recP = MemHandleLock(recH); 
 					fld = (FieldType*)FrmGetObjectPtr(frmP, FrmGetObjectIndex(frmP, formAddName)); 
 					FldInsert(fld, recP, StrLen(recP)); 
@@ -458,8 +515,7 @@ Boolean EditRecipeHandleEvent(EventPtr eventP) {
 	FormPtr frmP;
 	Boolean handled = false;
 	MemHandle recipeH = NULL;
-    MemPtr *recipeP = NULL;
-    RecipeRecord recipe;
+    RecipeView recipe;
     FieldType *fld;
     ListType *lst;
     Char *steps;
@@ -478,16 +534,18 @@ Boolean EditRecipeHandleEvent(EventPtr eventP) {
 			
 			if (!ctx.isNew) {
 				recipeH = DmQueryRecord(gRecipeDB, ctx.recipeIndex);
-				recipeP = MemHandleLock(recipeH);
-				recipe = RecipeGetRecord(recipeP);
-				MemHandleUnlock(recipeH);
+				RecipeViewInit(&recipe, MemHandleLock(recipeH));
 				
 				fld = FrmGetObjectPtr(frmP, FrmGetObjectIndex(frmP, EditRecipeName));
 				FldInsert(fld, recipe.name, StrLen(recipe.name));
 			
 	        	fld = FrmGetObjectPtr(frmP, FrmGetObjectIndex(frmP, EditRecipeSteps));
-	        	steps = RecipeGetStepsPtr(recipeP);
-	        	FldInsert(fld, steps, StrLen(steps));
+	        	steps = RecipeViewStepsText(&recipe);
+	        	if (steps) {
+	        		FldInsert(fld, steps, StrLen(steps));
+	        		MemPtrFree(steps);
+	        	}
+				MemHandleUnlock(recipeH);
 			}
 	        lst = FrmGetObjectPtr(frmP, FrmGetObjectIndex(frmP, EditRecipeIngredients));
 	       	LstSetListChoices(lst, NULL, ctx.numIngredients);
@@ -527,22 +585,9 @@ Boolean EditRecipeHandleEvent(EventPtr eventP) {
 			return EditRecipeDoCommand(eventP->data.menu.itemID);
 
 		case frmCloseEvent:
-			if (ctx.ingredientNames) {
-				MemPtrFree(ctx.ingredientNames);
-		       	ctx.ingredientNames = NULL;
-		    }
-			if (ctx.ingredientStorage) { 
-				MemPtrFree(ctx.ingredientStorage);
-		       	ctx.ingredientStorage = NULL;
-		    }
-			if (ctx.unitNames) {
-				MemPtrFree(ctx.unitNames);
-		       	ctx.unitNames = NULL;
-		    }
-			if (ctx.unitStorage) { 
-				MemPtrFree(ctx.unitStorage);
-		       	ctx.unitStorage = NULL;
-		    }
+			if (ctx.arena)
+				MemPtrFree(ctx.arena);
+			MemSet(&ctx, sizeof(EditRecipeContext), 0);
 			break;
 			
 		case keyDownEvent:
@@ -610,74 +655,45 @@ Boolean EditRecipeHandleEvent(EventPtr eventP) {
  ***********************************************************************/
 Err OpenEditRecipeForm(UInt16 selection, Boolean isNew) {    
     MemHandle recipeH = NULL;
-	MemPtr recipeP = NULL;
-	RecipeRecord recipe;
-    Char buf[32];
-    Char *storagePtr;
+	RecipeView recipe;
+    UInt16 numLines;
     UInt8 i;
+    Err err;
 
     MemSet(&ctx, sizeof(EditRecipeContext), 0);
     ctx.isNew             = isNew;
     ctx.recipeIndex       = selection;
-	ctx.ingredientNames   = MemPtrNew(sizeof(Char) * recipeMaxIngredients);
-	ctx.unitNames         = MemPtrNew(sizeof(Char) * recipeMaxIngredients);
+
+    // called before the form loads, so its databases are not open yet -
+    // names looked up without dbSetItems would come back blank
+    err = DatabaseRequire(dbSetAll);
+    if (err != errNone)
+        return err;
 
     if (!isNew) {
         recipeH = DmQueryRecord(gRecipeDB, selection);
-        if (recipeH) {
-            recipeP = MemHandleLock(recipeH);
-            recipe = RecipeGetRecord(recipeP);
-            MemHandleUnlock(recipeH);
-            ctx.numIngredients = recipe.numIngredients;
-            
-            if (ctx.numIngredients > 0) {
-				MemMove(ctx.ingredientCounts,
-					        recipe.ingredientCounts,
-					        ctx.numIngredients * sizeof(UInt8));
-
-				MemMove(ctx.ingredientFracs,
-					        recipe.ingredientFracs,
-					        ctx.numIngredients * sizeof(UInt8));
-
-				MemMove(ctx.ingredientDenoms,
-					        recipe.ingredientDenoms,
-					        ctx.numIngredients * sizeof(UInt8));
-	           
-	    		ctx.ingredientStorage = MemPtrNew(recipe.numIngredients * 32);
-	            storagePtr            = ctx.ingredientStorage;
-	                
-	   			if (!ctx.ingredientNames || !ctx.ingredientStorage)
-	   				return memErrNotEnoughSpace;
-	    			                
-			    for (i = 0; i < recipe.numIngredients; i++) {
-			        IngredientNameByID(buf, 32, recipe.ingredientIDs[i]);
-			        StrNCopy(storagePtr, buf, 31);
-					storagePtr[31] = '\0';
-					ctx.ingredientNames[i] = storagePtr;
-					storagePtr += StrLen(storagePtr) + 1; //max 32
-				}
-				    
-				MemPtrResize(ctx.ingredientStorage, (storagePtr - ctx.ingredientStorage));
-				ctx.ingredientStorageSize = storagePtr - ctx.ingredientStorage;
-	                
-				ctx.unitStorage = MemPtrNew(recipe.numIngredients * 32);
-	            storagePtr      = ctx.unitStorage;
-	                
-	            if (!ctx.unitNames || !ctx.unitStorage)
-	            	return memErrNotEnoughSpace;
-	                
-				for (i = 0; i < recipe.numIngredients; i++) {
-			        UnitNameByID(buf, 32, recipe.ingredientUnits[i]);
-					StrNCopy(storagePtr, buf, 31);
-					storagePtr[31] = '\0';
-					ctx.unitNames[i] = storagePtr;
-					storagePtr += StrLen(storagePtr) + 1; //max 32
-				}    
-				MemPtrResize(ctx.unitStorage, (storagePtr - ctx.unitStorage));
-				ctx.unitStorageSize = storagePtr - ctx.unitStorage;
-			}
+        if (recipeH)
+            RecipeViewInit(&recipe, MemHandleLock(recipeH));
+    }
+
+    // room for the recipe's own lines, and a few more before it grows
+    numLines = (recipeH ? recipe.numIngredients : 0) + editArenaSpare;
+    if (numLines > recipeMaxIngredients)
+        numLines = recipeMaxIngredients;
+    err = ArenaInit(numLines);
+    if (err == errNone && recipeH) {
+        ctx.numIngredients = recipe.numIngredients;
+        for (i = 0; i < recipe.numIngredients; i++) {
+            RecipeViewQuantity(&recipe, i, &ctx.ingredientCounts[i],
+                &ctx.ingredientFracs[i], &ctx.ingredientDenoms[i]);
+            IngredientNameByID(ctx.ingredientNames[i], editNameSize, RecipeViewIngredientID(&recipe, i));
+            UnitNameByID(ctx.unitNames[i], editNameSize, RecipeViewUnitID(&recipe, i));
         }
-    } 
+    }
+    if (recipeH)
+        MemHandleUnlock(recipeH);
+    if (err != errNone)
+        return err;
 
     FrmGotoForm(formEditRecipe); 
     return errNone;   
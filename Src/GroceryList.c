@@ -3,6 +3,12 @@
 #include "Quartermaster.h"
 #include "Quartermaster_Rsc.h"
 
+/*********************************************************************
+ * Internal constants
+ *********************************************************************/
+
+#define groceryShownAmounts		2	// quantities drawn per entry, the rest as "..."
+
 /*********************************************************************
  * Internal functions
  *********************************************************************/
@@ -19,36 +25,59 @@
  *
  ***********************************************************************/
 static void DrawGroceryList(Int16 itemNum, RectanglePtr bounds, Char** data) {
+	GroceryAmount amounts[groceryShownAmounts];
 	MemHandle groceryH;
-	UInt32* groceryP;
-	MemHandle ingredientH;
-	Char* ingredientP;
-	UInt16 index;
+	UInt32 id;
+	UInt16 numAmounts;
+	UInt16 recIndex;
+	UInt16 i;
+	Char namebuf[32];
+	Char unitbuf[32];
+	Char qtyBuf[18];
+	Char buf[160];
+	Char* end;
 
 	if (itemNum >= DmNumRecords(gGroceryDB)) return;
 	
-	groceryH = DmQueryRecord(gGroceryDB, itemNum);
+	recIndex = NameOrderIndex(gGroceryDB, itemNum);
+	groceryH = DmQueryRecord(gGroceryDB, recIndex);
 	
 	if (!groceryH) return;
 	
-	groceryP = MemHandleLock(groceryH);
+	id = *(UInt32*)MemHandleLock(groceryH);
+	MemHandleUnlock(groceryH);
 	
-	if (DmFindRecordByID(gIngredientDB, *groceryP, &index) == errNone) {
-		ingredientH = DmQueryRecord(gIngredientDB, index);
-		if (ingredientH) {
-			ingredientP = MemHandleLock(ingredientH);
-			
-			WinGlueDrawTruncChars(
-				ingredientP,
-				StrLen(ingredientP),
-				bounds->topLeft.x,
-				bounds->topLeft.y,
-				bounds->extent.x
-			);
-			MemHandleUnlock(ingredientH);
-		}
+	if (IngredientNameByID(namebuf, 32, id) != errNone) return;
+	
+	// Quantities go in front like on the recipe view, e.g.
+	// "2 1/2 cup, 100 g flour"
+	buf[0] = '\0';
+	end = buf;
+	numAmounts = GroceryGetAmounts(recIndex, amounts, groceryShownAmounts);
+	for (i = 0; i < numAmounts && i < groceryShownAmounts; i++) {
+		FormatQuantity(qtyBuf, amounts[i].whole, amounts[i].num, amounts[i].denom);
+		if (UnitNameByID(unitbuf, 32, amounts[i].unitId) != errNone)
+			unitbuf[0] = '\0';
+		
+		if (qtyBuf[0] != '\0' && unitbuf[0] != '\0')
+			end += StrPrintF(end, "%s %s", qtyBuf, unitbuf);
+		else
+			// Allows unitless ingredients (e.g. 2 eggs)
+			end += StrPrintF(end, "%s%s", qtyBuf, unitbuf);
+		if (end > buf)
+			end += StrPrintF(end, (i + 1 < numAmounts) ? ", " : " ");
 	}
-	MemHandleUnlock(groceryH);
+	if (numAmounts > groceryShownAmounts)
+		end += StrPrintF(end, "... ");
+	StrCopy(end, namebuf);
+	
+	WinGlueDrawTruncChars(
+		buf,
+		StrLen(buf),
+		bounds->topLeft.x,
+		bounds->topLeft.y,
+		bounds->extent.x
+	);
 }
 
 /***********************************************************************
@@ -77,7 +106,7 @@ static Boolean GroceryDoCommand(UInt16 command) {
 	   		lst = FrmGetObjectPtr(frmP, FrmGetObjectIndex(frmP, groceryOptionsList));
 	   		selection = LstGetSelection(lst); 
 			if (selection != noListSelection) {
-				id = IDFromIndex(gIngredientDB, selection);
+				id = IDFromIndex(gIngredientDB, LiveRecordIndex(gIngredientDB, selection));
 				if (EntryInDatabase(gPantryDB, id)) {
 					if (FrmAlert(InPantryAlert) != 0) // alert if ingredient is in pantry
 						return true; // exits early if cancel button chosen
@@ -95,7 +124,7 @@ static Boolean GroceryDoCommand(UInt16 command) {
 	   		lst = FrmGetObjectPtr(frmP, FrmGetObjectIndex(frmP, groceryList));
 	   		selection = LstGetSelection(lst); 
 			if (selection != noListSelection) {
-		        err = DmRemoveRecord(gGroceryDB, selection);
+		        err = RemoveEntry(gGroceryDB, NameOrderIndex(gGroceryDB, selection));
 		        if (err != errNone) {
 		            displayError(err);
 		        } else {
@@ -136,7 +165,7 @@ Boolean GroceryHandleEvent(EventPtr eventP) {
 			FrmDrawForm (frmP);
 
 			lst = FrmGetObjectPtr(frmP, FrmGetObjectIndex(frmP, groceryOptionsList));
-			LstSetListChoices(lst, NULL, DmNumRecords(gIngredientDB));
+			LstSetListChoices(lst, NULL, LiveRecordCount(gIngredientDB));
 			LstSetDrawFunction(lst, DrawIngredientList);
 	    	LstDrawList(lst);
 	    	LstSetSelection(lst, -1);
@@ -22,6 +22,8 @@ static Boolean ManageIngredientsDoCommand(UInt16 command) {
 	Boolean handled = false;
 	ListType* lst;
 	UInt16 selection;
+	MemHandle results;
+	UInt16 numResults;
 
 	switch(command) {
 		case IngredientAdd:
@@ -37,15 +39,29 @@ static Boolean ManageIngredientsDoCommand(UInt16 command) {
 	   		lst = FrmGetObjectPtr(frmP, FrmGetObjectIndex(frmP, ingredientList));
 	   		selection = LstGetSelection(lst); 
 			if (selection != noListSelection) {
-				displayErrorIf(RemoveIngredient(IDFromIndex(gIngredientDB, selection)));
+				displayErrorIf(RemoveIngredient(IDFromIndex(gIngredientDB, LiveRecordIndex(gIngredientDB, selection))));
 				// is this too many chained functions lol
 				lst = FrmGetObjectPtr(frmP, FrmGetObjectIndex(frmP, ingredientList));
-				LstSetListChoices(lst, NULL, DmNumRecords(gIngredientDB));
+				LstSetListChoices(lst, NULL, LiveRecordCount(gIngredientDB));
 		    	LstDrawList(lst);
 		    	LstSetSelection(lst, -1);
 			}
 			handled = true;
 			break;
+
+		case IngredientRecipes:
+			frmP = FrmGetActiveForm();
+	   		lst = FrmGetObjectPtr(frmP, FrmGetObjectIndex(frmP, ingredientList));
+	   		selection = LstGetSelection(lst); 
+			if (selection != noListSelection) {
+				numResults = IngredientRecipeSearch(IDFromIndex(gIngredientDB, LiveRecordIndex(gIngredientDB, selection)), &results);
+				if (numResults > 0)
+					OpenRecipeList(results, numResults);
+				else
+					displayError(errSearchNoMatch);
+			}
+			handled = true;
+			break;
 	}
 	return handled;
 } 
@@ -128,7 +144,7 @@ Boolean ManageIngredientsHandleEvent(EventPtr eventP) {
 			FrmDrawForm (frmP);
 
 			lst = FrmGetObjectPtr(frmP, FrmGetObjectIndex(frmP, ingredientList));
-			LstSetListChoices(lst, NULL, DmNumRecords(gIngredientDB));
+			LstSetListChoices(lst, NULL, LiveRecordCount(gIngredientDB));
 			LstSetDrawFunction(lst, DrawIngredientList);
 	    	LstDrawList(lst);
 	    	LstSetSelection(lst, -1);
@@ -139,7 +155,7 @@ Boolean ManageIngredientsHandleEvent(EventPtr eventP) {
 		case frmUpdateEvent:
 			frmP = FrmGetActiveForm();	
 			lst = FrmGetObjectPtr(frmP, FrmGetObjectIndex(frmP, ingredientList));
-			LstSetListChoices(lst, NULL, DmNumRecords(gIngredientDB));
+			LstSetListChoices(lst, NULL, LiveRecordCount(gIngredientDB));
 	    	LstDrawList(lst);
 	    	LstSetSelection(lst, -1);
 	    	break;
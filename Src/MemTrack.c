@@ -0,0 +1,433 @@
+#include <PalmOS.h>
+#include "Quartermaster.h"
+
+// Allocation tracking for debug builds: with DEBUG_MEMORY defined,
+// Quartermaster.h routes the Memory Manager calls of every file through
+// the functions below, and MemTrackCheckpoint logs whatever is left over.
+// Without it this file compiles to nothing. Quartermaster.mcp does not list
+// it; see the readme for adding it to the Debug target
+#ifdef DEBUG_MEMORY
+
+// The tracked calls themselves go to the real Memory Manager
+#undef MemPtrNew
+#undef MemPtrFree
+#undef MemHandleNew
+#undef MemHandleFree
+#undef MemHandleLock
+#undef MemHandleUnlock
+#undef MemHandleResize
+
+/*********************************************************************
+ * Internal Constants
+ *********************************************************************/
+
+#define memTrackMaxBlocks		512		// blocks and locked handles tracked at once
+#define memTrackMaxLines		24		// blocks listed per checkpoint
+#define memTrackLineSize		64
+#define memTrackLogName			"QMMemLog"
+#define memTrackLogType			'Mlog'
+
+#define memTrackPtr				0		// MemTrackBlock.kind
+#define memTrackHandle			1
+#define memTrackForeign			2		// a handle only locked here, such as a record
+
+/*********************************************************************
+ * Internal Structures
+ *********************************************************************/
+
+// A block allocated through MemTrack, or a handle locked through it
+typedef struct {
+	const void *block;
+	const Char *file;			// call site of the allocation, or of the first lock
+	const Char *lockFile;		// call site of the last lock or unlock
+	UInt32 size;
+	UInt16 line;
+	UInt16 lockLine;
+	UInt16 checkpoint;			// gTrack.checkpoints when allocated
+	Int8 locks;
+	Int8 checkedLocks;			// locks at the last checkpoint
+	UInt8 kind;
+} MemTrackBlock;
+
+typedef struct {
+	MemTrackBlock *blocks;		// packed, numBlocks in use
+	UInt16 numBlocks;
+	UInt16 checkpoints;
+	UInt16 dropped;				// blocks not tracked because the table was full
+	UInt16 unknownFrees;		// frees of blocks never tracked
+} MemTrack;
+
+/*********************************************************************
+ * Internal Variables
+ *********************************************************************/
+
+static MemTrack gTrack;
+
+/*********************************************************************
+ * Internal Functions
+ *********************************************************************/
+
+/***********************************************************************
+ *
+ * FUNCTION:     TrackFind
+ *
+ * DESCRIPTION:  Finds the entry of a pointer or handle
+ *
+ * PARAMETERS:   pointer or handle
+ *
+ * RETURNED:     entry, NULL if not tracked
+ *
+ ***********************************************************************/
+static MemTrackBlock* TrackFind(const void *block)
+{
+	UInt16 i;
+
+	for (i = 0; i < gTrack.numBlocks; i++) {
+		if (gTrack.blocks[i].block == block)
+			return &gTrack.blocks[i];
+	}
+	return NULL;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     TrackAdd
+ *
+ * DESCRIPTION:  Adds an entry, allocating the table on first use
+ *
+ * PARAMETERS:   pointer or handle, kind, size, call site
+ *
+ * RETURNED:     entry, NULL if the table is full
+ *
+ ***********************************************************************/
+static MemTrackBlock* TrackAdd(const void *block, UInt8 kind, UInt32 size,
+	const Char *file, UInt16 line)
+{
+	MemTrackBlock *entry;
+
+	if (!gTrack.blocks) {
+		gTrack.blocks = MemPtrNew(memTrackMaxBlocks * sizeof(MemTrackBlock));
+		if (!gTrack.blocks) {
+			gTrack.dropped++;
+			return NULL;
+		}
+	}
+	if (gTrack.numBlocks >= memTrackMaxBlocks) {
+		gTrack.dropped++;
+		return NULL;
+	}
+
+	entry = &gTrack.blocks[gTrack.numBlocks++];
+	MemSet(entry, sizeof(MemTrackBlock), 0);
+	entry->block      = block;
+	entry->kind       = kind;
+	entry->size       = size;
+	entry->file       = file;
+	entry->line       = line;
+	entry->lockFile   = file;
+	entry->lockLine   = line;
+	entry->checkpoint = gTrack.checkpoints;
+	return entry;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     TrackRemove
+ *
+ * DESCRIPTION:  Removes an entry, moving the last one into its place
+ *
+ * PARAMETERS:   entry
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void TrackRemove(MemTrackBlock *entry)
+{
+	gTrack.numBlocks--;
+	*entry = gTrack.blocks[gTrack.numBlocks];
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     TrackFree
+ *
+ * DESCRIPTION:  Forgets a block that is being freed
+ *
+ * PARAMETERS:   pointer or handle
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void TrackFree(const void *block)
+{
+	MemTrackBlock *entry = TrackFind(block);
+
+	if (entry)
+		TrackRemove(entry);
+	else if (block)
+		gTrack.unknownFrees++;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     TrackLock
+ *
+ * DESCRIPTION:  Follows the lock depth of a handle through a lock or
+ *				 unlock. Handles not allocated here (records) are tracked
+ *				 only while locked
+ *
+ * PARAMETERS:   handle, +1 or -1, call site
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void TrackLock(MemHandle h, Int8 delta, const Char *file, UInt16 line)
+{
+	MemTrackBlock *entry = TrackFind(h);
+
+	if (!entry) {
+		entry = TrackAdd(h, memTrackForeign, 0, file, line);
+		if (!entry)
+			return;
+	}
+	entry->locks   += delta;
+	entry->lockFile = file;
+	entry->lockLine = line;
+	if (entry->kind == memTrackForeign && entry->locks == 0 && entry->checkedLocks == 0)
+		TrackRemove(entry);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     BaseName
+ *
+ * DESCRIPTION:  Strips the directories from a __FILE__ path
+ *
+ * PARAMETERS:   path
+ *
+ * RETURNED:     file name
+ *
+ ***********************************************************************/
+static const Char* BaseName(const Char *path)
+{
+	const Char *nameP = path;
+
+	for (; *path; path++) {
+		if (*path == '/' || *path == '\\' || *path == ':')
+			nameP = path + 1;
+	}
+	return nameP;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     LogOpen
+ *
+ * DESCRIPTION:  Opens the checkpoint log database, creating it if needed
+ *
+ * PARAMETERS:   nothing
+ *
+ * RETURNED:     database, NULL on error
+ *
+ ***********************************************************************/
+static DmOpenRef LogOpen(void)
+{
+	LocalID dbID = DmFindDatabase(0, memTrackLogName);
+
+	if (!dbID) {
+		if (DmCreateDatabase(0, memTrackLogName, appFileCreator, memTrackLogType, false) != errNone)
+			return NULL;
+		dbID = DmFindDatabase(0, memTrackLogName);
+	}
+	return dbID ? DmOpenDatabase(0, dbID, dmModeReadWrite) : NULL;
+}
+
+/*********************************************************************
+ * External Functions
+ *********************************************************************/
+
+/***********************************************************************
+ *
+ * FUNCTION:     MemTrackPtrNew, MemTrackPtrFree, MemTrackHandleNew,
+ *				 MemTrackHandleFree, MemTrackHandleLock,
+ *				 MemTrackHandleUnlock, MemTrackHandleResize
+ *
+ * DESCRIPTION:  Stand in for the Memory Manager calls of the same names
+ *				 (see Quartermaster.h), recording the call site, size and
+ *				 lock depth of each block
+ *
+ * PARAMETERS:   those of the Memory Manager call, call site
+ *
+ * RETURNED:     that of the Memory Manager call
+ *
+ ***********************************************************************/
+MemPtr MemTrackPtrNew(UInt32 size, const Char *file, UInt16 line)
+{
+	MemPtr p = MemPtrNew(size);
+
+	if (p)
+		TrackAdd(p, memTrackPtr, size, file, line);
+	return p;
+}
+
+Err MemTrackPtrFree(MemPtr p, const Char *file, UInt16 line)
+{
+	TrackFree(p);
+	return MemPtrFree(p);
+}
+
+MemHandle MemTrackHandleNew(UInt32 size, const Char *file, UInt16 line)
+{
+	MemHandle h = MemHandleNew(size);
+
+	if (h)
+		TrackAdd(h, memTrackHandle, size, file, line);
+	return h;
+}
+
+Err MemTrackHandleFree(MemHandle h, const Char *file, UInt16 line)
+{
+	TrackFree(h);
+	return MemHandleFree(h);
+}
+
+MemPtr MemTrackHandleLock(MemHandle h, const Char *file, UInt16 line)
+{
+	TrackLock(h, 1, file, line);
+	return MemHandleLock(h);
+}
+
+Err MemTrackHandleUnlock(MemHandle h, const Char *file, UInt16 line)
+{
+	TrackLock(h, -1, file, line);
+	return MemHandleUnlock(h);
+}
+
+Err MemTrackHandleResize(MemHandle h, UInt32 newSize, const Char *file, UInt16 line)
+{
+	MemTrackBlock *entry;
+	Err err = MemHandleResize(h, newSize);
+
+	entry = TrackFind(h);
+	if (err == errNone && entry && entry->kind == memTrackHandle)
+		entry->size = newSize;
+	return err;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     MemTrackCheckpoint
+ *
+ * DESCRIPTION:  Appends a record to the QMMemLog database describing the
+ *				 blocks still allocated and the lock depths that changed
+ *				 since the last checkpoint. Blocks allocated since then
+ *				 are listed (all of them when closing is true, since
+ *				 everything left at that point has leaked), as are
+ *				 handles whose lock depth changed
+ *
+ * PARAMETERS:   what is being checked (e.g. "frmCloseEvent"), a form or
+ *				 other ID to go with it, true when the app is stopping
+ *
+ * RETURNED:     number of blocks and locks listed
+ *
+ ***********************************************************************/
+UInt16 MemTrackCheckpoint(const Char *where, UInt16 id, Boolean closing)
+{
+	Char line[memTrackLineSize];
+	DmOpenRef logDB;
+	MemHandle recH = NULL;
+	Char *recP = NULL;
+	MemTrackBlock *entry;
+	UInt32 bytes = 0;
+	UInt32 offset;
+	UInt16 numListed = 0;
+	UInt16 index = dmMaxRecordIndex;
+	UInt16 i;
+
+	for (i = 0; i < gTrack.numBlocks; i++)
+		bytes += gTrack.blocks[i].size;
+
+	logDB = LogOpen();
+	if (logDB) {
+		recH = DmNewRecord(logDB, &index, (memTrackMaxLines + 2) * memTrackLineSize);
+		if (recH)
+			recP = MemHandleLock(recH);
+	}
+
+	StrPrintF(line, "%s %u: %u blocks, %lu bytes\n", where, id,
+		gTrack.numBlocks, bytes);
+	offset = 0;
+	if (recP)
+		DmWrite(recP, offset, line, StrLen(line));
+	offset += StrLen(line);
+
+	for (i = 0; i < gTrack.numBlocks; i++) {
+		entry = &gTrack.blocks[i];
+		line[0] = '\0';
+		if (entry->locks != entry->checkedLocks || (closing && entry->locks != 0)) {
+			StrPrintF(line, " locks %d->%d %s:%u\n", entry->checkedLocks, entry->locks,
+				BaseName(entry->lockFile), entry->lockLine);
+		} else if (entry->kind != memTrackForeign &&
+				(closing || entry->checkpoint == gTrack.checkpoints)) {
+			StrPrintF(line, " %s %lu %s:%u\n", entry->kind == memTrackPtr ? "ptr" : "handle",
+				entry->size, BaseName(entry->file), entry->line);
+		}
+		entry->checkedLocks = entry->locks;
+		if (!line[0])
+			continue;
+
+		numListed++;
+		if (numListed <= memTrackMaxLines) {
+			if (recP)
+				DmWrite(recP, offset, line, StrLen(line));
+			offset += StrLen(line);
+		}
+	}
+
+	if (numListed > memTrackMaxLines || gTrack.dropped || gTrack.unknownFrees) {
+		StrPrintF(line, " %u more, %u untracked, %u unknown frees\n",
+			numListed > memTrackMaxLines ? numListed - memTrackMaxLines : 0,
+			gTrack.dropped, gTrack.unknownFrees);
+		if (recP)
+			DmWrite(recP, offset, line, StrLen(line));
+		offset += StrLen(line);
+	}
+
+	// forget the foreign handles now back at lock depth 0
+	for (i = gTrack.numBlocks; i > 0; i--) {
+		entry = &gTrack.blocks[i - 1];
+		if (entry->kind == memTrackForeign && entry->locks == 0)
+			TrackRemove(entry);
+	}
+	gTrack.checkpoints++;
+
+	if (recP) {
+		DmWrite(recP, offset, "", 1);
+		MemHandleUnlock(recH);
+		DmResizeRecord(logDB, index, offset + 1);
+		DmReleaseRecord(logDB, index, true);
+	}
+	if (logDB)
+		DmCloseDatabase(logDB);
+	return numListed;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     MemTrackStop
+ *
+ * DESCRIPTION:  Frees the tracking table (call after the last checkpoint)
+ *
+ * PARAMETERS:   nothing
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+void MemTrackStop(void)
+{
+	if (gTrack.blocks)
+		MemPtrFree(gTrack.blocks);
+	MemSet(&gTrack, sizeof(MemTrack), 0);
+}
+
+#endif /* DEBUG_MEMORY */
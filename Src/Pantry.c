@@ -27,13 +27,14 @@ static void DrawPantryList(Int16 itemNum, RectanglePtr bounds, Char** data) {
 
 	if (itemNum >= DmNumRecords(gPantryDB)) return;
 	
-	pantryH = DmQueryRecord(gPantryDB, itemNum);
+	pantryH = DmQueryRecord(gPantryDB, NameOrderIndex(gPantryDB, itemNum));
 	
 	if (!pantryH) return;
 	
 	pantryP = MemHandleLock(pantryH);
 	
-	if (DmFindRecordByID(gIngredientDB, *pantryP, &index) == errNone) {
+	index = IndexFromID(gIngredientDB, *pantryP);
+	if (index != 0xFFFF) {
 		ingredientH = DmQueryRecord(gIngredientDB, index);
 		if (ingredientH) {
 			ingredientP = MemHandleLock(ingredientH);
@@ -68,6 +69,7 @@ static Boolean PantryDoCommand(UInt16 command) {
 	ListType* lst;
 	UInt16 selection;
 	MemHandle results;
+	MemHandle missing;
 	UInt16 numResults;
 
 	switch(command) {
@@ -76,7 +78,7 @@ static Boolean PantryDoCommand(UInt16 command) {
 	   		lst = FrmGetObjectPtr(frmP, FrmGetObjectIndex(frmP, pantryOptionsList));
 	   		selection = LstGetSelection(lst); 
 			if (selection != noListSelection) {
-				AddIdToDatabase(gPantryDB, IDFromIndex(gIngredientDB, selection));
+				AddIdToDatabase(gPantryDB, IDFromIndex(gIngredientDB, LiveRecordIndex(gIngredientDB, selection)));
 				lst = FrmGetObjectPtr(frmP, FrmGetObjectIndex(frmP, pantryList));
 				LstSetListChoices(lst, NULL, DmNumRecords(gPantryDB));
 				LstDrawList(lst);
@@ -89,7 +91,7 @@ static Boolean PantryDoCommand(UInt16 command) {
 	   		lst = FrmGetObjectPtr(frmP, FrmGetObjectIndex(frmP, pantryList));
 	   		selection = LstGetSelection(lst); 
 			if (selection != noListSelection) {
-				DmRemoveRecord(gPantryDB, selection); //maybe make more robust
+				displayErrorIf(RemoveEntry(gPantryDB, NameOrderIndex(gPantryDB, selection)));
 				lst = FrmGetObjectPtr(frmP, FrmGetObjectIndex(frmP, pantryList));
 				LstSetListChoices(lst, NULL, DmNumRecords(gPantryDB));
 				LstDrawList(lst);
@@ -114,6 +116,15 @@ static Boolean PantryDoCommand(UInt16 command) {
 				displayError(errSearchNoMatch);
 			handled = true;
 			break;
+			
+		case RankedSearch:
+			numResults = PantryRankedSearch(searchMaxRanked, &results, &missing);
+			if (numResults > 0)
+				OpenRankedRecipeList(results, missing, numResults);
+			else
+				displayError(errSearchNoMatch);
+			handled = true;
+			break;
 	}
 	
 	if (!handled)
@@ -148,7 +159,7 @@ Boolean PantryHandleEvent(EventPtr eventP) {
 			FrmDrawForm (frmP);
 
 			lst = FrmGetObjectPtr(frmP, FrmGetObjectIndex(frmP, pantryOptionsList));
-			LstSetListChoices(lst, NULL, DmNumRecords(gIngredientDB));
+			LstSetListChoices(lst, NULL, LiveRecordCount(gIngredientDB));
 			LstSetDrawFunction(lst, DrawIngredientList);
 	    	LstDrawList(lst);
 	    	LstSetSelection(lst, -1);
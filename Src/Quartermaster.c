@@ -22,6 +22,27 @@
 #define ourMinVersion    sysMakeROMVersion(3,0,0,sysROMStageDevelopment,0)
 #define kPalmOS20Version sysMakeROMVersion(2,0,0,sysROMStageDevelopment,0)
 
+#define launchLogSize	8	// launch to first draw times kept, see LaunchLogAdd
+
+/*********************************************************************
+ * Internal Structures
+ *********************************************************************/
+
+typedef struct {
+	UInt16 numLaunches;
+	UInt16 ticks[launchLogSize];
+} LaunchLog;
+//Unsaved preference appLaunchPrefID: ticks from PilotMain to the first form
+//drawn, for the last launchLogSize launches. The next one goes in
+//ticks[numLaunches % launchLogSize]
+
+/*********************************************************************
+ * Internal Variables
+ *********************************************************************/
+
+// TimGetTicks when PilotMain started a normal launch, 0 once logged
+static UInt32 gLaunchTicks;
+
 /*********************************************************************
  * External Functions
  *********************************************************************/
@@ -42,9 +63,9 @@ void DrawIngredientList(Int16 itemNum, RectanglePtr bounds, Char** data) {
 	MemHandle ingredientH;
 	Char* ingredientP;
 
-	if (itemNum >= DmNumRecords(gIngredientDB)) return;
+	if (itemNum >= LiveRecordCount(gIngredientDB)) return;
 	
-    ingredientH = DmQueryRecord(gIngredientDB, itemNum);
+    ingredientH = DmQueryRecord(gIngredientDB, LiveRecordIndex(gIngredientDB, itemNum));
     if (!ingredientH) return;
         
     ingredientP = MemHandleLock(ingredientH);
@@ -67,15 +88,15 @@ void DrawIngredientList(Int16 itemNum, RectanglePtr bounds, Char** data) {
  * DESCRIPTION:  Builds string for recipe unit quantity, based on if a
  *				 fractional component is specified
  *				 NOTE: PalmOS doesn't have a StrNPrintF function
- *				 However, since the max value for each parameter is 255,
- *				 the max string length is 11
+ *				 However, since the max value for each parameter is 65535,
+ *				 the max string length is 17
  *
  * PARAMETERS:   output buffer, whole unit component, fraction components
  *
  * RETURNED:     nothing (writes to buffer)
  *
  ***********************************************************************/
-void FormatQuantity(Char *out, UInt16 count, UInt8 frac, UInt8 denom) {
+void FormatQuantity(Char *out, UInt16 count, UInt16 frac, UInt16 denom) {
     if (count == 0 && frac == 0)
         out[0] = '\0';
     else if (frac == 0)
@@ -142,6 +163,61 @@ Boolean MainMenuDoCommand(UInt16 command)
  * Internal Functions
  *********************************************************************/
 
+/***********************************************************************
+ *
+ * FUNCTION:     LaunchLogAdd
+ *
+ * DESCRIPTION:  Adds the time a launch took to draw its first form to
+ *				 the launch log, see LaunchLog
+ *
+ * PARAMETERS:   ticks
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void LaunchLogAdd(UInt32 ticks)
+{
+	LaunchLog log;
+	UInt16 size = sizeof(log);
+
+	if (PrefGetAppPreferences(appFileCreator, appLaunchPrefID, &log, &size, false)
+			!= appPrefVersionNum || size != sizeof(log))
+		MemSet(&log, sizeof(log), 0);
+
+	log.ticks[log.numLaunches % launchLogSize] = (ticks > 0xFFFF) ? 0xFFFF : (UInt16)ticks;
+	log.numLaunches++;
+	PrefSetAppPreferences(appFileCreator, appLaunchPrefID, appPrefVersionNum,
+		&log, sizeof(log), false);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     FormDatabases
+ *
+ * DESCRIPTION:  Database sets a form works with, opened when it loads
+ *				 (see DatabaseRequire). The recipe list only needs the
+ *				 recipes and their catalog, and viewing one only their
+ *				 ingredient and unit names; the other forms change what
+ *				 the indexes follow
+ *
+ * PARAMETERS:   form ID
+ *
+ * RETURNED:     dbSet flags
+ *
+ ***********************************************************************/
+static UInt16 FormDatabases(UInt16 formId)
+{
+	switch (formId)
+	{
+		case formRecipeList:
+			return dbSetRecipes | dbSetCatalog;
+
+		case formViewRecipe:
+			return dbSetItems;
+	}
+	return dbSetAll;
+}
+
 /*
  * FUNCTION: AppHandleEvent
  *
@@ -163,11 +239,20 @@ static Boolean AppHandleEvent(EventType * eventP)
 {
 	UInt16 formId;
 	FormType * frmP;
+	Err err;
 
 	if (eventP->eType == frmLoadEvent)
 	{
-		/* Load the form resource. */
+		/* Open the databases the form needs, then load its resource. */
 		formId = eventP->data.frmLoad.formID;
+		err = DatabaseRequire(FormDatabases(formId));
+		if (err != errNone)
+		{
+			displayError(err);
+			if (formId != formRecipeList)
+				FrmGotoForm(formRecipeList);
+			return true;
+		}
 		frmP = FrmInitForm(formId);
 		FrmSetActiveForm(frmP);
 
@@ -232,6 +317,19 @@ static void AppEventLoop(void)
 				}
 			}
 		}
+
+		/* The first form has drawn once its frmOpenEvent is handled */
+		if (gLaunchTicks && event.eType == frmOpenEvent)
+		{
+			LaunchLogAdd(TimGetTicks() - gLaunchTicks);
+			gLaunchTicks = 0;
+		}
+
+#ifdef DEBUG_MEMORY
+		/* Log the blocks and locks each form leaves behind */
+		if (event.eType == frmCloseEvent)
+			MemTrackCheckpoint("frmCloseEvent", event.data.frmClose.formID, false);
+#endif
 	} while (event.eType != appStopEvent);
 }
 
@@ -293,6 +391,12 @@ void AppStop(void)
 	FrmCloseAllForms();
 	DatabaseClose();
 
+#ifdef DEBUG_MEMORY
+	/* Everything still allocated now has leaked */
+	MemTrackCheckpoint("AppStop", 0, true);
+	MemTrackStop();
+#endif
+
 }
 
 /*
@@ -375,6 +479,7 @@ UInt32 PilotMain(UInt16 cmd, MemPtr cmdPBP, UInt16 launchFlags)
 	switch (cmd)
 	{
 		case sysAppLaunchCmdNormalLaunch:
+			gLaunchTicks = TimGetTicks();
 			error = AppStart();
 			if (error) 
 				return error;
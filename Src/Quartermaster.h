@@ -19,6 +19,9 @@
 #define appVersionNum			0x01
 #define appPrefID				0x00
 #define appPrefVersionNum	    0x01
+#define appDatabasePrefID		0x01	// unsaved: database LocalIDs, see DatabaseFind
+#define appLaunchPrefID			0x02	// unsaved: launch to first draw times, see LaunchLog
+#define appScrollPrefID			0x03	// unsaved: recipe viewer scroll times, see ScrollLog
 
 #define databaseCreatorID       'WOEM'
 #define databaseRecipeName      "QMRecipes"
@@ -26,7 +29,22 @@
 #define databaseUnitName 	    "QMUnits"
 #define databasePantryName 	    "QMPantry"
 #define databaseGroceryName	    "QMGrocList"
-#define recipeMaxIngredients    32
+#define databaseIndexName	    "QMIndex"
+#define databaseMakeableName    "QMMakeable"
+#define databaseTrigramName     "QMTrigrams"
+#define databaseCatalogName     "QMCatalog"
+#define recipeMaxIngredients    255	// RecipeHeader.numIngredients is a UInt8
+#define searchMaxRanked         30	// results kept by the Closest Recipes search
+#define mealPlanMaxRecipes      21	// three meals a day for a week
+
+// Database sets for DatabaseRequire. DatabaseOpen only opens dbSetRecipes and
+// dbSetCatalog, the others are opened when a form or function first needs them
+#define dbSetRecipes			0x01	// gRecipeDB
+#define dbSetLists				0x02	// gPantryDB, gGroceryDB
+#define dbSetItems				0x04	// gIngredientDB, gUnitDB
+#define dbSetIndexes			0x08	// gIndexDB, gTrigramDB, gMakeableDB (and all the others)
+#define dbSetCatalog			0x10	// gCatalogDB (and dbSetRecipes)
+#define dbSetAll				0x1F
 
 // Custom errors
 #define errRecipeNameBlank		(appErrorClass | 11)
@@ -37,6 +55,9 @@
 #define errAddingIngred         (appErrorClass | 23)
 
 #define errSearchNoMatch		(appErrorClass | 31)
+
+#define errMealPlanFull			(appErrorClass | 51)
+#define errMealPlanEmpty		(appErrorClass | 52)
 			
 #define errAssertFailed 		(appErrorClass | 41)
 			
@@ -45,27 +66,78 @@
  * Structures
  *********************************************************************/
  
-// Recipe Record Structure
+// View over a locked recipe record (see RecipeViewInit). Points into the
+// record, so it is only valid while the record stays locked. Layout 2
+// records are decoded one line at a time as the accessors step through
+// them, so the view is the same size whatever the number of ingredients
 typedef struct {
-    Char name[32];
+    const Char *name;
     UInt8 numIngredients;
-    UInt8 ingredientCounts[recipeMaxIngredients];
-    UInt8 ingredientFracs[recipeMaxIngredients];
-    UInt8 ingredientDenoms[recipeMaxIngredients];
-    UInt32 ingredientIDs[recipeMaxIngredients];
-    UInt32 ingredientUnits[recipeMaxIngredients];
-} RecipeRecord;
+    UInt8 layout;
+    const UInt8 *counts;         // layout 1 only, NULL otherwise
+    const UInt8 *fracs;
+    const UInt8 *denoms;
+    const UInt8 *ingredientIDs;  // big-endian, use RecipeViewIngredientID
+    const UInt8 *unitIDs;        // big-endian, use RecipeViewUnitID
+    const UInt8 *lines;          // layout 2 only, NULL otherwise
+    const UInt8 *cursor;         // just past the encoding of line cursorLine
+    UInt8 cursorLine;            // line decoded below, 0xFF if none yet
+    UInt8 count;
+    UInt8 frac;
+    UInt8 denom;
+    UInt16 ingredientRef;
+    UInt16 unitRef;
+    const Char *steps;           // as stored, possibly packed - read with StepsRead
+} RecipeView;
+
+// Reads the steps of a recipe view a piece at a time (see StepsRead), so
+// packed steps never have to be unpacked all at once
+typedef struct {
+    const UInt8 *next;           // next stored byte
+    const Char *pending;         // rest of a dictionary entry cut short by the last read
+    UInt16 pendingLen;
+    Boolean packed;
+} StepsReader;
+
+// Where a StepsReader is in the steps, as offsets rather than pointers, so
+// it can be kept while the record is unlocked (see StepsReaderTell)
+typedef struct {
+    UInt16 next;                 // stored bytes read
+    UInt8 pendingPos;            // characters read of the dictionary entry just before next, 0 if none
+} StepsMark;
+
+// One quantity of a grocery list entry (see GroceryGetAmounts). num/denom
+// is reduced and proper, denom is 0 when there is no fraction
+typedef struct {
+    UInt32 unitId;
+    UInt16 whole;
+    UInt16 num;
+    UInt16 denom;
+    UInt16 reserved;
+} GroceryAmount;
+
+// Counters kept by the recipe, ingredient and unit ID maps (see IDMapGetStats)
+typedef struct {
+    UInt32 hits;
+    UInt32 misses;
+    UInt32 rebuildTicks;
+    UInt16 rebuilds;
+} IDMapStats;
 
 /*********************************************************************
  * Global variables
  *********************************************************************/
  
-// Database handles 
+// Database handles, NULL until their set is opened (see DatabaseRequire)
 extern DmOpenRef gRecipeDB;
 extern DmOpenRef gIngredientDB;
 extern DmOpenRef gUnitDB;
 extern DmOpenRef gPantryDB;
 extern DmOpenRef gGroceryDB;
+extern DmOpenRef gIndexDB;
+extern DmOpenRef gMakeableDB;
+extern DmOpenRef gTrigramDB;
+extern DmOpenRef gCatalogDB;
 
 /*********************************************************************
  * Quartermaster.c functions
@@ -74,7 +146,7 @@ extern DmOpenRef gGroceryDB;
 void AppStop();
 //Misc shared functions
 void DrawIngredientList(Int16 itemNum, RectanglePtr bounds, Char** data);
-void FormatQuantity(Char *out, UInt16 count, UInt8 frac, UInt8 denom);
+void FormatQuantity(Char *out, UInt16 count, UInt16 frac, UInt16 denom);
 Boolean MainMenuDoCommand(UInt16 command);
  
 /*********************************************************************
@@ -82,35 +154,67 @@ Boolean MainMenuDoCommand(UInt16 command);
  *********************************************************************/
  
 Err DatabaseOpen();
+Err DatabaseRequire(UInt16 sets);
 void DatabaseClose();
+Err DatabaseCompact();
+UInt16 LiveRecordCount(DmOpenRef dbase);
+UInt16 LiveRecordIndex(DmOpenRef dbase, UInt16 position);
 Boolean EntryInDatabase(DmOpenRef dbase, UInt32 id);
 UInt16 IndexOfEntry(DmOpenRef dbase, UInt32 id);
 Err AddIdToDatabase(DmOpenRef dbase, UInt32 id);
+Err RemoveEntry(DmOpenRef dbase, UInt16 index);
+UInt16 NameOrderIndex(DmOpenRef dbase, UInt16 position);
 UInt16 IndexFromID(DmOpenRef dbase, UInt32 id);
 UInt32 IDFromIndex(DmOpenRef dbase, UInt16 index);
-RecipeRecord RecipeGetRecord(MemPtr recP);
+Err IDMapGetStats(DmOpenRef dbase, IDMapStats *stats);
+UInt16 UseCount(DmOpenRef dbase, UInt32 id);
+void RecipeViewInit(RecipeView *view, MemPtr recP);
+UInt32 RecipeViewIngredientID(RecipeView *view, UInt8 i);
+UInt32 RecipeViewUnitID(RecipeView *view, UInt8 i);
+void RecipeViewQuantity(RecipeView *view, UInt8 i, UInt8 *count, UInt8 *frac, UInt8 *denom);
+void StepsReaderInit(StepsReader *reader, const RecipeView *view);
+UInt16 StepsRead(StepsReader *reader, Char *buf, UInt16 size);
+void StepsReaderTell(const StepsReader *reader, const RecipeView *view, StepsMark *mark);
+void StepsReaderSeek(StepsReader *reader, const RecipeView *view, const StepsMark *mark);
+Char* RecipeViewStepsText(const RecipeView *view);
 
 Err AddRecipe(const Char *recipeName, const Char *ingredientNames[],
     const Char *unitNames[], UInt16 numIngredients, const UInt8 counts[],
     const UInt8 fracs[], const UInt8 denoms[], const Char *recipeSteps);
+Err UpdateRecipe(UInt16 recipeIndex, const Char *recipeName,
+    const Char *ingredientNames[], const Char *unitNames[],
+    UInt16 numIngredients, const UInt8 counts[], const UInt8 fracs[],
+    const UInt8 denoms[], const Char *recipeSteps);
+Err ImportBegin();
+Err ImportRecipe(const Char *recipeName, const Char *ingredientNames[],
+    const Char *unitNames[], UInt16 numIngredients, const UInt8 counts[],
+    const UInt8 fracs[], const UInt8 denoms[], const Char *recipeSteps);
+Err ImportEnd();
 Err RemoveRecipe(UInt16 recipeIndex);
-Char* RecipeGetStepsPtr(MemPtr recP); 
+UInt16 RecipePrefixPosition(const Char *prefix, const UInt32 *ids, UInt16 numIds);
+UInt16 RecipeTextSearch(const Char *text, MemHandle* ret);
     
 UInt32 IngredientIDByName(const Char *ingredientName);
 Err IngredientNameByID(Char* buffer, UInt8 len, UInt32 entryID);
 Err RemoveIngredient(UInt32 ingId);
+UInt16 IngredientRecipeSearch(UInt32 ingId, MemHandle* ret);
 
 UInt32 UnitIDByName(const Char *ingredientName);
 Err UnitNameByID(Char* buffer, UInt8 len, UInt32 entryID);
 
 UInt16 PantryFuzzySearch(MemHandle* ret);
 UInt16 PantryStrictSearch(MemHandle* ret);
+UInt16 PantryRankedSearch(UInt16 maxResults, MemHandle* ret, MemHandle* missingRet);
+
+Err GroceryAddRecipes(const UInt32 *recipeIds, UInt16 numRecipes, Boolean skipPantry);
+UInt16 GroceryGetAmounts(UInt16 index, GroceryAmount *amounts, UInt16 maxAmounts);
 
 /*********************************************************************
  * RecipeList.c functions
  *********************************************************************/
  Boolean RecipeListHandleEvent(EventPtr eventP);
  void OpenRecipeList(MemHandle results, UInt16 num);
+ void OpenRankedRecipeList(MemHandle results, MemHandle missing, UInt16 num);
  //Err PopulateRecipeList(ListType* list);
  
 /*********************************************************************
@@ -154,4 +258,31 @@ void displayFatalError(Err code);
 Boolean confirmChoice(UInt8 dialogC);
 void assert(Boolean value);
 
+/*********************************************************************
+ * MemTrack.c functions
+ *********************************************************************/
+
+// Debug builds define DEBUG_MEMORY to route the Memory Manager calls
+// below through MemTrack.c, which logs leaks at each checkpoint. Release
+// builds call the Memory Manager directly
+#ifdef DEBUG_MEMORY
+MemPtr MemTrackPtrNew(UInt32 size, const Char *file, UInt16 line);
+Err MemTrackPtrFree(MemPtr p, const Char *file, UInt16 line);
+MemHandle MemTrackHandleNew(UInt32 size, const Char *file, UInt16 line);
+Err MemTrackHandleFree(MemHandle h, const Char *file, UInt16 line);
+MemPtr MemTrackHandleLock(MemHandle h, const Char *file, UInt16 line);
+Err MemTrackHandleUnlock(MemHandle h, const Char *file, UInt16 line);
+Err MemTrackHandleResize(MemHandle h, UInt32 newSize, const Char *file, UInt16 line);
+UInt16 MemTrackCheckpoint(const Char *where, UInt16 id, Boolean closing);
+void MemTrackStop(void);
+
+#define MemPtrNew(size)				MemTrackPtrNew(size, __FILE__, __LINE__)
+#define MemPtrFree(p)				MemTrackPtrFree(p, __FILE__, __LINE__)
+#define MemHandleNew(size)			MemTrackHandleNew(size, __FILE__, __LINE__)
+#define MemHandleFree(h)			MemTrackHandleFree(h, __FILE__, __LINE__)
+#define MemHandleLock(h)			MemTrackHandleLock(h, __FILE__, __LINE__)
+#define MemHandleUnlock(h)			MemTrackHandleUnlock(h, __FILE__, __LINE__)
+#define MemHandleResize(h, size)	MemTrackHandleResize(h, size, __FILE__, __LINE__)
+#endif
+
 #endif /* QUARTERMASTER_H_ */
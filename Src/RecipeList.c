@@ -3,17 +3,38 @@
 #include "Quartermaster.h"
 #include "Quartermaster_Rsc.h"
 
+/*********************************************************************
+ * Internal constants
+ *********************************************************************/
+
+#define typeAheadMaxLen		31	// recipe names are at most 31 characters
+
 /*********************************************************************
  * Internal variables
  *********************************************************************/
 
 typedef struct {
 	MemHandle results;
+	MemHandle missing;
 	UInt16 numResults;
+	Char prefix[typeAheadMaxLen + 1];
+	UInt32 prefixTicks;
 } RecipeListContext;
+// missing holds a UInt8 missing ingredient count per result (ranked
+// searches only, NULL otherwise). prefix is what has been typed so far,
+// prefixTicks when the last character was
 
 static RecipeListContext ctx = {0};
 
+typedef struct {
+	UInt32 recipeIds[mealPlanMaxRecipes];
+	UInt16 numRecipes;
+} MealPlan;
+// Recipes picked with "Add to Meal Plan", in the order they were added.
+// Kept until the plan is shopped for or cleared (not saved between runs)
+
+static MealPlan plan = {0};
+
 /*********************************************************************
  * Internal functions
  *********************************************************************/
@@ -31,19 +52,189 @@ static RecipeListContext ctx = {0};
  *
  ***********************************************************************/
 static Int16 TranslateIndex(Int16 index) {
-	UInt16* resultP;
-	Int16 result;
+	UInt32* resultP;
+	UInt16 result;
 
 	if (ctx.results == NULL) {
-		return index;
+		if (index < 0) return noListSelection;
+		result = LiveRecordIndex(gRecipeDB, index);
+		if (result == 0xFFFF) return noListSelection;
+		return result;
 	} else {
-		if (index >= ctx.numResults) return noListSelection;
+		if (index < 0 || index >= ctx.numResults) return noListSelection;
 		resultP = MemHandleLock(ctx.results);
-		result = resultP[index];
+		result = IndexFromID(gRecipeDB, resultP[index]);
 		MemHandleUnlock(ctx.results);
+		if (result == 0xFFFF) return noListSelection;
 		return result;
 	}	
 } 
+
+ /***********************************************************************
+ *
+ * FUNCTION:     DropResult
+ *
+ * DESCRIPTION:  Removes a deleted recipe from the search results. The
+ *				 rest stay valid since results are kept as recipe IDs
+ *
+ * PARAMETERS:   recipe ID
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void DropResult(UInt32 recipeId) {
+	UInt32* resultP;
+	UInt8* missingP;
+	UInt16 i;
+
+	if (ctx.results == NULL) return;
+
+	resultP = MemHandleLock(ctx.results);
+	for (i = 0; i < ctx.numResults && resultP[i] != recipeId; i++)
+		;
+	if (i < ctx.numResults) {
+		MemMove(resultP + i, resultP + i + 1, (ctx.numResults - i - 1) * sizeof(UInt32));
+		if (ctx.missing) {
+			missingP = MemHandleLock(ctx.missing);
+			MemMove(missingP + i, missingP + i + 1, ctx.numResults - i - 1);
+			MemHandleUnlock(ctx.missing);
+		}
+		ctx.numResults--;
+	}
+	MemHandleUnlock(ctx.results);
+} 
+
+ /***********************************************************************
+ *
+ * FUNCTION:     ClearResults
+ *
+ * DESCRIPTION:  Frees search results, going back to listing all recipes
+ *
+ * PARAMETERS:   nothing
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void ClearResults() {
+	if (ctx.results) {
+		MemHandleFree(ctx.results);
+	    ctx.results = NULL;
+	}
+	if (ctx.missing) {
+		MemHandleFree(ctx.missing);
+	    ctx.missing = NULL;
+	}
+	ctx.numResults = 0;
+	ctx.prefix[0] = '\0';
+} 
+
+ /***********************************************************************
+ *
+ * FUNCTION:     PlanPosition
+ *
+ * DESCRIPTION:  Finds a recipe in the meal plan
+ *
+ * PARAMETERS:   recipe ID
+ *
+ * RETURNED:     position in plan.recipeIds, plan.numRecipes if it isn't
+ *				 planned
+ *
+ ***********************************************************************/
+static UInt16 PlanPosition(UInt32 recipeId) {
+	UInt16 i;
+	
+	for (i = 0; i < plan.numRecipes && plan.recipeIds[i] != recipeId; i++)
+		;
+	return i;
+} 
+
+ /***********************************************************************
+ *
+ * FUNCTION:     PlanDrop
+ *
+ * DESCRIPTION:  Takes a deleted recipe out of the meal plan
+ *
+ * PARAMETERS:   recipe ID
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void PlanDrop(UInt32 recipeId) {
+	UInt16 pos = PlanPosition(recipeId);
+	
+	if (pos < plan.numRecipes) {
+		MemMove(&plan.recipeIds[pos], &plan.recipeIds[pos + 1],
+			(plan.numRecipes - pos - 1) * sizeof(UInt32));
+		plan.numRecipes--;
+	}
+} 
+
+ /***********************************************************************
+ *
+ * FUNCTION:     TypeAhead
+ *
+ * DESCRIPTION:  Adds a typed character to the type-ahead prefix and
+ *				 selects the first recipe starting with it. The prefix
+ *				 starts over after a second without typing
+ *
+ * PARAMETERS:   listptr, character (backspace shortens the prefix)
+ *
+ * RETURNED:     true if the character was used
+ *
+ ***********************************************************************/
+static Boolean TypeAhead(ListType* lst, WChar chr) {
+	UInt32* resultP;
+	UInt32 now = TimGetTicks();
+	UInt16 len;
+	UInt16 position = 0xFFFF;
+	UInt16 i;
+
+	if (now - ctx.prefixTicks > SysTicksPerSecond())
+		ctx.prefix[0] = '\0';
+	ctx.prefixTicks = now;
+	len = StrLen(ctx.prefix);
+
+	if (chr == backspaceChr) {
+		if (len == 0) return false;
+		ctx.prefix[--len] = '\0';
+		if (len == 0) return true;
+	} else if (chr < ' ' || chr > 0xFF || len == typeAheadMaxLen) {
+		return false;
+	} else {
+		ctx.prefix[len++] = (Char)chr;
+		ctx.prefix[len] = '\0';
+	}
+
+	if (ctx.results == NULL) {
+		position = RecipePrefixPosition(ctx.prefix, NULL, 0);
+	} else if (ctx.missing == NULL) {
+		// search results are kept in name order
+		resultP = MemHandleLock(ctx.results);
+		position = RecipePrefixPosition(ctx.prefix, resultP, ctx.numResults);
+		MemHandleUnlock(ctx.results);
+	} else {
+		// ranked results are ordered by missing count (30 at most), so
+		// each one is checked on its own
+		resultP = MemHandleLock(ctx.results);
+		for (i = 0; i < ctx.numResults && position == 0xFFFF; i++) {
+			if (RecipePrefixPosition(ctx.prefix, resultP + i, 1) == 0)
+				position = i;
+		}
+		MemHandleUnlock(ctx.results);
+	}
+
+	if (position == 0xFFFF) {
+		// keep the last prefix that matched
+		ctx.prefix[--len] = '\0';
+		SndPlaySystemSound(sndError);
+		return true;
+	}
+
+	LstSetSelection(lst, position);
+	LstMakeItemVisible(lst, position);
+	LstDrawList(lst);
+	return true;
+}
  
  /***********************************************************************
  *
@@ -57,16 +248,23 @@ static Int16 TranslateIndex(Int16 index) {
  *
  ***********************************************************************/
 static void DrawRecipeList(Int16 itemNum, RectanglePtr bounds, Char** data) {
-	UInt16* resultP;
 	MemHandle nameH;
 	Char* nameP;
+	UInt8* missingP;
+	Char countStr[maxStrIToALen];
+	Coord width;
+	FontID oldFont;
+	Int16 index;
 	
 	if (ctx.results == NULL) {
-		if (itemNum >= DmNumRecords(gRecipeDB)) return;
+		if (itemNum >= LiveRecordCount(gRecipeDB)) return;
 	
-        nameH = DmQueryRecord(gRecipeDB, itemNum);
+		index = LiveRecordIndex(gRecipeDB, itemNum);
+        nameH = DmQueryRecord(gCatalogDB, index);
         if (!nameH) return;
         
+        // recipes in the meal plan are drawn in bold
+        oldFont = FntSetFont(PlanPosition(IDFromIndex(gRecipeDB, index)) < plan.numRecipes ? boldFont : stdFont);
         nameP = MemHandleLock(nameH);
         
 		WinGlueDrawTruncChars(
@@ -81,13 +279,23 @@ static void DrawRecipeList(Int16 itemNum, RectanglePtr bounds, Char** data) {
 	} else {
 		if (itemNum >= ctx.numResults) return;
 		
-		resultP = MemHandleLock(ctx.results);
-	
-        nameH = DmQueryRecord(gRecipeDB, resultP[itemNum]);
-        MemHandleUnlock(ctx.results);
-        
+		index = TranslateIndex(itemNum);
+		if (index == noListSelection) return;
+        nameH = DmQueryRecord(gCatalogDB, index);
         if (!nameH) return;
         
+        // ranked results show how many ingredients are missing, right aligned
+        width = bounds->extent.x;
+        if (ctx.missing) {
+        	missingP = MemHandleLock(ctx.missing);
+        	StrIToA(countStr, missingP[itemNum]);
+        	MemHandleUnlock(ctx.missing);
+        	width -= FntCharsWidth(countStr, StrLen(countStr));
+        	WinDrawChars(countStr, StrLen(countStr), bounds->topLeft.x + width, bounds->topLeft.y);
+        	width -= 4;
+        }
+        
+        oldFont = FntSetFont(PlanPosition(IDFromIndex(gRecipeDB, index)) < plan.numRecipes ? boldFont : stdFont);
         nameP = MemHandleLock(nameH);
         
 		WinGlueDrawTruncChars(
@@ -95,11 +303,12 @@ static void DrawRecipeList(Int16 itemNum, RectanglePtr bounds, Char** data) {
 			StrLen(nameP),
 			bounds->topLeft.x,
 			bounds->topLeft.y,
-			bounds->extent.x
+			width
 		);
 		
 		MemHandleUnlock(nameH);
 	}
+	FntSetFont(oldFont);
 }
 
 
@@ -116,16 +325,126 @@ static void DrawRecipeList(Int16 itemNum, RectanglePtr bounds, Char** data) {
  ***********************************************************************/
 static Err PopulateRecipeList(ListType* lst) {
 	if (ctx.results == NULL)
-		LstSetListChoices(lst, NULL, DmNumRecords(gRecipeDB));
+		LstSetListChoices(lst, NULL, LiveRecordCount(gRecipeDB));
 	else
 		LstSetListChoices(lst, NULL, ctx.numResults);
 	LstSetDrawFunction(lst, DrawRecipeList);
 	LstDrawList(lst);
 	LstSetSelection(lst, -1);
+	ctx.prefix[0] = '\0';
 	
 	return errNone;
 } 
 
+/***********************************************************************
+ *
+ * FUNCTION:     FindText
+ *
+ * DESCRIPTION:  Asks for text with formTextSearch and lists the recipes
+ *				 whose name or steps contain it
+ *
+ * PARAMETERS:   listptr
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void FindText(ListType* lst) {
+	FormPtr frmP;
+	Char* textP;
+	MemHandle results = NULL;
+	UInt16 numResults = 0;
+	Boolean searched = false;
+
+	MenuEraseStatus(0);
+	frmP = FrmInitForm(formTextSearch);
+	FrmSetFocus(frmP, FrmGetObjectIndex(frmP, fieldTextSearch));
+	if (FrmDoDialog(frmP) == TextSearchFind) {
+		textP = FldGetTextPtr(FrmGetObjectPtr(frmP, FrmGetObjectIndex(frmP, fieldTextSearch)));
+		if (textP && *textP) {
+			numResults = RecipeTextSearch(textP, &results);
+			searched = true;
+		}
+	}
+	FrmDeleteForm(frmP);
+
+	if (!searched) return;
+	if (numResults == 0) {
+		displayError(errSearchNoMatch);
+		return;
+	}
+	ClearResults();
+	ctx.results    = results;
+	ctx.numResults = numResults;
+	PopulateRecipeList(lst);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     RecipeListDoMenuCommand
+ *
+ * DESCRIPTION:  Handles the Search and Plan menus of the recipe list
+ *
+ * PARAMETERS:   command ID
+ *
+ * RETURNED:     handled boolean
+ *
+ ***********************************************************************/
+static Boolean RecipeListDoMenuCommand(UInt16 command) {
+    FormPtr frmP = FrmGetActiveForm();
+    ListType* list = FrmGetObjectPtr(frmP, FrmGetObjectIndex(frmP, RecipeList));
+	Boolean handled = true;
+	Int16 selection;
+    UInt32 recipeId;
+	Err err;
+	
+	switch (command) {
+		case RecipeListFindText:
+			FindText(list);
+			break;
+			
+		case RecipeListPlanAdd:
+	   		selection = TranslateIndex(LstGetSelection(list));
+			if (selection == noListSelection)
+				break;
+			recipeId = IDFromIndex(gRecipeDB, selection);
+			if (PlanPosition(recipeId) < plan.numRecipes)
+				break;
+			if (plan.numRecipes == mealPlanMaxRecipes) {
+				displayError(errMealPlanFull);
+				break;
+			}
+			plan.recipeIds[plan.numRecipes++] = recipeId;
+			LstDrawList(list);
+			break;
+			
+		case RecipeListPlanShop:
+			if (plan.numRecipes == 0) {
+				displayError(errMealPlanEmpty);
+				break;
+			}
+			// whatever is already in the pantry stays off the list
+			err = GroceryAddRecipes(plan.recipeIds, plan.numRecipes, true);
+			if (err != errNone) {
+				displayError(err);
+				break;
+			}
+			plan.numRecipes = 0;
+			FrmGotoForm(formGrocery);
+			break;
+			
+		case RecipeListPlanClear:
+			plan.numRecipes = 0;
+			LstDrawList(list);
+			break;
+			
+		default:
+			handled = MainMenuDoCommand(command);
+			break;
+	}
+	
+	return handled;
+}
+
 /***********************************************************************
  *
  * FUNCTION:     RecipeListDoButtonCommand
@@ -142,6 +461,7 @@ static Boolean RecipeListDoButtonCommand(UInt16 command) {
 	Boolean handled = false;
 	Int16 selection;
     ListType* list;
+    UInt32 recipeId;
 	Err err;
 	
 	switch (command) {
@@ -159,15 +479,12 @@ static Boolean RecipeListDoButtonCommand(UInt16 command) {
 	   		selection = TranslateIndex(LstGetSelection(list));
 			if (selection != noListSelection) {
 				if (confirmChoice(0)) {
+					recipeId = IDFromIndex(gRecipeDB, selection);
 					err = RemoveRecipe(selection);
 					if (err != errNone) displayError(err); //Non-fatal error if delete fails
-					if (ctx.results) {
-						MemHandleFree(ctx.results);
-			    		ctx.results = NULL;
-			    		ctx.numResults = 0;
-			    		// Clears search results if recipe is deleted
-			    		// This is because the recipe indices in results
-			    		// are no longer guaranteed to be valid
+					else {
+						DropResult(recipeId);
+						PlanDrop(recipeId);
 					}
 					err = PopulateRecipeList(list);
 					if (err != errNone) displayError(err);
@@ -188,16 +505,14 @@ static Boolean RecipeListDoButtonCommand(UInt16 command) {
 	   	    break;
 
 	   	case RecipeListNew:
-			OpenEditRecipeForm(0, true);
+			err = OpenEditRecipeForm(0, true);
+			if (err != errNone)
+				displayError(err);
 	   	    handled = true;
 	   	    break;
 	   	    
 	   	case RecipeListClear: // clear search results
-			if (ctx.results) {
-				MemHandleFree(ctx.results);
-			    ctx.results = NULL;
-			}
-			ctx.numResults = 0;
+			ClearResults();
 			list = FrmGetObjectPtr(frmP, FrmGetObjectIndex(frmP, RecipeList));
 			err  = PopulateRecipeList(list);
 			if (err != errNone) displayError(err);	
@@ -248,15 +563,18 @@ Boolean RecipeListHandleEvent(EventPtr eventP) {
 			break;
 			
 		case frmCloseEvent:
-			if (ctx.results) {
-				MemHandleFree(ctx.results);
-			    ctx.results = NULL;
-			}
-			ctx.numResults = 0;
+			ClearResults();
+			break;
+			
+		case keyDownEvent: // Graffiti jumps to the first recipe starting with what was written
+			if (eventP->data.keyDown.modifiers & commandKeyMask) break;
+			frmP = FrmGetActiveForm();
+			lst = FrmGetObjectPtr(frmP, FrmGetObjectIndex(frmP, RecipeList));
+			handled = TypeAhead(lst, eventP->data.keyDown.chr);
 			break;
 			
-		case menuEvent: //Likely change later
-			return MainMenuDoCommand(eventP->data.menu.itemID);
+		case menuEvent:
+			return RecipeListDoMenuCommand(eventP->data.menu.itemID);
 			
 		default:		
 			break;
@@ -270,13 +588,34 @@ Boolean RecipeListHandleEvent(EventPtr eventP) {
  *
  * DESCRIPTION:  Opens and initializes RecipeList with the results of a search query
  *
- * PARAMETERS:   MemHandle to list of recipe indices
+ * PARAMETERS:   MemHandle to list of recipe IDs, number of recipes
  *
  * RETURNED:     nothing
  *
  ***********************************************************************/
 void OpenRecipeList(MemHandle results, UInt16 num) {
     ctx.results    = results;
+    ctx.missing    = NULL;
+    ctx.numResults = num;
+    FrmGotoForm(formRecipeList);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     OpenRankedRecipeList
+ *
+ * DESCRIPTION:  OpenRecipeList for ranked searches - also shows the
+ *				 number of missing ingredients next to each recipe
+ *
+ * PARAMETERS:   MemHandle to list of recipe IDs, MemHandle to list of
+ *				 missing counts (UInt8), number of recipes
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+void OpenRankedRecipeList(MemHandle results, MemHandle missing, UInt16 num) {
+    ctx.results    = results;
+    ctx.missing    = missing;
     ctx.numResults = num;
     FrmGotoForm(formRecipeList);
 }
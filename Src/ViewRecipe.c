@@ -2,15 +2,73 @@
 #include "Quartermaster.h"
 #include "Quartermaster_Rsc.h"
 
+/*********************************************************************
+ * Internal Constants
+ *********************************************************************/
+
+#define stepsWrapSize	160	// steps unpacked ahead of the word wrap, over two lines
+#define layoutRowsGrow	16	// rows added to a full line table at a time
+#define layoutTextGrow	256	// bytes added to a full row text buffer at a time
+
+#define rowText			0	// RecipeRow.source: ctx.textH
+#define rowSteps		1	// ... the steps, read from the row's StepsMark
+
+#define offscreenMaxBytes	16384	// largest offscreen copy of a recipe kept
+#define offscreenReserve	8192	// dynamic heap left free after creating it
+#define offscreenMinVersion	sysMakeROMVersion(3,5,0,sysROMStageDevelopment,0)	// WinScreenMode, to size it
+
+#define scrollRedraw	0	// ScrollLog modes: the whole rectangle drawn again
+#define scrollBlit		1	// ... moved with WinScrollRectangle, exposed rows drawn
+#define scrollOffscreen	2	// ... copied from the offscreen window
+#define scrollNumModes	3
+
 /*********************************************************************
  * Internal variables
  *********************************************************************/
 
+// One row of the recipe as laid out on screen (see LayoutRecipe)
+typedef struct {
+    UInt16 y;              // from the top of the recipe, in pixels
+    UInt16 offset;         // of the first character in ctx.textH (rowText), or
+                           // StepsMark.next of it in the steps (rowSteps)
+    UInt8 len;
+    UInt8 source;          // rowText or rowSteps
+    UInt8 font;            // FontID
+    UInt8 pendingPos;      // StepsMark.pendingPos of a rowSteps row
+} RecipeRow;
+
+typedef struct {
+	UInt32 numScrolls[scrollNumModes];
+	UInt32 ticks[scrollNumModes];
+} ScrollLog;
+//Unsaved preference appScrollPrefID: scroll events of the recipe viewer
+//and the ticks spent redrawing for them, by how the rectangle was
+//updated (scrollRedraw, scrollBlit, scrollOffscreen). Most events take
+//less than a tick, so only the totals over many events mean anything
+
 // Stores recipe handle and scroll information
 typedef struct {
     MemHandle recipe;  	   // pointer to the recipe to display
+    UInt32 recipeId;       // its unique ID, for GroceryAddRecipes
     Int16 scrollPos;       // vertical scroll position in pixels
  	Int16 maxScroll;
+ 	
+ 	// Line table, built by the first draw and kept until the recipe, the
+ 	// width or the font height changes
+ 	MemHandle rowsH;       // RecipeRow, in y order
+ 	UInt16 numRows;
+ 	MemHandle textH;       // the name and formatted ingredient lines
+ 	UInt16 textSize;
+ 	UInt16 height;         // of the whole recipe
+ 	UInt16 layoutWidth;
+ 	UInt16 layoutLineHeight;
+ 	
+ 	// The whole recipe drawn once, when it is small enough (see
+ 	// OffscreenCreate). Freed with the line table
+ 	WinHandle offscreen;
+ 	Boolean offscreenTried;
+ 	
+ 	ScrollLog scrolls;     // since the form opened, see ScrollLogSave
 } RecipeFormContext;
 
 static RecipeFormContext ctx;
@@ -22,125 +80,536 @@ static RecipeFormContext ctx;
 
 /***********************************************************************
  *
- * FUNCTION:     DrawRecipe
+ * FUNCTION:     LayoutFree
  *
- * DESCRIPTION:  Draws the recipe on screen, accounting for scrolling
+ * DESCRIPTION:  Frees the line table, so the next draw lays the recipe
+ *				 out again
  *
- * PARAMETERS:   Pointer to current form
+ * PARAMETERS:   nothing
  *
- * RETURNED:     content height (used in initial maxScroll calculation)
+ * RETURNED:     nothing
  *
  ***********************************************************************/
-static UInt16 DrawRecipe(FormType *form)
+static void LayoutFree()
 {
-    MemPtr *recipeP;
-    RecipeRecord recipe;
+    if (ctx.rowsH)
+        MemHandleFree(ctx.rowsH);
+    if (ctx.textH)
+        MemHandleFree(ctx.textH);
+    if (ctx.offscreen)
+        WinDeleteWindow(ctx.offscreen, false);
+    ctx.rowsH    = NULL;
+    ctx.textH    = NULL;
+    ctx.numRows  = 0;
+    ctx.textSize = 0;
+    ctx.height   = 0;
+    ctx.offscreen      = NULL;
+    ctx.offscreenTried = false;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     LayoutAddRow
+ *
+ * DESCRIPTION:  Appends a row to the line table, and its text to the
+ *				 row text buffer if it comes from there
+ *
+ * PARAMETERS:   y, font, source, text (rowText) or where the row
+ *				 starts in the steps (rowSteps), length
+ *
+ * RETURNED:     err
+ *
+ ***********************************************************************/
+static Err LayoutAddRow(UInt16 y, FontID font, UInt8 source, const Char *text,
+	const StepsMark *mark, UInt16 len)
+{
+    RecipeRow *rowP;
+    Char *textP;
+    UInt16 offset = 0;
+    UInt8 pendingPos = 0;
+
+    if (!ctx.rowsH)
+        ctx.rowsH = MemHandleNew(layoutRowsGrow * sizeof(RecipeRow));
+    else if ((ctx.numRows + 1) * sizeof(RecipeRow) > MemHandleSize(ctx.rowsH) &&
+            MemHandleResize(ctx.rowsH, (ctx.numRows + layoutRowsGrow) * sizeof(RecipeRow)) != errNone)
+        return memErrNotEnoughSpace;
+    if (!ctx.rowsH)
+        return memErrNotEnoughSpace;
+
+    if (source == rowText) {
+        if (!ctx.textH)
+            ctx.textH = MemHandleNew(len + layoutTextGrow);
+        else if (ctx.textSize + len > MemHandleSize(ctx.textH) &&
+                MemHandleResize(ctx.textH, ctx.textSize + len + layoutTextGrow) != errNone)
+            return memErrNotEnoughSpace;
+        if (!ctx.textH)
+            return memErrNotEnoughSpace;
+
+        textP = MemHandleLock(ctx.textH);
+        MemMove(textP + ctx.textSize, text, len);
+        MemHandleUnlock(ctx.textH);
+        offset = ctx.textSize;
+        ctx.textSize += len;
+    } else {
+        offset     = mark->next;
+        pendingPos = mark->pendingPos;
+    }
+
+    rowP = (RecipeRow *)MemHandleLock(ctx.rowsH) + ctx.numRows;
+    rowP->y      = y;
+    rowP->offset = offset;
+    rowP->len    = len;
+    rowP->source = source;
+    rowP->font   = font;
+    rowP->pendingPos = pendingPos;
+    MemHandleUnlock(ctx.rowsH);
+    ctx.numRows++;
+    return errNone;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     LayoutRecipe
+ *
+ * DESCRIPTION:  Builds the line table: resolves and formats every
+ *				 ingredient line and word wraps the steps once, keeping
+ *				 where each row starts and how long it is. A steps row
+ *				 keeps the StepsMark it starts at, so drawing it need not
+ *				 read the steps above it
+ *
+ * PARAMETERS:   width to wrap to
+ *
+ * RETURNED:     err
+ *
+ ***********************************************************************/
+static Err LayoutRecipe(UInt16 width)
+{
+    RecipeView recipe;
     Char buf[80];
     Char namebuf[32];
     Char unitbuf[32];
 	Char qtyBuf[16];
-    Char *lineStart;
+	UInt8 count, frac, denom;
+    Char steps[stepsWrapSize + 1];
+    StepsReader reader;
+    StepsReader rowReader;	// kept at steps[0], behind the read ahead
+    StepsMark mark;
+    Char skip[32];
+    UInt16 stepsLen;
+    UInt16 n;
     Char *lineEnd;
     UInt16 lineBreakOffset;
-    RectangleType r;
     UInt16 len;
-    UInt16 y;
+    UInt16 y = 0;
     UInt16 i;
-    
-    recipeP = MemHandleLock(ctx.recipe);
-    recipe  = RecipeGetRecord(recipeP); 
-    
-    // Creates drawing window based on scrollbar
-    FrmGetObjectBounds(form, FrmGetObjectIndex(form, ViewRecipeScrollbar), &r);
-    r.extent.x  = r.topLeft.x;
-    r.topLeft.x = 0;
-    WinEraseRectangle(&r, 0);
-    
-
-    y = r.topLeft.y - ctx.scrollPos; // start at top minus scroll offset
-
-    // Draw recipe name
+    Err err;
+
+    LayoutFree();
+    FntSetFont(stdFont);
+    ctx.layoutWidth      = width;
+    ctx.layoutLineHeight = FntLineHeight();
+
+    RecipeViewInit(&recipe, MemHandleLock(ctx.recipe));
+
+    // Recipe name
     FntSetFont(boldFont);
-    if (y >= r.topLeft.y && y < r.topLeft.y + r.extent.y) WinDrawChars(recipe.name, StrLen(recipe.name), 0, y);
+    err = LayoutAddRow(y, boldFont, rowText, recipe.name, NULL, StrLen(recipe.name));
     y += FntLineHeight() + 2;
 
-    // Draw ingredients
+    // Ingredients
     FntSetFont(stdFont);
-    for (i = 0; i < recipeMaxIngredients && recipe.ingredientIDs[i] != 0; i++) {
-        IngredientNameByID(namebuf, 32, recipe.ingredientIDs[i]);
-        UnitNameByID(unitbuf, 32, recipe.ingredientUnits[i]);
+    for (i = 0; i < recipe.numIngredients && err == errNone; i++) {
+        IngredientNameByID(namebuf, 32, RecipeViewIngredientID(&recipe, i));
+        UnitNameByID(unitbuf, 32, RecipeViewUnitID(&recipe, i));
         
-		FormatQuantity(qtyBuf, recipe.ingredientCounts[i],
-                       recipe.ingredientFracs[i],
-                       recipe.ingredientDenoms[i]);
+        RecipeViewQuantity(&recipe, i, &count, &frac, &denom);
+		FormatQuantity(qtyBuf, count, frac, denom);
 		if (qtyBuf[0] != '\0')
 			// Allows unitless ingredients (e.g. pinch salt)
    			StrPrintF(buf, "%s %s %s", qtyBuf, unitbuf, namebuf);
 		else
     		StrPrintF(buf, "%s %s", unitbuf, namebuf);
         
-        lineBreakOffset = FntWordWrap(buf, r.extent.x);
-        
-        if (lineBreakOffset < StrLen(buf)) {
-        	if (y >= r.topLeft.y && y < r.topLeft.y + r.extent.y) WinDrawChars(buf, lineBreakOffset, 0, y);
+        lineBreakOffset = FntWordWrap(buf, width);
+        len = StrLen(buf);
+        if (lineBreakOffset < len) {
+            err = LayoutAddRow(y, stdFont, rowText, buf, NULL, lineBreakOffset);
         	y += FntLineHeight();
-        	if (y >= r.topLeft.y && y < r.topLeft.y + r.extent.y) WinDrawChars(((Char*)buf + lineBreakOffset), StrLen(((Char*)buf + lineBreakOffset)), 0, y);
+        	if (err == errNone)
+        	    err = LayoutAddRow(y, stdFont, rowText, buf + lineBreakOffset, NULL, len - lineBreakOffset);
         } else {
-        	if (y >= r.topLeft.y && y < r.topLeft.y + r.extent.y) WinDrawChars(buf, StrLen(buf), 0, y);
+            err = LayoutAddRow(y, stdFont, rowText, buf, NULL, len);
         }
         y += FntLineHeight();
     }
     y += 4;
 
-    // Draw steps
-    lineStart = RecipeGetStepsPtr(recipeP);
-    while (*lineStart) {
-        lineEnd = lineStart;
+    // Steps, unpacked just ahead of the word wrap
+    StepsReaderInit(&reader, &recipe);
+    StepsReaderInit(&rowReader, &recipe);
+    stepsLen = StepsRead(&reader, steps, stepsWrapSize);
+    steps[stepsLen] = '\0';
+    while (stepsLen > 0 && err == errNone) {
+        lineEnd = steps;
         len = 0;
         
-        lineBreakOffset = FntWordWrap(lineStart, r.extent.x);
+        lineBreakOffset = FntWordWrap(steps, width);
         while (*lineEnd && len < lineBreakOffset && *lineEnd != '\n') { 
         	lineEnd++; len++; 
         }
 
-        if (y >= r.topLeft.y && y < r.topLeft.y + r.extent.y) WinDrawChars(lineStart, len, 0, y);
+        StepsReaderTell(&rowReader, &recipe, &mark);
+        err = LayoutAddRow(y, stdFont, rowSteps, NULL, &mark, len);
         y += FntLineHeight();
         if (*lineEnd == '\n') lineEnd++;
-        lineStart = lineEnd;
+        
+        // drop the line laid out and top the buffer up again
+        for (len = lineEnd - steps; len > 0; len -= n) {
+            n = StepsRead(&rowReader, skip, len < sizeof(skip) ? len : sizeof(skip));
+            if (n == 0)
+                break;
+        }
+        stepsLen -= lineEnd - steps;
+        MemMove(steps, lineEnd, stepsLen);
+        stepsLen += StepsRead(&reader, steps + stepsLen, stepsWrapSize - stepsLen);
+        steps[stepsLen] = '\0';
     }
-    
-    r.topLeft.y += r.extent.y;
-    WinEraseRectangle(&r, 0);
 
     MemHandleUnlock(ctx.recipe);
-    return y;
+    ctx.height = y;
+    if (err != errNone)
+        LayoutFree();
+    return err;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     FirstVisibleRow
+ *
+ * DESCRIPTION:  Binary search of the line table for the first row that
+ *				 starts at or below a scroll position
+ *
+ * PARAMETERS:   line table, scroll position
+ *
+ * RETURNED:     row index, ctx.numRows if none
+ *
+ ***********************************************************************/
+static UInt16 FirstVisibleRow(const RecipeRow *rows, UInt16 top)
+{
+    UInt16 lo = 0;
+    UInt16 hi = ctx.numRows;
+    UInt16 mid;
+
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (rows[mid].y < top)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     ContentBounds
+ *
+ * DESCRIPTION:  The rectangle the recipe is drawn in: left of the
+ *				 scrollbar, as tall as it is
+ *
+ * PARAMETERS:   Pointer to current form, receives the rectangle
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void ContentBounds(FormType *form, RectangleType *r)
+{
+    FrmGetObjectBounds(form, FrmGetObjectIndex(form, ViewRecipeScrollbar), r);
+    r->extent.x  = r->topLeft.x;
+    r->topLeft.x = 0;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     LayoutCurrent
+ *
+ * DESCRIPTION:  Whether the line table fits the rectangle and the font
+ *				 height, with stdFont set
+ *
+ * PARAMETERS:   width of the rectangle
+ *
+ * RETURNED:     true if the recipe need not be laid out again
+ *
+ ***********************************************************************/
+static Boolean LayoutCurrent(UInt16 width)
+{
+    return ctx.rowsH && ctx.layoutWidth == width && ctx.layoutLineHeight == FntLineHeight();
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     DrawRows
+ *
+ * DESCRIPTION:  Draws the rows of the recipe that overlap a band of it,
+ *				 including ones that only partly do; the caller clips to
+ *				 the band. Steps rows are read from the record with a
+ *				 StepsReader started at the row's StepsMark
+ *
+ * PARAMETERS:   top and bottom of the band, from the top of the recipe,
+ *				 window y the top of the recipe is drawn at
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void DrawRows(UInt16 top, UInt16 bottom, Coord originY)
+{
+    RecipeView recipe;
+    StepsReader reader;
+    StepsMark mark;
+    Char buf[stepsWrapSize];
+    RecipeRow *rows;
+    Char *textP;
+    Boolean recipeLocked = false;
+    UInt16 n;
+    UInt16 i;
+
+    rows  = MemHandleLock(ctx.rowsH);
+    textP = MemHandleLock(ctx.textH);
+
+    // the row above the first one starting in the band may reach into it
+    i = FirstVisibleRow(rows, top);
+    while (i > 0) {
+        FntSetFont(rows[i - 1].font);
+        if (rows[i - 1].y + FntLineHeight() <= top)
+            break;
+        i--;
+    }
+
+    for (; i < ctx.numRows && rows[i].y < bottom; i++) {
+        FntSetFont(rows[i].font);
+        if (rows[i].source == rowText) {
+            WinDrawChars(textP + rows[i].offset, rows[i].len, 0, originY + rows[i].y);
+            continue;
+        }
+
+        if (!recipeLocked) {
+            RecipeViewInit(&recipe, MemHandleLock(ctx.recipe));
+            recipeLocked = true;
+        }
+        mark.next       = rows[i].offset;
+        mark.pendingPos = rows[i].pendingPos;
+        StepsReaderSeek(&reader, &recipe, &mark);
+        n = StepsRead(&reader, buf, rows[i].len);
+        WinDrawChars(buf, n, 0, originY + rows[i].y);
+    }
+    FntSetFont(stdFont);
+
+    if (recipeLocked)
+        MemHandleUnlock(ctx.recipe);
+    MemHandleUnlock(ctx.textH);
+    MemHandleUnlock(ctx.rowsH);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     OffscreenCreate
+ *
+ * DESCRIPTION:  Draws the whole recipe into an offscreen window, so
+ *				 scrolling only copies from it. Tried once per layout,
+ *				 and only when the window is at most offscreenMaxBytes
+ *				 and leaves offscreenReserve of the dynamic heap free,
+ *				 on PalmOS 3.5 or later (the screen depth is not known
+ *				 before); without it the recipe is drawn from the line
+ *				 table
+ *
+ * PARAMETERS:   width of the recipe
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void OffscreenCreate(UInt16 width)
+{
+    WinHandle drawWin;
+    UInt32 romVersion;
+    UInt32 depth;
+    UInt32 bytes;
+    UInt32 free;
+    UInt32 max;
+    UInt16 err;
+
+    ctx.offscreenTried = true;
+    if (ctx.height == 0 || FtrGet(sysFtrCreator, sysFtrNumROMVersion, &romVersion) != errNone ||
+            romVersion < offscreenMinVersion)
+        return;
+    if (WinScreenMode(winScreenModeGet, NULL, NULL, &depth, NULL) != errNone)
+        return;
+    bytes = ((width * depth + 15) / 16) * 2 * ctx.height;
+    if (bytes > offscreenMaxBytes || MemHeapFreeBytes(0, &free, &max) != errNone ||
+            max < bytes + offscreenReserve)
+        return;
+
+    ctx.offscreen = WinCreateOffscreenWindow(width, ctx.height, screenFormat, &err);
+    if (!ctx.offscreen)
+        return;
+
+    drawWin = WinSetDrawWindow(ctx.offscreen);
+    WinEraseWindow();
+    DrawRows(0, ctx.height, 0);
+    WinSetDrawWindow(drawWin);
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     DrawRecipe
+ *
+ * DESCRIPTION:  Draws the part of the recipe at the scroll position,
+ *				 laying it out first if needed. Copied from the offscreen
+ *				 window when there is one, otherwise drawn from the line
+ *				 table clipped to the rectangle
+ *
+ * PARAMETERS:   Pointer to current form
+ *
+ * RETURNED:     content height (used in initial maxScroll calculation)
+ *
+ ***********************************************************************/
+static UInt16 DrawRecipe(FormType *form)
+{
+    RectangleType r;
+    RectangleType src;
+    UInt16 bottom;
+    Err err = errNone;
+
+    ContentBounds(form, &r);
+    FntSetFont(stdFont);
+    if (!LayoutCurrent(r.extent.x))
+        err = LayoutRecipe(r.extent.x);
+    if (err != errNone) {
+        WinEraseRectangle(&r, 0);
+        displayError(err);
+        return r.topLeft.y;
+    }
+    if (!ctx.offscreenTried)
+        OffscreenCreate(r.extent.x);
+    bottom = r.topLeft.y - ctx.scrollPos + ctx.height;
+
+    if (!ctx.offscreen) {
+        WinEraseRectangle(&r, 0);
+        WinSetClip(&r);
+        DrawRows(ctx.scrollPos, ctx.scrollPos + r.extent.y, r.topLeft.y - ctx.scrollPos);
+        WinResetClip();
+        return bottom;
+    }
+
+    // copy what the offscreen window has, erase the rest
+    src.topLeft.x = 0;
+    src.topLeft.y = ctx.scrollPos;
+    src.extent.x  = r.extent.x;
+    src.extent.y  = (ctx.scrollPos < ctx.height) ? ctx.height - ctx.scrollPos : 0;
+    if (src.extent.y > r.extent.y)
+        src.extent.y = r.extent.y;
+    if (src.extent.y > 0)
+        WinCopyRectangle(ctx.offscreen, WinGetDrawWindow(), &src, r.topLeft.x, r.topLeft.y, winPaint);
+    r.topLeft.y += src.extent.y;
+    r.extent.y  -= src.extent.y;
+    if (r.extent.y > 0)
+        WinEraseRectangle(&r, 0);
+    return bottom;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     ScrollRecipe
+ *
+ * DESCRIPTION:  Moves the recipe to a new scroll position. Unless the
+ *				 offscreen window can be copied from, what is still
+ *				 visible is moved with WinScrollRectangle and only the
+ *				 rows in the strip it leaves are drawn. Counts the event
+ *				 and its ticks in ctx.scrolls
+ *
+ * PARAMETERS:   Pointer to current form, new scroll position
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void ScrollRecipe(FormType *form, Int16 newPos)
+{
+    RectangleType r;
+    RectangleType vacated;
+    UInt32 start = TimGetTicks();
+    Int16 delta = newPos - ctx.scrollPos;
+    UInt16 mode;
+
+    if (delta == 0)
+        return;
+    ctx.scrollPos = newPos;
+
+    ContentBounds(form, &r);
+    FntSetFont(stdFont);
+    if (ctx.offscreen) {
+        mode = scrollOffscreen;
+        DrawRecipe(form);
+    } else if (!LayoutCurrent(r.extent.x) || delta >= r.extent.y || -delta >= r.extent.y) {
+        mode = scrollRedraw;
+        DrawRecipe(form);
+    } else {
+        mode = scrollBlit;
+        WinScrollRectangle(&r, (delta > 0) ? winUp : winDown, (delta > 0) ? delta : -delta, &vacated);
+        WinEraseRectangle(&vacated, 0);
+        WinSetClip(&vacated);
+        DrawRows(newPos + vacated.topLeft.y - r.topLeft.y,
+            newPos + vacated.topLeft.y - r.topLeft.y + vacated.extent.y, r.topLeft.y - newPos);
+        WinResetClip();
+    }
+
+    ctx.scrolls.numScrolls[mode]++;
+    ctx.scrolls.ticks[mode] += TimGetTicks() - start;
+}
+
+/***********************************************************************
+ *
+ * FUNCTION:     ScrollLogSave
+ *
+ * DESCRIPTION:  Adds the scroll events since the form opened to the
+ *				 scroll log, see ScrollLog, and clears them
+ *
+ * PARAMETERS:   nothing
+ *
+ * RETURNED:     nothing
+ *
+ ***********************************************************************/
+static void ScrollLogSave()
+{
+    ScrollLog log;
+    UInt16 size = sizeof(log);
+    UInt16 i;
+
+    if (ctx.scrolls.numScrolls[scrollRedraw] + ctx.scrolls.numScrolls[scrollBlit] +
+            ctx.scrolls.numScrolls[scrollOffscreen] == 0)
+        return;
+    if (PrefGetAppPreferences(appFileCreator, appScrollPrefID, &log, &size, false)
+            != appPrefVersionNum || size != sizeof(log))
+        MemSet(&log, sizeof(log), 0);
+
+    for (i = 0; i < scrollNumModes; i++) {
+        log.numScrolls[i] += ctx.scrolls.numScrolls[i];
+        log.ticks[i]      += ctx.scrolls.ticks[i];
+    }
+    PrefSetAppPreferences(appFileCreator, appScrollPrefID, appPrefVersionNum,
+        &log, sizeof(log), false);
+    MemSet(&ctx.scrolls, sizeof(ctx.scrolls), 0);
 }
 
 static Boolean ViewRecipeDoCommand(UInt16 command) {
 	Boolean handled = false;
-	MemPtr recipeP;
-	RecipeRecord recipe;
-	UInt16 i;
 
 	switch(command) {
 		case AddAll:
-		    recipeP = MemHandleLock(ctx.recipe);
-		    recipe  = RecipeGetRecord(recipeP); 
-		    for (i = 0; i < recipe.numIngredients; i++) {
-		    	AddIdToDatabase(gGroceryDB, recipe.ingredientIDs[i]);
-		    }
-		    MemHandleUnlock(ctx.recipe);
+		    displayErrorIf(GroceryAddRecipes(&ctx.recipeId, 1, false));
 		    handled = true;
 			break;
 			
 		case AddMissing:
-		    recipeP = MemHandleLock(ctx.recipe);
-		    recipe  = RecipeGetRecord(recipeP); 
-		    for (i = 0; i < recipe.numIngredients; i++) {
-		    	if (!EntryInDatabase(gPantryDB, recipe.ingredientIDs[i]))
-			    	AddIdToDatabase(gGroceryDB, recipe.ingredientIDs[i]);
-		    }
-			MemHandleUnlock(ctx.recipe);
+		    displayErrorIf(GroceryAddRecipes(&ctx.recipeId, 1, true));
 		    handled = true;
 			break;
 	}
@@ -172,6 +641,7 @@ Boolean ViewRecipeHandleEvent(EventPtr eventP) {
 	RectangleType r;
 	Coord displayHeight;
 	Coord contentHeight;
+	Int16 newPos;
 
 	switch (eventP->eType) {
 		case frmOpenEvent:
@@ -187,36 +657,52 @@ Boolean ViewRecipeHandleEvent(EventPtr eventP) {
                             0, 0, ctx.maxScroll, displayHeight-1);
 			handled = true;
 			break;
-			
+
+        case sclRepeatEvent:
+            //Follows the scrollbar while it is held; not handled, so it keeps repeating
+            ScrollRecipe(frmP, eventP->data.sclRepeat.newValue);
+            break;
+
         case sclExitEvent:
-            ctx.scrollPos = (eventP->data.sclExit.newValue);
-            if (ctx.scrollPos < 0) ctx.scrollPos = 0;
-            DrawRecipe(frmP); //Change to frmUpdateForm if more is needed on form updates
+            newPos = eventP->data.sclExit.newValue;
+            if (newPos < 0) newPos = 0;
+            ScrollRecipe(frmP, newPos);
             return true;
-            
+
         case frmUpdateEvent:
             DrawRecipe(frmP);
             return true;
-            
+
+        case frmCloseEvent:
+            ScrollLogSave();
+            LayoutFree();
+            break;
+
 		case menuEvent:
 			return ViewRecipeDoCommand(eventP->data.menu.itemID);
-			
+
 		case keyDownEvent:
+			//A page at a time, keeping one line of the last page in view
 			FrmGetFormBounds(frmP, &r);
 			displayHeight = r.extent.y;
+			ContentBounds(frmP, &r);
 			if (eventP->data.keyDown.chr == pageUpChr) {
-				ctx.scrollPos -= FntLineHeight();
-				if (ctx.scrollPos < 0) ctx.scrollPos = 0;
-			
+				newPos = ctx.scrollPos - (r.extent.y - FntLineHeight());
+				if (newPos < 0) newPos = 0;
+
 			} else if (eventP->data.keyDown.chr == pageDownChr) {
-				ctx.scrollPos += FntLineHeight();
-				if (ctx.scrollPos > ctx.maxScroll) ctx.scrollPos = ctx.maxScroll;
+				newPos = ctx.scrollPos + (r.extent.y - FntLineHeight());
+				if (newPos > ctx.maxScroll) newPos = ctx.maxScroll;
+			} else {
+				break;
 			}
 			SclSetScrollBar(FrmGetObjectPtr(frmP, FrmGetObjectIndex(frmP, ViewRecipeScrollbar)),
-                            ctx.scrollPos, 0, ctx.maxScroll, displayHeight-1);
-			DrawRecipe(frmP);
-			
-		default:		
+                            newPos, 0, ctx.maxScroll, displayHeight-1);
+			ScrollRecipe(frmP, newPos);
+			handled = true;
+			break;
+
+		default:
 			break;
 	}
 	return handled;
@@ -236,8 +722,10 @@ Boolean ViewRecipeHandleEvent(EventPtr eventP) {
 void OpenRecipeForm(UInt16 selection) {
 	Err err;
 
+    LayoutFree();
     ctx.recipe    = DmQueryRecord(gRecipeDB, selection);
     if (ctx.recipe) {
+	    ctx.recipeId  = IDFromIndex(gRecipeDB, selection);
 	    ctx.scrollPos = 0;
 	    ctx.maxScroll = 0;
 	    FrmGotoForm(formViewRecipe);
@@ -1,4 +1,4 @@
-import struct, yaml, sys
+import argparse, struct, yaml, sys
 from datetime import datetime
 
 class PalmRecord:
@@ -18,6 +18,96 @@ def palm_timestamp():
     seconds = int((now - epoch_1904).total_seconds())
     return seconds & 0xFFFFFFFF  # I hate silent promotion
 
+def sort_key(name):
+    # Same folding as SortKeyMake in Database.c: ASCII and Latin-1 letters
+    # lower case, white space runs turned into one space, ends trimmed
+    out = []
+    space = False
+    for c in name:
+        if c in " \t\n\r":
+            space = len(out) > 0
+            continue
+        if space:
+            out.append(" ")
+        space = False
+        o = ord(c)
+        if "A" <= c <= "Z" or (0xC0 <= o <= 0xDE and o != 0xD7):
+            c = chr(o + 32)
+        out.append(c)
+    return "".join(out)
+
+# Same entries in the same order as stepsDict in Database.c
+STEPS_DICT = [
+    " the ", " and ", " until ", " with ", " minutes", " into ", " of ",
+    " to ", " in ", " a ", " on ", " for ", " or ", " is ", " at ", " from ",
+    " over ", " each ", "then ", "about ", " before ", "ate", " degrees",
+    " hour", "heat", "oven", "bake", "boil", "simmer", "stir", "Stir",
+    "add ", "Add ", "mix", "pour", "Pour", "place", "Place", "serve",
+    "Serve", "salt", "pepper", "sugar", "butter", "flour", "water", "milk",
+    "egg", "cream", "sauce", "onion", "garlic", "cook", "Cook", "remove",
+    "Remove", "cover", "brown", "large", "small", "medium", "bowl", "pan",
+    "dish", "skillet", "pot", "mixture", "well", "beat", "whisk", "combine",
+    "Combine", "chop", "slice", "cut ", "Cut ", "tender", "golden",
+    "preheat", "Preheat", "season", "Season", "taste", "together",
+    "sprinkle", "spoon", "cheese", "chicken", "meat", "oil", "juice",
+    "lemon", "dough", "baking", "powder", "vanilla", "melt", "stand", "let ",
+    "Let ", "In a ", "Bring", "bring", "drain", "Drain", "inch", "tea",
+    "fry", "cup", "side", "top", "hot", "ing ", "ing", "tion", "ed ", "er ",
+    "es ", "ly ", "ent", "ound", "the", "and", "ll", ". ", ", ", ".\n",
+]
+
+def varint(value):
+    # 7 bits per byte, lowest first, top bit set if another byte follows
+    out = b""
+    while value >= 0x80:
+        out += bytes([(value & 0x7F) | 0x80])
+        value >>= 7
+    return out + bytes([value])
+
+def pack_lines(ingredient_ids, unit_ids, quantities, fracs, denoms, layout):
+    num_ing = len(ingredient_ids)
+    if layout == 1:
+        # fixed arrays, IDs as 4 big-endian bytes
+        data = struct.pack(f">{num_ing}B", *quantities)
+        data += struct.pack(f">{num_ing}B", *fracs)
+        data += struct.pack(f">{num_ing}B", *denoms)
+        data += struct.pack(f">{num_ing}L", *ingredient_ids)
+        data += struct.pack(f">{num_ing}L", *unit_ids)
+        return data
+
+    # layout 2: refs (an item's rank by unique ID, so id - 1 here) and the
+    # whole count shifted left one as varints, the low bit set if fraction
+    # and denominator bytes follow
+    data = b""
+    for i in range(num_ing):
+        data += varint(ingredient_ids[i] - 1) + varint(unit_ids[i] - 1)
+        if fracs[i] or denoms[i]:
+            data += varint(quantities[i] << 1 | 1) + bytes([fracs[i], denoms[i]])
+        else:
+            data += varint(quantities[i] << 1)
+    return data
+
+def pack_steps(steps):
+    # Same packing as StepsPack in Database.c: the longest STEPS_DICT entry
+    # at each position becomes byte 0x81 + its index, bytes from 0x80 up
+    # are escaped with 0x80. Returns None if packing doesn't save anything
+    entries = [e.encode("ascii") for e in STEPS_DICT]
+    data = b""
+    i = 0
+    while i < len(steps):
+        best, best_len = 0, 1
+        for k, entry in enumerate(entries):
+            if len(entry) > best_len and steps.startswith(entry, i):
+                best, best_len = k, len(entry)
+        if best_len > 1:
+            data += bytes([0x81 + best])
+        elif steps[i] >= 0x80:
+            data += bytes([0x80, steps[i]])
+        else:
+            data += steps[i:i + 1]
+        i += best_len
+    return data if len(data) < len(steps) else None
+
 def write_pdb(filename, dbname, creator, typecode, records):
     num_records = len(records)
     header = struct.pack(
@@ -56,28 +146,32 @@ def write_pdb(filename, dbname, creator, typecode, records):
     print(f"Wrote {filename} ({num_records} records)")
     
     
-def build_records(data):
+def build_records(data, layout=2):
     recipe_records = []
     next_recipe_id = 1
 
     ingredient_records = []
     unit_records = []
 
-    ingredient_ids = {} #lookup dict for ingredient ids
+    ingredient_ids = {} #lookup dict for ingredient ids, by sort key
+    ingredient_names = {} #first spelling of each key
     next_ingredient_id = 1
 
-    unit_ids = {} #lookup dict for unit ids
+    unit_ids = {} #lookup dict for unit ids, by sort key
+    unit_names = {}
     next_unit_id = 1
     
     for r in data["recipes"]:
         name = r["name"].encode("ascii", errors='ignore')[:31] + b"\x00"
-        steps = r.get("steps", "").replace("\\n", "\n").encode("ascii", errors='ignore') + b"\x00"
+        steps = r.get("steps", "").replace("\\n", "\n").encode("ascii", errors='ignore')
         # Allows steps to be omitted
 
-        num_ing = len(r["ingredients"])  # max 256
+        num_ing = len(r["ingredients"])
+        if num_ing > 255:
+            sys.exit(f"{r['name']}: {num_ing} ingredients, at most 255 fit a recipe")
 
-        ingredient_names = [x["name"] for x in r["ingredients"]]
-        unit_names = [x["unit"] for x in r["ingredients"]]
+        recipe_ingredients = [x["name"] for x in r["ingredients"]]
+        recipe_units = [x["unit"] for x in r["ingredients"]]
 
         quantities = [x["whole"] for x in r["ingredients"]]
         fracs = [x["frac"] for x in r["ingredients"]]
@@ -86,29 +180,36 @@ def build_records(data):
         recipe_ingredient_ids = []
         recipe_unit_ids = []
 
-        for i, ingredient in enumerate(ingredient_names):
-            if ingredient in ingredient_ids:
-                recipe_ingredient_ids.append(ingredient_ids[ingredient])
+        # names are merged by sort key like the app does, so "Butter" and
+        # "butter" are one ingredient
+        for i, ingredient in enumerate(recipe_ingredients):
+            key = sort_key(ingredient)
+            if key in ingredient_ids:
+                recipe_ingredient_ids.append(ingredient_ids[key])
             else:
-                ingredient_ids[ingredient] = next_ingredient_id
+                ingredient_ids[key] = next_ingredient_id
+                ingredient_names[key] = ingredient
                 recipe_ingredient_ids.append(next_ingredient_id)
                 next_ingredient_id += 1
 
-        for i, unit in enumerate(unit_names):
-            if unit in unit_ids:
-                recipe_unit_ids.append(unit_ids[unit])
+        for i, unit in enumerate(recipe_units):
+            key = sort_key(unit)
+            if key in unit_ids:
+                recipe_unit_ids.append(unit_ids[key])
             else:
-                unit_ids[unit] = next_unit_id
+                unit_ids[key] = next_unit_id
+                unit_names[key] = unit
                 recipe_unit_ids.append(next_unit_id)
                 next_unit_id += 1
 
-        record = struct.pack(">32sBB", name, num_ing, 0)
-        record += struct.pack(f">{num_ing}B", *quantities)
-        record += struct.pack(f">{num_ing}B", *fracs)
-        record += struct.pack(f">{num_ing}B", *denoms)
-        record += struct.pack(f">{num_ing}L", *recipe_ingredient_ids)
-        record += struct.pack(f">{num_ing}L", *recipe_unit_ids)
-        record += struct.pack(f">{len(steps)}s", steps)
+        # the byte after num_ing is the record layout, see RecipeHeader;
+        # layout 2 steps are packed when that makes them smaller
+        packed = pack_steps(steps) if layout == 2 else None
+        record_layout = 0 if layout == 1 else 2 | (packed is not None)
+        record = struct.pack(">32sBB", name, num_ing, record_layout)
+        record += pack_lines(recipe_ingredient_ids, recipe_unit_ids,
+                             quantities, fracs, denoms, layout)
+        record += (steps if packed is None else packed) + b"\x00"
 
         recipe_records.append(PalmRecord(record, next_recipe_id))
         next_recipe_id += 1
@@ -118,21 +219,23 @@ def build_records(data):
     unit_ids = dict(sorted(unit_ids.items()))
 
     for key in ingredient_ids:
-        data = key.encode("ascii") + b"\x00"
+        data = ingredient_names[key].encode("ascii") + b"\x00"
         ingredient_records.append(PalmRecord(data, ingredient_ids[key]))
 
     for key in unit_ids:
-        data = key.encode("ascii") + b"\x00"
+        data = unit_names[key].encode("ascii") + b"\x00"
         unit_records.append(PalmRecord(data, unit_ids[key]))
 
     return unit_records, ingredient_records, recipe_records
 
 if __name__ == "__main__":
-    if len(sys.argv) < 2:
-        print("Usage: build_pdb.py [yaml recipe file]")
-        sys.exit(1)
-    data = read_data(sys.argv[1])
-    unit_recs, ing_recs, recipe_recs = build_records(data)
+    parser = argparse.ArgumentParser(description="Builds Quartermaster databases from a yaml recipe file")
+    parser.add_argument("recipes", help="yaml recipe file")
+    parser.add_argument("--layout", type=int, choices=(1, 2), default=2,
+                        help="recipe record layout (1 is read by older versions of the app)")
+    args = parser.parse_args()
+    data = read_data(args.recipes)
+    unit_recs, ing_recs, recipe_recs = build_records(data, args.layout)
     write_pdb(f"Units{palm_timestamp()}.pdb", "QMUnits", "WOEM", "Data", unit_recs)
     write_pdb(f"Ingredients{palm_timestamp()}.pdb", "QMIngredients", "WOEM", "Data", ing_recs)
     write_pdb(f"Recipes{palm_timestamp()}.pdb", "QMRecipes", "WOEM", "Data", recipe_recs)
@@ -1,10 +1,14 @@
 import struct, yaml, sys
+from build_pdb import STEPS_DICT
 
 def read_pdb(filename):
     with open(filename, "rb") as f:
         data = f.read()
     return data
 
+def pdb_version(data):
+    return struct.unpack_from(">H", data, 34)[0]
+
 def parse_pdb(data):
     num_records = struct.unpack_from(">H", data, 76)[0]
     offset = 78
@@ -25,35 +29,101 @@ def parse_pdb(data):
 
     return record_data
 
-def unpack_recipe(recipe_record, ingredient_records, unit_records):
+def item_refs(item_records, version):
+    # ref -> unique ID for layout 2 recipes. From version 3 the ref follows
+    # the name, the 2-byte use count and the sort key; before that items
+    # get their rank by unique ID when the app opens them (see RefMigrate)
+    if version < 3:
+        return dict(enumerate(sorted(item_records)))
+    refs = {}
+    for uid, rec in item_records.items():
+        key_start = rec.index(b"\x00") + 1 + 2
+        ref_start = rec.index(b"\x00", key_start) + 1
+        refs[struct.unpack_from(">H", rec, ref_start)[0]] = uid
+    return refs
+
+def varint(data, offset):
+    value = 0
+    shift = 0
+    while True:
+        byte = data[offset]
+        offset += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, offset
+
+def unpack_steps(data):
+    # reverses pack_steps in build_pdb.py
+    out = b""
+    i = 0
+    while i < len(data):
+        byte = data[i]
+        i += 1
+        if byte < 0x80:
+            out += bytes([byte])
+        elif byte == 0x80:
+            out += data[i:i + 1]
+            i += 1
+        else:
+            out += STEPS_DICT[byte - 0x81].encode("ascii")
+    return out
+
+def unpack_recipe(recipe_record, header_size, ingredient_records, unit_records, ingredient_refs, unit_refs):
     offset = 0
-    name, num_ing = struct.unpack_from(">32sB", recipe_record, offset)
-    offset += 34
+    name = struct.unpack_from(">32s", recipe_record, offset)[0]
+    # header ends with the ingredient count and the record layout; version 1
+    # databases have a 32-byte sort key between the name and those
+    num_ing, layout = struct.unpack_from(">BB", recipe_record, header_size - 2)
+    offset += header_size
     name = name.split(b"\x00")[0].decode("ascii")
 
-    recipe_quants = list(struct.unpack_from(f">{num_ing}B", recipe_record, offset))
-    offset += num_ing
-    recipe_fracs = list(struct.unpack_from(f">{num_ing}B", recipe_record, offset))
-    offset += num_ing
-    recipe_denoms = list(struct.unpack_from(f">{num_ing}B", recipe_record, offset))
-    offset += num_ing
+    # layout 2 (3 with packed steps) or layout 1 (0)
+    if layout & 2:
+        recipe_quants, recipe_fracs, recipe_denoms = [], [], []
+        ingredient_ids, unit_ids = [], []
+        for i in range(num_ing):
+            ref, offset = varint(recipe_record, offset)
+            ingredient_ids.append(ingredient_refs[ref])
+            ref, offset = varint(recipe_record, offset)
+            unit_ids.append(unit_refs[ref])
+            count, offset = varint(recipe_record, offset)
+            recipe_quants.append(count >> 1)
+            if count & 1:
+                recipe_fracs.append(recipe_record[offset])
+                recipe_denoms.append(recipe_record[offset + 1])
+                offset += 2
+            else:
+                recipe_fracs.append(0)
+                recipe_denoms.append(0)
+    else:
+        recipe_quants = list(struct.unpack_from(f">{num_ing}B", recipe_record, offset))
+        offset += num_ing
+        recipe_fracs = list(struct.unpack_from(f">{num_ing}B", recipe_record, offset))
+        offset += num_ing
+        recipe_denoms = list(struct.unpack_from(f">{num_ing}B", recipe_record, offset))
+        offset += num_ing
 
-    ingredient_ids = list(struct.unpack_from(f">{num_ing}L", recipe_record, offset))
-    offset += 4 * num_ing
+        ingredient_ids = list(struct.unpack_from(f">{num_ing}L", recipe_record, offset))
+        offset += 4 * num_ing
 
-    unit_ids = list(struct.unpack_from(f">{num_ing}L", recipe_record, offset))
-    
-    offset += 4 * num_ing
+        unit_ids = list(struct.unpack_from(f">{num_ing}L", recipe_record, offset))
+
+        offset += 4 * num_ing
 
     # assumes steps are remaining bytes, null-terminated
-    steps = recipe_record[offset:].split(b"\x00", 1)[0].decode("ascii", "ignore")
+    steps = recipe_record[offset:].split(b"\x00", 1)[0]
+    if layout & 1:
+        steps = unpack_steps(steps)
+    steps = steps.decode("ascii", "ignore")
     
     ingredients = []
     
+    # item records may carry a use count, sort key and ref after the name
     for i in range(num_ing):
         ingredients.append( {
-            "name": ingredient_records[ingredient_ids[i]].decode("ascii", "ignore").rstrip("\0"),
-            "unit": unit_records[unit_ids[i]].decode("ascii", "ignore").rstrip("\0"),
+            "name": ingredient_records[ingredient_ids[i]].split(b"\x00")[0].decode("ascii", "ignore"),
+            "unit": unit_records[unit_ids[i]].split(b"\x00")[0].decode("ascii", "ignore"),
             "whole": recipe_quants[i],
             "frac": recipe_fracs[i],
             "denom": recipe_denoms[i]
@@ -69,10 +139,17 @@ if __name__ == "__main__":
     if len(sys.argv) != 5:
         print("Usage: python3 pdb_to_yaml.py [Recipe PDB] [Ingredients PDB] [Units PDB] [Output YML]")
         sys.exit(1)
-    recipe_db = parse_pdb(read_pdb(sys.argv[1]))
-    ingredients_db = parse_pdb(read_pdb(sys.argv[2]))
-    units_db = parse_pdb(read_pdb(sys.argv[3])) 
-    recipes = {"recipes": [unpack_recipe(v, ingredients_db, units_db) for v in recipe_db.values()]}
+    recipe_data = read_pdb(sys.argv[1])
+    ingredient_data = read_pdb(sys.argv[2])
+    unit_data = read_pdb(sys.argv[3])
+    recipe_db = parse_pdb(recipe_data)
+    ingredients_db = parse_pdb(ingredient_data)
+    units_db = parse_pdb(unit_data)
+    header_size = 66 if pdb_version(recipe_data) >= 1 else 34
+    ingredient_refs = item_refs(ingredients_db, pdb_version(ingredient_data))
+    unit_refs = item_refs(units_db, pdb_version(unit_data))
+    recipes = {"recipes": [unpack_recipe(v, header_size, ingredients_db, units_db, ingredient_refs, unit_refs)
+                           for v in recipe_db.values()]}
     
     with open(sys.argv[4], "w") as f:
         yaml.dump(recipes, f, sort_keys=False)